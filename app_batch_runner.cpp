@@ -0,0 +1,48 @@
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "include/batch_runner.h"
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3) {
+        std::cout << "usage : ./batch_runner <manifest> <result_file> [-j workers]\n"
+                     "  manifest lines : <6502_hex_mc> <start_addr_in_hex> <cycle_limit>\n";
+        return 1;
+    }
+
+    unsigned workers = 0;
+    for (int i = 3; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg == "-j" and i + 1 < argc) {
+            workers = std::strtoul(argv[++i], nullptr, 10);
+        } else {
+            std::cout << "unknown option : " << arg << '\n';
+            return 1;
+        }
+    }
+
+    BatchRunner runner;
+    std::string error;
+    if (!runner.LoadManifest(argv[1], &error) or !runner.Run(argv[2], workers, &error)) {
+        std::cout << error << '\n';
+        return 1;
+    }
+
+    double elapsed = runner.ElapsedSeconds();
+    std::cout << std::fixed << std::setprecision(2) << "jobs=" << runner.JobCount()
+              << " seconds=" << elapsed << " jobs_per_sec=" << runner.JobCount() / elapsed << '\n';
+
+    const auto& stats = runner.GetWorkerStats();
+    for (size_t w = 0; w < stats.size(); w++) {
+        double mips = (stats[w].busySeconds > 0.0)
+                          ? stats[w].instructions / stats[w].busySeconds / 1e6
+                          : 0.0;
+        std::cout << "worker=" << w << " jobs=" << stats[w].jobs
+                  << " instructions=" << stats[w].instructions << " busy_seconds=" << stats[w].busySeconds
+                  << " mips=" << mips << '\n';
+    }
+    return 0;
+}
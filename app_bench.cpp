@@ -0,0 +1,779 @@
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "include/mos6502_engine.h"
+
+// Standard workloads and per opcode class / addressing mode micro kernels, run on every core.
+// Every run starts from a fresh engine and ends on TERMINATE_OPCODE; all cores must leave the
+// same ram behind, otherwise the run is reported as a failure (exit code 2).
+
+enum Op : uint8_t
+{
+    LDA_IMM   = 0xa9,
+    LDA_ZP    = 0xa5,
+    LDA_ZP_X  = 0xb5,
+    LDA_ABS   = 0xad,
+    LDA_ABS_X = 0xbd,
+    LDA_ABS_Y = 0xb9,
+    LDA_IND_X = 0xa1,
+    LDA_IND_Y = 0xb1,
+    LDX_IMM   = 0xa2,
+    LDX_ZP    = 0xa6,
+    LDY_IMM   = 0xa0,
+    STA_ZP    = 0x85,
+    STA_ZP_X  = 0x95,
+    STA_ABS   = 0x8d,
+    STA_ABS_X = 0x9d,
+    STA_ABS_Y = 0x99,
+    STA_IND_X = 0x81,
+    STA_IND_Y = 0x91,
+    ADC_IMM   = 0x69,
+    ADC_ZP    = 0x65,
+    ADC_ZP_X  = 0x75,
+    ADC_ABS   = 0x6d,
+    ADC_ABS_X = 0x7d,
+    ADC_ABS_Y = 0x79,
+    ADC_IND_X = 0x61,
+    ADC_IND_Y = 0x71,
+    EOR_IMM   = 0x49,
+    EOR_ZP    = 0x45,
+    EOR_ABS   = 0x4d,
+    CMP_IMM   = 0xc9,
+    CMP_ZP    = 0xc5,
+    CMP_ABS   = 0xcd,
+    CMP_ABS_X = 0xdd,
+    CPX_IMM   = 0xe0,
+    ASL_A     = 0x0a,
+    ASL_ZP    = 0x06,
+    ASL_ABS   = 0x0e,
+    ASL_ABS_X = 0x1e,
+    ROL_ZP    = 0x26,
+    INC_ZP    = 0xe6,
+    INC_ABS   = 0xee,
+    INC_ABS_X = 0xfe,
+    DEC_ZP    = 0xc6,
+    INX       = 0xe8,
+    INY       = 0xc8,
+    DEX       = 0xca,
+    DEY       = 0x88,
+    TAX       = 0xaa,
+    TAY       = 0xa8,
+    TXA       = 0x8a,
+    TYA       = 0x98,
+    CLC       = 0x18,
+    PHA       = 0x48,
+    PLA       = 0x68,
+    BIT_ZP    = 0x24,
+    BCC       = 0x90,
+    BCS       = 0xb0,
+    BEQ       = 0xf0,
+    BNE       = 0xd0,
+    BMI       = 0x30,
+    BPL       = 0x10,
+    BVC       = 0x50,
+    BVS       = 0x70,
+    JMP_ABS   = 0x4c,
+    JMP_IND   = 0x6c,
+    JSR       = 0x20,
+    RTS       = 0x60,
+};
+
+// just enough of an assembler to keep branch offsets out of the byte lists
+class Asm {
+   public:
+    typedef size_t Label;
+
+    explicit Asm(uint16_t origin) : m_origin(origin) {}
+
+    uint16_t Here() const { return m_origin + m_code.size(); }
+
+    void Op0(uint8_t opcode) { m_code.push_back(opcode); }
+    void Op1(uint8_t opcode, uint8_t operand)
+    {
+        m_code.push_back(opcode);
+        m_code.push_back(operand);
+    }
+    void Op2(uint8_t opcode, uint16_t operand)
+    {
+        m_code.push_back(opcode);
+        m_code.push_back(operand & 0xff);
+        m_code.push_back(operand >> 8);
+    }
+
+    Label NewLabel()
+    {
+        m_labels.push_back(-1);
+        return m_labels.size() - 1;
+    }
+    void Bind(Label label) { m_labels[label] = Here(); }
+    Label BindNew()
+    {
+        Label label = NewLabel();
+        Bind(label);
+        return label;
+    }
+
+    void Branch(uint8_t opcode, Label target)
+    {
+        m_code.push_back(opcode);
+        m_fixups.push_back({m_code.size(), target, true});
+        m_code.push_back(0x00);
+    }
+    void Jump(uint8_t opcode, Label target)  // JMP abs / JSR
+    {
+        m_code.push_back(opcode);
+        m_fixups.push_back({m_code.size(), target, false});
+        m_code.push_back(0x00);
+        m_code.push_back(0x00);
+    }
+
+    // DEC lo / hi until both were 0 once more : 65536 rounds when both start at 0
+    void LoopWhile16(uint8_t zpCounter, Label loop)
+    {
+        Label again = NewLabel();
+        Label done  = NewLabel();
+        Op1(DEC_ZP, zpCounter);
+        Branch(BNE, again);
+        Op1(DEC_ZP, zpCounter + 1);
+        Branch(BEQ, done);
+        Bind(again);
+        Jump(JMP_ABS, loop);
+        Bind(done);
+    }
+
+    void Terminate() { m_code.push_back(TERMINATE_OPCODE); }
+
+    // false when a label is unbound or a branch is out of range
+    bool Finish(std::vector<uint8_t>* out)
+    {
+        for (const auto& fixup : m_fixups) {
+            int32_t target = m_labels[fixup.label];
+            if (target < 0) {
+                return false;
+            }
+            if (fixup.relative) {
+                int32_t delta = target - (int32_t)(m_origin + fixup.pos + 1);
+                if (delta < -128 or delta > 127) {
+                    return false;
+                }
+                m_code[fixup.pos] = (uint8_t)delta;
+            } else {
+                m_code[fixup.pos]     = target & 0xff;
+                m_code[fixup.pos + 1] = (target >> 8) & 0xff;
+            }
+        }
+        *out = m_code;
+        return true;
+    }
+
+   private:
+    struct Fixup {
+        size_t pos;
+        Label label;
+        bool relative;
+    };
+
+    uint16_t m_origin;
+    std::vector<uint8_t> m_code;
+    std::vector<int32_t> m_labels;
+    std::vector<Fixup> m_fixups;
+};
+
+struct Program {
+    struct Segment {
+        uint16_t addr;
+        std::vector<uint8_t> bytes;
+    };
+
+    std::string name;
+    uint16_t origin = 0x0600;
+    std::vector<Segment> segments;  // code first
+};
+
+struct RunResult {
+    bool ok = false;
+    uint64_t instructions = 0;
+    uint64_t cycles       = 0;
+    double seconds        = 0.0;
+    uint64_t ramDigest    = 0;
+};
+
+static const uint16_t kOrigin = 0x0600;
+
+static bool Assemble(const std::string& name, Asm& as, Program* program)
+{
+    program->name   = name;
+    program->origin = kOrigin;
+    program->segments.resize(1);
+    program->segments[0].addr = kOrigin;
+    return as.Finish(&program->segments[0].bytes);
+}
+
+// workloads
+
+// nested counters around a small add/xor/shift body
+static bool BuildArithmetic(Program* program)
+{
+    Asm as(kOrigin);
+    as.Op1(LDA_IMM, 0x08);
+    as.Op1(STA_ZP, 0x20);
+    Asm::Label outer = as.BindNew();
+    as.Op1(LDY_IMM, 0x00);
+    Asm::Label middle = as.BindNew();
+    as.Op1(LDX_IMM, 0x00);
+    Asm::Label inner = as.BindNew();
+    as.Op0(TXA);
+    as.Op0(CLC);
+    as.Op1(ADC_IMM, 0x03);
+    as.Op1(STA_ZP, 0x10);
+    as.Op1(EOR_ZP, 0x11);
+    as.Op0(ASL_A);
+    as.Op1(ADC_ZP, 0x10);
+    as.Op1(STA_ZP, 0x11);
+    as.Op0(DEX);
+    as.Branch(BNE, inner);
+    as.Op0(DEY);
+    as.Branch(BNE, middle);
+    as.Op1(DEC_ZP, 0x20);
+    as.Branch(BNE, outer);
+    as.Terminate();
+    return Assemble("arithmetic_loop", as, program);
+}
+
+// 16 pages from 0x1000 to 0x2000 through (zp),y pointers, 255 times
+static bool BuildMemoryCopy(Program* program)
+{
+    Asm as(kOrigin);
+    as.Op1(LDA_IMM, 0xff);
+    as.Op1(STA_ZP, 0x22);
+    Asm::Label repeat = as.BindNew();
+    as.Op1(LDA_IMM, 0x00);
+    as.Op1(STA_ZP, 0x30);
+    as.Op1(STA_ZP, 0x32);
+    as.Op1(LDA_IMM, 0x10);
+    as.Op1(STA_ZP, 0x31);
+    as.Op1(LDA_IMM, 0x20);
+    as.Op1(STA_ZP, 0x33);
+    as.Op1(LDX_IMM, 0x10);
+    Asm::Label page = as.BindNew();
+    as.Op1(LDY_IMM, 0x00);
+    Asm::Label byte = as.BindNew();
+    as.Op1(LDA_IND_Y, 0x30);
+    as.Op1(STA_IND_Y, 0x32);
+    as.Op0(INY);
+    as.Branch(BNE, byte);
+    as.Op1(INC_ZP, 0x31);
+    as.Op1(INC_ZP, 0x33);
+    as.Op0(DEX);
+    as.Branch(BNE, page);
+    as.Op1(DEC_ZP, 0x22);
+    as.Branch(BNE, repeat);
+    as.Terminate();
+    if (!Assemble("memory_copy", as, program)) {
+        return false;
+    }
+
+    Program::Segment source{0x1000, std::vector<uint8_t>(0x1000)};
+    for (size_t i = 0; i < source.bytes.size(); i++) {
+        source.bytes[i] = (uint8_t)(i * 7 + (i >> 8));
+    }
+    program->segments.push_back(source);
+    return true;
+}
+
+// bubble sort of 64 descending bytes at 0x0400, refilled and sorted 100 times
+static bool BuildSort(Program* program)
+{
+    const uint8_t count = 64;
+    const uint16_t data = 0x0400;
+
+    Asm as(kOrigin);
+    as.Op1(LDA_IMM, 100);
+    as.Op1(STA_ZP, 0x22);
+    Asm::Label repeat = as.BindNew();
+    as.Op1(LDX_IMM, 0x00);
+    Asm::Label fill = as.BindNew();
+    as.Op0(TXA);
+    as.Op1(EOR_IMM, 0xff);
+    as.Op2(STA_ABS_X, data);
+    as.Op0(INX);
+    as.Op1(CPX_IMM, count);
+    as.Branch(BNE, fill);
+    Asm::Label pass = as.BindNew();
+    as.Op1(LDA_IMM, 0x00);
+    as.Op1(STA_ZP, 0x23);  // swapped
+    as.Op1(LDX_IMM, 0x00);
+    Asm::Label compare = as.BindNew();
+    Asm::Label noSwap  = as.NewLabel();
+    as.Op2(LDA_ABS_X, data);
+    as.Op2(CMP_ABS_X, data + 1);
+    as.Branch(BCC, noSwap);
+    as.Branch(BEQ, noSwap);
+    as.Op0(TAY);
+    as.Op2(LDA_ABS_X, data + 1);
+    as.Op2(STA_ABS_X, data);
+    as.Op0(TYA);
+    as.Op2(STA_ABS_X, data + 1);
+    as.Op1(LDA_IMM, 0x01);
+    as.Op1(STA_ZP, 0x23);
+    as.Bind(noSwap);
+    as.Op0(INX);
+    as.Op1(CPX_IMM, count - 1);
+    as.Branch(BNE, compare);
+    as.Op1(LDA_ZP, 0x23);
+    as.Branch(BNE, pass);
+    as.Op1(DEC_ZP, 0x22);
+    as.Branch(BNE, repeat);
+    as.Terminate();
+    return Assemble("bubble_sort", as, program);
+}
+
+// 32 bit fibonacci and a shift register, all operands in the zero page
+static bool BuildZeroPage(Program* program)
+{
+    Asm as(kOrigin);
+    as.Op1(LDA_IMM, 0x01);
+    as.Op1(STA_ZP, 0x10);
+    as.Op1(STA_ZP, 0x14);
+    Asm::Label loop = as.BindNew();
+    as.Op0(CLC);
+    for (uint8_t i = 0; i < 4; i++) {  // c = a + b
+        as.Op1(LDA_ZP, 0x10 + i);
+        as.Op1(ADC_ZP, 0x14 + i);
+        as.Op1(STA_ZP, 0x18 + i);
+    }
+    for (uint8_t i = 0; i < 4; i++) {  // a = b, b = c
+        as.Op1(LDA_ZP, 0x14 + i);
+        as.Op1(STA_ZP, 0x10 + i);
+        as.Op1(LDA_ZP, 0x18 + i);
+        as.Op1(STA_ZP, 0x14 + i);
+    }
+    as.Op1(ASL_ZP, 0x1c);
+    as.Op1(ROL_ZP, 0x1d);
+    as.Op1(LDA_ZP, 0x1d);
+    as.Op1(EOR_ZP, 0x18);
+    as.Op1(STA_ZP, 0x1c);
+    as.LoopWhile16(0x24, loop);
+    as.Terminate();
+    return Assemble("zero_page_kernel", as, program);
+}
+
+// four states driven by an lfsr, every transition is a data dependent branch
+static bool BuildStateMachine(Program* program)
+{
+    const uint8_t seed  = 0x26;
+    const uint8_t state = 0x27;
+
+    Asm as(kOrigin);
+    as.Op1(LDA_IMM, 0xa5);
+    as.Op1(STA_ZP, seed);
+    as.Op1(LDA_IMM, 0x04);
+    as.Op1(STA_ZP, 0x28);
+    Asm::Label outer = as.BindNew();
+    Asm::Label loop  = as.BindNew();
+    Asm::Label noTap = as.NewLabel();
+    as.Op1(LDA_ZP, seed);
+    as.Op0(ASL_A);
+    as.Branch(BCC, noTap);
+    as.Op1(EOR_IMM, 0x1d);
+    as.Bind(noTap);
+    as.Op1(STA_ZP, seed);
+    as.Op1(LDX_ZP, state);
+
+    Asm::Label to[4] = {as.NewLabel(), as.NewLabel(), as.NewLabel(), as.NewLabel()};
+    Asm::Label in[4] = {as.NewLabel(), as.NewLabel(), as.NewLabel(), as.NewLabel()};
+    Asm::Label next  = as.NewLabel();
+    as.Op1(CPX_IMM, 0x00);
+    as.Branch(BEQ, in[0]);
+    as.Op1(CPX_IMM, 0x01);
+    as.Branch(BEQ, in[1]);
+    as.Op1(CPX_IMM, 0x02);
+    as.Branch(BEQ, in[2]);
+    as.Jump(JMP_ABS, in[3]);
+
+    as.Bind(in[0]);
+    as.Op1(BIT_ZP, seed);  // N = bit 7, V = bit 6
+    as.Branch(BMI, to[1]);
+    as.Branch(BVS, to[2]);
+    as.Jump(JMP_ABS, next);
+    as.Bind(in[1]);
+    as.Op1(BIT_ZP, seed);  // N = bit 7, V = bit 6
+    as.Branch(BVC, to[3]);
+    as.Branch(BPL, to[0]);
+    as.Jump(JMP_ABS, next);
+    as.Bind(in[2]);
+    as.Op1(BIT_ZP, seed);  // N = bit 7, V = bit 6
+    as.Branch(BMI, to[3]);
+    as.Branch(BVS, to[1]);
+    as.Jump(JMP_ABS, to[0]);
+    as.Bind(in[3]);
+    as.Op1(BIT_ZP, seed);  // N = bit 7, V = bit 6
+    as.Branch(BPL, to[2]);
+    as.Jump(JMP_ABS, to[0]);
+
+    for (uint8_t s = 0; s < 4; s++) {
+        as.Bind(to[s]);
+        as.Op1(LDA_IMM, s);
+        as.Op1(STA_ZP, state);
+        as.Op2(INC_ABS_X, 0x0500);  // transitions out of each state
+        if (s != 3) {
+            as.Jump(JMP_ABS, next);
+        }
+    }
+    as.Bind(next);
+    as.LoopWhile16(0x24, loop);
+    as.Op1(DEC_ZP, 0x28);
+    as.Branch(BNE, outer);
+    as.Terminate();
+    return Assemble("branch_state_machine", as, program);
+}
+
+// micro kernels : kKernelCopies copies of one instruction (or pair) inside a 16 bit counted
+// loop; the same loop with an empty body is subtracted
+
+static const unsigned kKernelCopies = 32;
+static const uint8_t kKernelPages   = 64;  // loop rounds / 256
+
+struct KernelDef {
+    const char* opClass;
+    const char* mode;
+    uint8_t opcode;
+    uint16_t operand;
+    uint8_t pairOpcode;  // second instruction of a pair (PHA/PLA, JSR/RTS), 0 = none
+};
+
+static const uint16_t kKernelData = 0x3000;
+static const uint8_t kKernelPtr   = 0x40;  // -> kKernelData
+
+static const KernelDef kKernels[] = {
+        {"load", "immediate", LDA_IMM, 0x5a, 0},
+        {"load", "zero_page", LDA_ZP, 0x50, 0},
+        {"load", "zero_page_x", LDA_ZP_X, 0x50, 0},
+        {"load", "absolute", LDA_ABS, kKernelData, 0},
+        {"load", "absolute_x", LDA_ABS_X, kKernelData, 0},
+        {"load", "absolute_y", LDA_ABS_Y, kKernelData, 0},
+        {"load", "indirect_x", LDA_IND_X, kKernelPtr, 0},
+        {"load", "indirect_y", LDA_IND_Y, kKernelPtr, 0},
+        {"store", "zero_page", STA_ZP, 0x50, 0},
+        {"store", "zero_page_x", STA_ZP_X, 0x50, 0},
+        {"store", "absolute", STA_ABS, kKernelData, 0},
+        {"store", "absolute_x", STA_ABS_X, kKernelData, 0},
+        {"store", "absolute_y", STA_ABS_Y, kKernelData, 0},
+        {"store", "indirect_x", STA_IND_X, kKernelPtr, 0},
+        {"store", "indirect_y", STA_IND_Y, kKernelPtr, 0},
+        {"arithmetic", "immediate", ADC_IMM, 0x01, 0},
+        {"arithmetic", "zero_page", ADC_ZP, 0x50, 0},
+        {"arithmetic", "zero_page_x", ADC_ZP_X, 0x50, 0},
+        {"arithmetic", "absolute", ADC_ABS, kKernelData, 0},
+        {"arithmetic", "absolute_x", ADC_ABS_X, kKernelData, 0},
+        {"arithmetic", "absolute_y", ADC_ABS_Y, kKernelData, 0},
+        {"arithmetic", "indirect_x", ADC_IND_X, kKernelPtr, 0},
+        {"arithmetic", "indirect_y", ADC_IND_Y, kKernelPtr, 0},
+        {"logic", "immediate", EOR_IMM, 0x5a, 0},
+        {"logic", "zero_page", EOR_ZP, 0x50, 0},
+        {"logic", "absolute", EOR_ABS, kKernelData, 0},
+        {"compare", "immediate", CMP_IMM, 0x5a, 0},
+        {"compare", "zero_page", CMP_ZP, 0x50, 0},
+        {"compare", "absolute", CMP_ABS, kKernelData, 0},
+        {"shift", "implied", ASL_A, 0, 0},
+        {"shift", "zero_page", ASL_ZP, 0x50, 0},
+        {"shift", "absolute", ASL_ABS, kKernelData, 0},
+        {"shift", "absolute_x", ASL_ABS_X, kKernelData, 0},
+        {"increment", "implied", INX, 0, 0},
+        {"increment", "zero_page", INC_ZP, 0x50, 0},
+        {"increment", "absolute", INC_ABS, kKernelData, 0},
+        {"increment", "absolute_x", INC_ABS_X, kKernelData, 0},
+        {"transfer", "implied", TAX, 0, 0},
+        {"flag", "implied", CLC, 0, 0},
+        {"stack", "implied", PHA, 0, PLA},
+        {"branch_taken", "relative", BCC, 0, 0},
+        {"branch_not_taken", "relative", BCS, 0, 0},
+        {"jump", "absolute", JMP_ABS, 0, 0},
+        {"jump", "indirect", JMP_IND, 0, 0},
+        {"subroutine", "absolute", JSR, 0, RTS},
+};
+
+static bool BuildKernel(const KernelDef* def, Program* program)
+{
+    const uint16_t jumpTable = kKernelData + 0x100;  // JMP (ind) pointers, one per copy
+
+    Asm as(kOrigin);
+    Asm::Label start = as.NewLabel();
+    Asm::Label sub   = as.NewLabel();
+    as.Jump(JMP_ABS, start);
+    as.Bind(sub);
+    as.Op0(RTS);
+    as.Bind(start);
+    as.Op1(LDA_IMM, kKernelData & 0xff);
+    as.Op1(STA_ZP, kKernelPtr);
+    as.Op1(LDA_IMM, kKernelData >> 8);
+    as.Op1(STA_ZP, kKernelPtr + 1);
+    as.Op1(LDA_IMM, kKernelPages);
+    as.Op1(STA_ZP, 0x25);
+    as.Op1(LDX_IMM, 0x00);
+    as.Op1(LDY_IMM, 0x00);
+    as.Op0(CLC);
+    Asm::Label loop = as.BindNew();
+
+    Program::Segment pointers{jumpTable, {}};
+    for (unsigned i = 0; def and i < kKernelCopies; i++) {
+        switch (def->opcode) {
+            case (BCC):
+            case (BCS): {
+                as.Op1(def->opcode, 0x00);
+                break;
+            }
+            case (JMP_ABS): {
+                as.Op2(JMP_ABS, as.Here() + 3);
+                break;
+            }
+            case (JMP_IND): {
+                uint16_t target = as.Here() + 3;
+                as.Op2(JMP_IND, jumpTable + 2 * i);
+                pointers.bytes.push_back(target & 0xff);
+                pointers.bytes.push_back(target >> 8);
+                break;
+            }
+            case (JSR): {
+                as.Jump(JSR, sub);
+                break;
+            }
+            default: {
+                uint8_t length = MosT6502::GetInstrLength(MosT6502::Decode(def->opcode).addrMode);
+                if (length == 1) {
+                    as.Op0(def->opcode);
+                } else if (length == 2) {
+                    as.Op1(def->opcode, def->operand);
+                } else {
+                    as.Op2(def->opcode, def->operand);
+                }
+                if (def->pairOpcode) {
+                    as.Op0(def->pairOpcode);
+                }
+                break;
+            }
+        }
+    }
+    as.Op1(DEC_ZP, 0x24);
+    as.Branch(BNE, loop);
+    as.Op1(DEC_ZP, 0x25);
+    as.Branch(BNE, loop);
+    as.Terminate();
+
+    if (!Assemble((def) ? std::string(def->opClass) + "/" + def->mode : "empty_loop", as,
+                  program)) {
+        return false;
+    }
+    if (!pointers.bytes.empty()) {
+        program->segments.push_back(pointers);
+    }
+    return true;
+}
+
+// running
+
+static const char* CoreName(Mos6502Engine::Core core)
+{
+    switch (core) {
+        case (Mos6502Engine::CORE_INTERPRETER): {
+            return "interp";
+        }
+        case (Mos6502Engine::CORE_BLOCK_CACHE): {
+            return "block";
+        }
+        case (Mos6502Engine::CORE_JIT): {
+            return "jit";
+        }
+        case (Mos6502Engine::CORE_THREADED): {
+            return "threaded";
+        }
+        case (Mos6502Engine::CORE_RECOMPILED): {
+            return "recompiled";
+        }
+    }
+    return "xxx";
+}
+
+static uint64_t RamDigest(Bus& bus)  // fnv-1a 64
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (unsigned page = 0; page < 256; page++) {
+        const uint8_t* ram = bus.RamPage(page);
+        for (unsigned i = 0; i < 256; i++) {
+            hash = (hash ^ ram[i]) * 0x100000001b3ull;
+        }
+    }
+    return hash;
+}
+
+static RunResult RunOnce(const Program& program, Mos6502Engine::Core core)
+{
+    Mos6502Engine engine;
+    engine.SetCore(core);
+    for (const auto& segment : program.segments) {
+        engine.Load(segment.bytes.data(), segment.bytes.size(), segment.addr);
+    }
+    engine.SetResetVector(program.origin);
+    engine.Reset();
+
+    RunResult result;
+    MosT6502::StopReason reason;
+    auto start = std::chrono::steady_clock::now();
+    do {
+        engine.Run(1 << 20, &reason);
+    } while (reason == MosT6502::StopReason::CYCLE_BUDGET);
+    result.seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const MosT6502& cpu = engine.GetCpu();
+    result.ok           = (reason == MosT6502::StopReason::TERMINATED);
+    result.instructions = cpu.instructions;
+    result.cycles       = cpu.cycles;
+    result.ramDigest    = RamDigest(engine.GetBus());
+    return result;
+}
+
+static RunResult RunBest(const Program& program, Mos6502Engine::Core core, unsigned repeat)
+{
+    RunResult best = RunOnce(program, core);
+    for (unsigned i = 1; i < repeat and best.ok; i++) {
+        RunResult result = RunOnce(program, core);
+        best.seconds     = std::min(best.seconds, result.seconds);
+    }
+    return best;
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<Mos6502Engine::Core> cores = {
+            Mos6502Engine::CORE_INTERPRETER, Mos6502Engine::CORE_THREADED,
+            Mos6502Engine::CORE_BLOCK_CACHE, Mos6502Engine::CORE_JIT};
+    std::string jsonPath;
+    unsigned repeat = 3;
+    bool kernels    = true;
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg.compare(0, 7, "--json=") == 0) {
+            jsonPath = arg.substr(7);
+        } else if (arg.compare(0, 9, "--repeat=") == 0) {
+            repeat = std::max(1ul, std::strtoul(arg.c_str() + 9, nullptr, 10));
+        } else if (arg == "--no-kernels") {
+            kernels = false;
+        } else if (arg.compare(0, 7, "--core=") == 0 and arg != "--core=all") {
+            std::string name = arg.substr(7);
+            cores.clear();
+            for (auto core : {Mos6502Engine::CORE_INTERPRETER, Mos6502Engine::CORE_THREADED,
+                              Mos6502Engine::CORE_BLOCK_CACHE, Mos6502Engine::CORE_JIT}) {
+                if (name == CoreName(core)) {
+                    cores.push_back(core);
+                }
+            }
+            if (cores.empty()) {
+                std::cout << "unknown core : " << name << '\n';
+                return 1;
+            }
+        } else if (arg != "--core=all") {
+            std::cout << "usage : ./opcode_bench [options]\n"
+                         "  --json=<path> : write the results there as json\n"
+                         "  --core=interp|threaded|block|jit|all : cores to measure (default all)\n"
+                         "  --repeat=<n> : best of n runs per measurement (default 3)\n"
+                         "  --no-kernels : skip the per opcode class / addressing mode kernels\n";
+            return 1;
+        }
+    }
+
+    std::vector<Program> workloads(5);
+    bool (*builders[])(Program*) = {BuildArithmetic, BuildMemoryCopy, BuildSort, BuildZeroPage,
+                                    BuildStateMachine};
+    for (size_t i = 0; i < workloads.size(); i++) {
+        if (!builders[i](&workloads[i])) {
+            std::cout << "workload " << i << " does not assemble\n";
+            return 1;
+        }
+    }
+
+    std::ostringstream json;
+    json << std::setprecision(6) << "{\n  \"schema\": 1,\n  \"compiler\": \"" << __VERSION__
+         << "\",\n  \"repeat\": " << repeat << ",\n  \"workloads\": [";
+    bool failed = false;
+    bool first  = true;
+    std::cout << std::fixed << std::setprecision(2);
+    for (const auto& program : workloads) {
+        uint64_t digest = 0;
+        for (auto core : cores) {
+            RunResult r = RunBest(program, core, repeat);
+            bool agrees = r.ok and (core == cores.front() or r.ramDigest == digest);
+            digest      = (core == cores.front()) ? r.ramDigest : digest;
+            failed      = failed or !agrees;
+
+            double ips = r.instructions / r.seconds;
+            double cps = r.cycles / r.seconds;
+            std::cout << "workload=" << program.name << " core=" << CoreName(core)
+                      << " instructions=" << r.instructions << " cycles=" << r.cycles
+                      << " mips=" << ips / 1e6 << " emulated_mhz=" << cps / 1e6
+                      << " ns_per_instr=" << 1e9 / ips << ((agrees) ? "" : " FAILED") << '\n';
+            json << ((first) ? "\n" : ",\n") << "    {\"name\": \"" << program.name
+                 << "\", \"core\": \"" << CoreName(core) << "\", \"ok\": "
+                 << ((agrees) ? "true" : "false") << ", \"instructions\": " << r.instructions
+                 << ", \"cycles\": " << r.cycles << ", \"seconds\": " << r.seconds
+                 << ", \"instructions_per_sec\": " << ips << ", \"cycles_per_sec\": " << cps
+                 << ", \"ns_per_instruction\": " << 1e9 / ips << "}";
+            first = false;
+        }
+    }
+    json << "\n  ],\n  \"opcode_classes\": [";
+
+    if (kernels) {
+        Program empty;
+        BuildKernel(nullptr, &empty);
+        first = true;
+        for (auto core : cores) {
+            RunResult base = RunBest(empty, core, repeat);
+            for (const auto& def : kKernels) {
+                Program program;
+                if (!BuildKernel(&def, &program)) {
+                    std::cout << "kernel " << def.opClass << "/" << def.mode
+                              << " does not assemble\n";
+                    return 1;
+                }
+                RunResult r = RunBest(program, core, repeat);
+                double ns   = (r.seconds - base.seconds) * 1e9 /
+                            (double)(r.instructions - base.instructions);
+                failed = failed or !r.ok;
+                std::cout << "class=" << def.opClass << " mode=" << def.mode
+                          << " core=" << CoreName(core) << " ns_per_instr=" << ns
+                          << ((r.ok) ? "" : " FAILED") << '\n';
+                json << ((first) ? "\n" : ",\n") << "    {\"class\": \"" << def.opClass
+                     << "\", \"mode\": \"" << def.mode << "\", \"opcode\": " << (int)def.opcode
+                     << ", \"core\": \"" << CoreName(core) << "\", \"ok\": "
+                     << ((r.ok) ? "true" : "false") << ", \"ns_per_instruction\": " << ns << "}";
+                first = false;
+            }
+        }
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    long peakRssKib = usage.ru_maxrss;  // KiB on Linux
+    std::cout << "peak_rss_kib=" << peakRssKib << '\n';
+    json << "\n  ],\n  \"peak_rss_kib\": " << peakRssKib << "\n}\n";
+
+    if (!jsonPath.empty()) {
+        std::ofstream out(jsonPath);
+        out << json.str();
+        if (!out) {
+            std::cout << "cannot write " << jsonPath << '\n';
+            return 1;
+        }
+    }
+    return (failed) ? 2 : 0;
+}
@@ -0,0 +1,357 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "include/diff_fuzzer.h"
+#include "include/lockstep_engine.h"
+#include "include/reference_6502.h"
+#include "include/static_recompiler.h"
+
+// Runs random programs through every selected core and an oracle in lockstep. The first
+// divergence per core is minimised and written out as <out>_<core>.snap / .txt; any divergence
+// makes the exit code 2. With --lockstep=<n> each case also runs on n LockstepEngine lanes, all
+// but the first with other start registers and data bytes, each lane against its own interpreter.
+// --alu checks ADC/SBC on every a, operand, C and D against the reference model first.
+// --devices maps an interval timer into every case (see DiffFuzzer::SetDevices), so slices
+// also end early from inside a run.
+// --recompiled checks RecompiledCore : every case goes through StaticRecompiler and is built as
+// a shared object with $CXX (default g++) from the repo root, one compiler run per case.
+
+static const char* CoreName(Mos6502Engine::Core core)
+{
+    switch (core) {
+        case (Mos6502Engine::CORE_INTERPRETER): {
+            return "interp";
+        }
+        case (Mos6502Engine::CORE_BLOCK_CACHE): {
+            return "block";
+        }
+        case (Mos6502Engine::CORE_JIT): {
+            return "jit";
+        }
+        case (Mos6502Engine::CORE_THREADED): {
+            return "threaded";
+        }
+        case (Mos6502Engine::CORE_RECOMPILED): {
+            return "recompiled";
+        }
+    }
+    return "xxx";
+}
+
+// <prefix>.cpp from the program the way opcode_recompile translates an image, built to
+// <prefix>.so; *path is that, or "" when nothing in it translates (the interpreter runs it all)
+static bool BuildRecompiled(const DiffFuzzer::Case& fuzzCase, const std::string& prefix,
+                            std::string* path)
+{
+    StaticRecompiler recompiler(fuzzCase.ram.data());
+    recompiler.AddImageRange(DiffFuzzer::kProgramAddr, 0x0400);
+    recompiler.AddEntry(DiffFuzzer::kProgramAddr);
+    recompiler.AddVectorEntries();
+    recompiler.Analyze();
+
+    std::ofstream out(prefix + ".cpp");
+    if (!out.is_open()) {
+        return false;
+    }
+    StaticRecompiler::Status status = recompiler.Write(out, false);
+    out.close();
+    if (status == StaticRecompiler::ERR_NO_CODE) {
+        path->clear();
+        return true;
+    }
+    if (status != StaticRecompiler::OK) {
+        return false;
+    }
+    const char* cxx     = std::getenv("CXX");
+    std::string command = std::string(cxx ? cxx : "g++") + " -O1 -shared -fPIC -I. " + prefix +
+                          ".cpp -o " + prefix + ".so";
+    if (std::system(command.c_str()) != 0) {
+        return false;
+    }
+    // dlopen() only takes a name without a slash from the library search path
+    *path = (prefix.find('/') == std::string::npos) ? "./" + prefix + ".so" : prefix + ".so";
+    return true;
+}
+
+// the first lane that differs from its interpreter run, with what differs; -1 when none does
+static int CheckLockstep(const DiffFuzzer::Case& fuzzCase, unsigned lanes, std::mt19937_64& rng,
+                         std::string* detail)
+{
+    LockstepEngine lockstep(lanes);
+    std::vector<std::unique_ptr<Mos6502Engine>> engines;
+    std::vector<DiffFuzzer::Case> laneCases(lanes, fuzzCase);
+    for (unsigned lane = 0; lane < lanes; lane++) {
+        DiffFuzzer::Case& laneCase = laneCases[lane];
+        if (lane > 0) {
+            laneCase.a  = rng();
+            laneCase.x  = rng();
+            laneCase.y  = rng();
+            laneCase.sr = rng();
+            for (unsigned i = 0; i < 8; i++) {  // zero page and data, not the program
+                laneCase.ram[rng() % DiffFuzzer::kProgramAddr] = rng();
+            }
+        }
+        lockstep.LoadLane(lane, laneCase.ram.data(), laneCase.ram.size(), 0x0000);
+        engines.emplace_back(new Mos6502Engine());
+        engines[lane]->SetCore(Mos6502Engine::CORE_INTERPRETER);
+        engines[lane]->Load(laneCase.ram.data(), laneCase.ram.size(), 0x0000);
+        engines[lane]->Reset();
+    }
+    lockstep.Reset();
+    for (unsigned lane = 0; lane < lanes; lane++) {
+        const DiffFuzzer::Case& laneCase = laneCases[lane];
+        LockstepEngine::LaneState state  = lockstep.GetLane(lane);
+        MosT6502& cpu                    = engines[lane]->GetCpu();
+        state.a = cpu.a = laneCase.a;
+        state.x = cpu.x = laneCase.x;
+        state.y = cpu.y = laneCase.y;
+        state.sp = cpu.sp = laneCase.sp;
+        state.sr          = laneCase.sr;
+        cpu.SetStatus(laneCase.sr);
+        lockstep.SetLane(lane, state);
+    }
+
+    for (uint32_t budget : fuzzCase.budgets) {
+        lockstep.Run(budget);
+        for (unsigned lane = 0; lane < lanes; lane++) {
+            MosT6502::StopReason reason;
+            engines[lane]->Run(budget, &reason);
+            const MosT6502& cpu             = engines[lane]->GetCpu();
+            LockstepEngine::LaneState state = lockstep.GetLane(lane);
+            std::ostringstream diff;
+            if (state.a != cpu.a or state.x != cpu.x or state.y != cpu.y or state.sp != cpu.sp or
+                state.sr != cpu.GetStatus() or state.pc != cpu.pc) {
+                diff << std::hex << "registers : a=" << +cpu.a << " x=" << +cpu.x
+                     << " y=" << +cpu.y << " sp=" << +cpu.sp << " sr=" << +cpu.GetStatus()
+                     << " pc=" << cpu.pc << " vs a=" << +state.a << " x=" << +state.x
+                     << " y=" << +state.y << " sp=" << +state.sp << " sr=" << +state.sr
+                     << " pc=" << state.pc << std::dec << '\n';
+            }
+            if (state.cycles != cpu.cycles or state.instructions != cpu.instructions) {
+                diff << "counters : " << cpu.cycles << " cycles " << cpu.instructions
+                     << " instructions vs " << state.cycles << " cycles " << state.instructions
+                     << " instructions\n";
+            }
+            if (reason != lockstep.GetStopReason(lane)) {
+                diff << "stop : " << MosT6502::GetStopReasonName(reason) << " vs "
+                     << MosT6502::GetStopReasonName(lockstep.GetStopReason(lane)) << '\n';
+            }
+            for (uint32_t addr = 0; addr < 0x10000; addr++) {
+                uint8_t expected = engines[lane]->GetBus().RamPage(addr >> 8)[addr & 0xff];
+                if (lockstep.Read(lane, addr) != expected) {
+                    diff << std::hex << "ram 0x" << addr << " : " << +expected << " vs "
+                         << +lockstep.Read(lane, addr) << std::dec << '\n';
+                    break;
+                }
+            }
+            if (!diff.str().empty()) {
+                *detail = diff.str();
+                return lane;
+            }
+        }
+    }
+    return -1;
+}
+
+// ADC/SBC immediate on the interpreter, binary and decimal; the combinations that differ from
+// Reference6502, the first one described in *detail
+static unsigned CheckAlu(std::string* detail)
+{
+    std::unique_ptr<Reference6502> reference(new Reference6502());
+    MosT6502 cpu;  // immediate operands never reach the bus
+    const uint8_t flagSets[] = {0, MosT6502::C, MosT6502::D, MosT6502::D | MosT6502::C};
+    unsigned mismatches      = 0;
+    for (uint8_t opcode : {0x69, 0xe9}) {
+        for (uint8_t flags : flagSets) {
+            uint8_t sr = MosT6502::U | flags;
+            for (unsigned a = 0; a < 256; a++) {
+                for (unsigned m = 0; m < 256; m++) {
+                    reference->mem[DiffFuzzer::kProgramAddr]     = opcode;
+                    reference->mem[DiffFuzzer::kProgramAddr + 1] = m;
+                    reference->pc                                = DiffFuzzer::kProgramAddr;
+                    reference->a                                 = a;
+                    reference->sr                                = sr;
+                    reference->Step();
+
+                    cpu.pc = DiffFuzzer::kProgramAddr + 2;
+                    cpu.a  = a;
+                    cpu.SetStatus(sr);
+                    cpu.Execute(MosT6502::Decode(opcode), m);
+
+                    if (cpu.a == reference->a and cpu.GetStatus() == reference->sr) {
+                        continue;
+                    }
+                    if (mismatches++ == 0) {
+                        std::ostringstream diff;
+                        diff << std::hex << MosT6502::GetInstrString(opcode) << " a=0x" << a
+                             << " m=0x" << m << " sr=0x" << +sr << " : a 0x" << +reference->a
+                             << " vs 0x" << +cpu.a << ", sr 0x" << +reference->sr << " vs 0x"
+                             << +cpu.GetStatus() << std::dec << '\n';
+                        *detail = diff.str();
+                    }
+                }
+            }
+        }
+    }
+    return mismatches;
+}
+
+int main(int argc, char* argv[])
+{
+    uint64_t seed       = 1;
+    unsigned iterations = 1000;
+    unsigned lockstep   = 0;
+    bool alu            = false;
+    bool devices        = false;
+    bool recompiled     = false;
+    std::string out     = "fuzz_repro";
+    DiffFuzzer::Oracle oracle = DiffFuzzer::ORACLE_REFERENCE;
+    std::vector<Mos6502Engine::Core> cores = {
+        Mos6502Engine::CORE_INTERPRETER, Mos6502Engine::CORE_THREADED,
+        Mos6502Engine::CORE_BLOCK_CACHE, Mos6502Engine::CORE_JIT};
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg.compare(0, 7, "--seed=") == 0) {
+            seed = std::strtoull(arg.c_str() + 7, nullptr, 10);
+        } else if (arg.compare(0, 13, "--iterations=") == 0) {
+            iterations = std::strtoul(arg.c_str() + 13, nullptr, 10);
+        } else if (arg.compare(0, 11, "--lockstep=") == 0) {
+            lockstep = std::strtoul(arg.c_str() + 11, nullptr, 10);
+        } else if (arg == "--alu") {
+            alu = true;
+        } else if (arg == "--devices") {
+            devices = true;
+        } else if (arg == "--recompiled") {
+            recompiled = true;
+        } else if (arg.compare(0, 6, "--out=") == 0) {
+            out = arg.substr(6);
+        } else if (arg == "--against=interp") {
+            oracle = DiffFuzzer::ORACLE_INTERPRETER;
+        } else if (arg.compare(0, 7, "--core=") == 0 and arg != "--core=all") {
+            std::string name = arg.substr(7);
+            cores.clear();
+            for (auto core : {Mos6502Engine::CORE_INTERPRETER, Mos6502Engine::CORE_THREADED,
+                              Mos6502Engine::CORE_BLOCK_CACHE, Mos6502Engine::CORE_JIT}) {
+                if (name == CoreName(core)) {
+                    cores.push_back(core);
+                }
+            }
+            if (cores.empty()) {
+                std::cout << "unknown core : " << name << '\n';
+                return 1;
+            }
+        } else if (arg != "--core=all" and arg != "--against=reference") {
+            std::cout << "usage : ./opcode_fuzz [options]\n"
+                         "  --seed=<n> : first case seed (default 1), case i uses seed + i\n"
+                         "  --iterations=<n> : cases per core (default 1000)\n"
+                         "  --core=interp|threaded|block|jit|all : cores to check (default all)\n"
+                         "  --against=reference|interp : oracle (default reference)\n"
+                         "  --lockstep=<n> : also check every case on n lockstep lanes\n"
+                         "  --alu : also check ADC/SBC exhaustively, binary and decimal\n"
+                         "  --devices : map an irq timer the program pokes at (needs\n"
+                         "      --against=interp)\n"
+                         "  --recompiled : check the recompiled core instead, building a\n"
+                         "      module per case with $CXX -I. (run from the repo root)\n"
+                         "  --out=<prefix> : reproducer files prefix (default fuzz_repro)\n";
+            return 1;
+        }
+    }
+
+    if (devices and oracle != DiffFuzzer::ORACLE_INTERPRETER) {
+        std::cout << "--devices needs --against=interp, the reference model has no bus\n";
+        return 1;
+    }
+
+    if (recompiled) {
+        cores = {Mos6502Engine::CORE_RECOMPILED};
+    }
+
+    int exitCode = 0;
+    if (alu) {
+        std::string detail;
+        unsigned mismatches = CheckAlu(&detail);
+        if (mismatches > 0) {
+            exitCode = 2;
+            std::cout << "alu differs from the reference : " << detail;
+        }
+        std::cout << "alu against=reference cases=" << 2 * 4 * 256 * 256
+                  << " divergences=" << mismatches << '\n';
+    }
+
+    for (auto core : cores) {
+        DiffFuzzer fuzzer(core, oracle);
+        fuzzer.SetDevices(devices);
+        unsigned divergences = 0;
+        for (unsigned i = 0; i < iterations; i++) {
+            std::mt19937_64 rng(seed + i);
+            DiffFuzzer::Case fuzzCase = fuzzer.Generate(rng);
+            std::string module;
+            if (core == Mos6502Engine::CORE_RECOMPILED) {
+                if (!BuildRecompiled(fuzzCase, out + "_module", &module)) {
+                    std::cout << "unable to build " << out << "_module.so, seed=" << seed + i
+                              << '\n';
+                    return 1;
+                }
+                fuzzer.SetRecompiled(module);
+            }
+            DiffFuzzer::Divergence divergence = fuzzer.Check(fuzzCase);
+            if (!divergence.found) {
+                continue;
+            }
+            exitCode = 2;
+            if (divergences++ > 0) {
+                continue;  // one reproducer per core is enough
+            }
+            fuzzCase        = fuzzer.Minimize(fuzzCase, &divergence);
+            std::string path = out + "_" + CoreName(core);
+            if (!module.empty()) {  // kept next to the reproducer, later cases rebuild the other
+                std::rename((out + "_module.cpp").c_str(), (path + ".cpp").c_str());
+                std::rename(module.c_str(), (path + ".so").c_str());
+                fuzzer.SetRecompiled(path + ".so");
+            }
+            fuzzer.WriteReproducer(fuzzCase, divergence, path);
+            std::cout << "core=" << CoreName(core) << " seed=" << seed + i
+                      << " diverges at instruction #" << divergence.instruction << " pc=0x"
+                      << std::hex << divergence.pc << std::dec << ", see " << path << ".txt\n"
+                      << divergence.detail;
+        }
+        std::cout << "core=" << CoreName(core) << " against=" << DiffFuzzer::GetOracleName(oracle)
+                  << (devices ? " devices" : "") << " cases=" << iterations
+                  << " divergences=" << divergences << '\n';
+    }
+    if (recompiled) {
+        std::remove((out + "_module.cpp").c_str());
+        std::remove((out + "_module.so").c_str());
+    }
+
+    if (lockstep > 0) {
+        DiffFuzzer fuzzer(Mos6502Engine::CORE_INTERPRETER, DiffFuzzer::ORACLE_INTERPRETER);
+        unsigned divergences = 0;
+        for (unsigned i = 0; i < iterations; i++) {
+            std::mt19937_64 rng(seed + i);
+            DiffFuzzer::Case fuzzCase = fuzzer.Generate(rng);
+            std::string detail;
+            int lane = CheckLockstep(fuzzCase, lockstep, rng, &detail);
+            if (lane < 0) {
+                continue;
+            }
+            exitCode = 2;
+            if (divergences++ == 0) {
+                std::cout << "lockstep seed=" << seed + i << " lane " << lane
+                          << " diverges from the interpreter\n"
+                          << detail;
+            }
+        }
+        std::cout << "lockstep lanes=" << lockstep << " against=interp cases=" << iterations
+                  << " divergences=" << divergences << '\n';
+    }
+    return exitCode;
+}
@@ -1,15 +1,94 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <csignal>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <string>
 
+#include "include/job_server.h"
 #include "include/opcode_processor.hpp"
 
+// --serve[=<pipe>] [options] : job records in on stdin (or the named pipe), results out on
+// stdout, see JobServer. Diagnostics go to stderr, stdout carries nothing but results.
+static int Serve(int argc, char* argv[])
+{
+    std::string serveArg(argv[1]);
+    std::string inputPath = (serveArg.size() > 8) ? serveArg.substr(8) : std::string();
+    Mos6502Engine::Core core = Mos6502Engine::CORE_BLOCK_CACHE;
+    unsigned flushEvery      = 64;
+    for (int i = 2; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg == "--core=jit") {
+            core = Mos6502Engine::CORE_JIT;
+        } else if (arg == "--core=threaded") {
+            core = Mos6502Engine::CORE_THREADED;
+        } else if (arg == "--core=interp") {
+            core = Mos6502Engine::CORE_INTERPRETER;
+        } else if (arg.compare(0, 14, "--flush-every=") == 0) {
+            flushEvery = std::strtoul(arg.c_str() + 14, nullptr, 10);
+        } else if (arg != "--core=block") {
+            std::cerr << "unknown option : " << arg << '\n';
+            return 1;
+        }
+    }
+
+    int inFd = STDIN_FILENO;
+    if (!inputPath.empty()) {
+        inFd = open(inputPath.c_str(), O_RDONLY);
+        if (inFd < 0) {
+            std::cerr << "Unable to open " << inputPath << '\n';
+            return 1;
+        }
+    }
+    signal(SIGPIPE, SIG_IGN);  // a reader going away is an ERR_WRITE, not a kill
+
+    JobServer server(core);
+    server.SetFlushEvery(flushEvery);
+    JobServer::Status status = server.Serve(inFd, STDOUT_FILENO);
+    if (inFd != STDIN_FILENO) {
+        close(inFd);
+    }
+    const JobServer::Stats& stats = server.GetStats();
+    std::cerr << "jobs=" << stats.jobs << " bytes_in=" << stats.bytesIn
+              << " bytes_out=" << stats.bytesOut << " writes=" << stats.writes << '\n';
+    if (status != JobServer::OK) {
+        std::cerr << JobServer::GetStatusName(status) << '\n';
+        return 1;
+    }
+    return 0;
+}
+
 int main(int argc, char* argv[])
 {
+    if (argc >= 2 and (std::string(argv[1]) == "--serve" or
+                       std::string(argv[1]).compare(0, 8, "--serve=") == 0)) {
+        return Serve(argc, argv);
+    }
     if (argc < 3) {
-        std::cout << "usage : ./opcode_processor <start_addr_in_hex> 6502_hex_mc (ex: "
-                     ">./opcode_processor 0xffa0 6502_hex_mc)\n";
+        std::cout << "usage : ./opcode_processor <start_addr_in_hex> 6502_image [options] "
+                     "(ex: >./opcode_processor 0xffa0 6502_hex_mc)\n"
+                     "  --trace=none : headless, no per-instruction output (default)\n"
+                     "  --trace=text : one formatted line per executed instruction\n"
+                     "  --format=auto|hex|raw|prg|ihex|srec : image format (default auto)\n"
+                     "  --image-reset-vector : start from the image's own reset vector if any\n"
+                     "  --dump=dirty|full|binary|none : ram dump at the end (default dirty,\n"
+                     "      the pages the program wrote; binary is (u16 addr, u32 len, bytes))\n"
+                     "  --dump-file=<path> : write the ram dump there instead of stdout\n"
+                     "  --core=block|jit|threaded|interp : predecoded block cache (default),\n"
+                     "      the same plus native x86-64 code for hot blocks, per-opcode\n"
+                     "      specialised handlers, or the plain interpreter\n"
+                     "  --recompiled=<module.so> : run the image's code translated ahead of time\n"
+                     "      by opcode_recompile, the interpreter covers whatever it left out\n"
+                     "  --profile=<prefix> : count cycles per address / opcode / call path, write\n"
+                     "      <prefix>.txt (hot addresses) and <prefix>.folded (flamegraph.pl input)\n"
+                     "   or : ./opcode_processor --serve[=<pipe>] [--core=...] [--flush-every=<n>]\n"
+                     "      run length-prefixed job records from stdin (or the pipe) on one warm\n"
+                     "      engine, binary results on stdout every n jobs (default 64), see\n"
+                     "      include/job_server.h for both record layouts\n";
         return 1;
     }
 
@@ -18,9 +97,80 @@ int main(int argc, char* argv[])
     uint16_t startProcAddr;
     startProcAddrStream >> std::hex >> startProcAddr;
 
+    std::unique_ptr<TraceSink> traceSink;
+    ProgramImage::Format format = ProgramImage::AUTO;
+    bool useImageResetVector    = false;
+    OpcodeProcessor::RamDump ramDump = OpcodeProcessor::RAM_DUMP_DIRTY;
+    std::string dumpFile;
+    Mos6502Engine::Core core = Mos6502Engine::CORE_BLOCK_CACHE;
+    std::unique_ptr<GuestProfile> profile;
+    std::string profilePrefix;
+    std::string recompiledPath;
+    for (int i = 3; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg == "--trace=text") {
+            traceSink.reset(new TextTraceSink(std::cout));
+        } else if (arg == "--format=hex") {
+            format = ProgramImage::HEX_TEXT;
+        } else if (arg == "--format=raw") {
+            format = ProgramImage::RAW;
+        } else if (arg == "--format=prg") {
+            format = ProgramImage::PRG;
+        } else if (arg == "--format=ihex") {
+            format = ProgramImage::INTEL_HEX;
+        } else if (arg == "--format=srec") {
+            format = ProgramImage::SREC;
+        } else if (arg == "--image-reset-vector") {
+            useImageResetVector = true;
+        } else if (arg == "--dump=full") {
+            ramDump = OpcodeProcessor::RAM_DUMP_FULL;
+        } else if (arg == "--dump=binary") {
+            ramDump = OpcodeProcessor::RAM_DUMP_BINARY;
+        } else if (arg == "--dump=none") {
+            ramDump = OpcodeProcessor::RAM_DUMP_NONE;
+        } else if (arg.compare(0, 12, "--dump-file=") == 0) {
+            dumpFile = arg.substr(12);
+        } else if (arg.compare(0, 10, "--profile=") == 0) {
+            profilePrefix = arg.substr(10);
+            profile.reset(new GuestProfile);
+        } else if (arg.compare(0, 13, "--recompiled=") == 0) {
+            recompiledPath = arg.substr(13);
+            core           = Mos6502Engine::CORE_RECOMPILED;
+        } else if (arg == "--core=jit") {
+            core = Mos6502Engine::CORE_JIT;
+        } else if (arg == "--core=threaded") {
+            core = Mos6502Engine::CORE_THREADED;
+        } else if (arg == "--core=interp") {
+            core = Mos6502Engine::CORE_INTERPRETER;
+        } else if (arg != "--trace=none" and arg != "--format=auto" and arg != "--dump=dirty" and
+                   arg != "--core=block") {
+            std::cout << "unknown option : " << arg << '\n';
+            return 1;
+        }
+    }
+
     OpcodeProcessor ocp;
     ocp.Init();
-    ocp.ProcessFile(std::string(argv[2]), startProcAddr);
+    ocp.SetCore(core);
+    if (!recompiledPath.empty() and !ocp.LoadRecompiled(recompiledPath)) {
+        std::cout << "Unable to load a recompiled module from " << recompiledPath << '\n';
+        return 1;
+    }
+    ocp.SetTraceSink(traceSink.get());
+    ocp.SetProfile(profile.get());
+    ocp.SetRamDump(ramDump, dumpFile);
+    ocp.ProcessFile(std::string(argv[2]), startProcAddr, format, useImageResetVector);
     ocp.Shutdown();
+
+    if (profile) {
+        std::ofstream report(profilePrefix + ".txt");
+        std::ofstream folded(profilePrefix + ".folded");
+        if (!report.is_open() or !folded.is_open()) {
+            std::cout << "Unable to write the profile to " << profilePrefix << ".txt/.folded\n";
+            return 1;
+        }
+        profile->WriteReport(report);
+        profile->WriteFoldedStacks(folded);
+    }
     return 0;
 }
@@ -0,0 +1,117 @@
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "include/mos6502_engine.h"
+#include "include/static_recompiler.h"
+
+// <start_addr_in_hex> <image> [options] : the image loaded the way opcode_processor loads it,
+// translated to C++ from its reset vector (and any other entry point), see StaticRecompiler
+int main(int argc, char* argv[])
+{
+    if (argc < 3) {
+        std::cout << "usage : ./opcode_recompile <start_addr_in_hex> 6502_image [options]\n"
+                     "  --format=auto|hex|raw|prg|ihex|srec : image format (default auto)\n"
+                     "  --image-reset-vector : start from the image's own reset vector if any\n"
+                     "  --entry=<hex> : one more entry point (irq handlers, jump tables, ...)\n"
+                     "  --out=<path> : the C++ written (default recompiled.cpp)\n"
+                     "  --main : add a main() running the image, for a standalone program\n"
+                     "build : g++ -O2 -shared -fPIC -I<repo> recompiled.cpp -o rom.so, then\n"
+                     "        ./opcode_processor <start_addr> <image> --recompiled=./rom.so\n"
+                     "   or : g++ -O2 -I<repo> recompiled.cpp libmos6502.a -pthread -ldl -o rom\n"
+                     "        (with --main)\n";
+        return 1;
+    }
+
+    std::string startProcAddrString(argv[1]);
+    std::stringstream startProcAddrStream(startProcAddrString);
+    uint16_t startProcAddr;
+    startProcAddrStream >> std::hex >> startProcAddr;
+
+    ProgramImage::Format format = ProgramImage::AUTO;
+    bool useImageResetVector    = false;
+    bool withMain               = false;
+    std::string outPath("recompiled.cpp");
+    std::vector<uint16_t> entries;
+    for (int i = 3; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg == "--format=hex") {
+            format = ProgramImage::HEX_TEXT;
+        } else if (arg == "--format=raw") {
+            format = ProgramImage::RAW;
+        } else if (arg == "--format=prg") {
+            format = ProgramImage::PRG;
+        } else if (arg == "--format=ihex") {
+            format = ProgramImage::INTEL_HEX;
+        } else if (arg == "--format=srec") {
+            format = ProgramImage::SREC;
+        } else if (arg == "--image-reset-vector") {
+            useImageResetVector = true;
+        } else if (arg == "--main") {
+            withMain = true;
+        } else if (arg.compare(0, 8, "--entry=") == 0) {
+            entries.push_back(std::strtoul(arg.c_str() + 8, nullptr, 16));
+        } else if (arg.compare(0, 6, "--out=") == 0) {
+            outPath = arg.substr(6);
+        } else if (arg != "--format=auto") {
+            std::cout << "unknown option : " << arg << '\n';
+            return 1;
+        }
+    }
+
+    ProgramImage image;
+    ProgramImage::Status imageStatus = image.Open(std::string(argv[2]), format);
+    if (imageStatus != ProgramImage::OK) {
+        std::cout << ProgramImage::GetStatusName(imageStatus) << " : " << argv[2] << '\n';
+        return 1;
+    }
+    Mos6502Engine engine;
+    if (engine.LoadImage(image, startProcAddr, startProcAddr, useImageResetVector) !=
+        Mos6502Engine::OK) {
+        std::cout << "Program does not fit in memory, size=" << std::dec << image.TotalBytes()
+                  << " start_addr=" << STREAM_WORD(startProcAddr) << '\n';
+        return 1;
+    }
+
+    // the 64 KiB exactly as a run of opcode_processor starts out with
+    std::vector<uint8_t> memory(0x10000);
+    for (unsigned page = 0; page < 256; page++) {
+        memcpy(memory.data() + (page << 8), engine.GetBus().RamPage(page), 256);
+    }
+    StaticRecompiler recompiler(memory.data());
+    uint16_t shift = image.IsRelocatable() ? startProcAddr : 0;
+    for (const auto& seg : image.Segments()) {
+        recompiler.AddImageRange(seg.addr + shift, seg.size);
+    }
+    recompiler.AddEntry(memory[0xfffc] | (memory[0xfffd] << 8));
+    recompiler.AddVectorEntries();
+    for (uint16_t entry : entries) {
+        recompiler.AddEntry(entry);
+    }
+    recompiler.Analyze();
+
+    std::ofstream out(outPath);
+    if (!out.is_open()) {
+        std::cout << "Unable to write " << outPath << '\n';
+        return 1;
+    }
+    StaticRecompiler::Status status = recompiler.Write(out, withMain);
+    if (status == StaticRecompiler::ERR_NO_CODE) {
+        std::cout << "No code reachable from the entry points\n";
+        return 1;
+    }
+    if (status != StaticRecompiler::OK) {
+        std::cout << "Unable to write " << outPath << '\n';
+        return 1;
+    }
+
+    const StaticRecompiler::Stats& stats = recompiler.GetStats();
+    std::cout << outPath << " : entries=" << std::dec << stats.entries
+              << " blocks=" << stats.blocks << " instructions=" << stats.instructions
+              << " code_bytes=" << stats.codeBytes << " left_to_host=" << stats.leftToHost
+              << '\n';
+    return 0;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "program_image.h"
+
+// Runs a manifest of independent 6502 programs on a work-stealing thread pool.
+//
+// manifest : one job per line, '#' starts a comment
+//     <image_path> <start_addr_in_hex> <cycle_limit>
+// images may be in any ProgramImage format; raw/hex text ones are loaded at start_addr
+// results  : one line per job in completion order, jobs carry their manifest index
+//     <job> <image> <reason> <cycles> <instructions> <a> <x> <y> <sp> <pc> <sr> <ram_fnv1a>
+// ram_fnv1a is fnv-1a 64 over every ram page the job wrote after its reset, in page order, each
+// as its page number byte then its 256 bytes; pages it never wrote still hold the image
+class BatchRunner {
+   public:
+    struct WorkerStats {
+        uint64_t jobs         = 0;
+        uint64_t instructions = 0;
+        uint64_t cycles       = 0;
+        double busySeconds    = 0.0;
+    };
+
+    bool LoadManifest(const std::string& manifestPath, std::string* error);
+
+    // workerCount == 0 uses every hardware thread
+    bool Run(const std::string& resultPath, unsigned workerCount, std::string* error);
+
+    size_t JobCount() const { return m_jobs.size(); }
+    double ElapsedSeconds() const { return m_elapsedSeconds; }
+    const std::vector<WorkerStats>& GetWorkerStats() const { return m_workerStats; }
+
+   private:
+    struct Job {
+        size_t imageIndex;
+        uint16_t startAddr;
+        uint64_t cycleLimit;
+    };
+
+    struct Image {
+        std::string path;
+        std::unique_ptr<ProgramImage> program;
+    };
+
+    std::vector<Image> m_images;  // each distinct path is read once
+    std::vector<Job> m_jobs;
+    std::vector<WorkerStats> m_workerStats;
+    double m_elapsedSeconds = 0.0;
+};
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "block_jit.h"
+#include "bus.h"
+#include "mos_t_6502.h"
+
+// Predecoded straight-line runs of instructions, keyed by the pc they start at.
+// A block ends after the first branch/jump/JSR/RTS/RTI/BRK, before anything that stops the
+// cpu (illegal or terminate opcode, execute breakpoint) and before any byte that lives on a
+// device page.
+// Every page a block was decoded from is watched on the bus, a write to one of them drops
+// all blocks of that page, including the one currently running (it stops after the store).
+// Results are identical to MosT6502::Run(), including trace records and the budget check
+// before every instruction.
+// With the jit enabled, blocks that ran kJitThreshold times are translated by BlockJit; the
+// native code only runs when no trace sink or watchpoint is set and the whole block fits in
+// the remaining budget, otherwise the block is interpreted as usual.
+class BlockCache : public CodeWriteListener {
+   public:
+    static constexpr unsigned kMaxBlockInstrs = 32;
+    static constexpr uint32_t kJitThreshold   = 32;
+
+    typedef MosT6502::DecodedInstr DecodedInstr;
+
+    enum JitState : uint8_t
+    {
+        JIT_PENDING,   // still counting executions
+        JIT_NATIVE,    // native holds the translation
+        JIT_REJECTED,  // first instruction cannot be translated, or the jit is unavailable
+    };
+
+    struct Block {
+        uint16_t startPc;
+        uint8_t count;
+        uint8_t firstPage;
+        uint8_t lastPage;
+        JitState jitState;
+        uint32_t hits;
+        uint32_t jitLeadCycles;  // see BlockJit::Compile()
+        BlockJit::NativeBlock native;
+        uint64_t profileRuns;    // whole runs not handed to the GuestProfile yet
+        uint16_t baseCycles;     // of a whole run, without branches and page crossings
+        uint8_t extraAt;         // the one instruction that can take more, 0 if none can
+        bool extraEach;          // several can : their extra cycles are counted one by one
+        bool profiled;           // listed in m_profiled
+        DecodedInstr instrs[kMaxBlockInstrs];
+        uint64_t profileExtra[kMaxBlockInstrs];  // branch and page crossing cycles, same
+    };
+
+    explicit BlockCache(Bus& bus);
+    BlockCache(const BlockCache&) = delete;
+    BlockCache& operator=(const BlockCache&) = delete;
+    ~BlockCache() override;
+
+    // drop-in for cpu.Run(); cpu must be the one connected to the bus given at construction
+    MosT6502::StopReason Run(MosT6502& cpu, uint64_t cycleBudget);
+
+    void OnCodeWrite(uint8_t page) override;
+    void Invalidate();  // forget every block
+
+    // false drops every translation at once, handy when chasing a jit bug
+    void SetJitEnabled(bool enabled);
+    bool IsJitEnabled() const { return m_jit != nullptr; }
+
+    uint64_t BlocksBuilt() const { return m_blocksBuilt; }
+    uint64_t BlocksInvalidated() const { return m_blocksInvalidated; }
+    uint64_t BlocksTranslated() const { return m_blocksTranslated; }
+
+   private:
+    Block* Lookup(uint16_t pc)
+    {
+        Block* block = m_lookup[pc];
+        return (block) ? block : Build(pc);
+    }
+    template <bool kProfiling>  // instantiated with and without a GuestProfile attached
+    MosT6502::StopReason RunBlocks(MosT6502& cpu, uint64_t cycleBudget);
+    Block* Build(uint16_t pc);  // nullptr when not even one instruction can be cached
+    void Drop(Block* block);
+
+    // with a profile attached, whole runs of a block are counted per block and handed over
+    // per address when Run() returns or the block is dropped
+    void ProfileRun(const MosT6502& cpu, Block* block, const DecodedInstr* last,
+                    uint64_t startCycle);
+    void FlushProfile(Block* block);
+    void FlushProfile();
+    void Translate(const MosT6502& cpu, Block* block);
+    void ForgetTranslations();
+
+    Bus& m_bus;
+    std::unique_ptr<Block*[]> m_lookup;       // 64K entries, nullptr = not decoded yet
+    std::vector<std::unique_ptr<Block>> m_storage;
+    std::vector<Block*> m_free;
+    std::vector<Block*> m_pageBlocks[256];   // blocks decoded from (partly) each page
+    bool m_invalidated = false;              // the running block may be gone
+    GuestProfile* m_profile = nullptr;       // cpu.m_profile during Run()
+    uint64_t m_profileFrom  = 0;             // cpu.cycles up to which m_profile has the total
+    std::vector<Block*> m_profiled;          // blocks with counts not handed over yet
+
+    std::unique_ptr<BlockJit> m_jit;
+    JitContext m_jitContext;
+
+    uint64_t m_blocksBuilt       = 0;
+    uint64_t m_blocksInvalidated = 0;
+    uint64_t m_blocksTranslated  = 0;
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "mos_t_6502.h"
+
+class Bus;
+
+// everything generated code needs, handed over in the first argument register
+struct JitContext {
+    MosT6502* cpu;
+    Bus* bus;
+    const uint8_t* const* readMap;  // Bus page tables, see Bus::GetReadMap()
+    uint8_t* const* writeMap;
+    const uint8_t* nzTable;         // N and Z bits of sr for every result byte
+    const bool* invalidated;        // set when a store dropped cached code
+    uint64_t sliceEnd;              // cpu->m_sliceEnd when the block was entered
+    bool leave;  // set by a bus access that dropped code or moved the end of the slice
+};
+
+// Translates predecoded blocks (see BlockCache) to x86-64 machine code.
+// Guest a/x/y/sr live in host registers for the whole block, N/Z/C/V are only computed when a
+// later instruction of the block or the block exit can see them. Memory accesses go through
+// the bus page tables inline; null entries (devices, clean or code pages) call back into
+// Bus::Read()/Write(), and an access that invalidated cached code or ended the slice early
+// (a device scheduling an event, an irq line) leaves the block right after the instruction
+// that did it. The result, cycle count included, is the interpreter's.
+// Code pages are never writable and executable at once : they are made writable only while a
+// block is copied in. Where the kernel refuses exec mappings the jit is unavailable.
+// Only the longest prefix of supported instructions is translated; on hosts other than
+// x86-64 Linux nothing is and Compile() always fails.
+class BlockJit {
+   public:
+    typedef void (*NativeBlock)(JitContext* ctx);
+
+    BlockJit();
+    BlockJit(const BlockJit&) = delete;
+    BlockJit& operator=(const BlockJit&) = delete;
+    ~BlockJit();
+
+    bool IsAvailable() const { return m_code != nullptr; }
+
+    // *translated is the number of instructions covered (0 on failure); *leadCycles the most
+    // cycles the translated code can use before it starts its last instruction
+    NativeBlock Compile(const MosT6502& cpu, const MosT6502::DecodedInstr* instrs, unsigned count,
+                        unsigned* translated, uint32_t* leadCycles);
+
+    // out of code space : Reset() once no translated block is running and recompile
+    bool IsFull() const { return m_full; }
+    void Reset();
+
+    size_t CodeBytes() const { return m_used; }
+    const uint8_t* NzTable() const { return m_code; }
+
+   private:
+    bool Protect(size_t begin, size_t end, int prot);
+
+    uint8_t* m_code = nullptr;  // NZ table, then translated blocks
+    size_t m_size   = 0;
+    size_t m_used   = 0;
+    bool m_full     = false;
+};
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+
+#include "mos_t_6502.h"
+
+class Bus;
+
+// Execute breakpoints and read/write watchpoints as bitmaps over the 64K address space, with a
+// per-page count in front of each so untouched pages are never looked up. Attach with
+// Bus::SetBreakpoints(); with nothing attached the cores and the bus pay nothing.
+//
+// An execute breakpoint stops the cpu before the instruction at its address, with
+// StopReason::BREAKPOINT and pc on it; the next run executes that instruction first. The
+// interpreter and the threaded core run a second instantiation of their loop with the check
+// while Breakpoints are attached; blocks of the block cache end in front of breakpoints, so
+// those cores only look at the bitmap there.
+//
+// Watchpoints take their pages off the bus fast path : the access goes through the slow path,
+// which checks the bitmap and the optional value condition after the data moved. The
+// instruction completes and the run ends at the next instruction boundary; Mos6502Engine
+// Run()/Step() report StopReason::WATCHPOINT (a bare core Run() returns CYCLE_BUDGET early and
+// leaves the hit here). Instruction fetches are never reported to read watchpoints. Native
+// jit blocks are left alone while any watchpoint is set.
+class Breakpoints {
+   public:
+    enum Access : uint8_t
+    {
+        WATCH_READ   = 1,
+        WATCH_WRITE  = 2,
+        WATCH_ACCESS = WATCH_READ | WATCH_WRITE,
+    };
+
+    enum HitKind : uint8_t
+    {
+        HIT_NONE,
+        HIT_EXECUTE,
+        HIT_READ,
+        HIT_WRITE,
+    };
+
+    struct Hit {
+        HitKind kind;
+        uint16_t addr;   // breakpoint address or the accessed address
+        uint8_t data;    // the byte read or written, 0 for breakpoints
+        uint16_t pc;     // where the cpu stopped
+        uint64_t cycle;  // cpu cycles at the access / the breakpoint
+    };
+
+    Breakpoints() = default;
+    Breakpoints(const Breakpoints&) = delete;
+    Breakpoints& operator=(const Breakpoints&) = delete;
+    ~Breakpoints();
+
+    void AddBreakpoint(uint16_t addr);
+    void RemoveBreakpoint(uint16_t addr);
+    bool IsBreakpoint(uint16_t addr) const
+    {
+        return m_execPages[addr >> 8] != 0 and Test(m_exec, addr);
+    }
+
+    // every address in [first, last]; with a mask the access only hits when
+    // (data & mask) == value, mask 0 hits on any data. Adding again replaces the condition.
+    void AddWatchpoint(uint16_t first, uint16_t last, Access access, uint8_t value = 0x00,
+                       uint8_t mask = 0x00);
+    void RemoveWatchpoint(uint16_t first, uint16_t last, Access access);
+    bool IsReadWatchedPage(uint8_t page) const { return m_readPages[page] != 0; }
+    bool IsWriteWatchedPage(uint8_t page) const { return m_writePages[page] != 0; }
+    bool HasWatchpoints() const { return m_watchCount != 0; }
+
+    void Clear();
+
+    // the first hit since ClearHit(), which Mos6502Engine::Run()/Step() call on entry
+    bool IsHit() const { return m_hit.kind != HIT_NONE; }
+    const Hit& GetHit() const { return m_hit; }
+    void ClearHit() { m_hit.kind = HIT_NONE; }
+
+    // cores : true when the instruction at cpu.pc must not run yet
+    bool CheckExecute(const MosT6502& cpu)
+    {
+        return m_execPages[cpu.pc >> 8] != 0 and Test(m_exec, cpu.pc) and HitExecute(cpu);
+    }
+
+    // bus slow path, after the access
+    void CheckRead(MosT6502& cpu, uint16_t addr, uint8_t data)
+    {
+        if (m_readPages[addr >> 8] != 0 and Test(m_read, addr)) {
+            HitAccess(cpu, HIT_READ, addr, data);
+        }
+    }
+    void CheckWrite(MosT6502& cpu, uint16_t addr, uint8_t data)
+    {
+        if (m_writePages[addr >> 8] != 0 and Test(m_write, addr)) {
+            HitAccess(cpu, HIT_WRITE, addr, data);
+        }
+    }
+
+   private:
+    friend class Bus;  // attaches itself through m_bus
+
+    struct Condition {
+        uint8_t value;
+        uint8_t mask;
+    };
+
+    static bool Test(const uint64_t* bits, uint16_t addr)
+    {
+        return (bits[addr >> 6] >> (addr & 63)) & 1;
+    }
+    // sets or clears one bit, false when it already was that way
+    static bool Change(uint64_t* bits, uint16_t addr, bool set);
+
+    bool HitExecute(const MosT6502& cpu);
+    void HitAccess(MosT6502& cpu, HitKind kind, uint16_t addr, uint8_t data);
+    void ChangeWatch(uint16_t first, uint16_t last, Access access, bool set);
+
+    uint64_t m_exec[1024]  = {};
+    uint64_t m_read[1024]  = {};
+    uint64_t m_write[1024] = {};
+    uint16_t m_execPages[256]  = {};  // bits set per page
+    uint16_t m_readPages[256]  = {};
+    uint16_t m_writePages[256] = {};
+    uint32_t m_watchCount      = 0;
+    std::unordered_map<uint32_t, Condition> m_conditions;  // (write << 16 | addr)
+
+    Hit m_hit = {HIT_NONE, 0x0000, 0x00, 0x0000, 0};
+
+    // a breakpoint does not stop the instruction it already stopped once
+    uint16_t m_resumePc           = 0x0000;
+    uint64_t m_resumeInstructions = UINT64_MAX;
+
+    Bus* m_bus = nullptr;
+};
@@ -3,30 +3,196 @@
 #include <array>
 #include <cstdint>
 #include <iomanip>
+#include <memory>
 
 #include "mos_t_6502.h"
 #include "mos_t_common.h"
+#include "paged_memory.h"
+
+class Breakpoints;
+
+// a memory-mapped peripheral; addr is the full bus address that was accessed
+class BusDevice {
+   public:
+    virtual ~BusDevice() {}
+    virtual uint8_t Read(uint16_t addr)             = 0;
+    virtual void Write(uint16_t addr, uint8_t data) = 0;
+};
+
+// told before the first write lands on a page registered with Bus::WatchCodePage(); the watch
+// is dropped at that point, so the listener sees at most one call per WatchCodePage()
+class CodeWriteListener {
+   public:
+    virtual ~CodeWriteListener() {}
+    virtual void OnCodeWrite(uint8_t page) = 0;
+};
+
+// sees every byte a device hands to the bus, after the device produced it (see InputRecorder)
+class DeviceReadListener {
+   public:
+    virtual ~DeviceReadListener() {}
+    virtual void OnDeviceRead(uint16_t addr, uint8_t data) = 0;
+};
 
 class Bus {
    public:
+    Bus();
+    Bus(const Bus&) = delete;  // the cpu keeps a pointer back to its bus
+    Bus& operator=(const Bus&) = delete;
+    ~Bus();
+
+    // back to power-on memory : zeroes for flat ram, the shared image for paged ram
     void Initialize();
 
-    void StartCpu()
+    // pooled reuse : RevertToBaseline() copies back only the pages written since the last
+    // revert, from baseline (nullptr : zeroes), so a reset costs what the last job touched
+    // instead of 64 KiB. Setting a baseline switches to flat memory and loads it; paged
+    // memory has its image as baseline and reverts like Initialize().
+    void SetBaseline(std::shared_ptr<const PagedMemory::Image> baseline);
+    void RevertToBaseline();
+    unsigned TouchedPageCount() const { return m_touchedCount; }
+
+    // memory backends : a private flat 64 KiB array (the default, fastest for a single
+    // instance) or copy-on-write pages shared with every other bus built from the same image
+    void UseFlatMemory();
+    void UsePagedMemory(std::shared_ptr<const PagedMemory::Image> image);
+    bool IsPaged() const { return m_paged != nullptr; }
+
+    // current memory contents as a shareable image, to spin up paged buses from a warm state
+    std::shared_ptr<const PagedMemory::Image> CaptureImage(PagedMemory::PageSize pageSize) const;
+    PagedMemory::Stats GetMemoryStats() const;
+
+    // dirty page tracking : a ram page is dirty once anything wrote to it since the last
+    // Initialize()/ClearDirtyPages(). Clean pages have no direct write pointer, so the first
+    // write per page takes the out-of-line path and every later one costs nothing extra.
+    void ClearDirtyPages();
+    bool IsPageDirty(uint8_t page) const { return m_dirty[page]; }
+    unsigned DirtyPageCount() const;
+
+    enum RamDumpFormat
     {
-        std::cout << "\nPowering up the legendary MOS-Technology-6502's basic emulator ...\n";
-        mp.Reset();
+        DUMP_HEX,     // "0x0200 : 0x01 0x02 ..." lines, 16 bytes each
+        DUMP_BINARY,  // per region : u16 addr, u32 length (little endian), then the bytes
     };
 
-    MosT6502 GetMicroprocessor() { return mp; };
+    // only runs of dirty pages, coalesced into regions
+    void DumpDirtyRam(std::ostream& os, RamDumpFormat format);
+
+    // code watching : a watched page has no direct write pointer, so a store into it (program,
+    // loader, snapshot restore or a memory reset) reaches the listener before it changes ram.
+    // Setting another listener (or nullptr) drops every watch.
+    void SetCodeWriteListener(CodeWriteListener* listener);
+    void WatchCodePage(uint8_t page);
+    bool IsCodePage(uint8_t page) const { return m_codePage[page]; }
+
+    // route every access to pages [firstPage, lastPage] to device (not owned) instead of ram
+    void MapDevice(uint8_t firstPage, uint8_t lastPage, BusDevice* device);
+    void UnmapDevice(uint8_t firstPage, uint8_t lastPage);
+    BusDevice* GetDevice(uint8_t page) const { return m_devices[page]; }
 
-    void Write(uint16_t addr, uint8_t data);
-    uint8_t Read(uint16_t addr);
-    void PrintRamState();
-    void PrintCpuState() { mp.PrintState(); }
+    // one listener (or nullptr); ram reads never reach it
+    void SetDeviceReadListener(DeviceReadListener* listener) { m_deviceReadListener = listener; }
+
+    // one Breakpoints (not owned, or nullptr) for the bus and its cpu, see Breakpoints.
+    // Watched pages lose their direct pointers; cached code is dropped.
+    void SetBreakpoints(Breakpoints* breakpoints);
+    Breakpoints* GetBreakpoints() const { return m_breakpoints; }
+
+    // breakpoints changed on page : drop the code cached from it and remap it
+    void RefreshPage(uint8_t page);
+
+    void StartCpu() { mp.Reset(); };
+
+    MosT6502& GetMicroprocessor() { return mp; };
+
+    // plain ram is one table lookup + one indexed access; devices, not yet copied paged memory
+    // and watched pages have no direct pointer in the table and take the out-of-line path
+    void Write(uint16_t addr, uint8_t data)
+    {
+        uint8_t* page = m_writeMap[addr >> 8];
+        if (page) {
+            page[addr & 0xff] = data;
+        } else {
+            SlowWrite(addr, data);
+        }
+    }
+
+    uint8_t Read(uint16_t addr)
+    {
+        const uint8_t* page = m_readMap[addr >> 8];
+        return (page) ? page[addr & 0xff] : SlowRead(addr);
+    }
+
+    // opcode and operand bytes : Read(), except that read watchpoints do not see them
+    uint8_t Fetch(uint16_t addr)
+    {
+        const uint8_t* page = m_readMap[addr >> 8];
+        return (page) ? page[addr & 0xff] : SlowRead(addr, true);
+    }
+
+    // the page tables behind Read()/Write(), for generated code that inlines them; a null
+    // entry means the access has to go through Read()/Write()
+    const uint8_t* const* GetReadMap() const { return m_readMap; }
+    uint8_t* const* GetWriteMap() const { return m_writeMap; }
+
+    // bulk copy, page by page; plain ram pages are a memcpy, others go through Write()
+    void WriteBlock(uint16_t addr, const uint8_t* data, size_t size);
+
+    // overwrite the ram of one page, bypassing any device mapped on top of it
+    void LoadRamPage(uint8_t page, const uint8_t* data);
+
+    // the 256 bytes of ram at page << 8, read-only view; ignores any device mapped on top
+    const uint8_t* RamPage(uint8_t page) const
+    {
+        return (m_paged) ? m_paged->Page256(page) : ram->data() + ((unsigned)page << 8);
+    }
+
+    void PrintRamState(std::ostream& os);
+    void PrintCpuState(std::ostream& os) { mp.PrintState(os); }
 
     void Unplug(){};
 
    private:
+    void SlowWrite(uint16_t addr, uint8_t data);
+    uint8_t SlowRead(uint16_t addr, bool fetch = false);
+
+    // recompute the direct pointers of one page from the backend, leaves device pages alone
+    void MapRamPage(uint8_t page);
+    void MapAllRamPages();
+    void MapPagedSpan(uint8_t page);  // every 256-byte page sharing page's paged memory page
+
+    void ReleaseCodePage(uint8_t page);  // notify the listener and drop the watch
+    void ReleaseAllCodePages();
+
+    void Touch(uint8_t page)
+    {
+        if (!m_touched[page]) {
+            m_touched[page]                  = true;
+            m_touchedPages[m_touchedCount++] = page;
+        }
+    }
+    void TouchAllPages();
+    void ForgetTouchedPages();
+
     MosT6502 mp;
-    std::array<uint8_t, 64 * 1024> ram;
+    std::unique_ptr<std::array<uint8_t, 64 * 1024>> ram;  // flat backend
+    std::unique_ptr<PagedMemory> m_paged;                  // paged backend
+
+    const uint8_t* m_readMap[256];
+    uint8_t* m_writeMap[256];
+    BusDevice* m_devices[256] = {};
+    bool m_dirty[256]         = {};
+
+    // written since the last revert, dirty pages always are
+    std::shared_ptr<const PagedMemory::Image> m_baseline;
+    bool m_touched[256]     = {};
+    uint8_t m_touchedPages[256];
+    unsigned m_touchedCount = 0;
+
+    CodeWriteListener* m_codeListener = nullptr;
+    bool m_codePage[256]              = {};
+
+    DeviceReadListener* m_deviceReadListener = nullptr;
+
+    Breakpoints* m_breakpoints = nullptr;
 };
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "bus.h"
+#include "event_scheduler.h"
+
+// UART-like byte sink : register 0 is the data register, register 1 the status register.
+// Every byte written to the data register is appended to Output(); status always reads as
+// "transmitter ready" (bit 7). Registers repeat through the mapped pages.
+class ByteSinkDevice : public BusDevice {
+   public:
+    uint8_t Read(uint16_t addr) override { return ((addr & 0x01) == 1) ? 0x80 : m_lastByte; }
+    void Write(uint16_t addr, uint8_t data) override
+    {
+        if ((addr & 0x01) == 0) {
+            m_output.push_back((char)data);
+            m_lastByte = data;
+        }
+    }
+
+    const std::string& Output() const { return m_output; }
+    void Clear() { m_output.clear(); }
+
+   private:
+    std::string m_output;
+    uint8_t m_lastByte = 0x00;
+};
+
+// free running cycle counter : reading register 0 latches the cpu cycle count, registers
+// 0..3 then return it little endian so a guest can time itself without tearing
+class CycleTimerDevice : public BusDevice {
+   public:
+    explicit CycleTimerDevice(const MosT6502& cpu) : m_cpu(cpu) {}
+
+    uint8_t Read(uint16_t addr) override
+    {
+        unsigned reg = addr & 0x03;
+        if (reg == 0) {
+            m_latched = (uint32_t)m_cpu.cycles;
+        }
+        return (m_latched >> (8 * reg)) & 0xff;
+    }
+    void Write(uint16_t, uint8_t) override {}
+
+   private:
+    const MosT6502& m_cpu;
+    uint32_t m_latched = 0;
+};
+
+// periodic interrupt source : registers 0/1 hold the period in cycles (little endian, 0 means
+// 65536), register 2 is control (bit 0 run, bit 1 nmi instead of irq); writing it restarts the
+// count. On expiry the timer asserts its irq source (or raises an nmi) and sets bit 7 of
+// register 3, reading register 3 returns and clears that bit and releases the irq. Only the
+// scheduler runs it, between expiries it costs nothing. Must not outlive the scheduler.
+class IntervalTimerDevice : public BusDevice {
+   public:
+    IntervalTimerDevice(EventScheduler& scheduler, MosT6502& cpu, uint32_t irqSource)
+        : m_scheduler(scheduler), m_cpu(cpu), m_irqSource(irqSource)
+    {
+    }
+    ~IntervalTimerDevice() override { Stop(); }
+
+    uint8_t Read(uint16_t addr) override
+    {
+        switch (addr & 0x03) {
+            case (0): {
+                return m_period & 0xff;
+            }
+            case (1): {
+                return (m_period >> 8) & 0xff;
+            }
+            case (2): {
+                return m_control;
+            }
+            default: {
+                uint8_t status = m_status;
+                m_status       = 0x00;
+                m_cpu.SetIrqLine(m_irqSource, false);
+                return status;
+            }
+        }
+    }
+    void Write(uint16_t addr, uint8_t data) override
+    {
+        switch (addr & 0x03) {
+            case (0): {
+                m_period = (m_period & 0xff00) | data;
+                break;
+            }
+            case (1): {
+                m_period = (m_period & 0x00ff) | (uint16_t)(data << 8);
+                break;
+            }
+            case (2): {
+                m_control = data;
+                Restart(m_cpu.cycles);
+                break;
+            }
+            default: {
+                break;
+            }
+        }
+    }
+
+    static constexpr uint8_t kRun = 0x01;
+    static constexpr uint8_t kNmi = 0x02;
+
+   private:
+    void Stop()
+    {
+        if (m_event != 0) {
+            m_scheduler.Cancel(m_event);
+            m_event = 0;
+        }
+    }
+    void Restart(uint64_t from)
+    {
+        Stop();
+        if (m_control & kRun) {
+            uint32_t period = (m_period == 0) ? 0x10000 : m_period;
+            m_event = m_scheduler.Schedule(from + period,
+                                           [this](uint64_t cycle) { Expire(cycle); });
+        }
+    }
+    void Expire(uint64_t cycle)
+    {
+        m_event  = 0;
+        m_status = 0x80;
+        if (m_control & kNmi) {
+            m_cpu.TriggerNmi();
+        } else {
+            m_cpu.SetIrqLine(m_irqSource, true);
+        }
+        Restart(cycle);
+    }
+
+    EventScheduler& m_scheduler;
+    MosT6502& m_cpu;
+    uint32_t m_irqSource;
+    uint16_t m_period = 0;
+    uint8_t m_control = 0x00;
+    uint8_t m_status  = 0x00;
+    EventScheduler::EventId m_event = 0;
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "mos6502_engine.h"
+
+// Differential fuzzing : random programs and start states run through a core under test and an
+// oracle (Reference6502 or the plain interpreter) in lockstep. Both sides get the same list of
+// cycle budgets; after every Run() the registers, status byte, counters, stop reason and all of
+// ram have to match. A divergence is narrowed down to the first instruction that differs and
+// the case is shrunk before it is reported.
+class DiffFuzzer {
+   public:
+    enum Oracle
+    {
+        ORACLE_REFERENCE,    // Reference6502, shares no code with the cores
+        ORACLE_INTERPRETER,  // MosT6502::Run()
+    };
+
+    // program at kProgramAddr, random zero page / stack / data pages, registers applied after
+    // Reset(); the reset and brk vectors point at the program
+    struct Case {
+        std::vector<uint8_t> ram;  // 64 KiB
+        uint8_t a, x, y, sp, sr;
+        std::vector<uint32_t> budgets;  // one Run() per entry
+        uint16_t timerPeriod = 0;       // not 0 : an IntervalTimerDevice at kTimerPage
+        uint8_t timerControl = 0;       // what its control register starts with
+    };
+
+    struct Divergence {
+        bool found = false;
+        unsigned chunk = 0;         // index into Case::budgets
+        uint64_t instruction = 0;   // oracle instruction count before the first bad one
+        uint16_t pc = 0;            // where that instruction sits
+        bool exact = true;          // false : jit / recompiled, only native block ends show
+        std::string detail;         // "field : oracle vs core" lines
+    };
+
+    static constexpr uint16_t kProgramAddr = 0x0600;
+    static constexpr uint8_t kTimerPage    = 0xd0;  // its irq goes through the brk vector
+
+    DiffFuzzer(Mos6502Engine::Core core, Oracle oracle) : m_core(core), m_oracle(oracle) {}
+
+    // devices : cases also map the timer and aim some accesses at it, so the irq line and
+    // events scheduled from inside a slice cut slices short. Only the interpreter oracle
+    // models devices
+    void SetDevices(bool devices) { m_devices = devices; }
+
+    // the shared object CORE_RECOMPILED loads for every run of the next Check(), built from
+    // that case (see StaticRecompiler); Minimize() keeps it, shrunk blocks fall back to the
+    // interpreter
+    void SetRecompiled(const std::string& path) { m_recompiled = path; }
+
+    Case Generate(std::mt19937_64& rng) const;
+
+    // runs the case on both sides; on a divergence also locates the first bad instruction
+    Divergence Check(const Case& fuzzCase);
+
+    // greedy : nop out instructions, zero data bytes and start registers, drop budgets, as long
+    // as the case still diverges. *divergence is updated to the shrunk case
+    Case Minimize(const Case& fuzzCase, Divergence* divergence);
+
+    // <prefix>.snap : MachineSnapshot of the start state (see Mos6502Engine::Restore)
+    // <prefix>.txt  : budgets, divergence, disassembly of the program
+    bool WriteReproducer(const Case& fuzzCase, const Divergence& divergence,
+                         const std::string& prefix) const;
+
+    static const char* GetOracleName(Oracle oracle);
+
+   private:
+    bool Diverges(const Case& fuzzCase) { return Check(fuzzCase).found; }
+
+    Mos6502Engine::Core m_core;
+    Oracle m_oracle;
+    bool m_devices = false;
+    std::string m_recompiled;
+};
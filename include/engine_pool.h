@@ -0,0 +1,93 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "mos6502_engine.h"
+#include "paged_memory.h"
+
+// A fixed set of warm engines for running many short jobs from one starting state.
+// Acquire() hands out an engine that is reset to the baseline (registers, counters, ram, no
+// events); giving it back reverts only the pages the job wrote, see
+// Mos6502Engine::ResetToBaseline(), so what a reset costs follows what the job touched.
+// Engines are built on first use by the thread that acquires them.
+//
+// With AFFINITY_THREAD a thread gets the engine it had last time whenever that one is idle, so
+// its ram, block cache and page tables stay in that core's caches; otherwise, and with
+// AFFINITY_ANY, the most recently released idle engine is taken.
+class EnginePool {
+   public:
+    enum Affinity
+    {
+        AFFINITY_ANY,     // most recently released idle engine
+        AFFINITY_THREAD,  // the calling thread's previous engine when it is idle
+    };
+
+    struct Config {
+        size_t engines           = 0;  // 0 : one per hardware thread
+        Mos6502Engine::Core core = Mos6502Engine::CORE_BLOCK_CACHE;
+        Affinity affinity        = AFFINITY_THREAD;
+        std::shared_ptr<const PagedMemory::Image> baseline;  // nullptr : zeroed ram
+    };
+
+    struct Stats {
+        uint64_t acquires      = 0;
+        uint64_t affinityHits  = 0;  // got the same engine as the previous Acquire()
+        uint64_t waits         = 0;  // found every engine leased
+        uint64_t pagesReverted = 0;  // 256-byte pages copied back on release
+    };
+
+    // an engine until destroyed; not copyable, movable
+    class Lease {
+       public:
+        Lease(Lease&& other) : m_pool(other.m_pool), m_slot(other.m_slot)
+        {
+            other.m_pool = nullptr;
+        }
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        ~Lease();
+
+        Mos6502Engine& operator*() const { return *m_pool->m_slots[m_slot].engine; }
+        Mos6502Engine* operator->() const { return m_pool->m_slots[m_slot].engine.get(); }
+        size_t Slot() const { return m_slot; }
+
+       private:
+        friend class EnginePool;
+        Lease(EnginePool* pool, size_t slot) : m_pool(pool), m_slot(slot) {}
+
+        EnginePool* m_pool;
+        size_t m_slot;
+    };
+
+    explicit EnginePool(const Config& config);
+    EnginePool(const EnginePool&) = delete;
+    EnginePool& operator=(const EnginePool&) = delete;
+
+    // blocks while every engine is leased; leases must end before the pool does
+    Lease Acquire();
+
+    size_t Size() const { return m_slots.size(); }
+    Stats GetStats() const;
+
+   private:
+    struct Slot {
+        std::unique_ptr<Mos6502Engine> engine;
+        bool idle = true;
+    };
+
+    void Release(size_t slot);
+
+    Config m_config;
+    uint64_t m_id;
+    std::vector<Slot> m_slots;
+
+    mutable std::mutex m_lock;
+    std::condition_variable m_released;
+    std::vector<size_t> m_idle;  // idle slots, most recently released at the back
+    Stats m_stats;
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "mos_t_6502.h"
+
+// Future device work keyed by absolute cpu cycle, kept in a min-heap. Mos6502Engine::Run()
+// only runs the cores up to the next event; there it fires what is due and lets the cpu take
+// a pending interrupt, so nothing is checked per instruction. An event fires at the first
+// instruction boundary at or after its cycle. Scheduling from inside a run (a device register
+// written by the guest) shortens the running slice through MosT6502::EndSlice().
+class EventScheduler {
+   public:
+    typedef uint64_t EventId;  // 0 is never handed out
+
+    // cycle is the one the event was scheduled for, not the (possibly later) current one, so
+    // periodic devices can reschedule without drifting
+    typedef std::function<void(uint64_t cycle)> Callback;
+
+    explicit EventScheduler(MosT6502& cpu) : m_cpu(cpu) {}
+    EventScheduler(const EventScheduler&) = delete;
+    EventScheduler& operator=(const EventScheduler&) = delete;
+
+    EventId Schedule(uint64_t cycle, Callback callback);
+
+    // assert / release irq sources (see MosT6502::SetIrqLine), raise an nmi edge
+    EventId ScheduleIrq(uint64_t cycle, uint32_t sources, bool asserted);
+    EventId ScheduleNmi(uint64_t cycle);
+
+    // false when the event already fired or was cancelled
+    bool Cancel(EventId id);
+    void Clear() { m_events.clear(); }
+
+    bool IsEmpty() const { return m_events.empty(); }
+    size_t Pending() const { return m_events.size(); }
+    uint64_t NextCycle() const { return (m_events.empty()) ? UINT64_MAX : m_events.front().cycle; }
+
+    // fires every event due at now, by cycle then in scheduling order; events scheduled by a
+    // callback fire in the same call when they are due too
+    void RunDue(uint64_t now);
+
+   private:
+    struct Event {
+        uint64_t cycle;
+        EventId id;
+        Callback callback;
+    };
+
+    // std heap functions build a max-heap, so "less" is "fires later"
+    static bool FiresLater(const Event& l, const Event& r)
+    {
+        return (l.cycle != r.cycle) ? l.cycle > r.cycle : l.id > r.id;
+    }
+
+    MosT6502& m_cpu;
+    std::vector<Event> m_events;
+    EventId m_nextId = 1;
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+// Hot-spot counters for guest code, attached with MosT6502::SetProfile(). Executions and cycles
+// are kept per address in a flat 64K array, together with the first opcode seen there; the
+// opcode and addressing mode histograms are derived from it when a report is written. JSR/BRK,
+// irq/nmi entries and RTS/RTI maintain a shadow call stack, so cycles can also be reported per
+// call path, as folded stacks for flamegraph.pl. Call paths are only charged when they change;
+// the 7 cycles of an interrupt entry belong to no address and are left out.
+//
+// The interpreter and the threaded core call Count() after every instruction they execute;
+// the block cache counts whole blocks, see CountBlock(). With a profile attached the jit
+// leaves native blocks alone, as it does for a trace sink.
+class GuestProfile {
+   public:
+    GuestProfile();
+
+    // the instruction at pc took 'spent' cycles and left the cpu at next
+    void Count(uint16_t pc, uint8_t opcode, uint64_t spent, uint16_t next)
+    {
+        CountAt(pc, opcode, 1, spent);
+        CountBlock(opcode, spent, next);
+    }
+
+    // Count() taken apart for a run of instructions: CountAt() per address, any time before
+    // the report, and CountBlock() for the run as a whole, right after it. The run may only
+    // jump, call or return with its last instruction; runs that do neither can be handed over
+    // together with CountCycles(), as long as that happens before the next CountBlock()
+    void CountAt(uint16_t pc, uint8_t opcode, uint64_t executions, uint64_t cycles)
+    {
+        Counters& counters = m_counters[pc];
+        if (counters.executions == 0) {
+            m_opcodeAt[pc] = opcode;
+        }
+        counters.executions += executions;
+        counters.cycles += cycles;
+    }
+    void CountBlock(uint8_t lastOpcode, uint64_t spent, uint16_t next)
+    {
+        CountCycles(spent);
+        if (IsCallOrReturn(lastOpcode)) {
+            EnterOrLeave(lastOpcode, next);
+        }
+    }
+
+    void CountCycles(uint64_t cycles) { m_totalCycles += cycles; }
+
+    // JSR, BRK, RTS, RTI; folds away where the opcode is a constant (see ThreadedCore)
+    static constexpr bool IsCallOrReturn(uint8_t opcode)
+    {
+        return opcode == 0x20 or opcode == 0x00 or opcode == 0x60 or opcode == 0x40;
+    }
+
+    // the cpu took an interrupt and continues at handler
+    void Interrupt(uint16_t handler, bool nmi) { Enter(nmi ? CALL_NMI : CALL_IRQ, handler); }
+
+    void Clear();
+
+    uint64_t GetExecutions(uint16_t pc) const { return m_counters[pc].executions; }
+    uint64_t GetCycles(uint16_t pc) const { return m_counters[pc].cycles; }
+    uint64_t GetTotalCycles() const { return m_totalCycles; }
+
+    // "main;sub_0x1234;sub_0x2000 <cycles>" per call path, ready for flamegraph.pl
+    void WriteFoldedStacks(std::ostream& os) const;
+
+    // the 'top' addresses with most cycles, then the opcode and addressing mode histograms
+    void WriteReport(std::ostream& os, size_t top = 32) const;
+
+   private:
+    struct Counters {
+        uint64_t executions;
+        uint64_t cycles;
+    };
+
+    struct Frame {
+        uint32_t parent;
+        uint16_t entry;  // subroutine / interrupt handler address
+        uint8_t kind;    // CALL_JSR, CALL_BRK, CALL_IRQ or CALL_NMI
+        uint8_t depth;
+    };
+
+    enum CallEffect : int8_t
+    {
+        CALL_NONE   = 0,
+        CALL_JSR    = 1,
+        CALL_BRK    = 2,
+        CALL_IRQ    = 3,
+        CALL_NMI    = 4,
+        CALL_RETURN = -1,
+    };
+
+    static const int8_t kCallEffect[256];
+    static constexpr uint8_t kMaxDepth = 64;  // deeper calls are charged to the frame at 64
+
+    // opcode was a call or a return and target is where it went
+    void EnterOrLeave(uint8_t opcode, uint16_t target);
+    void Enter(CallEffect kind, uint16_t target);
+
+    std::vector<Counters> m_counters;
+    std::vector<uint8_t> m_opcodeAt;  // opcode seen on the first execution of each address
+    uint64_t m_totalCycles = 0;
+
+    std::vector<Frame> m_frames;  // 0 is the root, call paths form a tree
+    std::vector<uint64_t> m_frameCycles;
+    std::unordered_map<uint64_t, uint32_t> m_children;  // (parent << 19 | kind << 16 | entry)
+    uint32_t m_frame       = 0;
+    uint64_t m_frameStart  = 0;  // m_totalCycles when m_frame was entered
+    uint64_t m_cappedCalls = 0;  // calls made at kMaxDepth not returned from yet
+};
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "bus.h"
+#include "machine_snapshot.h"
+#include "mos6502_engine.h"
+
+// Everything a run took from outside the machine, so it can be run again bit-exactly without
+// its devices : the state recording started from, the pages devices were mapped on, and
+// cycle-stamped events. Interrupts are logged where the cpu entered them rather than where
+// lines changed; that is all the guest can observe, whatever device timing produced it.
+//
+// on-disk layout, little endian :
+//     "M65RLOG\0" u32 version u32 flags(bit0 = finished) u64 eventCount
+//     u64 endCycles u64 endId u8 devicePages[32], then the start state as a full MachineSnapshot
+//     per event : u8 type, LEB128 cycles since the previous event, u16 addr u8 data for device
+//     reads and host writes
+struct InputLog {
+    enum Status
+    {
+        OK,
+        ERR_OPEN,    // file could not be opened / written
+        ERR_FORMAT,  // not an input log, unknown version or truncated
+    };
+
+    enum EventType : uint8_t
+    {
+        EVENT_DEVICE_READ,  // a device returned data for addr
+        EVENT_IRQ,          // irq entry sequence started at cycle
+        EVENT_NMI,          // nmi entry sequence started at cycle
+        EVENT_HOST_WRITE,   // InputRecorder::HostWrite() between runs
+    };
+
+    struct Event {
+        uint64_t cycle;
+        uint16_t addr;
+        uint8_t data;
+        EventType type;
+    };
+
+    MachineSnapshot start;
+    uint8_t devicePages[32] = {};
+    std::vector<Event> events;
+
+    // end state, see InputRecorder::Stop() and InputReplayer::Verify()
+    bool finished      = false;
+    uint64_t endCycles = 0;
+    uint64_t endId     = 0;  // MachineSnapshot::GetId() of the end state
+
+    bool IsDevicePage(uint8_t page) const { return devicePages[page >> 3] & (1 << (page & 7)); }
+
+    Status Save(const std::string& path) const;
+    Status Load(const std::string& path);
+
+    static const char* GetStatusName(Status status);
+};
+
+// Fills an InputLog while engine runs with its real devices. Host code that changes memory
+// between runs has to do it through HostWrite(), anything else is not in the log.
+class InputRecorder : public DeviceReadListener, public InterruptListener {
+   public:
+    explicit InputRecorder(Mos6502Engine& engine) : m_engine(engine) {}
+    InputRecorder(const InputRecorder&) = delete;
+    InputRecorder& operator=(const InputRecorder&) = delete;
+    ~InputRecorder() override { Stop(); }
+
+    // captures the machine and the device map into *log (not owned), then logs until Stop()
+    void Start(InputLog* log);
+
+    // captures the end state and detaches
+    void Stop();
+    bool IsRecording() const { return m_log != nullptr; }
+
+    void HostWrite(uint16_t addr, uint8_t data);
+
+    void OnDeviceRead(uint16_t addr, uint8_t data) override
+    {
+        m_log->events.push_back(
+            {m_engine.GetCpu().cycles, addr, data, InputLog::EVENT_DEVICE_READ});
+    }
+    void OnInterrupt(bool nmi) override
+    {
+        m_log->events.push_back({m_engine.GetCpu().cycles, 0x0000, 0x00,
+                                 (nmi) ? InputLog::EVENT_NMI : InputLog::EVENT_IRQ});
+    }
+
+   private:
+    Mos6502Engine& m_engine;
+    InputLog* m_log = nullptr;
+};
+
+// Plays an InputLog back on an engine that has no devices of its own : it stands in for every
+// recorded device page, handing out the logged bytes in order (writes are dropped), and
+// schedules interrupt entries and host writes at their cycles on the engine's EventScheduler,
+// one at a time. Nothing is checked per instruction. A read or an interrupt that does not
+// match the log (other address or cycle) marks the replay as diverged and is served anyway.
+class InputReplayer : public BusDevice {
+   public:
+    InputReplayer(Mos6502Engine& engine, const InputLog& log) : m_engine(engine), m_log(log) {}
+    InputReplayer(const InputReplayer&) = delete;
+    InputReplayer& operator=(const InputReplayer&) = delete;
+    ~InputReplayer() override { Stop(); }
+
+    // restores the start state, maps itself and clears anything already scheduled
+    Mos6502Engine::Status Start();
+    void Stop();
+
+    uint8_t Read(uint16_t addr) override;
+    void Write(uint16_t, uint8_t) override {}
+
+    // Mos6502Engine::Run() up to the recorded end cycle
+    Mos6502Engine::Status RunToEnd(MosT6502::StopReason* reason);
+
+    bool IsDiverged() const { return m_diverged; }
+
+    // after RunToEnd() : true when nothing diverged, the whole log was consumed and the machine
+    // hashes like the recorded end state
+    bool Verify();
+
+   private:
+    void ScheduleNextTimed();
+    void FireTimed(const InputLog::Event& event);
+
+    Mos6502Engine& m_engine;
+    const InputLog& m_log;
+    std::vector<uint32_t> m_reads;  // indices of the device reads in m_log.events, in order
+    std::vector<uint32_t> m_timed;  // indices of everything else
+    size_t m_nextRead  = 0;
+    size_t m_nextTimed = 0;
+    EventScheduler::EventId m_pending = 0;
+    bool m_mapped   = false;
+    bool m_diverged = false;
+};
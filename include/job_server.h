@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "mos6502_engine.h"
+
+// Long-lived front end for pipelines that feed many small programs : job records come in on a
+// file descriptor (stdin or a named pipe), every job runs on the same warm engine, and a
+// binary result record per job goes out on another descriptor. Results are buffered and
+// written every flushEvery jobs, and always before the server blocks waiting for input, so a
+// client that sends one job and waits for its answer is never stuck behind a partial batch.
+//
+// every field little endian, records are back to back :
+// job     u32 length (bytes after this field), u32 jobId, u16 loadAddr, u16 startAddr,
+//         u64 cycleLimit, u32 flags (JOB_DUMP_DIRTY), then length - 20 raw image bytes
+// result  u32 length (bytes after this field), u32 jobId, u8 JobStatus,
+//         u8 MosT6502::StopReason, u16 pc, u8 a x y sp sr, u8 0, u64 cycles,
+//         u64 instructions, u32 dumpLength, then the dirty ram as Bus::DUMP_BINARY regions
+class JobServer {
+   public:
+    enum Status
+    {
+        OK,          // input ended cleanly between two records
+        ERR_READ,    // reading the input failed
+        ERR_WRITE,   // writing results failed (reader went away)
+        ERR_FORMAT,  // impossible record length or input ended inside a record
+    };
+
+    enum JobStatus : uint8_t
+    {
+        JOB_OK,
+        JOB_IMAGE_BOUNDS,  // image does not fit between loadAddr and 0xffff, nothing ran
+    };
+
+    enum JobFlags : uint32_t
+    {
+        JOB_DUMP_DIRTY = (1 << 0),  // append the pages the program wrote to the result
+    };
+
+    static constexpr size_t kJobHeaderBytes    = 20;
+    static constexpr size_t kResultHeaderBytes = 34;
+
+    struct Stats {
+        uint64_t jobs     = 0;
+        uint64_t bytesIn  = 0;
+        uint64_t bytesOut = 0;
+        uint64_t writes   = 0;  // write() calls on the output
+    };
+
+    explicit JobServer(Mos6502Engine::Core core = Mos6502Engine::CORE_BLOCK_CACHE);
+    JobServer(const JobServer&) = delete;
+    JobServer& operator=(const JobServer&) = delete;
+
+    void SetFlushEvery(unsigned jobs) { m_flushEvery = (jobs != 0) ? jobs : 1; }
+
+    // runs jobs until inFd reaches end of file; neither descriptor is closed
+    Status Serve(int inFd, int outFd);
+
+    const Stats& GetStats() const { return m_stats; }
+    static const char* GetStatusName(Status status);
+
+   private:
+    // true with *size bytes at *data, false at end of input (*status tells whether cleanly)
+    bool NextRecord(const uint8_t** data, size_t* size, Status* status);
+    bool Fill(size_t want, Status* status);  // flushes results before it may block
+    bool Flush();
+
+    void RunJob(const uint8_t* record, size_t size);
+
+    Mos6502Engine m_engine;
+    unsigned m_flushEvery = 64;
+    int m_inFd            = -1;
+    int m_outFd           = -1;
+
+    std::vector<uint8_t> m_in;  // unread input is [m_inPos, m_inEnd)
+    size_t m_inPos = 0;
+    size_t m_inEnd = 0;
+    std::string m_out;
+    unsigned m_unflushedJobs = 0;
+    std::ostringstream m_dump;
+
+    Stats m_stats;
+};
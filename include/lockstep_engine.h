@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "mos_t_6502.h"
+
+// Many independent 6502 machines ("lanes") running one program together, for parameter sweeps
+// and test matrices : every lane has its own registers and 64 KiB of ram, typically the same
+// program with different inputs.
+//
+// State is kept as structure of arrays : one array per register over all lanes, and ram
+// interleaved so that address addr of every lane is one contiguous row (addr * stride + lane).
+// Instructions run on kBlockLanes lanes at a time with vector ALU and flag logic (AVX2 when
+// the cpu has it, SSE2 otherwise); an access where every lane uses the same address is one row
+// load or store, others go lane by lane.
+//
+// Each step takes the lowest pc among the running lanes and executes its instruction on every
+// running lane sitting there with the same instruction bytes. Lanes that branch differently
+// split up and run as smaller groups until they reach a common pc again; the group further
+// back always goes first, so it catches up with the others.
+//
+// Per lane the results are exactly those of MosT6502::Run() on a plain Bus : registers,
+// status byte, cycle and instruction counters, stop reason and ram. There are no devices,
+// interrupts, traces or breakpoints.
+class LockstepEngine {
+   public:
+    static constexpr unsigned kBlockLanes = 16;
+
+    enum Status
+    {
+        OK,
+        ERR_IMAGE_BOUNDS,  // image does not fit between its load address and 0xffff
+        ERR_NOT_RESET,     // Run() called before Reset()
+    };
+
+    struct LaneState {
+        uint8_t a, x, y, sp, sr;
+        uint16_t pc;
+        uint64_t cycles;
+        uint64_t instructions;
+    };
+
+    struct Stats {
+        uint64_t steps            = 0;  // instructions issued to a group of lanes
+        uint64_t laneInstructions = 0;  // summed over lanes; / steps = average group size
+    };
+
+    explicit LockstepEngine(unsigned lanes);
+    LockstepEngine(const LockstepEngine&) = delete;
+    LockstepEngine& operator=(const LockstepEngine&) = delete;
+
+    unsigned LaneCount() const { return m_lanes; }
+
+    // ram : every lane, or one (lane < LaneCount() for everything taking a lane)
+    Status Load(const uint8_t* image, size_t size, uint16_t loadAddr);
+    Status LoadLane(unsigned lane, const uint8_t* image, size_t size, uint16_t loadAddr);
+    void SetResetVector(uint16_t addr);
+    uint8_t Read(unsigned lane, uint16_t addr) const { return Row(addr)[lane]; }
+    void Write(unsigned lane, uint16_t addr, uint8_t data) { Row(addr)[lane] = data; }
+
+    // every lane : registers, counters, pc from its own reset vector
+    void Reset();
+
+    // per lane inputs after Reset(), results after Run()
+    LaneState GetLane(unsigned lane) const;
+    void SetLane(unsigned lane, const LaneState& state);
+
+    // every lane runs until it used up cycleBudget or stops on its own, see MosT6502::Run
+    Status Run(uint64_t cycleBudget);
+    MosT6502::StopReason GetStopReason(unsigned lane) const
+    {
+        return (MosT6502::StopReason)m_reason[lane];
+    }
+
+    const Stats& GetStats() const { return m_stats; }
+
+   private:
+    uint8_t* Row(uint16_t addr) const { return m_ram.get() + (size_t)addr * m_stride; }
+
+    void RunLanes();
+
+    unsigned m_lanes;
+    size_t m_stride;  // lanes rounded up to whole blocks; the extra ones never run
+    std::unique_ptr<uint8_t[]> m_ram;
+
+    // status register split like MosT6502's : m_carry and m_overflow hold 0 / 1
+    std::vector<uint8_t> m_a, m_x, m_y, m_sp, m_sr, m_nValue, m_zValue, m_carry, m_overflow;
+    std::vector<uint16_t> m_pc;
+    std::vector<uint64_t> m_cycles, m_instructions;
+
+    // Run() : cycle each lane stops at; cycles and instructions not yet added to the counters,
+    // and how many more cycles may pile up before they have to be
+    std::vector<uint64_t> m_end;
+    std::vector<uint16_t> m_spent, m_counted, m_left;
+    std::vector<uint8_t> m_running;  // Run() : 0xff while the lane still takes part
+    std::vector<uint8_t> m_reason;   // MosT6502::StopReason
+
+    bool m_isReset = false;
+    Stats m_stats;
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class Bus;
+
+// Cpu registers, cycle counters and ram of one Bus + MosT6502, in memory or on disk.
+//
+// A full snapshot holds all 256 ram pages. A delta snapshot holds only the pages that differ
+// from the full snapshot it was taken against and can only be restored on top of that base
+// (checked through the base's content id). Devices are not part of a snapshot, only the ram
+// underneath them.
+//
+// on-disk layout, little endian :
+//     "M65SNAP\0" u32 version u32 flags(bit0 = delta) u64 id u64 baseId
+//     u8 a x y sp sr pad u16 pc u64 cycles u64 instructions
+//     u8 pageBitmap[32]  then 256 bytes for every page set in the bitmap, ascending
+class MachineSnapshot {
+   public:
+    enum Status
+    {
+        OK,
+        ERR_OPEN,           // file could not be opened / written
+        ERR_FORMAT,         // not a snapshot file, unknown version or truncated
+        ERR_BASE_MISMATCH,  // delta restored or taken against the wrong (or a delta) base
+        ERR_CORRUPT,        // a full snapshot file whose ram and registers do not hash to its id
+    };
+
+    struct CpuState {
+        uint8_t a;
+        uint8_t x;
+        uint8_t y;
+        uint8_t sp;
+        uint8_t sr;
+        uint16_t pc;
+        uint64_t cycles;
+        uint64_t instructions;
+    };
+
+    // full snapshot of bus and its cpu
+    void Capture(Bus& bus);
+
+    // only the pages that differ from base, which must be a full snapshot
+    Status CaptureDelta(Bus& bus, const MachineSnapshot& base);
+
+    // full : bus ends up exactly as captured. delta : base must be the snapshot it was taken
+    // against; base pages are copied first, then the delta pages on top
+    Status Restore(Bus& bus, const MachineSnapshot* base = nullptr) const;
+
+    Status Save(const std::string& path) const;
+    Status Load(const std::string& path);  // on error the snapshot keeps what it held
+
+    // same layout, embedded in a larger stream (see InputLog); ERR_OPEN means a stream error
+    Status Save(std::ostream& out) const;
+    Status Load(std::istream& in);
+
+    bool IsDelta() const { return m_isDelta; }
+    uint64_t GetId() const { return m_id; }  // content hash of the captured machine state
+    uint64_t GetBaseId() const { return m_baseId; }
+    const CpuState& GetCpuState() const { return m_cpu; }
+    size_t PageCount() const { return m_pages.size() / 256; }
+    bool HasPage(uint8_t page) const { return m_pageBitmap[page >> 3] & (1 << (page & 7)); }
+
+    static const char* GetStatusName(Status status);
+
+   private:
+    void CaptureCpu(Bus& bus);
+    const uint8_t* FindPage(uint8_t page) const;  // full snapshots only
+
+    bool m_isDelta  = false;
+    uint64_t m_id     = 0;
+    uint64_t m_baseId = 0;
+    CpuState m_cpu    = {};
+    uint8_t m_pageBitmap[32] = {};
+    std::vector<uint8_t> m_pages;  // 256 bytes per page present in the bitmap, ascending
+};
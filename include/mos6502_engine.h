@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "block_cache.h"
+#include "bus.h"
+#include "event_scheduler.h"
+#include "machine_snapshot.h"
+#include "mos_t_6502.h"
+#include "program_image.h"
+#include "recompiled_core.h"
+
+// Embeddable, non-terminating front end to a Bus + MosT6502 pair.
+// Nothing in here writes to stdout or ends the process; every failure comes back as a Status.
+// Instances share no mutable state, so one engine per thread can run concurrently.
+class Mos6502Engine {
+   public:
+    enum Status
+    {
+        OK,
+        ERR_IMAGE_BOUNDS,    // image does not fit between its load address and 0xffff
+        ERR_NOT_RESET,       // Step()/Run() called before Reset()
+        ERR_ILLEGAL_OPCODE,  // cpu stopped on an opcode it cannot execute, pc points at it
+        ERR_SNAPSHOT_BASE,   // delta snapshot used with a base it was not taken against
+        ERR_RECOMPILED,      // shared object is not a recompiled module, see RecompiledLibrary
+    };
+
+    // how Run() executes code; both give identical results
+    enum Core
+    {
+        CORE_INTERPRETER,  // decode every instruction as it is reached
+        CORE_BLOCK_CACHE,  // predecoded basic blocks, see BlockCache (the default)
+        CORE_JIT,          // block cache + native code for hot blocks, see BlockJit
+        CORE_THREADED,     // one specialised handler per opcode, see ThreadedCore
+        CORE_RECOMPILED,   // ahead-of-time translated image, see RecompiledCore; without a
+                           // module this is the interpreter
+    };
+
+    Mos6502Engine();
+    Mos6502Engine(const Mos6502Engine&) = delete;
+    Mos6502Engine& operator=(const Mos6502Engine&) = delete;
+
+    // copies image into ram at loadAddr
+    Status Load(const uint8_t* image, size_t size, uint16_t loadAddr);
+
+    // copies every segment of image; loadAddr places raw/hex text images.
+    // The reset vector is pointed at startAddr unless useImageResetVector is set and the image
+    // brings its own.
+    Status LoadImage(const ProgramImage& image, uint16_t loadAddr, uint16_t startAddr,
+                     bool useImageResetVector = false);
+    void SetResetVector(uint16_t addr);
+
+    // zero ram, keep nothing from a previous program (scheduled events and irq lines included)
+    void Clear();
+
+    // cpu reset : registers, cycle counter, pc from the reset vector; clears dirty pages
+    Status Reset();
+
+    // pooled reuse, see EnginePool : ResetToBaseline() is Clear() + Reset() against baseline
+    // (nullptr : zeroed ram) and only copies the pages written since the previous one
+    void SetBaseline(std::shared_ptr<const PagedMemory::Image> baseline);
+    void ResetToBaseline();
+
+    // one instruction, after firing due events and taking a pending interrupt;
+    // *reason is RUNNING unless the program stopped
+    Status Step(MosT6502::StopReason* reason);
+
+    // see MosT6502::Run, *reason tells why control came back. The budget is cut into slices
+    // at scheduled events, which fire between instructions along with interrupt entry.
+    // With Breakpoints attached to the bus, *reason can be BREAKPOINT or WATCHPOINT
+    Status Run(uint64_t cycleBudget, MosT6502::StopReason* reason);
+
+    // devices schedule irq/nmi assertions and callbacks here, see EventScheduler. Events and
+    // irq lines are device state : snapshots do not carry them
+    EventScheduler& GetScheduler() { return m_scheduler; }
+
+    void SetCore(Core core);
+    Core GetCore() const { return m_core; }
+
+    // the module CORE_RECOMPILED runs, see StaticRecompiler; not owned, nullptr drops it
+    void SetRecompiledModule(const RecompiledModule* module);
+    // the same from a module built as a shared object, kept open by the engine
+    Status LoadRecompiled(const std::string& path);
+    const RecompiledCore* GetRecompiledCore() const { return m_recompiledCore.get(); }
+
+    // share read-only memory with other engines : see Bus::UsePagedMemory
+    void UsePagedMemory(std::shared_ptr<const PagedMemory::Image> image)
+    {
+        m_bus.UsePagedMemory(std::move(image));
+        m_isReset = false;
+    }
+
+    // save / resume the whole machine (registers, counters, ram), see MachineSnapshot. Events,
+    // irq lines and a latched nmi are not in a snapshot : Restore() drops them like Clear()
+    void Snapshot(MachineSnapshot* out) { out->Capture(m_bus); }
+    Status SnapshotDelta(const MachineSnapshot& base, MachineSnapshot* out)
+    {
+        return (out->CaptureDelta(m_bus, base) == MachineSnapshot::OK) ? OK : ERR_SNAPSHOT_BASE;
+    }
+    Status Restore(const MachineSnapshot& snapshot, const MachineSnapshot* base = nullptr);
+
+    Bus& GetBus() { return m_bus; }
+    MosT6502& GetCpu() { return m_bus.GetMicroprocessor(); }
+
+   private:
+    // fires due events, then lets the cpu take an nmi or unmasked irq
+    void ServiceEvents()
+    {
+        MosT6502& cpu = GetCpu();
+        m_scheduler.RunDue(cpu.cycles);
+        cpu.TakeInterrupt();
+    }
+    MosT6502::StopReason RunCore(uint64_t cycleBudget);
+    // scheduled events and interrupt inputs, all timed against the cycle counter being replaced
+    void ClearDeviceState()
+    {
+        m_scheduler.Clear();
+        GetCpu().ClearInterruptInputs();
+    }
+
+    // see Breakpoints : a watchpoint hit ends the core's slice, it is reported from here
+    void ClearWatchpointHit();
+    bool IsWatchpointHit() const;
+
+    Status ToStatus(MosT6502::StopReason reason) const
+    {
+        return (reason == MosT6502::StopReason::ILLEGAL_OPCODE) ? ERR_ILLEGAL_OPCODE : OK;
+    }
+
+    Bus m_bus;
+    EventScheduler m_scheduler;  // after m_bus, it holds on to the cpu
+    Core m_core = CORE_INTERPRETER;
+    std::unique_ptr<BlockCache> m_blockCache;  // only for CORE_BLOCK_CACHE and CORE_JIT
+    std::unique_ptr<RecompiledLibrary> m_recompiledLibrary;
+    const RecompiledModule* m_recompiledModule = nullptr;
+    std::unique_ptr<RecompiledCore> m_recompiledCore;  // only for CORE_RECOMPILED with a module
+    bool m_isReset = false;
+};
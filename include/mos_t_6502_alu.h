@@ -0,0 +1,84 @@
+#pragma once
+
+#include "mos_t_6502.h"
+
+// Decimal mode ADC/SBC as the NMOS 6502 does them, including its flags for invalid BCD
+// operands : N and V come from the intermediate result after the low nibble is adjusted, Z
+// from the binary sum, and SBC sets every flag like binary mode. Only the cpu's
+// kDecimalTable is built from these, at compile time; binary mode stays plain arithmetic.
+
+constexpr uint16_t DecimalAluEntry(uint8_t result, uint8_t flags)
+{
+    return ((uint16_t)flags << 8) | result;
+}
+
+constexpr uint16_t DecimalAdd(unsigned a, unsigned m, unsigned c)
+{
+    int lo = (a & 0x0f) + (m & 0x0f) + c;
+    if (lo >= 0x0a) {
+        lo = ((lo + 0x06) & 0x0f) + 0x10;
+    }
+    int sum       = (a & 0xf0) + (m & 0xf0) + lo;
+    int signedSum = (int8_t)(a & 0xf0) + (int8_t)(m & 0xf0) + lo;
+
+    uint8_t flags = sum & MosT6502::N;
+    if (signedSum < -128 or signedSum > 127) {
+        flags |= MosT6502::V;
+    }
+    if (((a + m + c) & 0xff) == 0) {
+        flags |= MosT6502::Z;
+    }
+    if (sum >= 0xa0) {
+        sum += 0x60;
+    }
+    if (sum >= 0x100) {
+        flags |= MosT6502::C;
+    }
+    return DecimalAluEntry(sum & 0xff, flags);
+}
+
+constexpr uint16_t DecimalSubtract(unsigned a, unsigned m, unsigned c)
+{
+    int lo = (int)(a & 0x0f) - (int)(m & 0x0f) + (int)c - 1;
+    if (lo < 0) {
+        lo = ((lo - 0x06) & 0x0f) - 0x10;
+    }
+    int diff = (int)(a & 0xf0) - (int)(m & 0xf0) + lo;
+    if (diff < 0) {
+        diff -= 0x60;
+    }
+
+    unsigned binary = a + (m ^ 0xff) + c;
+    uint8_t flags   = binary & MosT6502::N;
+    if (~(a ^ (m ^ 0xff)) & (a ^ binary) & 0x80) {
+        flags |= MosT6502::V;
+    }
+    if ((binary & 0xff) == 0) {
+        flags |= MosT6502::Z;
+    }
+    if (binary > 0xff) {
+        flags |= MosT6502::C;
+    }
+    return DecimalAluEntry(diff & 0xff, flags);
+}
+
+constexpr MosT6502::DecimalTable BuildDecimalTable()
+{
+    MosT6502::DecimalTable table{};
+    for (unsigned c = 0; c < 2; c++) {
+        for (unsigned a = 0; a < 256; a++) {
+            for (unsigned m = 0; m < 256; m++) {
+                table.entries[0][c][a][m] = DecimalAdd(a, m, c);
+                table.entries[1][c][a][m] = DecimalSubtract(a, m, c);
+            }
+        }
+    }
+    return table;
+}
+
+// spot checks, the table is verified exhaustively by opcode_fuzz --alu
+static_assert(DecimalAdd(0x09, 0x01, 0) == DecimalAluEntry(0x10, 0), "");
+static_assert(DecimalAdd(0x99, 0x00, 1) == DecimalAluEntry(0x00, MosT6502::N | MosT6502::C), "");
+static_assert(DecimalAdd(0x79, 0x00, 1) == DecimalAluEntry(0x80, MosT6502::N | MosT6502::V), "");
+static_assert(DecimalSubtract(0x00, 0x01, 1) == DecimalAluEntry(0x99, MosT6502::N), "");
+static_assert(DecimalSubtract(0x46, 0x12, 1) == DecimalAluEntry(0x34, MosT6502::C), "");
@@ -1,4 +1,23 @@
+#pragma once
+
+#include <cstdint>
+
 #define STREAM_BYTE(X) "0x" << std::hex << std::setw(2) << std::setfill('0') << unsigned(X)
 #define STREAM_WORD(X) "0x" << std::hex << std::setw(4) << std::setfill('0') << X
 
 #define TERMINATE_OPCODE 0x11
+
+// stream-state free hex formatting for hot output paths; return the advanced out pointer
+inline char* PutHexByte(char* out, uint8_t v)
+{
+    static const char kDigits[] = "0123456789abcdef";
+    out[0] = kDigits[v >> 4];
+    out[1] = kDigits[v & 0x0f];
+    return out + 2;
+}
+
+inline char* PutHexWord(char* out, uint16_t v)
+{
+    out = PutHexByte(out, v >> 8);
+    return PutHexByte(out, v & 0xff);
+}
@@ -3,44 +3,137 @@
 #include <sstream>
 #include <string>
 
-#include "bus.h"
+#include "guest_profile.h"
+#include "mos6502_engine.h"
+#include "program_image.h"
+#include "trace_sink.h"
 
 class OpcodeProcessor {
    public:
-    void Init() { bus.Initialize(); }
+    void Init() { engine.Clear(); }
 
-    bool ProcessFile(const std::string& fileAbs, uint16_t startProcAddr)
+    void SetCore(Mos6502Engine::Core core) { engine.SetCore(core); }
+
+    // see Mos6502Engine::LoadRecompiled(), used by CORE_RECOMPILED
+    bool LoadRecompiled(const std::string& path)
+    {
+        return engine.LoadRecompiled(path) == Mos6502Engine::OK;
+    }
+
+    void SetTraceSink(TraceSink* sink)
     {
-        std::ifstream sourceFile;
-        sourceFile.open(fileAbs);
+        m_traceSink = sink;
+        engine.GetCpu().SetTraceSink(sink);
+    }
+
+    void SetProfile(GuestProfile* profile) { engine.GetCpu().SetProfile(profile); }
 
-        bus.Write(0xfffc, startProcAddr & 0xff);
-        bus.Write(0xfffd, (startProcAddr >> 8) & 0xff);
+    // raw and hex text images are loaded at startProcAddr, the other formats carry their own
+    // addresses; execution starts at startProcAddr unless the image's reset vector is wanted
+    bool ProcessFile(const std::string& fileAbs, uint16_t startProcAddr,
+                     ProgramImage::Format format = ProgramImage::AUTO,
+                     bool useImageResetVector = false)
+    {
+        ProgramImage image;
+        ProgramImage::Status imageStatus = image.Open(fileAbs, format);
+        if (imageStatus != ProgramImage::OK) {
+            std::cout << ProgramImage::GetStatusName(imageStatus) << " : " << fileAbs << '\n';
+            return false;
+        }
 
-        unsigned int sourceByte;
-        uint16_t byteCnt = 0;
+        if (engine.LoadImage(image, startProcAddr, startProcAddr, useImageResetVector) !=
+            Mos6502Engine::OK) {
+            std::cout << "Program does not fit in memory, size=" << std::dec << image.TotalBytes()
+                      << " start_addr=" << STREAM_WORD(startProcAddr) << '\n';
+            return false;
+        }
 
-        while (sourceFile >> std::hex >> sourceByte) {
-            bus.Write(startProcAddr + byteCnt, sourceByte);
-            byteCnt += 1;
+        uint16_t shift = image.IsRelocatable() ? startProcAddr : 0;
+        for (const auto& seg : image.Segments()) {
+            std::cout << "Program segment start_addr=" << STREAM_WORD((uint16_t)(seg.addr + shift))
+                      << " end_addr=" << STREAM_WORD((uint16_t)(seg.addr + shift + seg.size - 1))
+                      << '\n';
         }
 
-        sourceFile.close();
+        std::cout << "\nPowering up the legendary MOS-Technology-6502's basic emulator ...\n";
+        engine.Reset();
 
-        std::cout << "Program start_addr=" << STREAM_BYTE(startProcAddr)
-                  << " end_addr=" << STREAM_BYTE(startProcAddr + byteCnt - 1 - 1) << '\n';
+        MosT6502& mp = engine.GetCpu();
+        MosT6502::StopReason reason;
+        Mos6502Engine::Status status;
+        do {
+            status = engine.Run(kCyclesPerSlice, &reason);
+        } while (status == Mos6502Engine::OK and reason == MosT6502::StopReason::CYCLE_BUDGET);
 
-        bus.StartCpu();
+        if (m_traceSink) {
+            m_traceSink->Flush();
+        }
 
-        while (true) {
-            bus.GetMicroprocessor().ExecuteInstruction();
+        if (status == Mos6502Engine::ERR_ILLEGAL_OPCODE) {
+            std::cout << "Illegal instr in the code. opcode="
+                      << STREAM_BYTE(engine.GetBus().Read(mp.pc)) << " pc=" << STREAM_WORD(mp.pc)
+                      << '\n';
+            return false;
         }
 
+        if (reason == MosT6502::StopReason::BREAK) {
+            std::cout << "\nProgram stopped on BRK !";
+        } else {
+            std::cout << "\nProgram completed !";
+        }
+        std::cout << " cycles=" << std::dec << mp.cycles << '\n';
+        DumpRam();
         return true;
     }
 
-    void Shutdown() { bus.Unplug(); }
+    enum RamDump
+    {
+        RAM_DUMP_NONE,
+        RAM_DUMP_FULL,    // all 64 KiB as hex text
+        RAM_DUMP_DIRTY,   // pages the program wrote, as hex text
+        RAM_DUMP_BINARY,  // pages the program wrote, as (addr, length, bytes) records
+    };
+
+    // where the end-of-program ram dump goes; dumpFile empty means stdout
+    void SetRamDump(RamDump mode, const std::string& dumpFile)
+    {
+        m_ramDump  = mode;
+        m_dumpFile = dumpFile;
+    }
+
+    void Shutdown() { engine.GetBus().Unplug(); }
 
    private:
-    Bus bus;
+    void DumpRam()
+    {
+        if (m_ramDump == RAM_DUMP_NONE) {
+            return;
+        }
+        std::ofstream dumpFile;
+        if (!m_dumpFile.empty()) {
+            dumpFile.open(m_dumpFile, std::ios::binary);
+            if (!dumpFile.is_open()) {
+                std::cout << "Unable to open " << m_dumpFile << '\n';
+                return;
+            }
+        }
+        std::ostream& os = m_dumpFile.empty() ? std::cout : dumpFile;
+
+        Bus& bus = engine.GetBus();
+        if (m_ramDump == RAM_DUMP_FULL) {
+            bus.PrintRamState(os);
+        } else if (m_ramDump == RAM_DUMP_DIRTY) {
+            bus.DumpDirtyRam(os, Bus::DUMP_HEX);
+        } else {
+            bus.DumpDirtyRam(os, Bus::DUMP_BINARY);
+        }
+        os.flush();
+    }
+
+    static constexpr uint64_t kCyclesPerSlice = 1 << 20;
+
+    Mos6502Engine engine;
+    TraceSink* m_traceSink = nullptr;
+    RamDump m_ramDump      = RAM_DUMP_DIRTY;
+    std::string m_dumpFile;
 };
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Copy-on-write 64 KiB address space.
+// Any number of PagedMemory instances can be built from one Image; they all read the image's
+// pages in place and only get a private copy of a page on their first write to it.
+class PagedMemory {
+   public:
+    enum PageSize  // value is the page shift
+    {
+        PAGE_256 = 8,
+        PAGE_4K  = 12,
+    };
+
+    struct Stats {
+        size_t pageSize;
+        size_t sharedPages;    // still read from the image
+        size_t privatePages;   // copied on write, owned by this instance
+        size_t residentBytes;  // memory this instance owns : private pages + page tables
+    };
+
+    // immutable once built, safe to share between threads
+    class Image {
+       public:
+        // ram must hold 64 KiB; identical pages (typically all-zero ones) are stored once
+        Image(const uint8_t* ram, PageSize pageSize);
+
+        PageSize GetPageSize() const { return m_pageSize; }
+        size_t UniquePages() const { return m_storage.size(); }
+
+        // the 256 bytes at pageNumber << 8
+        const uint8_t* Page256(uint8_t pageNumber) const
+        {
+            unsigned addr = (unsigned)pageNumber << 8;
+            return m_pages[addr >> m_pageSize] + (addr & (((unsigned)1 << m_pageSize) - 1));
+        }
+
+       private:
+        friend class PagedMemory;
+
+        PageSize m_pageSize;
+        std::vector<std::unique_ptr<uint8_t[]>> m_storage;
+        std::vector<const uint8_t*> m_pages;  // one entry per page, may alias
+    };
+
+    explicit PagedMemory(std::shared_ptr<const Image> image);
+    PagedMemory(const PagedMemory&) = delete;
+    PagedMemory& operator=(const PagedMemory&) = delete;
+
+    uint8_t Read(uint16_t addr) const { return m_read[addr >> m_shift][addr & m_mask]; }
+
+    void Write(uint16_t addr, uint8_t data)
+    {
+        unsigned page = addr >> m_shift;
+        if (m_write[page] == nullptr) {
+            MakePrivate(page);
+        }
+        m_write[page][addr & m_mask] = data;
+    }
+
+    // drop every private copy, back to the image contents
+    void Revert();
+
+    // the 256 bytes at pageNumber << 8, read-only view
+    const uint8_t* Page256(uint8_t pageNumber) const
+    {
+        unsigned addr = (unsigned)pageNumber << 8;
+        return m_read[addr >> m_shift] + (addr & m_mask);
+    }
+
+    // writable view of the same 256 bytes; a shared page is copied first when makePrivate is
+    // set, otherwise nullptr comes back for it
+    uint8_t* WritablePage256(uint8_t pageNumber, bool makePrivate)
+    {
+        unsigned addr = (unsigned)pageNumber << 8;
+        unsigned page = addr >> m_shift;
+        if (m_write[page] == nullptr) {
+            if (!makePrivate) {
+                return nullptr;
+            }
+            MakePrivate(page);
+        }
+        return m_write[page] + (addr & m_mask);
+    }
+
+    size_t PageBytes() const { return (size_t)1 << m_shift; }
+    const Image& GetImage() const { return *m_image; }
+    Stats GetStats() const;
+
+   private:
+    void MakePrivate(unsigned page);
+
+    static constexpr unsigned kMaxPages = 256;
+
+    std::shared_ptr<const Image> m_image;
+    unsigned m_shift;
+    unsigned m_mask;
+    unsigned m_pageCount;
+    const uint8_t* m_read[kMaxPages];
+    uint8_t* m_write[kMaxPages];  // nullptr while the page is still shared
+    std::unique_ptr<uint8_t[]> m_private[kMaxPages];
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Bus;
+
+// A program file opened for loading into a Bus.
+// Binary formats (raw, prg) are mmapped and their segments point straight into the mapping;
+// text formats (whitespace hex, Intel HEX, S-record) are decoded once into an owned buffer.
+// Either way loading is one bulk copy per segment.
+class ProgramImage {
+   public:
+    enum Format
+    {
+        AUTO,       // .bin/.rom -> raw, .prg -> prg, text starting with ':' or 'S' -> ihex/srec,
+                    // anything else -> whitespace separated hex bytes
+        HEX_TEXT,   // "a9 01 8d 00 02 ...", the opcode_processor input format
+        RAW,        // plain bytes
+        PRG,        // 2-byte little endian load address followed by plain bytes
+        INTEL_HEX,  // data records 00, eof 01, extended addresses 02/04 (must stay below 64 KiB)
+        SREC,       // S1/S2/S3 data records, S0/S5/S6/S7/S8/S9 are checked and skipped
+    };
+
+    enum Status
+    {
+        OK,
+        ERR_OPEN,      // file missing or unreadable
+        ERR_FORMAT,    // malformed record or token
+        ERR_CHECKSUM,  // ihex/srec record checksum mismatch
+        ERR_BOUNDS,    // some byte would land above 0xffff
+    };
+
+    struct Segment {
+        uint16_t addr;
+        const uint8_t* data;
+        size_t size;
+    };
+
+    ProgramImage() = default;
+    ~ProgramImage() { Close(); }
+    ProgramImage(const ProgramImage&) = delete;
+    ProgramImage& operator=(const ProgramImage&) = delete;
+
+    Status Open(const std::string& path, Format format = AUTO);
+    void Close();
+
+    Format GetFormat() const { return m_format; }
+
+    // raw and hex text carry no address : their single segment sits at 0 and moves to the
+    // loadAddr given below, the other formats ignore loadAddr
+    bool IsRelocatable() const { return m_format == RAW or m_format == HEX_TEXT; }
+    const std::vector<Segment>& Segments() const { return m_segments; }
+    size_t TotalBytes() const;
+
+    // does the image itself provide both bytes of the reset vector (0xfffc/0xfffd)
+    bool ProvidesResetVector(uint16_t loadAddr) const;
+
+    // validates every segment against the 64 KiB space before copying anything
+    Status LoadInto(Bus& bus, uint16_t loadAddr) const;
+
+    static const char* GetStatusName(Status status);
+
+   private:
+    Status ParseHexText(const char* text, size_t size);
+    Status ParseIntelHex(const char* text, size_t size);
+    Status ParseSrec(const char* text, size_t size);
+
+    // decoded formats : append bytes at addr, merging with the previous segment when adjacent
+    void AppendDecoded(uint32_t addr, const uint8_t* bytes, size_t size);
+    void FinishDecoded();
+
+    Format m_format = AUTO;
+    void* m_mapping = nullptr;
+    size_t m_mappingSize = 0;
+
+    std::vector<uint8_t> m_decoded;
+    std::vector<std::pair<uint32_t, size_t>> m_decodedOffsets;  // per segment : addr, offset
+    std::vector<Segment> m_segments;
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bus.h"
+#include "mos_t_6502.h"
+#include "recompiled_module.h"
+
+// Runs a RecompiledModule (see StaticRecompiler) against a live bus, falling back to the
+// interpreter wherever the module has nothing : unknown pc, instructions it leaves to the host
+// and the tail of a slice too short for a whole block. A block is only entered once the bytes
+// it was translated from are what ram holds; its pages are then watched on the bus like the
+// block cache does, and a write to one of them takes the block back to the check.
+// Native code only runs without trace sink, profile and breakpoints; results are identical to
+// MosT6502::Run() otherwise.
+class RecompiledCore : public CodeWriteListener {
+   public:
+    // module must outlive the core
+    RecompiledCore(Bus& bus, const RecompiledModule& module);
+    RecompiledCore(const RecompiledCore&) = delete;
+    RecompiledCore& operator=(const RecompiledCore&) = delete;
+    ~RecompiledCore() override;
+
+    // drop-in for cpu.Run(); cpu must be the one connected to the bus given at construction
+    MosT6502::StopReason Run(MosT6502& cpu, uint64_t cycleBudget);
+
+    void OnCodeWrite(uint8_t page) override;
+
+    uint64_t ModuleRuns() const { return m_moduleRuns; }  // times control went native
+    uint64_t BlocksMismatched() const { return m_blocksMismatched; }
+
+   private:
+    enum BlockState : uint8_t
+    {
+        BLOCK_UNCHECKED,  // ram not compared since the last write to its pages
+        BLOCK_RUNNABLE,
+        BLOCK_MISMATCH,  // ram holds something else, the interpreter runs it
+    };
+
+    bool IsRunnable(uint32_t index);
+    void Enter(MosT6502& cpu);
+
+    // bus access for the pages the module does not touch directly; the cpu is synced first
+    static uint8_t HostRead(RecompiledContext* ctx, uint16_t addr);
+    static void HostWrite(RecompiledContext* ctx, uint16_t addr, uint8_t data);
+    void AfterHostAccess(RecompiledContext* ctx);
+
+    Bus& m_bus;
+    const RecompiledModule& m_module;
+    std::unique_ptr<int32_t[]> m_lookup;  // 64K entries, block index or -1
+    std::vector<uint32_t> m_pageBlocks[256];
+    std::vector<uint8_t> m_runnable;  // per block, handed to the module
+    std::vector<BlockState> m_state;
+    RecompiledContext m_context;
+    MosT6502* m_cpu    = nullptr;  // while a module runs
+    bool m_invalidated = false;    // a watched page was written since the module was entered
+
+    uint64_t m_moduleRuns       = 0;
+    uint64_t m_blocksMismatched = 0;
+};
+
+// a module built as a shared object, see recompiled_module.h
+class RecompiledLibrary {
+   public:
+    enum Status
+    {
+        OK,
+        ERR_OPEN,     // dlopen() failed
+        ERR_SYMBOL,   // no kRecompiledModuleSymbol in it
+        ERR_VERSION,  // built against another kRecompiledAbiVersion
+    };
+
+    RecompiledLibrary() = default;
+    RecompiledLibrary(const RecompiledLibrary&) = delete;
+    RecompiledLibrary& operator=(const RecompiledLibrary&) = delete;
+    ~RecompiledLibrary();
+
+    Status Open(const std::string& path);
+    const RecompiledModule* GetModule() const { return m_module; }
+
+   private:
+    void* m_handle                   = nullptr;
+    const RecompiledModule* m_module = nullptr;
+};
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Interface between the C++ written by StaticRecompiler and RecompiledCore, the side that runs
+// it. Generated translation units include nothing else, so a module builds on its own, as a
+// shared object (g++ -O2 -shared -fPIC -I<repo> rom.cpp -o rom.so) or straight into a program.
+//
+// The module exports one function, kRecompiledModuleSymbol, handing out its RecompiledModule.
+// RecompiledModule::run() starts at ctx->regs.pc and goes from block to block for as long as
+// the next pc is a block start, that block is marked runnable and all its instructions start
+// before ctx->sliceEnd. It returns with everything else (unknown pc, indirect jumps, BRK, CLI,
+// PLP, RTI, the end of the slice) left to the interpreter.
+
+static constexpr uint32_t kRecompiledAbiVersion = 1;
+static constexpr const char* kRecompiledModuleSymbol = "Mos6502RecompiledModule";
+
+// cpu state, split like MosT6502's : sr holds I, D, B, U; N = bit 7 of nValue, Z = (zValue ==
+// 0), carry and overflow are 0 / 1
+struct RecompiledRegs {
+    uint8_t a, x, y, sp, sr;
+    uint8_t nValue, zValue, carry, overflow;
+    uint16_t pc;
+    uint64_t cycles;
+    uint64_t instructions;
+};
+
+struct RecompiledContext {
+    RecompiledRegs regs;
+    uint64_t sliceEnd;
+
+    const uint8_t* const* readMap;  // Bus page tables, see Bus::GetReadMap()
+    uint8_t* const* writeMap;
+    uint8_t (*read)(RecompiledContext* ctx, uint16_t addr);  // for null entries, regs synced
+    void (*write)(RecompiledContext* ctx, uint16_t addr, uint8_t data);
+
+    const uint16_t* decimalTable;  // MosT6502::kDecimalTable
+    const uint8_t* runnable;       // per block : 0 while ram may not hold its bytes
+    uint8_t exit;                  // set by read / write : leave after this instruction
+    void* host;
+};
+
+struct RecompiledBlock {
+    uint16_t pc;
+    uint16_t size;         // code bytes, pc up to the last instruction's last operand byte
+    uint32_t codeOffset;   // where RecompiledModule::code keeps them
+    uint32_t leadCycles;   // the most cycles the block uses before its last instruction starts
+};
+
+struct RecompiledModule {
+    uint32_t abiVersion;
+    uint32_t blockCount;
+    const RecompiledBlock* blocks;
+    const uint8_t* code;  // the bytes every block was translated from
+    void (*run)(RecompiledContext* ctx);
+};
+
+typedef const RecompiledModule* (*RecompiledModuleGetter)();
+
+// helpers for generated code; r is the block's local copy of ctx->regs
+
+inline uint8_t RecompiledRead(RecompiledContext* ctx, const RecompiledRegs& r, uint16_t addr)
+{
+    const uint8_t* page = ctx->readMap[addr >> 8];
+    if (page) {
+        return page[addr & 0xff];
+    }
+    ctx->regs = r;
+    return ctx->read(ctx, addr);
+}
+
+inline void RecompiledWrite(RecompiledContext* ctx, const RecompiledRegs& r, uint16_t addr,
+                            uint8_t data)
+{
+    uint8_t* page = ctx->writeMap[addr >> 8];
+    if (page) {
+        page[addr & 0xff] = data;
+        return;
+    }
+    ctx->regs = r;
+    ctx->write(ctx, addr, data);
+}
+
+inline void RecompiledSetNz(RecompiledRegs& r, uint8_t value)
+{
+    r.nValue = value;
+    r.zValue = value;
+}
+
+inline uint8_t RecompiledGetStatus(const RecompiledRegs& r)
+{
+    return (r.sr & 0x3c) | (r.nValue & 0x80) | ((r.zValue == 0) ? 0x02 : 0) | r.carry |
+           (r.overflow << 6);
+}
+
+// ADC, and SBC with subtract set; D set goes through the decimal table
+inline void RecompiledAdd(RecompiledContext* ctx, RecompiledRegs& r, uint8_t data, bool subtract)
+{
+    if (r.sr & 0x08) {
+        uint16_t entry = ctx->decimalTable[((unsigned)subtract << 17) | (r.carry << 16) |
+                                           (r.a << 8) | data];
+        uint8_t flags = entry >> 8;
+        r.a           = entry & 0xff;
+        r.nValue      = flags;
+        r.zValue      = ~flags & 0x02;
+        r.carry       = flags & 0x01;
+        r.overflow    = (flags >> 6) & 1;
+        return;
+    }
+    if (subtract) {
+        data ^= 0xff;
+    }
+    unsigned result = r.a + data + r.carry;
+    r.overflow      = ((~(r.a ^ data) & (r.a ^ result)) >> 7) & 1;
+    r.carry         = result >> 8;
+    r.a             = result & 0xff;
+    RecompiledSetNz(r, r.a);
+}
+
+inline void RecompiledCompare(RecompiledRegs& r, uint8_t reg, uint8_t data)
+{
+    r.carry = reg >= data;
+    RecompiledSetNz(r, reg - data);
+}
+
+inline void RecompiledPush(RecompiledContext* ctx, RecompiledRegs& r, uint8_t data)
+{
+    RecompiledWrite(ctx, r, 0x0100 + r.sp, data);
+    r.sp -= 1;
+}
+
+inline uint8_t RecompiledPull(RecompiledContext* ctx, RecompiledRegs& r)
+{
+    r.sp += 1;
+    return RecompiledRead(ctx, r, 0x0100 + r.sp);
+}
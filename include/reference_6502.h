@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+
+#include "mos_t_6502.h"
+
+// Deliberately plain 6502 model the differential fuzzer checks every core against. It shares no
+// code or tables with MosT6502 : flat 64 KiB memory, a packed status byte, its own opcode matrix
+// (the 151 documented nmos opcodes, written out from the data sheet) and one switch. Slow and
+// obvious on purpose.
+//
+// Behaviour the cores agree on and the model copies : TERMINATE_OPCODE (0x11) stops before
+// executing, decimal ADC/SBC follow the nmos part including its flags (worked out nibble by
+// nibble here, from a table in the cores), B/U are not stored in sr beyond what PHP/BRK push
+// and PLP/RTI pull (B dropped, U forced).
+class Reference6502 {
+   public:
+    // pc from the reset vector, sp 0xff, sr U, counters zeroed
+    void Reset();
+
+    // same contract as MosT6502::Run()
+    MosT6502::StopReason Run(uint64_t cycleBudget);
+
+    // one instruction; RUNNING unless the program stopped
+    MosT6502::StopReason Step();
+
+    uint8_t a   = 0x00;
+    uint8_t x   = 0x00;
+    uint8_t y   = 0x00;
+    uint8_t sp  = 0x00;
+    uint8_t sr  = 0x00;
+    uint16_t pc = 0x0000;
+
+    uint64_t cycles       = 0;
+    uint64_t instructions = 0;
+
+    uint8_t mem[0x10000] = {};
+
+   private:
+    uint8_t Read(uint16_t addr) const { return mem[addr]; }
+    uint16_t ReadWord(uint16_t lo, uint16_t hi) const { return Read(lo) | (Read(hi) << 8); }
+    void Push(uint8_t v);
+    uint8_t Pull();
+    void SetFlag(uint8_t flag, bool v) { sr = v ? (sr | flag) : (sr & ~flag); }
+    void SetNz(uint8_t v);
+    void Add(uint8_t m);
+    void AddDecimal(uint8_t m);
+    void SubtractDecimal(uint8_t m);
+    void Compare(uint8_t reg, uint8_t m);
+    void Branch(bool taken, uint8_t offset);
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include "mos_t_6502.h"
+
+// Ahead-of-time translation of a fixed 6502 image to C++, for ROMs that never rewrite their
+// code. Code is found by following control flow (MosT6502's decode table) from the entry
+// points : branches both ways, JMP, JSR and the byte after it, never outside the image. The
+// output has one function per basic block with the registers in locals, and a dispatcher
+// going from block to block, see recompiled_module.h for the interface and RecompiledCore for
+// the side that runs it.
+//
+// Left to the interpreter at run time : JMP (ind) and wherever it lands outside known code,
+// BRK, CLI, PLP and RTI (they can take or unmask interrupts), and any block whose bytes are
+// no longer in ram when it is reached. Bytes after a JSR are assumed to be code; when they are
+// data the extra blocks are simply never entered.
+class StaticRecompiler {
+   public:
+    enum Status
+    {
+        OK,
+        ERR_NO_CODE,  // no entry point leads to anything translatable
+        ERR_WRITE,    // the output stream failed
+    };
+
+    struct Stats {
+        uint64_t entries      = 0;  // entry points inside the image
+        uint64_t blocks       = 0;
+        uint64_t instructions = 0;  // translated, overlapping decodes counted once per block
+        uint64_t codeBytes    = 0;
+        uint64_t leftToHost   = 0;  // reachable instructions only the interpreter runs
+    };
+
+    // memory : the 64 KiB the image was loaded into, copied
+    explicit StaticRecompiler(const uint8_t* memory);
+
+    // bytes that belong to the image; code is only followed inside them
+    void AddImageRange(uint16_t addr, size_t size);
+
+    void AddEntry(uint16_t addr);
+    // the nmi, reset and irq/brk vectors, those pointing into the image
+    void AddVectorEntries();
+
+    void Analyze();
+
+    // withMain adds a main() running the image (the image ranges are embedded) through
+    // Mos6502Engine from its reset vector, for a standalone program
+    Status Write(std::ostream& os, bool withMain) const;
+
+    const Stats& GetStats() const { return m_stats; }
+
+   private:
+    struct Instr {
+        uint16_t pc;
+        uint8_t opcode;
+        uint16_t operand;
+        MosT6502::OpcodeInfo info;
+    };
+
+    struct Block {
+        uint16_t pc;
+        uint16_t size;
+        uint32_t leadCycles;
+        std::vector<Instr> instrs;
+    };
+
+    bool Decode(uint16_t pc, Instr* instr) const;
+    void BuildBlocks();
+
+    void WriteInstr(std::ostream& os, const Instr& instr, bool last) const;
+    void WriteMain(std::ostream& os) const;
+
+    std::vector<uint8_t> m_memory;
+    std::vector<bool> m_inImage;  // per address
+    std::vector<uint16_t> m_entries;
+    std::vector<bool> m_leader;   // per address : a block starts here
+    std::vector<bool> m_visited;  // per address : decoded as an instruction start
+    std::vector<Block> m_blocks;  // by pc
+    Stats m_stats;
+};
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+
+#include "mos_t_6502.h"
+
+// Second interpreter core with the same results as MosT6502::Run()/ExecuteInstruction().
+// Every opcode gets its own handler, instantiated at compile time from kOpcodeDefs through
+// templates over (operation, addressing mode). Reads, writes and read-modify-writes use
+// separate access paths. Dispatch goes through a 256-entry table: labels plus computed goto
+// under GCC/Clang, function pointers elsewhere.
+class ThreadedCore {
+   public:
+    static MosT6502::StopReason Run(MosT6502& cpu, uint64_t cycleBudget);
+    static MosT6502::StopReason Step(MosT6502& cpu);
+};
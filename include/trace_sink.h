@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// one record per executed instruction; cpu state is captured before the instruction runs
+struct TraceRecord {
+    uint64_t cycle;
+    uint16_t pc;
+    uint8_t opcode;
+    uint8_t a;
+    uint8_t x;
+    uint8_t y;
+    uint8_t sp;
+    uint8_t sr;
+};
+
+// formats rec as a single text line (no trailing newline) into out, returns chars written.
+// out must hold at least kTraceLineMax chars.
+constexpr size_t kTraceLineMax = 128;
+size_t FormatTraceRecord(const TraceRecord& rec, char* out);
+
+class TraceSink {
+   public:
+    virtual ~TraceSink() {}
+    virtual void Record(const TraceRecord& rec) = 0;
+    virtual void Flush() {}
+};
+
+class NullTraceSink : public TraceSink {
+   public:
+    void Record(const TraceRecord&) override {}
+};
+
+// keeps the last Capacity() records in a preallocated buffer, nothing is formatted unless asked
+class RingTraceSink : public TraceSink {
+   public:
+    explicit RingTraceSink(size_t capacity);  // rounded up to a power of two, at least 1
+
+    void Record(const TraceRecord& rec) override
+    {
+        m_records[m_head & m_mask] = rec;
+        m_head += 1;
+    }
+
+    size_t Capacity() const { return m_records.size(); }
+    size_t Size() const { return (m_head < Capacity()) ? m_head : Capacity(); }
+    const TraceRecord& At(size_t i) const  // 0 is the oldest record still held
+    {
+        return m_records[(m_head - Size() + i) & m_mask];
+    }
+    uint64_t TotalRecorded() const { return m_head; }
+    void Clear() { m_head = 0; }
+
+    void Dump(std::ostream& os) const;
+
+   private:
+    std::vector<TraceRecord> m_records;
+    uint64_t m_head = 0;
+    uint64_t m_mask;
+};
+
+// formats every record as it arrives, output is batched into large writes
+class TextTraceSink : public TraceSink {
+   public:
+    explicit TextTraceSink(std::ostream& os, size_t bufferSize = 64 * 1024);
+    ~TextTraceSink() override { Flush(); }
+
+    void Record(const TraceRecord& rec) override;
+    void Flush() override;
+
+   private:
+    std::ostream& m_os;
+    std::vector<char> m_buffer;
+    size_t m_used = 0;
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// Runs a fixed set of job indices on a group of worker threads.
+// Jobs are dealt round-robin onto per-worker deques; a worker pops its own deque from the back
+// and, once empty, steals from the front of the others, so long jobs don't leave cores idle.
+class WorkStealingPool {
+   public:
+    // fn(jobIndex, workerIndex) is called exactly once for every job in [0, jobCount)
+    using JobFn = std::function<void(size_t, unsigned)>;
+
+    explicit WorkStealingPool(unsigned workerCount);
+
+    unsigned WorkerCount() const { return m_workerCount; }
+
+    // blocks until every job has run
+    void Run(size_t jobCount, const JobFn& fn);
+
+   private:
+    struct WorkQueue {
+        std::mutex lock;
+        std::deque<size_t> jobs;
+    };
+
+    bool PopLocal(unsigned worker, size_t* job);
+    bool Steal(unsigned thief, size_t* job);
+    void WorkerLoop(unsigned worker, const JobFn& fn);
+
+    unsigned m_workerCount;
+    std::vector<WorkQueue> m_queues;
+};
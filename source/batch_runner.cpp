@@ -0,0 +1,178 @@
+#include "../include/batch_runner.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include "../include/engine_pool.h"
+#include "../include/mos6502_engine.h"
+#include "../include/work_stealing_pool.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t kResultFlushBytes = 64 * 1024;
+
+uint64_t Fnv1a(uint64_t hash, uint8_t byte) { return (hash ^ byte) * 0x100000001b3ull; }
+
+// fnv-1a 64 over the pages the job wrote, see the result format in batch_runner.h. Reset()
+// clears the dirty flags after the image is loaded, so short jobs hash a few pages, not 64 KiB
+uint64_t RamDigest(const Bus& bus)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (unsigned page = 0; page < 256; page++) {
+        if (!bus.IsPageDirty(page)) {
+            continue;
+        }
+        hash                 = Fnv1a(hash, page);
+        const uint8_t* bytes = bus.RamPage(page);
+        for (unsigned i = 0; i < 256; i++) {
+            hash = Fnv1a(hash, bytes[i]);
+        }
+    }
+    return hash;
+}
+
+// everything a worker writes while jobs run, on cache lines of its own. alignas(64) on heap
+// storage needs -faligned-new below C++17
+struct alignas(64) WorkerSlot {
+    BatchRunner::WorkerStats stats;
+    std::string pending;  // result lines not written yet
+};
+
+}  // namespace
+
+bool BatchRunner::LoadManifest(const std::string& manifestPath, std::string* error)
+{
+    std::ifstream manifest(manifestPath);
+    if (!manifest.is_open()) {
+        *error = "unable to open manifest " + manifestPath;
+        return false;
+    }
+
+    std::map<std::string, size_t> imageIndex;
+    std::string line;
+    size_t lineNumber = 0;
+    while (std::getline(manifest, line)) {
+        lineNumber += 1;
+        line = line.substr(0, line.find('#'));
+
+        std::istringstream fields(line);
+        std::string path;
+        if (!(fields >> path)) {
+            continue;  // blank or comment
+        }
+        unsigned int startAddr;
+        uint64_t cycleLimit;
+        if (!(fields >> std::hex >> startAddr >> std::dec >> cycleLimit) or startAddr > 0xffff) {
+            *error = manifestPath + ":" + std::to_string(lineNumber) +
+                     " : expected <image> <start_addr_in_hex> <cycle_limit>";
+            return false;
+        }
+
+        auto found = imageIndex.find(path);
+        if (found == imageIndex.end()) {
+            Image image{path, std::unique_ptr<ProgramImage>(new ProgramImage())};
+            ProgramImage::Status status = image.program->Open(path);
+            if (status != ProgramImage::OK) {
+                *error = std::string(ProgramImage::GetStatusName(status)) + " : " + path;
+                return false;
+            }
+            found = imageIndex.emplace(path, m_images.size()).first;
+            m_images.push_back(std::move(image));
+        }
+        m_jobs.push_back({found->second, (uint16_t)startAddr, cycleLimit});
+    }
+    return true;
+}
+
+bool BatchRunner::Run(const std::string& resultPath, unsigned workerCount, std::string* error)
+{
+    std::ofstream results(resultPath, std::ios::binary);
+    if (!results.is_open()) {
+        *error = "unable to open " + resultPath;
+        return false;
+    }
+    results << "# job image reason cycles instructions a x y sp pc sr ram_fnv1a\n";
+
+    if (workerCount == 0) {
+        workerCount = std::thread::hardware_concurrency();
+    }
+    WorkStealingPool pool(workerCount);
+
+    // one warm engine per worker that only reverts what the previous job wrote, and one output
+    // buffer per worker
+    EnginePool::Config engineConfig;
+    engineConfig.engines  = pool.WorkerCount();
+    engineConfig.affinity = EnginePool::AFFINITY_THREAD;
+    EnginePool engines(engineConfig);
+    std::vector<WorkerSlot> workers(pool.WorkerCount());
+    std::mutex resultsLock;
+
+    auto flush = [&](std::string& out) {
+        std::lock_guard<std::mutex> guard(resultsLock);
+        results.write(out.data(), out.size());
+        out.clear();
+    };
+
+    auto runJob = [&](size_t jobIndex, unsigned worker) {
+        auto begin = Clock::now();
+        EnginePool::Lease lease = engines.Acquire();
+        Mos6502Engine& engine   = *lease;
+        const Job& job          = m_jobs[jobIndex];
+        const Image& image      = m_images[job.imageIndex];
+
+        MosT6502::StopReason reason = MosT6502::StopReason::RUNNING;
+        const char* outcome;
+        if (engine.LoadImage(*image.program, job.startAddr, job.startAddr) != Mos6502Engine::OK) {
+            outcome = "image_bounds";
+        } else {
+            engine.Reset();
+            engine.Run(job.cycleLimit, &reason);
+            outcome = MosT6502::GetStopReasonName(reason);
+        }
+
+        const MosT6502& cpu = engine.GetCpu();
+        char line[512];
+        int len = snprintf(line, sizeof(line),
+                           "%zu %s %s %llu %llu %02x %02x %02x %02x %04x %02x %016llx\n", jobIndex,
+                           image.path.c_str(), outcome, (unsigned long long)cpu.cycles,
+                           (unsigned long long)cpu.instructions, cpu.a, cpu.x, cpu.y, cpu.sp,
+                           cpu.pc, cpu.GetStatus(), (unsigned long long)RamDigest(engine.GetBus()));
+        if (len >= (int)sizeof(line)) {  // very long image path, keep the line intact
+            len = sizeof(line) - 1;
+            line[len - 1] = '\n';
+        }
+        WorkerSlot& slot = workers[worker];
+        slot.pending.append(line, len);
+        if (slot.pending.size() >= kResultFlushBytes) {
+            flush(slot.pending);
+        }
+
+        WorkerStats& stats = slot.stats;
+        stats.jobs += 1;
+        stats.instructions += cpu.instructions;
+        stats.cycles += cpu.cycles;
+        stats.busySeconds += std::chrono::duration<double>(Clock::now() - begin).count();
+    };
+
+    auto begin = Clock::now();
+    pool.Run(m_jobs.size(), runJob);
+    m_workerStats.clear();
+    for (WorkerSlot& slot : workers) {
+        flush(slot.pending);
+        m_workerStats.push_back(slot.stats);
+    }
+    m_elapsedSeconds = std::chrono::duration<double>(Clock::now() - begin).count();
+
+    if (!results.good()) {
+        *error = "write error on " + resultPath;
+        return false;
+    }
+    return true;
+}
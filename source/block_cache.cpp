@@ -0,0 +1,352 @@
+#include "../include/block_cache.h"
+
+#include <algorithm>
+
+#include "../include/breakpoints.h"
+#include "../include/guest_profile.h"
+#include "../include/trace_sink.h"
+
+// branches, page crossings : cycles on top of OpcodeInfo::cycles
+static bool HasExtraCycles(const MosT6502::OpcodeInfo& info)
+{
+    return (info.flags & MosT6502::OPCODE_PAGE_PENALTY) or
+           info.addrMode == MosT6502::AddrMode::RELATIVE;
+}
+
+static bool EndsBlock(MosT6502::InstrName instrName)
+{
+    switch (instrName) {
+        case (MosT6502::InstrName::BRK):
+        case (MosT6502::InstrName::BCC):
+        case (MosT6502::InstrName::BCS):
+        case (MosT6502::InstrName::BEQ):
+        case (MosT6502::InstrName::BMI):
+        case (MosT6502::InstrName::BNE):
+        case (MosT6502::InstrName::BPL):
+        case (MosT6502::InstrName::BVC):
+        case (MosT6502::InstrName::BVS):
+        case (MosT6502::InstrName::JMP):
+        case (MosT6502::InstrName::JSR):
+        case (MosT6502::InstrName::RTI):
+        case (MosT6502::InstrName::RTS): {
+            return true;
+        }
+        default: {
+            return false;
+        }
+    }
+}
+
+BlockCache::BlockCache(Bus& bus) : m_bus(bus), m_lookup(new Block*[0x10000]())
+{
+    m_bus.SetCodeWriteListener(this);
+    m_jitContext = {nullptr, &m_bus, m_bus.GetReadMap(), m_bus.GetWriteMap(), nullptr,
+                    &m_invalidated, 0, false};
+}
+
+BlockCache::~BlockCache() { m_bus.SetCodeWriteListener(nullptr); }
+
+MosT6502::StopReason BlockCache::Run(MosT6502& cpu, uint64_t cycleBudget)
+{
+    if (!cpu.m_profile) {
+        return RunBlocks<false>(cpu, cycleBudget);
+    }
+    m_profile                   = cpu.m_profile;
+    m_profileFrom               = cpu.cycles;
+    MosT6502::StopReason reason = RunBlocks<true>(cpu, cycleBudget);
+    m_profile->CountCycles(cpu.cycles - m_profileFrom);
+    FlushProfile();
+    m_profile = nullptr;
+    return reason;
+}
+
+template <bool kProfiling>
+MosT6502::StopReason BlockCache::RunBlocks(MosT6502& cpu, uint64_t cycleBudget)
+{
+    cpu.m_sliceEnd = cpu.cycles + cycleBudget;
+    while (cpu.cycles < cpu.m_sliceEnd) {
+        Block* block = Lookup(cpu.pc);
+        if (!block) {  // pc is on something that stops the cpu, a breakpoint or a device page
+            if (kProfiling) {  // ExecuteInstruction() counts its own cycles
+                m_profile->CountCycles(cpu.cycles - m_profileFrom);
+            }
+            MosT6502::StopReason reason = cpu.ExecuteInstruction();
+            m_profileFrom               = cpu.cycles;
+            if (reason != MosT6502::StopReason::RUNNING) {
+                return reason;
+            }
+            continue;
+        }
+
+        if (m_jit and block->jitState != JIT_REJECTED) {
+            if (block->jitState == JIT_PENDING) {
+                block->hits += 1;
+                if (block->hits >= kJitThreshold) {
+                    Translate(cpu, block);
+                }
+            }
+            if (block->native and !cpu.m_traceSink and !cpu.m_profile and
+                (!cpu.m_breakpoints or !cpu.m_breakpoints->HasWatchpoints()) and
+                cpu.cycles + block->jitLeadCycles < cpu.m_sliceEnd) {
+                m_invalidated         = false;
+                m_jitContext.cpu      = &cpu;
+                m_jitContext.sliceEnd = cpu.m_sliceEnd;
+                m_jitContext.leave    = false;
+                block->native(&m_jitContext);
+                continue;
+            }
+        }
+
+        m_invalidated                 = false;
+        const DecodedInstr* instr     = block->instrs;
+        const DecodedInstr* lastInstr = block->instrs + block->count - 1;
+        const bool extraEach          = kProfiling and block->extraEach;
+        uint64_t blockStart           = cpu.cycles;
+        while (true) {
+            if (cpu.m_traceSink) {
+                cpu.m_traceSink->Record(
+                    {cpu.cycles, cpu.pc, instr->opcode, cpu.a, cpu.x, cpu.y, cpu.sp, cpu.GetStatus()});
+            }
+            uint64_t startCycle         = cpu.cycles;
+            MosT6502::StopReason reason = cpu.Execute(instr->info, instr->operand);
+            if (extraEach and HasExtraCycles(instr->info)) {
+                block->profileExtra[instr - block->instrs] +=
+                        cpu.cycles - startCycle - instr->info.cycles;
+            }
+            if (reason != MosT6502::StopReason::RUNNING or instr == lastInstr or m_invalidated or
+                cpu.cycles >= cpu.m_sliceEnd) {
+                if (kProfiling) {
+                    if (instr == lastInstr and block->profiled and !m_invalidated and
+                        !GuestProfile::IsCallOrReturn(instr->opcode)) {
+                        block->profileRuns += 1;  // the common case of ProfileRun()
+                        if (!extraEach) {
+                            block->profileExtra[block->extraAt] +=
+                                    cpu.cycles - blockStart - block->baseCycles;
+                        }
+                    } else {
+                        ProfileRun(cpu, block, instr, blockStart);
+                    }
+                }
+                if (reason != MosT6502::StopReason::RUNNING) {
+                    return reason;
+                }
+                break;
+            }
+            instr += 1;
+        }
+    }
+    return MosT6502::StopReason::CYCLE_BUDGET;
+}
+
+BlockCache::Block* BlockCache::Build(uint16_t pc)
+{
+    Block* block;
+    if (m_free.empty()) {
+        m_storage.emplace_back(new Block);
+        block = m_storage.back().get();
+    } else {
+        block = m_free.back();
+        m_free.pop_back();
+    }
+    block->startPc     = pc;
+    block->count       = 0;
+    block->firstPage   = pc >> 8;
+    block->lastPage    = pc >> 8;
+    block->jitState    = JIT_PENDING;
+    block->hits        = 0;
+    block->native      = nullptr;
+    block->profileRuns = 0;
+    block->baseCycles  = 0;
+    block->extraAt     = 0;
+    block->extraEach   = false;
+    block->profiled    = false;
+    std::fill(block->profileExtra, block->profileExtra + kMaxBlockInstrs, 0);
+
+    const Breakpoints* breakpoints = m_bus.GetBreakpoints();
+    uint16_t addr                  = pc;
+    bool anyExtra                  = false;
+    while (block->count < kMaxBlockInstrs) {
+        if (m_bus.GetDevice(addr >> 8) or (breakpoints and breakpoints->IsBreakpoint(addr))) {
+            break;
+        }
+        uint8_t opcode = m_bus.Fetch(addr);
+        if (opcode == TERMINATE_OPCODE) {
+            break;
+        }
+        const MosT6502::OpcodeInfo& info = MosT6502::Decode(opcode);
+        if (!MosT6502::IsLegal(info)) {
+            break;
+        }
+
+        uint8_t length = MosT6502::GetInstrLength(info.addrMode);
+        uint16_t last  = addr + length - 1;
+        if (m_bus.GetDevice(last >> 8)) {
+            break;
+        }
+        uint16_t operand = 0x0000;
+        for (uint8_t i = length - 1; i > 0; i--) {
+            operand = (operand << 8) | m_bus.Fetch(addr + i);
+        }
+
+        block->instrs[block->count] = {info, addr, operand, opcode};
+        block->baseCycles += info.cycles;
+        if (HasExtraCycles(info)) {
+            block->extraEach = anyExtra;
+            block->extraAt   = block->count;
+            anyExtra         = true;
+        }
+        block->count += 1;
+        block->lastPage = last >> 8;
+        addr += length;
+        if (EndsBlock(info.instrName)) {
+            break;
+        }
+    }
+
+    if (block->count == 0) {
+        m_free.push_back(block);
+        return nullptr;
+    }
+
+    uint8_t page = block->firstPage;
+    while (true) {
+        m_pageBlocks[page].push_back(block);
+        m_bus.WatchCodePage(page);
+        if (page == block->lastPage) {
+            break;
+        }
+        page += 1;
+    }
+    m_lookup[pc] = block;
+    m_blocksBuilt += 1;
+    return block;
+}
+
+void BlockCache::Drop(Block* block)
+{
+    FlushProfile(block);
+    uint8_t page = block->firstPage;
+    while (true) {
+        auto& blocks = m_pageBlocks[page];
+        blocks.erase(std::remove(blocks.begin(), blocks.end(), block), blocks.end());
+        if (page == block->lastPage) {
+            break;
+        }
+        page += 1;
+    }
+    m_lookup[block->startPc] = nullptr;
+    m_free.push_back(block);  // only reused by Build(), i.e. once Run() left the block
+    m_blocksInvalidated += 1;
+}
+
+// one run of block through last, started at startCycle. A whole run only bumps profileRuns
+// and the extra cycles; a run cut short counts the instructions that ran right away. The cycles
+// since m_profileFrom go to the profile when the run ends in a call or return, the call path
+// changes there
+void BlockCache::ProfileRun(const MosT6502& cpu, Block* block, const DecodedInstr* last,
+                            uint64_t startCycle)
+{
+    if (!block->profiled) {
+        block->profiled = true;
+        m_profiled.push_back(block);
+    }
+    uint64_t extra = cpu.cycles - startCycle;
+    if (last == block->instrs + block->count - 1 and !m_invalidated) {
+        block->profileRuns += 1;
+        extra -= block->baseCycles;
+    } else {
+        for (const DecodedInstr* instr = block->instrs; instr <= last; instr++) {
+            m_profile->CountAt(instr->pc, instr->opcode, 1, instr->info.cycles);
+            extra -= instr->info.cycles;
+        }
+    }
+    if (!block->extraEach) {  // otherwise already in profileExtra
+        block->profileExtra[block->extraAt] += extra;
+    }
+    if (m_invalidated) {  // may be gone : hand over its counts now
+        FlushProfile(block);
+    }
+    if (GuestProfile::IsCallOrReturn(last->opcode)) {
+        m_profile->CountBlock(last->opcode, cpu.cycles - m_profileFrom, cpu.pc);
+        m_profileFrom = cpu.cycles;
+    }
+}
+
+void BlockCache::FlushProfile(Block* block)
+{
+    uint64_t runs = block->profileRuns;
+    for (unsigned i = 0; i < block->count; i++) {
+        const DecodedInstr& instr = block->instrs[i];
+        uint64_t cycles           = runs * instr.info.cycles + block->profileExtra[i];
+        if (cycles != 0) {
+            m_profile->CountAt(instr.pc, instr.opcode, runs, cycles);
+        }
+        block->profileExtra[i] = 0;
+    }
+    block->profileRuns = 0;
+}
+
+void BlockCache::FlushProfile()
+{
+    for (Block* block : m_profiled) {  // a block dropped and rebuilt meanwhile can be listed twice
+        FlushProfile(block);
+        block->profiled = false;
+    }
+    m_profiled.clear();
+}
+
+void BlockCache::OnCodeWrite(uint8_t page)
+{
+    while (!m_pageBlocks[page].empty()) {
+        Drop(m_pageBlocks[page].back());
+    }
+    m_invalidated = true;
+}
+
+void BlockCache::Translate(const MosT6502& cpu, Block* block)
+{
+    unsigned translated;
+    BlockJit::NativeBlock native = m_jit->Compile(cpu, block->instrs, block->count, &translated,
+                                                  &block->jitLeadCycles);
+    if (!native and m_jit->IsFull()) {
+        ForgetTranslations();  // safe : no native block is running between blocks
+        native = m_jit->Compile(cpu, block->instrs, block->count, &translated,
+                                &block->jitLeadCycles);
+    }
+    block->native   = native;
+    block->jitState = (native) ? JIT_NATIVE : JIT_REJECTED;
+    m_blocksTranslated += (native) ? 1 : 0;
+}
+
+void BlockCache::ForgetTranslations()
+{
+    for (auto& block : m_storage) {
+        block->jitState = JIT_PENDING;
+        block->hits     = 0;
+        block->native   = nullptr;
+    }
+    if (m_jit) {
+        m_jit->Reset();
+    }
+}
+
+void BlockCache::SetJitEnabled(bool enabled)
+{
+    if (enabled == IsJitEnabled()) {
+        return;
+    }
+    ForgetTranslations();
+    if (enabled) {
+        m_jit.reset(new BlockJit);
+        m_jitContext.nzTable = m_jit->NzTable();
+    } else {
+        m_jit.reset();
+    }
+}
+
+void BlockCache::Invalidate()
+{
+    for (unsigned page = 0; page < 256; page++) {
+        OnCodeWrite(page);
+    }
+}
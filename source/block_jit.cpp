@@ -0,0 +1,1419 @@
+#include "../include/block_jit.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include "../include/bus.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+#define MOS6502_JIT_X64 1
+#include <sys/mman.h>
+#include <unistd.h>
+#else
+#define MOS6502_JIT_X64 0
+#endif
+
+static constexpr size_t kJitCodeBytes = 8 * 1024 * 1024;
+static constexpr size_t kNzTableBytes = 256;
+
+static constexpr uint8_t kFlagC = 0x01;
+static constexpr uint8_t kFlagZ = 0x02;
+static constexpr uint8_t kFlagI = 0x04;
+static constexpr uint8_t kFlagD = 0x08;
+static constexpr uint8_t kFlagB = 0x10;
+static constexpr uint8_t kFlagU = 0x20;
+static constexpr uint8_t kFlagV = 0x40;
+static constexpr uint8_t kFlagN = 0x80;
+
+#if MOS6502_JIT_X64
+
+// called by generated code for everything the page tables cannot serve directly
+static void JitCheckLeave(JitContext* ctx)
+{
+    if (*ctx->invalidated or ctx->cpu->m_sliceEnd != ctx->sliceEnd) {
+        ctx->leave = true;
+    }
+}
+
+static uint32_t JitRead(JitContext* ctx, uint32_t addr)
+{
+    uint32_t data = ctx->bus->Read(addr);
+    JitCheckLeave(ctx);
+    return data;
+}
+
+static void JitWrite(JitContext* ctx, uint32_t addr, uint32_t data)
+{
+    ctx->bus->Write(addr, data);
+    JitCheckLeave(ctx);
+}
+
+enum X64Reg
+{
+    RAX,
+    RCX,
+    RDX,
+    RBX,
+    RSP,
+    RBP,
+    RSI,
+    RDI,
+    R8,
+    R9,
+    R10,
+    R11,
+    R12,
+    R13,
+    R14,
+    R15
+};
+
+// register assignment inside a translated block
+static constexpr int kRegA      = R8;   // guest registers, always zero extended bytes
+static constexpr int kRegX      = R9;
+static constexpr int kRegY      = R10;
+static constexpr int kRegSr     = R11;
+static constexpr int kRegCtx    = R12;  // callee saved : survive the helper calls
+static constexpr int kRegWrMap  = R13;
+static constexpr int kRegRdMap  = R14;
+static constexpr int kRegCpu    = R15;
+static constexpr int kRegNz     = RBX;
+static constexpr int kRegCycles = RBP;
+
+static constexpr int32_t kSlotAddr = 0;  // scratch stack slots, see the prologue
+static constexpr int32_t kSlotTemp = 8;
+
+enum X64Cond
+{
+    COND_AE = 0x3,
+    COND_Z  = 0x4,
+    COND_NZ = 0x5,
+};
+
+enum X64AluOp  // /digit of the 0x81/0x83 group, opcode of the reg/reg form is (op << 3) | 1
+{
+    ALU_ADD = 0,
+    ALU_OR  = 1,
+    ALU_AND = 4,
+    ALU_SUB = 5,
+    ALU_XOR = 6,
+    ALU_CMP = 7,
+};
+
+struct X64Mem {
+    int base;
+    int index;  // -1 : none
+    int scale;
+    int32_t disp;
+};
+
+static X64Mem MemAt(int base, int32_t disp) { return {base, -1, 1, disp}; }
+static X64Mem MemIndexed(int base, int index, int scale, int32_t disp)
+{
+    return {base, index, scale, disp};
+}
+
+// just the handful of encodings the translator needs
+class X64Emitter {
+   public:
+    size_t Pos() const { return m_code.size(); }
+    const std::vector<uint8_t>& Code() const { return m_code; }
+
+    void Byte(uint8_t b) { m_code.push_back(b); }
+    void Dword(uint32_t d)
+    {
+        for (int i = 0; i < 4; i++) {
+            Byte((d >> (8 * i)) & 0xff);
+        }
+    }
+    void Qword(uint64_t q)
+    {
+        for (int i = 0; i < 8; i++) {
+            Byte((q >> (8 * i)) & 0xff);
+        }
+    }
+
+    // op reg, rm (register direct)
+    void OpRR(uint8_t op0, int op1, int reg, int rm, bool wide, bool byteRegs = false)
+    {
+        Rex(wide, reg, 0, rm, byteRegs);
+        Byte(op0);
+        if (op1 >= 0) {
+            Byte(op1);
+        }
+        Byte(0xc0 | ((reg & 7) << 3) | (rm & 7));
+    }
+
+    // op reg, [mem]
+    void OpRM(uint8_t op0, int op1, int reg, const X64Mem& m, bool wide, bool byteRegs = false,
+              bool size16 = false)
+    {
+        if (size16) {
+            Byte(0x66);
+        }
+        Rex(wide, reg, (m.index >= 0) ? m.index : 0, m.base, byteRegs);
+        Byte(op0);
+        if (op1 >= 0) {
+            Byte(op1);
+        }
+        int mod = 2;
+        if (m.disp == 0 and (m.base & 7) != RBP) {
+            mod = 0;
+        } else if (m.disp >= -128 and m.disp <= 127) {
+            mod = 1;
+        }
+        if (m.index < 0 and (m.base & 7) != RSP) {
+            Byte((mod << 6) | ((reg & 7) << 3) | (m.base & 7));
+        } else {
+            int scaleBits = (m.scale == 8) ? 3 : (m.scale == 4) ? 2 : (m.scale == 2) ? 1 : 0;
+            int index     = (m.index < 0) ? 4 : (m.index & 7);
+            Byte((mod << 6) | ((reg & 7) << 3) | 4);
+            Byte((scaleBits << 6) | (index << 3) | (m.base & 7));
+        }
+        if (mod == 1) {
+            Byte(m.disp & 0xff);
+        } else if (mod == 2) {
+            Dword(m.disp);
+        }
+    }
+
+    void MovRR(int dst, int src, bool wide = false) { OpRR(0x89, -1, src, dst, wide); }
+    void MovRI(int dst, uint32_t imm)
+    {
+        Rex(false, 0, 0, dst, false);
+        Byte(0xb8 + (dst & 7));
+        Dword(imm);
+    }
+    void MovRI64(int dst, uint64_t imm)
+    {
+        Rex(true, 0, 0, dst, false);
+        Byte(0xb8 + (dst & 7));
+        Qword(imm);
+    }
+    void Load32(int dst, const X64Mem& m) { OpRM(0x8b, -1, dst, m, false); }
+    void Load64(int dst, const X64Mem& m) { OpRM(0x8b, -1, dst, m, true); }
+    void LoadU8(int dst, const X64Mem& m) { OpRM(0x0f, 0xb6, dst, m, false); }
+    void LoadU16(int dst, const X64Mem& m) { OpRM(0x0f, 0xb7, dst, m, false); }
+    void Store8(const X64Mem& m, int src) { OpRM(0x88, -1, src, m, false, true); }
+    void Store16(const X64Mem& m, int src) { OpRM(0x89, -1, src, m, false, false, true); }
+    void Store32(const X64Mem& m, int src) { OpRM(0x89, -1, src, m, false); }
+    void Store64(const X64Mem& m, int src) { OpRM(0x89, -1, src, m, true); }
+    void StoreImm16(const X64Mem& m, uint16_t imm)
+    {
+        OpRM(0xc7, -1, 0, m, false, false, true);
+        Byte(imm & 0xff);
+        Byte(imm >> 8);
+    }
+    void MovzxRR8(int dst, int src) { OpRR(0x0f, 0xb6, dst, src, false, true); }
+
+    void AluRR(X64AluOp op, int dst, int src, bool wide = false)
+    {
+        OpRR((op << 3) | 1, -1, src, dst, wide);
+    }
+    void AluRI(X64AluOp op, int dst, int32_t imm, bool wide = false)
+    {
+        if (imm >= -128 and imm <= 127) {
+            OpRR(0x83, -1, op, dst, wide);
+            Byte(imm & 0xff);
+        } else {
+            OpRR(0x81, -1, op, dst, wide);
+            Dword(imm);
+        }
+    }
+    void AluMI64(X64AluOp op, const X64Mem& m, int32_t imm)
+    {
+        if (imm >= -128 and imm <= 127) {
+            OpRM(0x83, -1, op, m, true);
+            Byte(imm & 0xff);
+        } else {
+            OpRM(0x81, -1, op, m, true);
+            Dword(imm);
+        }
+    }
+    void AluMI8(X64AluOp op, const X64Mem& m, uint8_t imm)
+    {
+        OpRM(0x80, -1, op, m, false);
+        Byte(imm);
+    }
+    void OrRM8(int dst, const X64Mem& m) { OpRM(0x0a, -1, dst, m, false, true); }
+    void OrRM32(int dst, const X64Mem& m) { OpRM(0x0b, -1, dst, m, false); }
+    void TestRR(int a, int b, bool wide = false) { OpRR(0x85, -1, b, a, wide); }
+    void TestRI(int dst, uint32_t imm)
+    {
+        OpRR(0xf7, -1, 0, dst, false);
+        Dword(imm);
+    }
+    void Shl(int dst, uint8_t count)
+    {
+        OpRR(0xc1, -1, 4, dst, false);
+        Byte(count);
+    }
+    void Shr(int dst, uint8_t count)
+    {
+        OpRR(0xc1, -1, 5, dst, false);
+        Byte(count);
+    }
+    void Not(int dst) { OpRR(0xf7, -1, 2, dst, false); }
+    void Setcc(X64Cond cond, int dst) { OpRR(0x0f, 0x90 | cond, 0, dst, false, true); }
+
+    // rel32 jumps : return the position of the displacement, to be filled in later
+    size_t Jcc(X64Cond cond)
+    {
+        Byte(0x0f);
+        Byte(0x80 | cond);
+        Dword(0);
+        return Pos() - 4;
+    }
+    size_t Jmp()
+    {
+        Byte(0xe9);
+        Dword(0);
+        return Pos() - 4;
+    }
+    void CallAbs(const void* fn)
+    {
+        MovRI64(RAX, reinterpret_cast<uint64_t>(fn));
+        OpRR(0xff, -1, 2, RAX, false);
+    }
+    void Push(int reg)
+    {
+        Rex(false, 0, 0, reg, false);
+        Byte(0x50 + (reg & 7));
+    }
+    void Pop(int reg)
+    {
+        Rex(false, 0, 0, reg, false);
+        Byte(0x58 + (reg & 7));
+    }
+    void Ret() { Byte(0xc3); }
+
+   private:
+    void Rex(bool wide, int reg, int index, int base, bool byteRegs)
+    {
+        uint8_t rex = 0x40 | (wide ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((index & 8) ? 2 : 0) |
+                      ((base & 8) ? 1 : 0);
+        if (rex != 0x40 or byteRegs) {
+            Byte(rex);
+        }
+    }
+
+    std::vector<uint8_t> m_code;
+};
+
+// flags read / written by each instruction, for the liveness pass
+static void GetFlagUse(MosT6502::InstrName instrName, uint8_t* reads, uint8_t* writes)
+{
+    *reads  = 0;
+    *writes = 0;
+    switch (instrName) {
+        case (MosT6502::InstrName::LDA):
+        case (MosT6502::InstrName::LDX):
+        case (MosT6502::InstrName::LDY):
+        case (MosT6502::InstrName::TAX):
+        case (MosT6502::InstrName::TAY):
+        case (MosT6502::InstrName::TXA):
+        case (MosT6502::InstrName::TYA):
+        case (MosT6502::InstrName::TSX):
+        case (MosT6502::InstrName::INX):
+        case (MosT6502::InstrName::INY):
+        case (MosT6502::InstrName::DEX):
+        case (MosT6502::InstrName::DEY):
+        case (MosT6502::InstrName::INC):
+        case (MosT6502::InstrName::DEC):
+        case (MosT6502::InstrName::AND):
+        case (MosT6502::InstrName::ORA):
+        case (MosT6502::InstrName::EOR):
+        case (MosT6502::InstrName::PLA): {
+            *writes = kFlagN | kFlagZ;
+            break;
+        }
+        case (MosT6502::InstrName::ADC):
+        case (MosT6502::InstrName::SBC): {
+            *reads  = kFlagC;
+            *writes = kFlagN | kFlagZ | kFlagC | kFlagV;
+            break;
+        }
+        case (MosT6502::InstrName::CMP):
+        case (MosT6502::InstrName::CPX):
+        case (MosT6502::InstrName::CPY):
+        case (MosT6502::InstrName::ASL):
+        case (MosT6502::InstrName::LSR): {
+            *writes = kFlagN | kFlagZ | kFlagC;
+            break;
+        }
+        case (MosT6502::InstrName::PHP): {
+            *reads = kFlagN | kFlagZ | kFlagC | kFlagV;
+            break;
+        }
+        case (MosT6502::InstrName::PLP): {
+            *writes = kFlagN | kFlagZ | kFlagC | kFlagV;
+            break;
+        }
+        case (MosT6502::InstrName::ROL):
+        case (MosT6502::InstrName::ROR): {
+            *reads  = kFlagC;
+            *writes = kFlagN | kFlagZ | kFlagC;
+            break;
+        }
+        case (MosT6502::InstrName::BIT): {
+            *writes = kFlagN | kFlagZ | kFlagV;
+            break;
+        }
+        case (MosT6502::InstrName::BCC):
+        case (MosT6502::InstrName::BCS): {
+            *reads = kFlagC;
+            break;
+        }
+        case (MosT6502::InstrName::BEQ):
+        case (MosT6502::InstrName::BNE): {
+            *reads = kFlagZ;
+            break;
+        }
+        case (MosT6502::InstrName::BMI):
+        case (MosT6502::InstrName::BPL): {
+            *reads = kFlagN;
+            break;
+        }
+        case (MosT6502::InstrName::BVC):
+        case (MosT6502::InstrName::BVS): {
+            *reads = kFlagV;
+            break;
+        }
+        default: {  // the rest either leaves N/Z/C/V alone or sets single bits unconditionally
+            break;
+        }
+    }
+}
+
+// Instructions left to the interpreter : the ones that stop the cpu (BRK), the ones that can
+// unmask a held irq and so have to end the run slice (CLI, PLP, RTI, see
+// MosT6502::SetIrqLine) and the rare JMP (ind).
+static bool IsTranslatable(const MosT6502::OpcodeInfo& info)
+{
+    if (info.addrMode == MosT6502::AddrMode::INDIRECT) {
+        return false;
+    }
+    switch (info.instrName) {
+        case (MosT6502::InstrName::BRK):
+        case (MosT6502::InstrName::CLI):
+        case (MosT6502::InstrName::PLP):
+        case (MosT6502::InstrName::RTI):
+        case (MosT6502::InstrName::XXX): {
+            return false;
+        }
+        default: {
+            return true;
+        }
+    }
+}
+
+class BlockTranslator {
+   public:
+    BlockTranslator(const MosT6502& cpu, const MosT6502::DecodedInstr* instrs, unsigned count)
+        : m_instrs(instrs), m_count(count)
+    {
+        const char* base = reinterpret_cast<const char*>(&cpu);
+        m_offA           = reinterpret_cast<const char*>(&cpu.a) - base;
+        m_offX           = reinterpret_cast<const char*>(&cpu.x) - base;
+        m_offY           = reinterpret_cast<const char*>(&cpu.y) - base;
+        m_offSp          = reinterpret_cast<const char*>(&cpu.sp) - base;
+        m_offPc          = reinterpret_cast<const char*>(&cpu.pc) - base;
+        m_offSr          = reinterpret_cast<const char*>(&cpu.m_sr) - base;
+        m_offNValue      = reinterpret_cast<const char*>(&cpu.m_nValue) - base;
+        m_offZValue      = reinterpret_cast<const char*>(&cpu.m_zValue) - base;
+        m_offCarry       = reinterpret_cast<const char*>(&cpu.m_carry) - base;
+        m_offOverflow    = reinterpret_cast<const char*>(&cpu.m_overflow) - base;
+        m_offCycles      = reinterpret_cast<const char*>(&cpu.cycles) - base;
+        m_offInstr       = reinterpret_cast<const char*>(&cpu.instructions) - base;
+    }
+
+    // hot path then cold (slow paths and exits) in one buffer
+    void Translate(std::vector<uint8_t>* out)
+    {
+        ComputeLiveness();
+        EmitCommonExit();
+        EmitPrologue();
+        for (m_current = 0; m_current < m_count; m_current++) {
+            m_pendingLeave = false;
+            EmitInstr(m_instrs[m_current]);
+            if (m_pendingLeave and m_current + 1 < m_count) {
+                EmitLeaveCheck(&m_hot);
+                JumpHotToCold(COND_NZ);
+                EmitExitStub(NextPc(m_current), m_current + 1);
+            }
+        }
+        if (!EndsWithJump()) {
+            JumpToExit(NextPc(m_count - 1), m_count);
+        }
+
+        *out = m_hot.Code();
+        size_t hotSize = out->size();
+        out->insert(out->end(), m_cold.Code().begin(), m_cold.Code().end());
+        for (const auto& fix : m_fixups) {
+            size_t at     = fix.at + (fix.inCold ? hotSize : 0);
+            size_t target = fix.target + (fix.toCold ? hotSize : 0);
+            uint32_t rel  = (uint32_t)(target - (at + 4));
+            for (int i = 0; i < 4; i++) {
+                (*out)[at + i] = (rel >> (8 * i)) & 0xff;
+            }
+        }
+    }
+
+   private:
+    struct Fixup {
+        bool inCold;
+        size_t at;
+        bool toCold;
+        size_t target;
+    };
+
+    X64Mem Cpu(int32_t offset) const { return MemAt(kRegCpu, offset); }
+
+    uint16_t NextPc(unsigned i) const
+    {
+        return m_instrs[i].pc + MosT6502::GetInstrLength(m_instrs[i].info.addrMode);
+    }
+
+    bool EndsWithJump() const
+    {
+        switch (m_instrs[m_count - 1].info.instrName) {
+            case (MosT6502::InstrName::BCC):
+            case (MosT6502::InstrName::BCS):
+            case (MosT6502::InstrName::BEQ):
+            case (MosT6502::InstrName::BMI):
+            case (MosT6502::InstrName::BNE):
+            case (MosT6502::InstrName::BPL):
+            case (MosT6502::InstrName::BVC):
+            case (MosT6502::InstrName::BVS):
+            case (MosT6502::InstrName::JMP):
+            case (MosT6502::InstrName::JSR):
+            case (MosT6502::InstrName::RTS): {
+                return true;
+            }
+            default: {
+                return false;
+            }
+        }
+    }
+
+    // a flag result is needed when something later in the block reads it before it is
+    // overwritten, or when the block can be left (its end, or a bus access that may hit code
+    // or a device)
+    void ComputeLiveness()
+    {
+        uint8_t live = 0xff;
+        for (unsigned i = m_count; i-- > 0;) {
+            if (MayExitAfter(m_instrs[i])) {
+                live = 0xff;
+            }
+            m_liveOut[i] = live;
+            uint8_t reads, writes;
+            GetFlagUse(m_instrs[i].info.instrName, &reads, &writes);
+            live = (live & ~writes) | reads;
+        }
+    }
+
+    static bool MayExitAfter(const MosT6502::DecodedInstr& instr)
+    {
+        switch (instr.info.instrName) {
+            case (MosT6502::InstrName::PHA):
+            case (MosT6502::InstrName::PHP):
+            case (MosT6502::InstrName::PLA): {
+                return true;
+            }
+            case (MosT6502::InstrName::JMP):
+            case (MosT6502::InstrName::JSR):
+            case (MosT6502::InstrName::RTS): {
+                return false;  // end the block anyway
+            }
+            default: {
+                return instr.info.addrMode != MosT6502::AddrMode::IMPLIED and
+                       instr.info.addrMode != MosT6502::AddrMode::IMMEDIATE and
+                       instr.info.addrMode != MosT6502::AddrMode::RELATIVE;
+            }
+        }
+    }
+
+    bool IsLive(uint8_t flags) const { return (m_liveOut[m_current] & flags) != 0; }
+
+    // jumps between the two halves are patched once both sizes are known
+    void JumpHotToCold(X64Cond cond, bool always = false)
+    {
+        size_t at = always ? m_hot.Jmp() : m_hot.Jcc(cond);
+        m_fixups.push_back({false, at, true, m_cold.Pos()});
+    }
+    void JumpColdToHot(size_t target) { m_fixups.push_back({true, m_cold.Jmp(), false, target}); }
+    void JumpColdToCold(X64Cond cond, size_t target)
+    {
+        m_fixups.push_back({true, m_cold.Jcc(cond), true, target});
+    }
+
+    void EmitPrologue()
+    {
+        m_hot.Push(RBX);
+        m_hot.Push(RBP);
+        m_hot.Push(R12);
+        m_hot.Push(R13);
+        m_hot.Push(R14);
+        m_hot.Push(R15);
+        m_hot.AluRI(ALU_SUB, RSP, 24, true);  // 2 scratch slots, keeps rsp 16 byte aligned
+        m_hot.MovRR(kRegCtx, RDI, true);
+        m_hot.Load64(kRegCpu, MemAt(kRegCtx, offsetof(JitContext, cpu)));
+        m_hot.Load64(kRegRdMap, MemAt(kRegCtx, offsetof(JitContext, readMap)));
+        m_hot.Load64(kRegWrMap, MemAt(kRegCtx, offsetof(JitContext, writeMap)));
+        m_hot.Load64(kRegNz, MemAt(kRegCtx, offsetof(JitContext, nzTable)));
+        m_hot.Load64(kRegCycles, Cpu(m_offCycles));
+        LoadGuestRegs(m_hot);
+    }
+
+    // the cpu keeps N/Z/C/V unpacked (see MosT6502::GetStatus()), the block a packed sr;
+    // both use only ecx as scratch
+    void LoadGuestRegs(X64Emitter& e)
+    {
+        e.LoadU8(kRegA, Cpu(m_offA));
+        e.LoadU8(kRegX, Cpu(m_offX));
+        e.LoadU8(kRegY, Cpu(m_offY));
+        e.LoadU8(kRegSr, Cpu(m_offSr));
+        e.AluRI(ALU_AND, kRegSr, (uint8_t) ~(kFlagN | kFlagZ | kFlagC | kFlagV));
+        e.LoadU8(RCX, Cpu(m_offCarry));
+        e.AluRR(ALU_OR, kRegSr, RCX);
+        e.LoadU8(RCX, Cpu(m_offOverflow));
+        e.Shl(RCX, 6);
+        e.AluRR(ALU_OR, kRegSr, RCX);
+        e.LoadU8(RCX, Cpu(m_offNValue));
+        e.AluRI(ALU_AND, RCX, kFlagN);
+        e.AluRR(ALU_OR, kRegSr, RCX);
+        e.LoadU8(RCX, Cpu(m_offZValue));  // 0 -> 0xffffffff -> bit 1 (Z) set
+        e.AluRI(ALU_SUB, RCX, 1);
+        e.Shr(RCX, 8);
+        e.AluRI(ALU_AND, RCX, kFlagZ);
+        e.AluRR(ALU_OR, kRegSr, RCX);
+    }
+
+    void StoreGuestRegs(X64Emitter& e)
+    {
+        e.Store64(Cpu(m_offCycles), kRegCycles);
+        e.Store8(Cpu(m_offA), kRegA);
+        e.Store8(Cpu(m_offX), kRegX);
+        e.Store8(Cpu(m_offY), kRegY);
+        e.Store8(Cpu(m_offSr), kRegSr);
+        e.Store8(Cpu(m_offNValue), kRegSr);
+        e.MovRR(RCX, kRegSr);
+        e.Not(RCX);
+        e.AluRI(ALU_AND, RCX, kFlagZ);
+        e.Store8(Cpu(m_offZValue), RCX);
+        e.MovRR(RCX, kRegSr);
+        e.AluRI(ALU_AND, RCX, kFlagC);
+        e.Store8(Cpu(m_offCarry), RCX);
+        e.MovRR(RCX, kRegSr);
+        e.Shr(RCX, 6);
+        e.AluRI(ALU_AND, RCX, 1);
+        e.Store8(Cpu(m_offOverflow), RCX);
+    }
+
+    // cold offset 0 : write everything back and return to BlockCache::Run()
+    void EmitCommonExit()
+    {
+        StoreGuestRegs(m_cold);
+        m_cold.AluRI(ALU_ADD, RSP, 24, true);
+        m_cold.Pop(R15);
+        m_cold.Pop(R14);
+        m_cold.Pop(R13);
+        m_cold.Pop(R12);
+        m_cold.Pop(RBP);
+        m_cold.Pop(RBX);
+        m_cold.Ret();
+    }
+
+    // leaves the block with pc and the instruction counter as after 'executed' instructions
+    size_t EmitExitStub(uint16_t pc, unsigned executed)
+    {
+        size_t stub = m_cold.Pos();
+        m_cold.StoreImm16(Cpu(m_offPc), pc);
+        m_cold.AluMI64(ALU_ADD, Cpu(m_offInstr), executed);
+        m_fixups.push_back({true, m_cold.Jmp(), true, 0});
+        return stub;
+    }
+
+    void JumpToExit(uint16_t pc, unsigned executed)
+    {
+        JumpHotToCold(COND_Z, true);
+        EmitExitStub(pc, executed);
+    }
+
+    // flags set when JitContext::leave is
+    void EmitLeaveCheck(X64Emitter* e)
+    {
+        e->AluMI8(ALU_CMP, MemAt(kRegCtx, offsetof(JitContext, leave)), 0);
+    }
+
+    // helper calls see the same cpu state the interpreter has at this point
+    void SyncOut()
+    {
+        StoreGuestRegs(m_cold);
+        m_cold.StoreImm16(Cpu(m_offPc), NextPc(m_current));
+        m_cold.AluMI64(ALU_ADD, Cpu(m_offInstr), m_current + 1);
+    }
+
+    void SyncIn()
+    {
+        m_cold.AluMI64(ALU_SUB, Cpu(m_offInstr), m_current + 1);
+        LoadGuestRegs(m_cold);
+    }
+
+    // eax = byte at the address in edx; keeps edx
+    void EmitRead()
+    {
+        m_hot.MovRR(RCX, RDX);
+        m_hot.Shr(RCX, 8);
+        m_hot.Load64(RCX, MemIndexed(kRegRdMap, RCX, 8, 0));
+        m_hot.TestRR(RCX, RCX, true);
+        JumpHotToCold(COND_Z);
+        m_hot.MovzxRR8(RSI, RDX);
+        m_hot.LoadU8(RAX, MemIndexed(RCX, RSI, 1, 0));
+        size_t back = m_hot.Pos();
+
+        SyncOut();
+        m_cold.Store32(MemAt(RSP, kSlotAddr), RDX);
+        m_cold.MovRR(RDI, kRegCtx, true);
+        m_cold.MovRR(RSI, RDX);
+        m_cold.CallAbs(reinterpret_cast<const void*>(&JitRead));
+        m_cold.MovzxRR8(RAX, RAX);
+        m_cold.Load32(RDX, MemAt(RSP, kSlotAddr));
+        SyncIn();
+        JumpColdToHot(back);
+        m_pendingLeave = true;
+    }
+
+    // eax = byte at a fixed address
+    void EmitReadStatic(uint16_t addr)
+    {
+        m_hot.Load64(RCX, MemAt(kRegRdMap, (addr >> 8) * 8));
+        m_hot.TestRR(RCX, RCX, true);
+        JumpHotToCold(COND_Z);
+        m_hot.LoadU8(RAX, MemAt(RCX, addr & 0xff));
+        size_t back = m_hot.Pos();
+
+        SyncOut();
+        m_cold.MovRR(RDI, kRegCtx, true);
+        m_cold.MovRI(RSI, addr);
+        m_cold.CallAbs(reinterpret_cast<const void*>(&JitRead));
+        m_cold.MovzxRR8(RAX, RAX);
+        SyncIn();
+        JumpColdToHot(back);
+        m_pendingLeave = true;
+    }
+
+    // stores al at the address in edx (or addr when isStatic); checkCode leaves the block
+    // after this instruction when this or an earlier access of it dropped cached code or
+    // ended the slice, so it has to be the last thing the instruction does
+    void EmitWrite(bool isStatic, uint16_t addr, bool checkCode)
+    {
+        if (isStatic) {
+            m_hot.Load64(RCX, MemAt(kRegWrMap, (addr >> 8) * 8));
+            m_hot.TestRR(RCX, RCX, true);
+            JumpHotToCold(COND_Z);
+            m_hot.Store8(MemAt(RCX, addr & 0xff), RAX);
+        } else {
+            m_hot.MovRR(RCX, RDX);
+            m_hot.Shr(RCX, 8);
+            m_hot.Load64(RCX, MemIndexed(kRegWrMap, RCX, 8, 0));
+            m_hot.TestRR(RCX, RCX, true);
+            JumpHotToCold(COND_Z);
+            m_hot.MovzxRR8(RSI, RDX);
+            m_hot.Store8(MemIndexed(RCX, RSI, 1, 0), RAX);
+        }
+        size_t back = m_hot.Pos();
+
+        SyncOut();
+        m_cold.MovRR(RDI, kRegCtx, true);
+        if (isStatic) {
+            m_cold.MovRI(RSI, addr);
+        } else {
+            m_cold.MovRR(RSI, RDX);
+        }
+        m_cold.MovRR(RDX, RAX);
+        m_cold.CallAbs(reinterpret_cast<const void*>(&JitWrite));
+        SyncIn();
+        if (checkCode) {
+            EmitLeaveCheck(&m_cold);
+            JumpColdToCold(COND_NZ, m_cold.Pos() + 6 + 5);  // over the jcc and the jmp back
+            JumpColdToHot(back);
+            EmitExitStub(NextPc(m_current), m_current + 1);
+            m_pendingLeave = false;  // reads before the store are covered by the check above
+        } else {
+            JumpColdToHot(back);
+        }
+    }
+
+    // +1 cycle when the page of the address in edx differs from the one in 'other'
+    void EmitPagePenalty(int other)
+    {
+        m_hot.MovRR(RCX, RDX);
+        m_hot.AluRR(ALU_XOR, RCX, other);
+        m_hot.Shr(RCX, 8);
+        m_hot.AluRI(ALU_ADD, RCX, 0xff);
+        m_hot.Shr(RCX, 8);
+        m_hot.AluRR(ALU_ADD, kRegCycles, RCX, true);
+    }
+
+    // effective address of a memory operand in edx, or *isStatic and *addr for fixed ones
+    void EmitAddress(const MosT6502::DecodedInstr& instr, bool* isStatic, uint16_t* addr)
+    {
+        bool penalty = instr.info.flags & MosT6502::OPCODE_PAGE_PENALTY;
+        *isStatic    = false;
+        switch (instr.info.addrMode) {
+            case (MosT6502::AddrMode::ZERO_PAGE): {
+                *isStatic = true;
+                *addr     = instr.operand & 0x00ff;
+                break;
+            }
+            case (MosT6502::AddrMode::ABSOLUTE): {
+                *isStatic = true;
+                *addr     = instr.operand;
+                break;
+            }
+            case (MosT6502::AddrMode::ZERO_PAGE_X):
+            case (MosT6502::AddrMode::ZERO_PAGE_Y): {
+                int index = (instr.info.addrMode == MosT6502::AddrMode::ZERO_PAGE_X) ? kRegX : kRegY;
+                m_hot.MovRI(RDX, instr.operand & 0x00ff);
+                m_hot.AluRR(ALU_ADD, RDX, index);
+                m_hot.AluRI(ALU_AND, RDX, 0x00ff);
+                break;
+            }
+            case (MosT6502::AddrMode::ABSOLUTE_X):
+            case (MosT6502::AddrMode::ABSOLUTE_Y): {
+                int index = (instr.info.addrMode == MosT6502::AddrMode::ABSOLUTE_X) ? kRegX : kRegY;
+                m_hot.MovRI(RDX, instr.operand);
+                m_hot.AluRR(ALU_ADD, RDX, index);
+                m_hot.AluRI(ALU_AND, RDX, 0xffff);
+                if (penalty) {
+                    m_hot.MovRI(RAX, instr.operand);
+                    EmitPagePenalty(RAX);
+                }
+                break;
+            }
+            case (MosT6502::AddrMode::INDIRECT_X): {  // the pointer wraps inside the zero page
+                m_hot.MovRI(RDX, instr.operand & 0x00ff);
+                m_hot.AluRR(ALU_ADD, RDX, kRegX);
+                m_hot.AluRI(ALU_AND, RDX, 0x00ff);
+                EmitRead();
+                m_hot.Store32(MemAt(RSP, kSlotTemp), RAX);
+                m_hot.AluRI(ALU_ADD, RDX, 1);
+                m_hot.AluRI(ALU_AND, RDX, 0x00ff);
+                EmitRead();
+                m_hot.Shl(RAX, 8);
+                m_hot.OrRM32(RAX, MemAt(RSP, kSlotTemp));
+                m_hot.MovRR(RDX, RAX);
+                break;
+            }
+            case (MosT6502::AddrMode::INDIRECT_Y): {
+                uint16_t ptr = instr.operand & 0x00ff;
+                EmitReadStatic(ptr);
+                m_hot.Store32(MemAt(RSP, kSlotTemp), RAX);
+                EmitReadStatic((ptr + 1) & 0x00ff);
+                m_hot.Shl(RAX, 8);
+                m_hot.OrRM32(RAX, MemAt(RSP, kSlotTemp));
+                m_hot.MovRR(RDX, RAX);
+                m_hot.AluRR(ALU_ADD, RDX, kRegY);
+                m_hot.AluRI(ALU_AND, RDX, 0xffff);
+                if (penalty) {
+                    EmitPagePenalty(RAX);
+                }
+                break;
+            }
+            default: {
+                break;
+            }
+        }
+    }
+
+    // eax = operand value, edx = its address when it has one
+    void EmitLoadOperand(const MosT6502::DecodedInstr& instr, bool* isStatic, uint16_t* addr)
+    {
+        *isStatic = false;
+        if (instr.info.addrMode == MosT6502::AddrMode::IMMEDIATE) {
+            m_hot.MovRI(RAX, instr.operand & 0x00ff);
+        } else if (instr.info.addrMode == MosT6502::AddrMode::IMPLIED) {
+            m_hot.MovRR(RAX, kRegA);
+        } else {
+            EmitAddress(instr, isStatic, addr);
+            if (*isStatic) {
+                EmitReadStatic(*addr);
+            } else {
+                EmitRead();
+            }
+        }
+    }
+
+    void EmitNz(int reg)
+    {
+        if (IsLive(kFlagN | kFlagZ)) {
+            m_hot.AluRI(ALU_AND, kRegSr, (uint8_t) ~(kFlagN | kFlagZ));
+            m_hot.OrRM8(kRegSr, MemIndexed(kRegNz, reg, 1, 0));
+        }
+    }
+
+    // C = bit 8 of reg, then reg is cut down to a byte
+    void EmitCarryFromBit8(int reg)
+    {
+        if (IsLive(kFlagC)) {
+            m_hot.AluRI(ALU_AND, kRegSr, (uint8_t)~kFlagC);
+            m_hot.MovRR(RCX, reg);
+            m_hot.Shr(RCX, 8);
+            m_hot.AluRR(ALU_OR, kRegSr, RCX);
+        }
+        m_hot.MovzxRR8(reg, reg);
+    }
+
+    void EmitLoadRegister(const MosT6502::DecodedInstr& instr, int reg)
+    {
+        bool isStatic;
+        uint16_t addr;
+        EmitLoadOperand(instr, &isStatic, &addr);
+        m_hot.MovRR(reg, RAX);
+        EmitNz(reg);
+    }
+
+    void EmitStoreRegister(const MosT6502::DecodedInstr& instr, int reg)
+    {
+        bool isStatic;
+        uint16_t addr;
+        EmitAddress(instr, &isStatic, &addr);
+        m_hot.MovRR(RAX, reg);
+        EmitWrite(isStatic, addr, true);
+    }
+
+    // a = a + eax + C, SBC inverts the operand first; D set takes the cold path, one load from
+    // MosT6502::kDecimalTable for the result and N/V/Z/C
+    void EmitAddWithCarry(bool subtract)
+    {
+        const uint16_t* table = &MosT6502::kDecimalTable.entries[subtract][0][0][0];
+        m_hot.TestRI(kRegSr, kFlagD);
+        JumpHotToCold(COND_NZ);
+        m_cold.MovRR(RCX, kRegSr);
+        m_cold.AluRI(ALU_AND, RCX, kFlagC);
+        m_cold.Shl(RCX, 16);
+        m_cold.MovRR(RSI, kRegA);
+        m_cold.Shl(RSI, 8);
+        m_cold.AluRR(ALU_OR, RCX, RSI);
+        m_cold.AluRR(ALU_OR, RCX, RAX);  // ecx = c << 16 | a << 8 | m
+        m_cold.MovRI64(RDX, reinterpret_cast<uint64_t>(table));
+        m_cold.LoadU16(RCX, MemIndexed(RDX, RCX, 2, 0));
+        m_cold.MovzxRR8(kRegA, RCX);
+        m_cold.Shr(RCX, 8);
+        m_cold.AluRI(ALU_AND, kRegSr, (uint8_t) ~(kFlagN | kFlagZ | kFlagC | kFlagV));
+        m_cold.AluRR(ALU_OR, kRegSr, RCX);
+        size_t back = m_fixups.size();
+        JumpColdToHot(0);  // patched below, once the binary path is emitted
+
+        if (subtract) {
+            m_hot.AluRI(ALU_XOR, RAX, 0xff);
+        }
+        m_hot.MovRR(RCX, kRegSr);
+        m_hot.AluRI(ALU_AND, RCX, kFlagC);
+        m_hot.MovRR(RSI, kRegA);
+        m_hot.AluRR(ALU_ADD, RSI, RAX);
+        m_hot.AluRR(ALU_ADD, RSI, RCX);  // esi = a + m + c, 9 bits
+        if (IsLive(kFlagV)) {            // (~(a ^ m) & (a ^ r)) & 0x80
+            m_hot.MovRR(RCX, kRegA);
+            m_hot.AluRR(ALU_XOR, RCX, RAX);
+            m_hot.Not(RCX);
+            m_hot.MovRR(RDX, kRegA);
+            m_hot.AluRR(ALU_XOR, RDX, RSI);
+            m_hot.AluRR(ALU_AND, RCX, RDX);
+            m_hot.AluRI(ALU_AND, RCX, 0x80);
+            m_hot.Shr(RCX, 1);
+            m_hot.AluRI(ALU_AND, kRegSr, (uint8_t)~kFlagV);
+            m_hot.AluRR(ALU_OR, kRegSr, RCX);
+        }
+        EmitCarryFromBit8(RSI);
+        m_hot.MovRR(kRegA, RSI);
+        EmitNz(kRegA);
+        m_fixups[back].target = m_hot.Pos();
+    }
+
+    // CMP/CPX/CPY : C = reg >= m, N/Z from reg - m
+    void EmitCompare(const MosT6502::DecodedInstr& instr, int reg)
+    {
+        bool isStatic;
+        uint16_t addr;
+        EmitLoadOperand(instr, &isStatic, &addr);
+        if (IsLive(kFlagC)) {
+            m_hot.AluRI(ALU_AND, kRegSr, (uint8_t)~kFlagC);
+            m_hot.AluRR(ALU_CMP, reg, RAX);
+            m_hot.Setcc(COND_AE, RCX);
+            m_hot.MovzxRR8(RCX, RCX);
+            m_hot.AluRR(ALU_OR, kRegSr, RCX);
+        }
+        m_hot.MovRR(RCX, reg);
+        m_hot.AluRR(ALU_SUB, RCX, RAX);
+        m_hot.MovzxRR8(RCX, RCX);
+        EmitNz(RCX);
+    }
+
+    void EmitTransfer(int dst, int src)
+    {
+        m_hot.MovRR(dst, src);
+        EmitNz(dst);
+    }
+
+    void EmitIncrement(int reg, int32_t delta)
+    {
+        m_hot.AluRI(ALU_ADD, reg, delta);
+        m_hot.MovzxRR8(reg, reg);
+        EmitNz(reg);
+    }
+
+    // ASL/LSR/ROL/ROR/INC/DEC : op turns eax into the new value and sets the flags
+    template <typename Op>
+    void EmitReadModifyWrite(const MosT6502::DecodedInstr& instr, Op op)
+    {
+        bool isStatic;
+        uint16_t addr;
+        EmitLoadOperand(instr, &isStatic, &addr);
+        op();
+        if (instr.info.addrMode == MosT6502::AddrMode::IMPLIED) {
+            m_hot.MovRR(kRegA, RAX);
+        } else {
+            EmitWrite(isStatic, addr, true);
+        }
+    }
+
+    // edx = 0x0100 | sp before the push, sp -= 1
+    void EmitPushAddress()
+    {
+        m_hot.LoadU8(RDX, Cpu(m_offSp));
+        m_hot.AluRI(ALU_OR, RDX, 0x0100);
+        m_hot.AluMI8(ALU_SUB, Cpu(m_offSp), 1);
+    }
+
+    // sp += 1, edx = 0x0100 | sp
+    void EmitPullAddress()
+    {
+        m_hot.AluMI8(ALU_ADD, Cpu(m_offSp), 1);
+        m_hot.LoadU8(RDX, Cpu(m_offSp));
+        m_hot.AluRI(ALU_OR, RDX, 0x0100);
+    }
+
+    void EmitBranch(const MosT6502::DecodedInstr& instr, uint8_t flag, bool expected)
+    {
+        uint16_t next   = NextPc(m_current);
+        uint16_t target = next + (int8_t)(instr.operand & 0xff);
+        m_hot.TestRI(kRegSr, flag);
+        JumpHotToCold(expected ? COND_NZ : COND_Z);
+        m_cold.AluRI(ALU_ADD, kRegCycles, ((target & 0xff00) != (next & 0xff00)) ? 2 : 1, true);
+        EmitExitStub(target, m_current + 1);
+        JumpToExit(next, m_current + 1);
+    }
+
+    void EmitInstr(const MosT6502::DecodedInstr& instr)
+    {
+        m_hot.AluRI(ALU_ADD, kRegCycles, instr.info.cycles, true);
+        switch (instr.info.instrName) {
+            case (MosT6502::InstrName::LDA): {
+                EmitLoadRegister(instr, kRegA);
+                break;
+            }
+            case (MosT6502::InstrName::LDX): {
+                EmitLoadRegister(instr, kRegX);
+                break;
+            }
+            case (MosT6502::InstrName::LDY): {
+                EmitLoadRegister(instr, kRegY);
+                break;
+            }
+            case (MosT6502::InstrName::STA): {
+                EmitStoreRegister(instr, kRegA);
+                break;
+            }
+            case (MosT6502::InstrName::STX): {
+                EmitStoreRegister(instr, kRegX);
+                break;
+            }
+            case (MosT6502::InstrName::STY): {
+                EmitStoreRegister(instr, kRegY);
+                break;
+            }
+            case (MosT6502::InstrName::TAX): {
+                EmitTransfer(kRegX, kRegA);
+                break;
+            }
+            case (MosT6502::InstrName::TAY): {
+                EmitTransfer(kRegY, kRegA);
+                break;
+            }
+            case (MosT6502::InstrName::TXA): {
+                EmitTransfer(kRegA, kRegX);
+                break;
+            }
+            case (MosT6502::InstrName::TYA): {
+                EmitTransfer(kRegA, kRegY);
+                break;
+            }
+            case (MosT6502::InstrName::TSX): {
+                m_hot.LoadU8(kRegX, Cpu(m_offSp));
+                EmitNz(kRegX);
+                break;
+            }
+            case (MosT6502::InstrName::TXS): {
+                m_hot.Store8(Cpu(m_offSp), kRegX);
+                break;
+            }
+            case (MosT6502::InstrName::INX): {
+                EmitIncrement(kRegX, 1);
+                break;
+            }
+            case (MosT6502::InstrName::INY): {
+                EmitIncrement(kRegY, 1);
+                break;
+            }
+            case (MosT6502::InstrName::DEX): {
+                EmitIncrement(kRegX, -1);
+                break;
+            }
+            case (MosT6502::InstrName::DEY): {
+                EmitIncrement(kRegY, -1);
+                break;
+            }
+            case (MosT6502::InstrName::AND):
+            case (MosT6502::InstrName::ORA):
+            case (MosT6502::InstrName::EOR): {
+                bool isStatic;
+                uint16_t addr;
+                EmitLoadOperand(instr, &isStatic, &addr);
+                X64AluOp op = (instr.info.instrName == MosT6502::InstrName::AND)   ? ALU_AND
+                              : (instr.info.instrName == MosT6502::InstrName::ORA) ? ALU_OR
+                                                                                   : ALU_XOR;
+                m_hot.AluRR(op, kRegA, RAX);
+                EmitNz(kRegA);
+                break;
+            }
+            case (MosT6502::InstrName::ADC):
+            case (MosT6502::InstrName::SBC): {
+                bool isStatic;
+                uint16_t addr;
+                EmitLoadOperand(instr, &isStatic, &addr);
+                EmitAddWithCarry(instr.info.instrName == MosT6502::InstrName::SBC);
+                break;
+            }
+            case (MosT6502::InstrName::CMP): {
+                EmitCompare(instr, kRegA);
+                break;
+            }
+            case (MosT6502::InstrName::CPX): {
+                EmitCompare(instr, kRegX);
+                break;
+            }
+            case (MosT6502::InstrName::CPY): {
+                EmitCompare(instr, kRegY);
+                break;
+            }
+            case (MosT6502::InstrName::BIT): {
+                bool isStatic;
+                uint16_t addr;
+                EmitLoadOperand(instr, &isStatic, &addr);
+                m_hot.AluRI(ALU_AND, kRegSr, (uint8_t) ~(kFlagN | kFlagV | kFlagZ));
+                m_hot.MovRR(RCX, RAX);
+                m_hot.AluRI(ALU_AND, RCX, kFlagN | kFlagV);
+                m_hot.AluRR(ALU_OR, kRegSr, RCX);
+                m_hot.TestRR(RAX, kRegA);
+                m_hot.Setcc(COND_Z, RCX);
+                m_hot.MovzxRR8(RCX, RCX);
+                m_hot.AluRR(ALU_ADD, RCX, RCX);  // Z is bit 1
+                m_hot.AluRR(ALU_OR, kRegSr, RCX);
+                break;
+            }
+            case (MosT6502::InstrName::ASL): {
+                EmitReadModifyWrite(instr, [this]() {
+                    m_hot.Shl(RAX, 1);
+                    EmitCarryFromBit8(RAX);
+                    EmitNz(RAX);
+                });
+                break;
+            }
+            case (MosT6502::InstrName::LSR): {
+                EmitReadModifyWrite(instr, [this]() {
+                    if (IsLive(kFlagC)) {
+                        m_hot.AluRI(ALU_AND, kRegSr, (uint8_t)~kFlagC);
+                        m_hot.MovRR(RCX, RAX);
+                        m_hot.AluRI(ALU_AND, RCX, kFlagC);
+                        m_hot.AluRR(ALU_OR, kRegSr, RCX);
+                    }
+                    m_hot.Shr(RAX, 1);
+                    EmitNz(RAX);
+                });
+                break;
+            }
+            case (MosT6502::InstrName::ROL): {
+                EmitReadModifyWrite(instr, [this]() {
+                    m_hot.MovRR(RCX, kRegSr);
+                    m_hot.AluRI(ALU_AND, RCX, kFlagC);
+                    m_hot.Shl(RAX, 1);
+                    m_hot.AluRR(ALU_OR, RAX, RCX);
+                    EmitCarryFromBit8(RAX);
+                    EmitNz(RAX);
+                });
+                break;
+            }
+            case (MosT6502::InstrName::ROR): {
+                EmitReadModifyWrite(instr, [this]() {
+                    m_hot.MovRR(RSI, kRegSr);
+                    m_hot.AluRI(ALU_AND, RSI, kFlagC);
+                    m_hot.Shl(RSI, 7);
+                    if (IsLive(kFlagC)) {
+                        m_hot.AluRI(ALU_AND, kRegSr, (uint8_t)~kFlagC);
+                        m_hot.MovRR(RCX, RAX);
+                        m_hot.AluRI(ALU_AND, RCX, kFlagC);
+                        m_hot.AluRR(ALU_OR, kRegSr, RCX);
+                    }
+                    m_hot.Shr(RAX, 1);
+                    m_hot.AluRR(ALU_OR, RAX, RSI);
+                    EmitNz(RAX);
+                });
+                break;
+            }
+            case (MosT6502::InstrName::INC):
+            case (MosT6502::InstrName::DEC): {
+                int32_t delta = (instr.info.instrName == MosT6502::InstrName::INC) ? 1 : -1;
+                EmitReadModifyWrite(instr, [this, delta]() {
+                    m_hot.AluRI(ALU_ADD, RAX, delta);
+                    m_hot.MovzxRR8(RAX, RAX);
+                    EmitNz(RAX);
+                });
+                break;
+            }
+            case (MosT6502::InstrName::CLC): {
+                m_hot.AluRI(ALU_AND, kRegSr, (uint8_t)~kFlagC);
+                break;
+            }
+            case (MosT6502::InstrName::SEC): {
+                m_hot.AluRI(ALU_OR, kRegSr, kFlagC);
+                break;
+            }
+            case (MosT6502::InstrName::CLV): {
+                m_hot.AluRI(ALU_AND, kRegSr, (uint8_t)~kFlagV);
+                break;
+            }
+            case (MosT6502::InstrName::CLD): {
+                m_hot.AluRI(ALU_AND, kRegSr, (uint8_t)~kFlagD);
+                break;
+            }
+            case (MosT6502::InstrName::SED): {
+                m_hot.AluRI(ALU_OR, kRegSr, kFlagD);
+                break;
+            }
+            case (MosT6502::InstrName::SEI): {
+                m_hot.AluRI(ALU_OR, kRegSr, kFlagI);
+                break;
+            }
+            case (MosT6502::InstrName::NOP): {
+                break;
+            }
+            case (MosT6502::InstrName::PHA): {
+                EmitPushAddress();
+                m_hot.MovRR(RAX, kRegA);
+                EmitWrite(false, 0, true);
+                break;
+            }
+            case (MosT6502::InstrName::PHP): {
+                EmitPushAddress();
+                m_hot.MovRR(RAX, kRegSr);
+                m_hot.AluRI(ALU_OR, RAX, kFlagB | kFlagU);
+                EmitWrite(false, 0, true);
+                break;
+            }
+            case (MosT6502::InstrName::PLA): {
+                EmitPullAddress();
+                EmitRead();
+                m_hot.MovRR(kRegA, RAX);
+                EmitNz(kRegA);
+                break;
+            }
+            case (MosT6502::InstrName::BCC): {
+                EmitBranch(instr, kFlagC, false);
+                break;
+            }
+            case (MosT6502::InstrName::BCS): {
+                EmitBranch(instr, kFlagC, true);
+                break;
+            }
+            case (MosT6502::InstrName::BEQ): {
+                EmitBranch(instr, kFlagZ, true);
+                break;
+            }
+            case (MosT6502::InstrName::BNE): {
+                EmitBranch(instr, kFlagZ, false);
+                break;
+            }
+            case (MosT6502::InstrName::BMI): {
+                EmitBranch(instr, kFlagN, true);
+                break;
+            }
+            case (MosT6502::InstrName::BPL): {
+                EmitBranch(instr, kFlagN, false);
+                break;
+            }
+            case (MosT6502::InstrName::BVC): {
+                EmitBranch(instr, kFlagV, false);
+                break;
+            }
+            case (MosT6502::InstrName::BVS): {
+                EmitBranch(instr, kFlagV, true);
+                break;
+            }
+            case (MosT6502::InstrName::JMP): {
+                JumpToExit(instr.operand, m_current + 1);
+                break;
+            }
+            case (MosT6502::InstrName::JSR): {  // pushes the address of its own last byte
+                uint16_t ret = NextPc(m_current) - 1;
+                EmitPushAddress();
+                m_hot.MovRI(RAX, ret >> 8);
+                EmitWrite(false, 0, false);
+                EmitPushAddress();
+                m_hot.MovRI(RAX, ret & 0xff);
+                EmitWrite(false, 0, false);
+                JumpToExit(instr.operand, m_current + 1);
+                break;
+            }
+            case (MosT6502::InstrName::RTS): {
+                EmitPullAddress();
+                EmitRead();
+                m_hot.Store32(MemAt(RSP, kSlotTemp), RAX);
+                EmitPullAddress();
+                EmitRead();
+                m_hot.Shl(RAX, 8);
+                m_hot.OrRM32(RAX, MemAt(RSP, kSlotTemp));
+                m_hot.AluRI(ALU_ADD, RAX, 1);
+                m_hot.Store16(Cpu(m_offPc), RAX);
+                m_hot.AluMI64(ALU_ADD, Cpu(m_offInstr), m_current + 1);
+                m_fixups.push_back({false, m_hot.Jmp(), true, 0});
+                break;
+            }
+            default: {  // filtered out by IsTranslatable()
+                break;
+            }
+        }
+    }
+
+    const MosT6502::DecodedInstr* m_instrs;
+    unsigned m_count;
+    unsigned m_current = 0;
+    bool m_pendingLeave = false;  // m_current read through the bus and has not checked leave
+    uint8_t m_liveOut[64];
+
+    int32_t m_offA, m_offX, m_offY, m_offSp, m_offPc, m_offSr, m_offCycles, m_offInstr;
+    int32_t m_offNValue, m_offZValue, m_offCarry, m_offOverflow;
+
+    X64Emitter m_hot;
+    X64Emitter m_cold;
+    std::vector<Fixup> m_fixups;
+};
+
+// W^X : the buffer is executable except for the pages a block is being copied to, and those
+// are not executable meanwhile
+BlockJit::BlockJit()
+{
+    void* code = mmap(nullptr, kJitCodeBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                      -1, 0);
+    if (code == MAP_FAILED) {
+        return;  // stays unavailable, every block is interpreted
+    }
+    m_code = static_cast<uint8_t*>(code);
+    m_size = kJitCodeBytes;
+    for (unsigned v = 0; v < 256; v++) {
+        m_code[v] = ((v == 0) ? kFlagZ : 0) | (v & kFlagN);
+    }
+    if (!Protect(0, m_size, PROT_READ | PROT_EXEC)) {  // no exec mappings on this kernel
+        munmap(m_code, m_size);
+        m_code = nullptr;
+        m_size = 0;
+        return;
+    }
+    Reset();
+}
+
+BlockJit::~BlockJit()
+{
+    if (m_code) {
+        munmap(m_code, m_size);
+    }
+}
+
+BlockJit::NativeBlock BlockJit::Compile(const MosT6502& cpu, const MosT6502::DecodedInstr* instrs,
+                                        unsigned count, unsigned* translated,
+                                        uint32_t* leadCycles)
+{
+    *translated = 0;
+    if (!m_code) {
+        return nullptr;
+    }
+
+    unsigned prefix = 0;
+    while (prefix < count and IsTranslatable(instrs[prefix].info)) {
+        prefix++;
+    }
+    if (prefix == 0) {
+        return nullptr;
+    }
+
+    std::vector<uint8_t> code;
+    BlockTranslator(cpu, instrs, prefix).Translate(&code);
+
+    size_t start = (m_used + 15) & ~(size_t)15;
+    if (start + code.size() > m_size) {
+        m_full = true;
+        return nullptr;
+    }
+    if (!Protect(start, start + code.size(), PROT_READ | PROT_WRITE)) {
+        return nullptr;
+    }
+    memcpy(m_code + start, code.data(), code.size());
+    if (!Protect(start, start + code.size(), PROT_READ | PROT_EXEC)) {
+        m_full = true;  // blocks sharing these pages cannot run : drop them all, see Reset()
+        return nullptr;
+    }
+    m_used = start + code.size();
+
+    *leadCycles = 0;
+    for (unsigned i = 0; i + 1 < prefix; i++) {
+        bool penalty = instrs[i].info.flags & MosT6502::OPCODE_PAGE_PENALTY;
+        *leadCycles += instrs[i].info.cycles + (penalty ? 1 : 0);
+    }
+    *translated = prefix;
+    return reinterpret_cast<NativeBlock>(m_code + start);
+}
+
+void BlockJit::Reset()
+{
+    m_used = kNzTableBytes;
+    m_full = false;
+}
+
+// [begin, end) widened to whole pages; m_code is page aligned
+bool BlockJit::Protect(size_t begin, size_t end, int prot)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    begin       = begin & ~(page - 1);
+    end         = std::min(m_size, (end + page - 1) & ~(page - 1));
+    return mprotect(m_code + begin, end - begin, prot) == 0;
+}
+
+#else  // no code generator for this host
+
+BlockJit::BlockJit() {}
+BlockJit::~BlockJit() {}
+
+BlockJit::NativeBlock BlockJit::Compile(const MosT6502&, const MosT6502::DecodedInstr*, unsigned,
+                                        unsigned* translated, uint32_t*)
+{
+    *translated = 0;
+    return nullptr;
+}
+
+void BlockJit::Reset() { m_full = false; }
+
+#endif
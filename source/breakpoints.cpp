@@ -0,0 +1,138 @@
+#include "../include/breakpoints.h"
+
+#include "../include/bus.h"
+
+Breakpoints::~Breakpoints()
+{
+    if (m_bus) {
+        m_bus->SetBreakpoints(nullptr);
+    }
+}
+
+bool Breakpoints::Change(uint64_t* bits, uint16_t addr, bool set)
+{
+    uint64_t mask = (uint64_t)1 << (addr & 63);
+    if (((bits[addr >> 6] & mask) != 0) == set) {
+        return false;
+    }
+    bits[addr >> 6] ^= mask;
+    return true;
+}
+
+void Breakpoints::AddBreakpoint(uint16_t addr)
+{
+    if (Change(m_exec, addr, true)) {
+        m_execPages[addr >> 8] += 1;
+        if (m_bus) {
+            m_bus->RefreshPage(addr >> 8);  // cached blocks running over addr are cut there
+        }
+    }
+}
+
+void Breakpoints::RemoveBreakpoint(uint16_t addr)
+{
+    if (Change(m_exec, addr, false)) {
+        m_execPages[addr >> 8] -= 1;
+        if (m_bus) {
+            m_bus->RefreshPage(addr >> 8);
+        }
+    }
+}
+
+void Breakpoints::AddWatchpoint(uint16_t first, uint16_t last, Access access, uint8_t value,
+                                uint8_t mask)
+{
+    ChangeWatch(first, last, access, true);
+    for (uint32_t addr = first; addr <= last; addr++) {
+        for (uint32_t write = 0; write < 2; write++) {
+            if (!(access & (write ? WATCH_WRITE : WATCH_READ))) {
+                continue;
+            }
+            if (mask != 0x00) {
+                m_conditions[write << 16 | addr] = {(uint8_t)(value & mask), mask};
+            } else {
+                m_conditions.erase(write << 16 | addr);
+            }
+        }
+    }
+}
+
+void Breakpoints::RemoveWatchpoint(uint16_t first, uint16_t last, Access access)
+{
+    ChangeWatch(first, last, access, false);
+    for (uint32_t addr = first; addr <= last and !m_conditions.empty(); addr++) {
+        if (access & WATCH_READ) {
+            m_conditions.erase(addr);
+        }
+        if (access & WATCH_WRITE) {
+            m_conditions.erase(1 << 16 | addr);
+        }
+    }
+}
+
+void Breakpoints::ChangeWatch(uint16_t first, uint16_t last, Access access, bool set)
+{
+    for (uint32_t addr = first; addr <= last; addr++) {
+        uint8_t page = addr >> 8;
+        if ((access & WATCH_READ) and Change(m_read, addr, set)) {
+            m_readPages[page] += (set) ? 1 : -1;
+            m_watchCount += (set) ? 1 : -1;
+        }
+        if ((access & WATCH_WRITE) and Change(m_write, addr, set)) {
+            m_writePages[page] += (set) ? 1 : -1;
+            m_watchCount += (set) ? 1 : -1;
+        }
+        if (m_bus and (addr == last or (addr & 0xff) == 0xff)) {
+            m_bus->RefreshPage(page);
+        }
+    }
+}
+
+void Breakpoints::Clear()
+{
+    for (unsigned page = 0; page < 256; page++) {
+        if (m_execPages[page] or m_readPages[page] or m_writePages[page]) {
+            m_execPages[page]  = 0;
+            m_readPages[page]  = 0;
+            m_writePages[page] = 0;
+            if (m_bus) {
+                m_bus->RefreshPage(page);
+            }
+        }
+    }
+    for (unsigned i = 0; i < 1024; i++) {
+        m_exec[i]  = 0;
+        m_read[i]  = 0;
+        m_write[i] = 0;
+    }
+    m_watchCount = 0;
+    m_conditions.clear();
+    ClearHit();
+}
+
+bool Breakpoints::HitExecute(const MosT6502& cpu)
+{
+    if (cpu.pc == m_resumePc and cpu.instructions == m_resumeInstructions) {
+        return false;  // stopped here already, this time it runs
+    }
+    m_resumePc           = cpu.pc;
+    m_resumeInstructions = cpu.instructions;
+    if (m_hit.kind == HIT_NONE) {
+        m_hit = {HIT_EXECUTE, cpu.pc, 0x00, cpu.pc, cpu.cycles};
+    }
+    return true;
+}
+
+void Breakpoints::HitAccess(MosT6502& cpu, HitKind kind, uint16_t addr, uint8_t data)
+{
+    if (!m_conditions.empty()) {
+        auto it = m_conditions.find((uint32_t)(kind == HIT_WRITE) << 16 | addr);
+        if (it != m_conditions.end() and (data & it->second.mask) != it->second.value) {
+            return;
+        }
+    }
+    if (m_hit.kind == HIT_NONE) {
+        m_hit = {kind, addr, data, cpu.pc, cpu.cycles};
+    }
+    cpu.EndSlice(cpu.cycles);  // the core stops after this instruction
+}
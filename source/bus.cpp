@@ -1,41 +1,416 @@
 #include "../include/bus.h"
 
+#include <cstring>
+
+#include "../include/breakpoints.h"
+
+Bus::Bus() : ram(new std::array<uint8_t, 64 * 1024>) { MapAllRamPages(); }
+
+Bus::~Bus()
+{
+    if (m_breakpoints) {
+        m_breakpoints->m_bus = nullptr;
+    }
+}
+
 void Bus::Initialize()
 {
-    for (int i = 0; i < ram.size(); i++) {
-        ram[i] = 0x00;
+    ReleaseAllCodePages();
+    if (m_paged) {
+        m_paged->Revert();
+    } else {
+        ram->fill(0x00);
+    }
+    for (unsigned page = 0; page < 256; page++) {
+        m_dirty[page] = false;
     }
+    if (m_baseline) {
+        TouchAllPages();  // zeroes are not the baseline
+    } else {
+        ForgetTouchedPages();
+    }
+    MapAllRamPages();
     mp.ConnectBus(this);
 }
 
-void Bus::Write(uint16_t addr, uint8_t data)
+void Bus::SetBaseline(std::shared_ptr<const PagedMemory::Image> baseline)
+{
+    UseFlatMemory();
+    m_baseline = std::move(baseline);
+    TouchAllPages();
+    RevertToBaseline();
+}
+
+void Bus::RevertToBaseline()
+{
+    if (m_paged) {
+        Initialize();
+        return;
+    }
+    for (unsigned i = 0; i < m_touchedCount; i++) {
+        uint8_t page = m_touchedPages[i];
+        ReleaseCodePage(page);
+        uint8_t* bytes = ram->data() + ((unsigned)page << 8);
+        if (m_baseline) {
+            memcpy(bytes, m_baseline->Page256(page), 256);
+        } else {
+            memset(bytes, 0x00, 256);
+        }
+        m_touched[page] = false;
+        m_dirty[page]   = false;
+        MapRamPage(page);
+    }
+    m_touchedCount = 0;
+}
+
+void Bus::TouchAllPages()
+{
+    for (unsigned page = 0; page < 256; page++) {
+        Touch(page);
+    }
+}
+
+void Bus::ForgetTouchedPages()
+{
+    for (unsigned i = 0; i < m_touchedCount; i++) {
+        m_touched[m_touchedPages[i]] = false;
+    }
+    m_touchedCount = 0;
+}
+
+void Bus::UseFlatMemory()
+{
+    if (m_paged) {
+        ReleaseAllCodePages();
+        ram.reset(new std::array<uint8_t, 64 * 1024>);
+        for (unsigned page = 0; page < 256; page++) {
+            memcpy(ram->data() + (page << 8), m_paged->Page256(page), 256);
+        }
+        m_paged.reset();
+        TouchAllPages();  // whatever the image held is not the baseline
+        MapAllRamPages();
+    }
+}
+
+void Bus::UsePagedMemory(std::shared_ptr<const PagedMemory::Image> image)
+{
+    ReleaseAllCodePages();
+    m_paged.reset(new PagedMemory(std::move(image)));
+    ram.reset();
+    MapAllRamPages();
+}
+
+std::shared_ptr<const PagedMemory::Image> Bus::CaptureImage(PagedMemory::PageSize pageSize) const
+{
+    std::unique_ptr<uint8_t[]> bytes(new uint8_t[0x10000]);
+    for (unsigned page = 0; page < 256; page++) {
+        memcpy(bytes.get() + (page << 8), RamPage(page), 256);
+    }
+    return std::make_shared<const PagedMemory::Image>(bytes.get(), pageSize);
+}
+
+PagedMemory::Stats Bus::GetMemoryStats() const
+{
+    if (m_paged) {
+        return m_paged->GetStats();
+    }
+    return {ram->size(), 0, 1, ram->size()};
+}
+
+void Bus::MapDevice(uint8_t firstPage, uint8_t lastPage, BusDevice* device)
+{
+    for (unsigned page = firstPage; page <= lastPage; page++) {
+        ReleaseCodePage(page);
+        m_devices[page]  = device;
+        m_readMap[page]  = nullptr;
+        m_writeMap[page] = nullptr;
+    }
+}
+
+void Bus::UnmapDevice(uint8_t firstPage, uint8_t lastPage)
+{
+    for (unsigned page = firstPage; page <= lastPage; page++) {
+        ReleaseCodePage(page);
+        m_devices[page] = nullptr;
+        MapRamPage(page);
+    }
+}
+
+void Bus::MapRamPage(uint8_t page)
+{
+    if (m_devices[page]) {
+        return;
+    }
+    if (m_paged) {
+        m_readMap[page]  = m_paged->Page256(page);
+        m_writeMap[page] = m_paged->WritablePage256(page, false);
+    } else {
+        m_readMap[page]  = ram->data() + ((unsigned)page << 8);
+        m_writeMap[page] = ram->data() + ((unsigned)page << 8);
+    }
+    if (!m_dirty[page] or m_codePage[page]) {
+        m_writeMap[page] = nullptr;  // first write has to come through SlowWrite
+    }
+    if (m_breakpoints) {
+        if (m_breakpoints->IsReadWatchedPage(page)) {
+            m_readMap[page] = nullptr;
+        }
+        if (m_breakpoints->IsWriteWatchedPage(page)) {
+            m_writeMap[page] = nullptr;
+        }
+    }
+}
+
+void Bus::MapAllRamPages()
+{
+    for (unsigned page = 0; page < 256; page++) {
+        MapRamPage(page);
+    }
+}
+
+void Bus::SlowWrite(uint16_t addr, uint8_t data)
+{
+    uint8_t page = addr >> 8;
+    if (m_devices[page]) {
+        m_devices[page]->Write(addr, data);
+        if (m_breakpoints) {
+            m_breakpoints->CheckWrite(mp, addr, data);
+        }
+        return;
+    }
+
+    ReleaseCodePage(page);
+    m_dirty[page] = true;
+    Touch(page);
+    if (m_paged) {
+        // first write to a shared page : copy it, then every 256-byte page it covers is direct
+        m_paged->WritablePage256(page, true)[addr & 0xff] = data;
+        MapPagedSpan(page);
+    } else {
+        (*ram)[addr] = data;
+        MapRamPage(page);
+    }
+    if (m_breakpoints) {
+        m_breakpoints->CheckWrite(mp, addr, data);
+    }
+}
+
+void Bus::MapPagedSpan(uint8_t page)
 {
-    if (addr >= 0x0000 and addr <= 0xFFFF) {
-        ram[addr] = data;
+    unsigned span = m_paged->PageBytes() >> 8;
+    uint8_t first = page & ~(span - 1);
+    for (unsigned p = first; p < first + span; p++) {
+        MapRamPage(p);
     }
 }
 
-uint8_t Bus::Read(uint16_t addr)
+void Bus::LoadRamPage(uint8_t page, const uint8_t* data)
 {
-    if (addr >= 0x0000 and addr <= 0xFFFF) {
-        return ram[addr];
+    if (memcmp(RamPage(page), data, 256) == 0) {
+        return;  // nothing changes, paged memory stays shared
+    }
+    ReleaseCodePage(page);
+    m_dirty[page] = true;
+    Touch(page);
+    if (m_paged) {
+        memcpy(m_paged->WritablePage256(page, true), data, 256);
+        MapPagedSpan(page);
     } else {
-        return 0x00;
+        memcpy(ram->data() + ((unsigned)page << 8), data, 256);
+        MapRamPage(page);
     }
 }
 
-void Bus::PrintRamState()
+void Bus::SetCodeWriteListener(CodeWriteListener* listener)
 {
-    std::cout << "\nRam state starts :\n";
-    uint16_t lineNumber = 0x0000;
-    std::cout << STREAM_WORD(lineNumber) << " : ";
-    for (int i = 0; i < ram.size(); i++) {
-        if ((i % 16 == 0) and (i != 0)) {
-            std::cout << '\n';
-            lineNumber += 16;
-            std::cout << STREAM_WORD(lineNumber) << " : ";
+    for (unsigned page = 0; page < 256; page++) {
+        if (m_codePage[page]) {
+            m_codePage[page] = false;
+            MapRamPage(page);
         }
-        std::cout << STREAM_BYTE(ram[i]) << " ";
     }
-    std::cout << "\nRam state ends !\n";
+    m_codeListener = listener;
+}
+
+void Bus::WatchCodePage(uint8_t page)
+{
+    if (m_codeListener and !m_codePage[page] and !m_devices[page]) {
+        m_codePage[page] = true;
+        m_writeMap[page] = nullptr;
+    }
+}
+
+void Bus::ReleaseCodePage(uint8_t page)
+{
+    if (m_codePage[page]) {
+        m_codePage[page] = false;
+        m_codeListener->OnCodeWrite(page);
+        MapRamPage(page);
+    }
+}
+
+void Bus::SetBreakpoints(Breakpoints* breakpoints)
+{
+    if (m_breakpoints) {
+        m_breakpoints->m_bus = nullptr;
+    }
+    if (breakpoints and breakpoints->m_bus) {
+        breakpoints->m_bus->SetBreakpoints(nullptr);  // one bus at a time
+    }
+    m_breakpoints    = breakpoints;
+    mp.m_breakpoints = breakpoints;
+    if (breakpoints) {
+        breakpoints->m_bus = this;
+    }
+    ReleaseAllCodePages();  // blocks were cut at the old breakpoints
+    MapAllRamPages();
+}
+
+void Bus::RefreshPage(uint8_t page)
+{
+    ReleaseCodePage(page);
+    MapRamPage(page);
+}
+
+void Bus::ReleaseAllCodePages()
+{
+    for (unsigned page = 0; page < 256; page++) {
+        ReleaseCodePage(page);
+    }
+}
+
+void Bus::ClearDirtyPages()
+{
+    for (unsigned i = 0; i < m_touchedCount; i++) {  // a dirty page is always touched
+        uint8_t page = m_touchedPages[i];
+        if (m_dirty[page]) {
+            m_dirty[page] = false;
+            MapRamPage(page);
+        }
+    }
+}
+
+unsigned Bus::DirtyPageCount() const
+{
+    unsigned count = 0;
+    for (unsigned page = 0; page < 256; page++) {
+        count += m_dirty[page] ? 1 : 0;
+    }
+    return count;
+}
+
+void Bus::WriteBlock(uint16_t addr, const uint8_t* data, size_t size)
+{
+    uint32_t pos = addr;
+    uint32_t end = pos + size;
+    while (pos < end and pos < 0x10000) {
+        uint32_t chunk = 256 - (pos & 0xff);
+        if (chunk > end - pos) {
+            chunk = end - pos;
+        }
+        uint8_t* page = m_writeMap[pos >> 8];
+        if (page) {
+            memcpy(page + (pos & 0xff), data, chunk);
+        } else {
+            for (uint32_t i = 0; i < chunk; i++) {
+                Write(pos + i, data[i]);
+            }
+        }
+        pos += chunk;
+        data += chunk;
+    }
+}
+
+uint8_t Bus::SlowRead(uint16_t addr, bool fetch)
+{
+    uint8_t page = addr >> 8;
+    uint8_t data;
+    if (m_devices[page]) {
+        data = m_devices[page]->Read(addr);
+        if (m_deviceReadListener) {
+            m_deviceReadListener->OnDeviceRead(addr, data);
+        }
+    } else {
+        data = RamPage(page)[addr & 0xff];  // only read watchpoints take ram off the fast path
+    }
+    if (m_breakpoints and !fetch) {
+        m_breakpoints->CheckRead(mp, addr, data);
+    }
+    return data;
+}
+
+// "0xaddr : 0xbb 0xbb ..." for [begin, end), 16 bytes per line, buffered
+static void WriteHexLines(std::ostream& os, Bus& bus, uint32_t begin, uint32_t end)
+{
+    char buffer[16 * 1024];
+    size_t used = 0;
+    for (uint32_t line = begin; line < end; line += 16) {
+        if (sizeof(buffer) - used < 128) {
+            os.write(buffer, used);
+            used = 0;
+        }
+        char* p = buffer + used;
+        *p++    = '0';
+        *p++    = 'x';
+        p       = PutHexWord(p, line);
+        *p++    = ' ';
+        *p++    = ':';
+        *p++    = ' ';
+        const uint8_t* bytes = bus.RamPage(line >> 8) + (line & 0xff);
+        for (uint32_t i = 0; i < 16 and line + i < end; i++) {
+            *p++ = '0';
+            *p++ = 'x';
+            p    = PutHexByte(p, bytes[i]);
+            *p++ = ' ';
+        }
+        *p++ = '\n';
+        used = p - buffer;
+    }
+    os.write(buffer, used);
+}
+
+void Bus::DumpDirtyRam(std::ostream& os, RamDumpFormat format)
+{
+    if (format == RamDumpFormat::DUMP_HEX) {
+        os << "\nRam changes start : dirty_pages=" << std::dec << DirtyPageCount() << '\n';
+    }
+    unsigned page = 0;
+    while (page < 256) {
+        if (!m_dirty[page]) {
+            page++;
+            continue;
+        }
+        unsigned first = page;
+        while (page < 256 and m_dirty[page]) {
+            page++;
+        }
+        uint32_t begin = first << 8;
+        uint32_t end   = page << 8;
+
+        if (format == RamDumpFormat::DUMP_HEX) {
+            WriteHexLines(os, *this, begin, end);
+        } else {
+            uint8_t header[6];
+            uint32_t length = end - begin;
+            header[0]       = begin & 0xff;
+            header[1]       = (begin >> 8) & 0xff;
+            for (int i = 0; i < 4; i++) {
+                header[2 + i] = (length >> (8 * i)) & 0xff;
+            }
+            os.write(reinterpret_cast<const char*>(header), sizeof(header));
+            for (unsigned p = first; p < page; p++) {
+                os.write(reinterpret_cast<const char*>(RamPage(p)), 256);
+            }
+        }
+    }
+    if (format == RamDumpFormat::DUMP_HEX) {
+        os << "Ram changes end !\n";
+    }
+}
+
+void Bus::PrintRamState(std::ostream& os)
+{
+    os << "\nRam state starts :\n";
+    WriteHexLines(os, *this, 0x0000, 0x10000);
+    os << "Ram state ends !\n";
 }
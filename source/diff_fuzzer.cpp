@@ -0,0 +1,502 @@
+#include "../include/diff_fuzzer.h"
+
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+
+#include "../include/bus_devices.h"
+#include "../include/reference_6502.h"
+
+namespace {
+
+struct State {
+    uint8_t a, x, y, sp, sr;
+    uint16_t pc;
+    uint64_t cycles, instructions;
+    MosT6502::StopReason reason;
+};
+
+// one side of the lockstep run, started from a Case
+class Side {
+   public:
+    virtual ~Side() {}
+    virtual void Run(uint64_t cycleBudget) = 0;
+    virtual State Get() = 0;
+    virtual const uint8_t* RamPage(uint8_t page) = 0;
+};
+
+class EngineSide : public Side {
+   public:
+    EngineSide(Mos6502Engine::Core core, const DiffFuzzer::Case& fuzzCase,
+               const std::string& recompiled = std::string())
+    {
+        if (!recompiled.empty()) {
+            m_engine.LoadRecompiled(recompiled);  // a failure leaves the interpreter running it
+        }
+        m_engine.SetCore(core);
+        m_engine.Load(fuzzCase.ram.data(), fuzzCase.ram.size(), 0x0000);
+        m_engine.Reset();
+        MosT6502& cpu = m_engine.GetCpu();
+        cpu.a         = fuzzCase.a;
+        cpu.x         = fuzzCase.x;
+        cpu.y         = fuzzCase.y;
+        cpu.sp        = fuzzCase.sp;
+        cpu.SetStatus(fuzzCase.sr);
+        if (fuzzCase.timerPeriod != 0) {
+            uint16_t base = DiffFuzzer::kTimerPage << 8;
+            m_timer.reset(new IntervalTimerDevice(m_engine.GetScheduler(), cpu, 0x01));
+            m_engine.GetBus().MapDevice(DiffFuzzer::kTimerPage, DiffFuzzer::kTimerPage,
+                                        m_timer.get());
+            m_timer->Write(base + 0, fuzzCase.timerPeriod & 0xff);
+            m_timer->Write(base + 1, fuzzCase.timerPeriod >> 8);
+            m_timer->Write(base + 2, fuzzCase.timerControl);
+        }
+    }
+    void Run(uint64_t cycleBudget) override { m_engine.Run(cycleBudget, &m_reason); }
+    State Get() override
+    {
+        const MosT6502& cpu = m_engine.GetCpu();
+        return {cpu.a,  cpu.x,      cpu.y,            cpu.sp, cpu.GetStatus(),
+                cpu.pc, cpu.cycles, cpu.instructions, m_reason};
+    }
+    const uint8_t* RamPage(uint8_t page) override { return m_engine.GetBus().RamPage(page); }
+    Mos6502Engine& GetEngine() { return m_engine; }
+
+   private:
+    Mos6502Engine m_engine;
+    std::unique_ptr<IntervalTimerDevice> m_timer;  // after m_engine, it holds on to the scheduler
+    MosT6502::StopReason m_reason = MosT6502::StopReason::RUNNING;
+};
+
+class ReferenceSide : public Side {
+   public:
+    explicit ReferenceSide(const DiffFuzzer::Case& fuzzCase) : m_cpu(new Reference6502)
+    {
+        memcpy(m_cpu->mem, fuzzCase.ram.data(), sizeof(m_cpu->mem));
+        m_cpu->Reset();
+        m_cpu->a  = fuzzCase.a;
+        m_cpu->x  = fuzzCase.x;
+        m_cpu->y  = fuzzCase.y;
+        m_cpu->sp = fuzzCase.sp;
+        m_cpu->sr = fuzzCase.sr;
+    }
+    void Run(uint64_t cycleBudget) override { m_reason = m_cpu->Run(cycleBudget); }
+    State Get() override
+    {
+        return {m_cpu->a,  m_cpu->x,      m_cpu->y,            m_cpu->sp, m_cpu->sr,
+                m_cpu->pc, m_cpu->cycles, m_cpu->instructions, m_reason};
+    }
+    const uint8_t* RamPage(uint8_t page) override { return m_cpu->mem + (page << 8); }
+
+   private:
+    std::unique_ptr<Reference6502> m_cpu;  // 64 KiB, kept off the stack
+    MosT6502::StopReason m_reason = MosT6502::StopReason::RUNNING;
+};
+
+std::string Hex(unsigned value, int digits)
+{
+    std::ostringstream os;
+    os << "0x" << std::hex;
+    os.width(digits);
+    os.fill('0');
+    os << value;
+    return os.str();
+}
+
+// "" when both sides agree, else one "field : oracle vs core" line per difference
+std::string Diff(Side& oracle, Side& core)
+{
+    State o = oracle.Get();
+    State c = core.Get();
+    std::ostringstream os;
+    auto field = [&os](const char* name, unsigned ov, unsigned cv, int digits) {
+        if (ov != cv) {
+            os << name << " : " << Hex(ov, digits) << " vs " << Hex(cv, digits) << '\n';
+        }
+    };
+    field("a", o.a, c.a, 2);
+    field("x", o.x, c.x, 2);
+    field("y", o.y, c.y, 2);
+    field("sp", o.sp, c.sp, 2);
+    field("sr", o.sr, c.sr, 2);
+    field("pc", o.pc, c.pc, 4);
+    if (o.cycles != c.cycles) {
+        os << "cycles : " << o.cycles << " vs " << c.cycles << '\n';
+    }
+    if (o.instructions != c.instructions) {
+        os << "instructions : " << o.instructions << " vs " << c.instructions << '\n';
+    }
+    if (o.reason != c.reason) {
+        os << "stop : " << MosT6502::GetStopReasonName(o.reason) << " vs "
+           << MosT6502::GetStopReasonName(c.reason) << '\n';
+    }
+    unsigned shown = 0;
+    for (unsigned page = 0; page < 256; page++) {
+        const uint8_t* op = oracle.RamPage(page);
+        const uint8_t* cp = core.RamPage(page);
+        if (memcmp(op, cp, 256) == 0) {
+            continue;
+        }
+        for (unsigned i = 0; i < 256 and shown < 8; i++) {
+            if (op[i] != cp[i]) {
+                field(("ram[" + Hex((page << 8) | i, 4) + "]").c_str(), op[i], cp[i], 2);
+                shown++;
+            }
+        }
+    }
+    return os.str();
+}
+
+struct Sides {
+    std::unique_ptr<Side> oracle;
+    std::unique_ptr<Side> core;
+};
+
+Sides Start(const DiffFuzzer::Case& fuzzCase, Mos6502Engine::Core core, DiffFuzzer::Oracle oracle,
+            const std::string& recompiled)
+{
+    Sides sides;
+    if (oracle == DiffFuzzer::ORACLE_REFERENCE) {
+        sides.oracle.reset(new ReferenceSide(fuzzCase));
+    } else {
+        sides.oracle.reset(new EngineSide(Mos6502Engine::CORE_INTERPRETER, fuzzCase));
+    }
+    sides.core.reset(new EngineSide(core, fuzzCase, recompiled));
+    return sides;
+}
+
+// runs budgets [0, chunks) then lastBudget on both sides
+void Replay(Sides& sides, const DiffFuzzer::Case& fuzzCase, unsigned chunks, uint64_t lastBudget)
+{
+    for (unsigned i = 0; i < chunks; i++) {
+        sides.oracle->Run(fuzzCase.budgets[i]);
+        sides.core->Run(fuzzCase.budgets[i]);
+    }
+    sides.oracle->Run(lastBudget);
+    sides.core->Run(lastBudget);
+}
+
+bool IsFinished(const State& state) { return state.reason != MosT6502::StopReason::CYCLE_BUDGET; }
+
+std::string Disassemble(const std::vector<uint8_t>& ram, uint16_t pc)
+{
+    uint8_t opcode   = ram[pc];
+    const auto& info = MosT6502::Decode(opcode);
+    std::ostringstream os;
+    os << Hex(pc, 4) << " : " << Hex(opcode, 2);
+    if (opcode == TERMINATE_OPCODE) {
+        os << "  terminate";
+        return os.str();
+    }
+    unsigned length = MosT6502::GetInstrLength(info.addrMode);
+    for (unsigned i = 1; i < length; i++) {
+        os << ' ' << Hex(ram[(uint16_t)(pc + i)], 2);
+    }
+    os << "  " << (MosT6502::IsLegal(info) ? MosT6502::GetInstrString(opcode) : "illegal");
+    return os.str();
+}
+
+}  // namespace
+
+const char* DiffFuzzer::GetOracleName(Oracle oracle)
+{
+    switch (oracle) {
+        case (Oracle::ORACLE_REFERENCE): {
+            return "reference";
+        }
+        case (Oracle::ORACLE_INTERPRETER): {
+            return "interp";
+        }
+    }
+    return "xxx";
+}
+
+DiffFuzzer::Case DiffFuzzer::Generate(std::mt19937_64& rng) const
+{
+    Case fuzzCase;
+    fuzzCase.ram.assign(0x10000, 0x00);
+    std::vector<uint8_t>& ram = fuzzCase.ram;
+
+    // zero page : mostly pointers into the data pages, for the (zp,x) / (zp),y modes
+    for (unsigned i = 0; i < 0x100; i += 2) {
+        uint16_t ptr = 0x0200 + rng() % 0x0400;
+        ram[i]       = (rng() % 4) ? ptr & 0xff : rng();
+        ram[i + 1]   = (rng() % 4) ? ptr >> 8 : rng();
+    }
+    for (unsigned i = 0x0100; i < 0x0600; i++) {  // stack and data
+        ram[i] = rng();
+    }
+
+    std::vector<uint8_t> legal;
+    for (unsigned opcode = 0; opcode < 256; opcode++) {
+        if (opcode != TERMINATE_OPCODE and MosT6502::IsLegal(MosT6502::Decode(opcode))) {
+            legal.push_back(opcode);
+        }
+    }
+
+    // opcodes first, so jumps can target instruction starts
+    std::vector<uint16_t> starts;
+    uint16_t pc    = kProgramAddr;
+    unsigned count = 16 + rng() % 112;
+    for (unsigned i = 0; i < count; i++) {
+        uint8_t opcode = legal[rng() % legal.size()];
+        switch (MosT6502::Decode(opcode).instrName) {
+            case (MosT6502::InstrName::BRK):  // these end the run or jump off into the data
+            case (MosT6502::InstrName::RTI):
+            case (MosT6502::InstrName::RTS): {
+                opcode = (rng() % 8) ? 0xea : opcode;
+                break;
+            }
+            default: {
+                break;
+            }
+        }
+        starts.push_back(pc);
+        ram[pc] = opcode;
+        pc += MosT6502::GetInstrLength(MosT6502::Decode(opcode).addrMode);
+    }
+    if (rng() % 2) {  // long running : start over instead of stopping
+        ram[pc++] = 0x4c;
+        ram[pc++] = kProgramAddr & 0xff;
+        ram[pc++] = kProgramAddr >> 8;
+    }
+    ram[pc] = TERMINATE_OPCODE;
+    uint16_t programEnd = pc;
+
+    for (uint16_t start : starts) {
+        const auto& info = MosT6502::Decode(ram[start]);
+        uint16_t operand = rng() & 0xff;
+        switch (info.addrMode) {
+            case (MosT6502::AddrMode::RELATIVE): {  // another instruction, mostly backwards
+                int next   = start + 2;
+                int target = starts[rng() % starts.size()];
+                if (target - next < -128 or target - next > 127 or rng() % 4 == 0) {
+                    target = next + (int)(rng() % 48) - 32;
+                }
+                operand = (uint8_t)(target - next);
+                break;
+            }
+            case (MosT6502::AddrMode::ABSOLUTE):
+            case (MosT6502::AddrMode::ABSOLUTE_X):
+            case (MosT6502::AddrMode::ABSOLUTE_Y):
+            case (MosT6502::AddrMode::INDIRECT): {
+                if (info.instrName == MosT6502::InstrName::JMP or info.instrName == MosT6502::InstrName::JSR) {
+                    uint16_t target = starts[rng() % starts.size()];
+                    operand         = target;
+                    if (info.addrMode == MosT6502::AddrMode::INDIRECT) {
+                        operand = (rng() % 8) ? 0x0200 + rng() % 0x0400 : 0x02ff;
+                        ram[operand] = target & 0xff;
+                        ram[(operand & 0xff00) | ((operand + 1) & 0xff)] = target >> 8;
+                    }
+                } else if (rng() % 16 == 0) {  // self-modifying code
+                    operand = kProgramAddr + rng() % (programEnd - kProgramAddr);
+                } else if (m_devices and rng() % 4 == 0) {  // restart, ack, read the timer
+                    operand = (kTimerPage << 8) | (rng() % 4);
+                } else {
+                    operand = 0x0200 + rng() % 0x0400;
+                }
+                break;
+            }
+            default: {
+                break;
+            }
+        }
+        unsigned length = MosT6502::GetInstrLength(info.addrMode);
+        if (length >= 2) {
+            ram[start + 1] = operand & 0xff;
+        }
+        if (length == 3) {
+            ram[start + 2] = operand >> 8;
+        }
+    }
+
+    // timer restarts (control from a), acks and CLIs often enough that an irq falls due in the
+    // middle of a block; jumps and branches stay, so starts remain instruction starts
+    for (uint16_t start : starts) {
+        if (!m_devices or rng() % 4 != 0) {
+            continue;
+        }
+        const auto& info = MosT6502::Decode(ram[start]);
+        if (info.addrMode == MosT6502::AddrMode::RELATIVE or
+            info.instrName == MosT6502::InstrName::JMP or
+            info.instrName == MosT6502::InstrName::JSR) {
+            continue;
+        }
+        unsigned length = MosT6502::GetInstrLength(info.addrMode);
+        if (length == 3) {
+            ram[start]     = (rng() % 2) ? 0x8d : 0xad;  // STA / LDA abs
+            ram[start + 1] = (ram[start] == 0x8d) ? 0x02 : 0x03;
+            ram[start + 2] = kTimerPage;
+        } else if (length == 1) {
+            ram[start] = 0x58;  // CLI
+        }
+    }
+
+    ram[0xfffc] = ram[0xfffe] = kProgramAddr & 0xff;
+    ram[0xfffd] = ram[0xffff] = kProgramAddr >> 8;
+
+    fuzzCase.a  = rng();
+    fuzzCase.x  = rng();
+    fuzzCase.y  = rng();
+    fuzzCase.sp = rng();
+    fuzzCase.sr = (rng() & ~MosT6502::B) | MosT6502::U;
+    if (m_devices) {
+        // stopped until the program starts it or short periods : events land inside blocks
+        fuzzCase.timerPeriod  = 1 + rng() % ((rng() % 2) ? 16 : 400);
+        fuzzCase.timerControl = (rng() % 2) ? IntervalTimerDevice::kRun : 0x00;
+    }
+
+    // short and long chunks : boundaries everywhere, and enough loop trips to get blocks jitted
+    unsigned chunks = 8 + rng() % 24;
+    for (unsigned i = 0; i < chunks; i++) {
+        fuzzCase.budgets.push_back(1 + rng() % ((rng() % 4) ? 64 : 4000));
+    }
+    return fuzzCase;
+}
+
+DiffFuzzer::Divergence DiffFuzzer::Check(const Case& fuzzCase)
+{
+    Divergence divergence;
+    Sides sides = Start(fuzzCase, m_core, m_oracle, m_recompiled);
+    unsigned chunk;
+    for (chunk = 0; chunk < fuzzCase.budgets.size(); chunk++) {
+        sides.oracle->Run(fuzzCase.budgets[chunk]);
+        sides.core->Run(fuzzCase.budgets[chunk]);
+        divergence.detail = Diff(*sides.oracle, *sides.core);
+        if (!divergence.detail.empty() or IsFinished(sides.oracle->Get())) {
+            break;
+        }
+    }
+    if (divergence.detail.empty()) {
+        return divergence;
+    }
+    divergence.found = true;
+    divergence.chunk = chunk;
+
+    // smallest budget for this chunk that already diverges; budget lo is known to match
+    uint64_t lo = 0;
+    uint64_t hi = fuzzCase.budgets[chunk];
+    while (hi - lo > 1) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        Sides probe  = Start(fuzzCase, m_core, m_oracle, m_recompiled);
+        Replay(probe, fuzzCase, chunk, mid);
+        if (Diff(*probe.oracle, *probe.core).empty()) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    Sides before = Start(fuzzCase, m_core, m_oracle, m_recompiled);
+    Replay(before, fuzzCase, chunk, lo);
+    State good             = before.oracle->Get();
+    divergence.instruction = good.instructions;
+    divergence.pc          = good.pc;
+
+    Sides after = Start(fuzzCase, m_core, m_oracle, m_recompiled);
+    Replay(after, fuzzCase, chunk, hi);
+    divergence.detail = Diff(*after.oracle, *after.core);
+    divergence.exact  = m_core != Mos6502Engine::CORE_JIT and
+                       m_core != Mos6502Engine::CORE_RECOMPILED;
+    return divergence;
+}
+
+DiffFuzzer::Case DiffFuzzer::Minimize(const Case& fuzzCase, Divergence* divergence)
+{
+    Case best = fuzzCase;
+    best.budgets.resize(divergence->chunk + 1);
+
+    // whole instructions become NOPs, front to back
+    uint16_t pc = kProgramAddr;
+    while (best.ram[pc] != TERMINATE_OPCODE) {
+        uint8_t opcode  = best.ram[pc];
+        unsigned length = MosT6502::GetInstrLength(MosT6502::Decode(opcode).addrMode);
+        if (opcode != 0xea) {
+            Case trial = best;
+            for (unsigned i = 0; i < length; i++) {
+                trial.ram[pc + i] = 0xea;
+            }
+            if (Diverges(trial)) {
+                best = trial;
+            }
+        }
+        pc += length;
+    }
+
+    // data : whole pages, then 16 byte runs, then single bytes
+    for (unsigned step : {256u, 16u, 1u}) {
+        for (unsigned addr = 0x0000; addr < kProgramAddr; addr += step) {
+            bool zero = true;
+            for (unsigned i = 0; i < step; i++) {
+                zero = zero and best.ram[addr + i] == 0;
+            }
+            if (zero) {
+                continue;
+            }
+            Case trial = best;
+            memset(&trial.ram[addr], 0x00, step);
+            if (Diverges(trial)) {
+                best = trial;
+            }
+        }
+    }
+
+    for (uint8_t Case::*reg : {&Case::a, &Case::x, &Case::y}) {
+        Case trial = best;
+        trial.*reg = 0x00;
+        if (trial.*reg != best.*reg and Diverges(trial)) {
+            best = trial;
+        }
+    }
+
+    *divergence = Check(best);
+    return best;
+}
+
+bool DiffFuzzer::WriteReproducer(const Case& fuzzCase, const Divergence& divergence,
+                                 const std::string& prefix) const
+{
+    EngineSide start(Mos6502Engine::CORE_INTERPRETER, fuzzCase);
+    MachineSnapshot snapshot;
+    start.GetEngine().Snapshot(&snapshot);
+    if (snapshot.Save(prefix + ".snap") != MachineSnapshot::OK) {
+        return false;
+    }
+
+    std::ofstream out(prefix + ".txt");
+    if (!out.is_open()) {
+        return false;
+    }
+    out << "oracle : " << GetOracleName(m_oracle) << '\n';
+    out << "start : " << prefix << ".snap\n";
+    if (fuzzCase.timerPeriod != 0) {
+        out << "devices : IntervalTimerDevice at " << Hex(kTimerPage << 8, 4)
+            << ", irq source 0x01, period " << fuzzCase.timerPeriod << ", control "
+            << Hex(fuzzCase.timerControl, 2) << " once the registers are set (not in the "
+            << "snapshot)\n";
+    }
+    if (m_core == Mos6502Engine::CORE_RECOMPILED) {
+        out << "recompiled : " << m_recompiled << " (see Mos6502Engine::LoadRecompiled)\n";
+    }
+    out << "budgets :";
+    for (uint32_t budget : fuzzCase.budgets) {
+        out << ' ' << budget;
+    }
+    out << "\n\nfirst divergent instruction : #" << divergence.instruction << " at "
+        << Disassemble(fuzzCase.ram, divergence.pc) << " (chunk " << divergence.chunk << ")\n";
+    if (!divergence.exact) {
+        out << "native blocks only run when they fit the budget : the bad instruction can be "
+               "anywhere in the block that ends with this one\n";
+    }
+    out << "\noracle vs core after it :\n" << divergence.detail << "\nprogram :\n";
+    uint16_t pc = kProgramAddr;
+    while (true) {
+        out << Disassemble(fuzzCase.ram, pc) << '\n';
+        if (fuzzCase.ram[pc] == TERMINATE_OPCODE) {
+            break;
+        }
+        pc += MosT6502::GetInstrLength(MosT6502::Decode(fuzzCase.ram[pc]).addrMode);
+    }
+    return out.good();
+}
@@ -0,0 +1,90 @@
+#include "../include/engine_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace {
+
+std::atomic<uint64_t> g_nextPoolId(1);  // a pool at a reused address is a different pool
+
+// the engine this thread leased last, per pool; one entry is enough for the usual one pool
+struct LastLease {
+    uint64_t poolId;
+    size_t slot;
+};
+thread_local LastLease t_lastLease = {0, 0};
+
+}  // namespace
+
+EnginePool::EnginePool(const Config& config) : m_config(config), m_id(g_nextPoolId++)
+{
+    size_t count = config.engines;
+    if (count == 0) {
+        count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    m_slots.resize(count);
+    for (size_t slot = count; slot > 0; slot--) {
+        m_idle.push_back(slot - 1);  // slot 0 is handed out first
+    }
+}
+
+EnginePool::Lease EnginePool::Acquire()
+{
+    size_t slot;
+    {
+        std::unique_lock<std::mutex> guard(m_lock);
+        if (m_idle.empty()) {
+            m_stats.waits += 1;
+            m_released.wait(guard, [this] { return !m_idle.empty(); });
+        }
+        auto pick = m_idle.end() - 1;
+        if (m_config.affinity == AFFINITY_THREAD and t_lastLease.poolId == m_id and
+            m_slots[t_lastLease.slot].idle) {
+            pick = std::find(m_idle.begin(), m_idle.end(), t_lastLease.slot);
+        }
+        slot = *pick;
+        m_idle.erase(pick);
+        m_slots[slot].idle = false;
+        m_stats.acquires += 1;
+        if (t_lastLease.poolId == m_id and t_lastLease.slot == slot) {
+            m_stats.affinityHits += 1;
+        }
+    }
+    t_lastLease = {m_id, slot};
+
+    std::unique_ptr<Mos6502Engine>& engine = m_slots[slot].engine;
+    if (!engine) {  // the slot is ours, build it outside the lock
+        engine.reset(new Mos6502Engine());
+        engine->SetCore(m_config.core);
+        engine->SetBaseline(m_config.baseline);
+    }
+    return Lease(this, slot);
+}
+
+void EnginePool::Release(size_t slot)
+{
+    // revert while the engine is still ours and its pages are still in this core's cache
+    Mos6502Engine& engine = *m_slots[slot].engine;
+    unsigned touched      = engine.GetBus().TouchedPageCount();
+    engine.ResetToBaseline();
+
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_stats.pagesReverted += touched;
+    m_slots[slot].idle = true;
+    m_idle.push_back(slot);
+    m_released.notify_one();
+}
+
+EnginePool::Stats EnginePool::GetStats() const
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    return m_stats;
+}
+
+EnginePool::Lease::~Lease()
+{
+    if (m_pool) {
+        m_pool->Release(m_slot);
+    }
+}
@@ -0,0 +1,50 @@
+#include "../include/event_scheduler.h"
+
+#include <algorithm>
+#include <utility>
+
+EventScheduler::EventId EventScheduler::Schedule(uint64_t cycle, Callback callback)
+{
+    EventId id = m_nextId++;
+    m_events.push_back({cycle, id, std::move(callback)});
+    std::push_heap(m_events.begin(), m_events.end(), FiresLater);
+    m_cpu.EndSlice(cycle);
+    return id;
+}
+
+EventScheduler::EventId EventScheduler::ScheduleIrq(uint64_t cycle, uint32_t sources,
+                                                    bool asserted)
+{
+    MosT6502& cpu = m_cpu;
+    return Schedule(cycle, [&cpu, sources, asserted](uint64_t) {
+        cpu.SetIrqLine(sources, asserted);
+    });
+}
+
+EventScheduler::EventId EventScheduler::ScheduleNmi(uint64_t cycle)
+{
+    MosT6502& cpu = m_cpu;
+    return Schedule(cycle, [&cpu](uint64_t) { cpu.TriggerNmi(); });
+}
+
+bool EventScheduler::Cancel(EventId id)
+{
+    auto it = std::find_if(m_events.begin(), m_events.end(),
+                           [id](const Event& event) { return event.id == id; });
+    if (it == m_events.end()) {
+        return false;
+    }
+    m_events.erase(it);
+    std::make_heap(m_events.begin(), m_events.end(), FiresLater);
+    return true;
+}
+
+void EventScheduler::RunDue(uint64_t now)
+{
+    while (!m_events.empty() and m_events.front().cycle <= now) {
+        std::pop_heap(m_events.begin(), m_events.end(), FiresLater);
+        Event event = std::move(m_events.back());
+        m_events.pop_back();
+        event.callback(event.cycle);  // may schedule or cancel, the heap is consistent again
+    }
+}
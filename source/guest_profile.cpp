@@ -0,0 +1,189 @@
+#include "../include/guest_profile.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+#include "../include/mos_t_6502.h"
+
+static constexpr int8_t BuildCallEffect(uint8_t opcode)
+{
+    return (opcode == 0x20)                      ? 1    // JSR
+           : (opcode == 0x00)                    ? 2    // BRK
+           : (opcode == 0x60 or opcode == 0x40) ? -1   // RTS, RTI
+                                                 : 0;
+}
+
+#define MOS6502_CALL_EFFECT_ROW(h)                                                            \
+    BuildCallEffect(h + 0x0), BuildCallEffect(h + 0x1), BuildCallEffect(h + 0x2),             \
+        BuildCallEffect(h + 0x3), BuildCallEffect(h + 0x4), BuildCallEffect(h + 0x5),         \
+        BuildCallEffect(h + 0x6), BuildCallEffect(h + 0x7), BuildCallEffect(h + 0x8),         \
+        BuildCallEffect(h + 0x9), BuildCallEffect(h + 0xa), BuildCallEffect(h + 0xb),         \
+        BuildCallEffect(h + 0xc), BuildCallEffect(h + 0xd), BuildCallEffect(h + 0xe),         \
+        BuildCallEffect(h + 0xf)
+
+const int8_t GuestProfile::kCallEffect[256] = {
+        MOS6502_CALL_EFFECT_ROW(0x00), MOS6502_CALL_EFFECT_ROW(0x10),
+        MOS6502_CALL_EFFECT_ROW(0x20), MOS6502_CALL_EFFECT_ROW(0x30),
+        MOS6502_CALL_EFFECT_ROW(0x40), MOS6502_CALL_EFFECT_ROW(0x50),
+        MOS6502_CALL_EFFECT_ROW(0x60), MOS6502_CALL_EFFECT_ROW(0x70),
+        MOS6502_CALL_EFFECT_ROW(0x80), MOS6502_CALL_EFFECT_ROW(0x90),
+        MOS6502_CALL_EFFECT_ROW(0xa0), MOS6502_CALL_EFFECT_ROW(0xb0),
+        MOS6502_CALL_EFFECT_ROW(0xc0), MOS6502_CALL_EFFECT_ROW(0xd0),
+        MOS6502_CALL_EFFECT_ROW(0xe0), MOS6502_CALL_EFFECT_ROW(0xf0)};
+
+GuestProfile::GuestProfile() { Clear(); }
+
+void GuestProfile::Clear()
+{
+    m_counters.assign(0x10000, {0, 0});
+    m_opcodeAt.assign(0x10000, 0);
+    m_totalCycles = 0;
+
+    m_frames.assign(1, {0, 0, CALL_NONE, 0});
+    m_frameCycles.assign(1, 0);
+    m_children.clear();
+    m_frame       = 0;
+    m_frameStart  = 0;
+    m_cappedCalls = 0;
+}
+
+void GuestProfile::EnterOrLeave(uint8_t opcode, uint16_t target)
+{
+    int8_t effect = kCallEffect[opcode];
+    if (effect != CALL_RETURN) {
+        Enter((CallEffect)effect, target);
+        return;
+    }
+    m_frameCycles[m_frame] += m_totalCycles - m_frameStart;
+    m_frameStart = m_totalCycles;
+    if (m_cappedCalls != 0) {  // returns from a call that never got a frame of its own
+        m_cappedCalls -= 1;
+        return;
+    }
+    m_frame = m_frames[m_frame].parent;  // unbalanced returns (stack games) stay at the root
+}
+
+void GuestProfile::Enter(CallEffect kind, uint16_t target)
+{
+    m_frameCycles[m_frame] += m_totalCycles - m_frameStart;
+    m_frameStart = m_totalCycles;
+
+    if (m_frames[m_frame].depth >= kMaxDepth) {
+        m_cappedCalls += 1;
+        return;
+    }
+    uint64_t key = ((uint64_t)m_frame << 19) | ((uint64_t)kind << 16) | target;
+    auto it      = m_children.find(key);
+    if (it != m_children.end()) {
+        m_frame = it->second;
+        return;
+    }
+    uint32_t child = m_frames.size();
+    m_frames.push_back({m_frame, target, (uint8_t)kind, (uint8_t)(m_frames[m_frame].depth + 1)});
+    m_frameCycles.push_back(0);
+    m_children.emplace(key, child);
+    m_frame = child;
+}
+
+static std::string Hex(unsigned value, int digits)
+{
+    std::ostringstream os;
+    os << "0x" << std::hex << std::setw(digits) << std::setfill('0') << value;
+    return os.str();
+}
+
+static const char* Mnemonic(uint8_t opcode)
+{
+    const MosT6502::OpcodeInfo& info = MosT6502::Decode(opcode);
+    return MosT6502::IsLegal(info) ? MosT6502::GetInstrString(opcode) : "illegal";
+}
+
+void GuestProfile::WriteFoldedStacks(std::ostream& os) const
+{
+    static const char* const kPrefix[] = {"", ";sub_", ";brk_", ";irq_", ";nmi_"};
+    std::vector<std::string> paths(m_frames.size());
+    paths[0] = "main";
+    for (uint32_t i = 1; i < m_frames.size(); i++) {  // parents always come first
+        const Frame& frame = m_frames[i];
+        paths[i]           = paths[frame.parent] + kPrefix[frame.kind] + Hex(frame.entry, 4);
+    }
+    for (uint32_t i = 0; i < m_frames.size(); i++) {
+        uint64_t cycles = m_frameCycles[i];
+        if (i == m_frame) {  // not charged until it is left
+            cycles += m_totalCycles - m_frameStart;
+        }
+        if (cycles != 0) {
+            os << paths[i] << ' ' << cycles << '\n';
+        }
+    }
+}
+
+void GuestProfile::WriteReport(std::ostream& os, size_t top) const
+{
+    // self-modified code is charged to whatever opcode was seen first at its address
+    std::vector<uint32_t> hot;
+    Counters opcodes[256] = {};
+    Counters modes[16]    = {};
+    for (uint32_t pc = 0; pc < 0x10000; pc++) {
+        const Counters& c = m_counters[pc];
+        if (c.executions == 0) {
+            continue;
+        }
+        hot.push_back(pc);
+        uint8_t opcode = m_opcodeAt[pc];
+        opcodes[opcode].executions += c.executions;
+        opcodes[opcode].cycles += c.cycles;
+        unsigned mode = MosT6502::Decode(opcode).addrMode;
+        modes[mode].executions += c.executions;
+        modes[mode].cycles += c.cycles;
+    }
+    double total = (m_totalCycles != 0) ? (double)m_totalCycles : 1.0;
+    os << std::fixed << std::setprecision(2);
+
+    std::sort(hot.begin(), hot.end(), [this](uint32_t l, uint32_t r) {
+        const Counters& cl = m_counters[l];
+        const Counters& cr = m_counters[r];
+        return (cl.cycles != cr.cycles) ? cl.cycles > cr.cycles : l < r;
+    });
+    if (hot.size() > top) {
+        hot.resize(top);
+    }
+    os << "hot addresses (" << m_totalCycles << " cycles)\n";
+    os << "  addr    cycles%      cycles  executions  opcode\n";
+    for (uint32_t pc : hot) {
+        const Counters& c = m_counters[pc];
+        os << "  " << Hex(pc, 4) << std::setw(9) << 100.0 * c.cycles / total << std::setw(12)
+           << c.cycles << std::setw(12) << c.executions << "  " << Mnemonic(m_opcodeAt[pc])
+           << '\n';
+    }
+
+    std::vector<unsigned> byCycles;
+    for (unsigned opcode = 0; opcode < 256; opcode++) {
+        if (opcodes[opcode].executions != 0) {
+            byCycles.push_back(opcode);
+        }
+    }
+    std::sort(byCycles.begin(), byCycles.end(), [&opcodes](unsigned l, unsigned r) {
+        return (opcodes[l].cycles != opcodes[r].cycles) ? opcodes[l].cycles > opcodes[r].cycles
+                                                        : l < r;
+    });
+    os << "\nopcodes\n";
+    os << "  opcode  cycles%      cycles  executions  mnemonic\n";
+    for (unsigned opcode : byCycles) {
+        os << "  " << Hex(opcode, 2) << std::setw(11) << 100.0 * opcodes[opcode].cycles / total
+           << std::setw(12) << opcodes[opcode].cycles << std::setw(12)
+           << opcodes[opcode].executions << "  " << Mnemonic(opcode) << '\n';
+    }
+
+    os << "\naddressing modes\n";
+    os << "  cycles%      cycles  executions  mode\n";
+    for (unsigned mode = 0; mode <= MosT6502::AddrMode::INDIRECT_Y; mode++) {
+        if (modes[mode].executions != 0) {
+            os << "  " << std::setw(7) << 100.0 * modes[mode].cycles / total << std::setw(12)
+               << modes[mode].cycles << std::setw(12) << modes[mode].executions << "  "
+               << MosT6502::GetAddrModeName((MosT6502::AddrMode)mode) << '\n';
+        }
+    }
+}
@@ -0,0 +1,338 @@
+#include "../include/input_log.h"
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace {
+
+const char kMagic[8]         = {'M', '6', '5', 'R', 'L', 'O', 'G', '\0'};
+const uint32_t kVersion      = 1;
+const uint32_t kFlagFinished = 1;
+const size_t kHeaderSize     = 8 + 4 + 4 + 8 + 8 + 8 + 32;
+
+void PutLe(uint8_t* out, uint64_t v, int bytes)
+{
+    for (int i = 0; i < bytes; i++) {
+        out[i] = (v >> (8 * i)) & 0xff;
+    }
+}
+
+uint64_t GetLe(const uint8_t* in, int bytes)
+{
+    uint64_t v = 0;
+    for (int i = bytes - 1; i >= 0; i--) {
+        v = (v << 8) | in[i];
+    }
+    return v;
+}
+
+bool HasPayload(InputLog::EventType type)
+{
+    return type == InputLog::EVENT_DEVICE_READ or type == InputLog::EVENT_HOST_WRITE;
+}
+
+}  // namespace
+
+InputLog::Status InputLog::Save(const std::string& path) const
+{
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) {
+        return ERR_OPEN;
+    }
+
+    uint8_t header[kHeaderSize];
+    uint8_t* p = header;
+    memcpy(p, kMagic, 8);
+    p += 8;
+    PutLe(p, kVersion, 4);
+    p += 4;
+    PutLe(p, finished ? kFlagFinished : 0, 4);
+    p += 4;
+    PutLe(p, events.size(), 8);
+    p += 8;
+    PutLe(p, endCycles, 8);
+    p += 8;
+    PutLe(p, endId, 8);
+    p += 8;
+    memcpy(p, devicePages, 32);
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    if (start.Save(out) != MachineSnapshot::OK) {
+        return ERR_OPEN;
+    }
+
+    // most events are a few cycles apart : 1 type byte, 1-2 delta bytes, 3 payload bytes
+    std::vector<uint8_t> buffer;
+    buffer.reserve(64 * 1024);
+    uint64_t last = start.GetCpuState().cycles;
+    for (const Event& event : events) {
+        buffer.push_back(event.type);
+        uint64_t delta = event.cycle - last;
+        last           = event.cycle;
+        do {
+            uint8_t byte = delta & 0x7f;
+            delta >>= 7;
+            buffer.push_back((delta != 0) ? (byte | 0x80) : byte);
+        } while (delta != 0);
+        if (HasPayload(event.type)) {
+            buffer.push_back(event.addr & 0xff);
+            buffer.push_back(event.addr >> 8);
+            buffer.push_back(event.data);
+        }
+        if (buffer.size() > 60 * 1024) {
+            out.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+            buffer.clear();
+        }
+    }
+    out.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+    return out.good() ? OK : ERR_OPEN;
+}
+
+InputLog::Status InputLog::Load(const std::string& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) {
+        return ERR_OPEN;
+    }
+
+    uint8_t header[kHeaderSize];
+    if (!in.read(reinterpret_cast<char*>(header), sizeof(header)) or
+        memcmp(header, kMagic, 8) != 0 or GetLe(header + 8, 4) != kVersion) {
+        return ERR_FORMAT;
+    }
+    const uint8_t* p = header + 12;
+    finished         = (GetLe(p, 4) & kFlagFinished) != 0;
+    p += 4;
+    uint64_t count = GetLe(p, 8);
+    p += 8;
+    endCycles = GetLe(p, 8);
+    p += 8;
+    endId = GetLe(p, 8);
+    p += 8;
+    memcpy(devicePages, p, 32);
+    if (start.Load(in) != MachineSnapshot::OK or start.IsDelta()) {
+        return ERR_FORMAT;
+    }
+
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(in)),
+                               std::istreambuf_iterator<char>());
+    events.clear();
+    events.reserve(count);
+    size_t at     = 0;
+    uint64_t last = start.GetCpuState().cycles;
+    for (uint64_t i = 0; i < count; i++) {
+        if (at >= bytes.size() or bytes[at] > EVENT_HOST_WRITE) {
+            return ERR_FORMAT;
+        }
+        Event event = {0, 0x0000, 0x00, (EventType)bytes[at++]};
+        uint64_t delta = 0;
+        for (int shift = 0;; shift += 7) {
+            if (at >= bytes.size() or shift > 63) {
+                return ERR_FORMAT;
+            }
+            uint8_t byte = bytes[at++];
+            delta |= (uint64_t)(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                break;
+            }
+        }
+        event.cycle = last + delta;
+        last        = event.cycle;
+        if (HasPayload(event.type)) {
+            if (bytes.size() - at < 3) {
+                return ERR_FORMAT;
+            }
+            event.addr = bytes[at] | (bytes[at + 1] << 8);
+            event.data = bytes[at + 2];
+            at += 3;
+        }
+        events.push_back(event);
+    }
+    return OK;
+}
+
+const char* InputLog::GetStatusName(Status status)
+{
+    switch (status) {
+        case (Status::OK): {
+            return "ok";
+        }
+        case (Status::ERR_OPEN): {
+            return "unable to open input log";
+        }
+        case (Status::ERR_FORMAT): {
+            return "not a valid input log";
+        }
+    }
+    return "xxx";
+}
+
+// recording
+
+void InputRecorder::Start(InputLog* log)
+{
+    Stop();
+    Bus& bus = m_engine.GetBus();
+    memset(log->devicePages, 0, sizeof(log->devicePages));
+    for (unsigned page = 0; page < 256; page++) {
+        if (bus.GetDevice(page)) {
+            log->devicePages[page >> 3] |= 1 << (page & 7);
+        }
+    }
+    m_engine.Snapshot(&log->start);
+    log->events.clear();
+    log->finished  = false;
+    log->endCycles = 0;
+    log->endId     = 0;
+
+    m_log = log;
+    bus.SetDeviceReadListener(this);
+    m_engine.GetCpu().SetInterruptListener(this);
+}
+
+void InputRecorder::Stop()
+{
+    if (!m_log) {
+        return;
+    }
+    m_engine.GetBus().SetDeviceReadListener(nullptr);
+    m_engine.GetCpu().SetInterruptListener(nullptr);
+
+    MachineSnapshot end;
+    m_engine.Snapshot(&end);
+    m_log->finished  = true;
+    m_log->endCycles = m_engine.GetCpu().cycles;
+    m_log->endId     = end.GetId();
+    m_log            = nullptr;
+}
+
+void InputRecorder::HostWrite(uint16_t addr, uint8_t data)
+{
+    if (m_log) {
+        m_log->events.push_back(
+            {m_engine.GetCpu().cycles, addr, data, InputLog::EVENT_HOST_WRITE});
+    }
+    m_engine.GetBus().Write(addr, data);
+}
+
+// replay
+
+Mos6502Engine::Status InputReplayer::Start()
+{
+    Stop();
+    Mos6502Engine::Status status = m_engine.Restore(m_log.start);
+    if (status != Mos6502Engine::OK) {
+        return status;
+    }
+
+    Bus& bus = m_engine.GetBus();
+    for (unsigned page = 0; page < 256; page++) {
+        if (m_log.IsDevicePage(page)) {
+            bus.MapDevice(page, page, this);
+        }
+    }
+    m_mapped = true;
+
+    m_reads.clear();
+    m_timed.clear();
+    for (uint32_t i = 0; i < m_log.events.size(); i++) {
+        if (m_log.events[i].type == InputLog::EVENT_DEVICE_READ) {
+            m_reads.push_back(i);
+        } else {
+            m_timed.push_back(i);
+        }
+    }
+    m_nextRead  = 0;
+    m_nextTimed = 0;
+    m_diverged  = false;
+    ScheduleNextTimed();
+    return Mos6502Engine::OK;
+}
+
+void InputReplayer::Stop()
+{
+    if (m_pending != 0) {
+        m_engine.GetScheduler().Cancel(m_pending);
+        m_pending = 0;
+    }
+    if (m_mapped) {
+        Bus& bus = m_engine.GetBus();
+        for (unsigned page = 0; page < 256; page++) {
+            if (bus.GetDevice(page) == this) {
+                bus.UnmapDevice(page, page);
+            }
+        }
+        m_mapped = false;
+    }
+}
+
+uint8_t InputReplayer::Read(uint16_t addr)
+{
+    if (m_nextRead >= m_reads.size()) {
+        m_diverged = true;
+        return 0xff;
+    }
+    const InputLog::Event& event = m_log.events[m_reads[m_nextRead++]];
+    if (event.addr != addr or event.cycle != m_engine.GetCpu().cycles) {
+        m_diverged = true;
+    }
+    return event.data;
+}
+
+// one timed event in the scheduler at a time, each one schedules the next as it fires
+void InputReplayer::ScheduleNextTimed()
+{
+    m_pending = 0;
+    if (m_nextTimed >= m_timed.size()) {
+        return;
+    }
+    const InputLog::Event& event = m_log.events[m_timed[m_nextTimed++]];
+    m_pending = m_engine.GetScheduler().Schedule(event.cycle, [this, &event](uint64_t) {
+        FireTimed(event);
+        ScheduleNextTimed();
+    });
+}
+
+void InputReplayer::FireTimed(const InputLog::Event& event)
+{
+    MosT6502& cpu = m_engine.GetCpu();
+    if (cpu.cycles != event.cycle) {
+        m_diverged = true;
+    }
+    switch (event.type) {
+        case (InputLog::EVENT_IRQ): {
+            if (cpu.GetFlag(MosT6502::I)) {
+                m_diverged = true;  // the recorded run had I clear here
+            }
+            cpu.SetFlag(MosT6502::I, false);
+            cpu.ExecIRQ();
+            break;
+        }
+        case (InputLog::EVENT_NMI): {
+            cpu.NmExecIRQ();
+            break;
+        }
+        case (InputLog::EVENT_HOST_WRITE): {
+            m_engine.GetBus().Write(event.addr, event.data);
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+
+Mos6502Engine::Status InputReplayer::RunToEnd(MosT6502::StopReason* reason)
+{
+    uint64_t cycles = m_engine.GetCpu().cycles;
+    return m_engine.Run((m_log.endCycles > cycles) ? m_log.endCycles - cycles : 0, reason);
+}
+
+bool InputReplayer::Verify()
+{
+    MachineSnapshot end;
+    m_engine.Snapshot(&end);
+    return m_log.finished and !m_diverged and m_nextRead == m_reads.size() and
+           m_nextTimed == m_timed.size() and m_pending == 0 and
+           m_engine.GetCpu().cycles == m_log.endCycles and end.GetId() == m_log.endId;
+}
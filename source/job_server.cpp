@@ -0,0 +1,199 @@
+#include "../include/job_server.h"
+
+#include <poll.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+namespace {
+
+constexpr size_t kReadChunk     = 256 * 1024;
+constexpr size_t kMaxImageBytes = 0x10000;
+
+uint64_t GetLe(const uint8_t* in, int bytes)
+{
+    uint64_t v = 0;
+    for (int i = bytes - 1; i >= 0; i--) {
+        v = (v << 8) | in[i];
+    }
+    return v;
+}
+
+void AppendLe(std::string* out, uint64_t v, int bytes)
+{
+    for (int i = 0; i < bytes; i++) {
+        out->push_back((char)((v >> (8 * i)) & 0xff));
+    }
+}
+
+}  // namespace
+
+JobServer::JobServer(Mos6502Engine::Core core) : m_in(kReadChunk) { m_engine.SetCore(core); }
+
+JobServer::Status JobServer::Serve(int inFd, int outFd)
+{
+    m_inFd          = inFd;
+    m_outFd         = outFd;
+    m_inPos         = 0;
+    m_inEnd         = 0;
+    m_unflushedJobs = 0;
+    m_out.clear();
+
+    Status status = OK;
+    const uint8_t* record;
+    size_t size;
+    while (NextRecord(&record, &size, &status)) {
+        RunJob(record, size);
+        m_unflushedJobs += 1;
+        if (m_unflushedJobs >= m_flushEvery and !Flush()) {
+            return ERR_WRITE;
+        }
+    }
+    if (!Flush() and status == OK) {
+        status = ERR_WRITE;
+    }
+    return status;
+}
+
+bool JobServer::NextRecord(const uint8_t** data, size_t* size, Status* status)
+{
+    if (!Fill(4, status)) {
+        return false;
+    }
+    size_t length = GetLe(m_in.data() + m_inPos, 4);
+    if (length < kJobHeaderBytes or length > kJobHeaderBytes + kMaxImageBytes) {
+        *status = ERR_FORMAT;
+        return false;
+    }
+    if (!Fill(4 + length, status)) {
+        return false;
+    }
+    *data = m_in.data() + m_inPos + 4;
+    *size = length;
+    m_inPos += 4 + length;
+    return true;
+}
+
+bool JobServer::Fill(size_t want, Status* status)
+{
+    while (m_inEnd - m_inPos < want) {
+        if (m_inPos != 0) {  // keep the unread tail at the front
+            memmove(m_in.data(), m_in.data() + m_inPos, m_inEnd - m_inPos);
+            m_inEnd -= m_inPos;
+            m_inPos = 0;
+        }
+        if (m_in.size() < want) {
+            m_in.resize(want);
+        }
+
+        // nothing to read right now : the client may be waiting for what we have
+        pollfd ready = {m_inFd, POLLIN, 0};
+        if (poll(&ready, 1, 0) == 0 and !Flush()) {
+            *status = ERR_WRITE;
+            return false;
+        }
+
+        ssize_t got = read(m_inFd, m_in.data() + m_inEnd, m_in.size() - m_inEnd);
+        if (got < 0 and errno == EINTR) {
+            continue;
+        }
+        if (got < 0) {
+            *status = ERR_READ;
+            return false;
+        }
+        if (got == 0) {
+            *status = (m_inEnd == m_inPos) ? OK : ERR_FORMAT;
+            return false;
+        }
+        m_inEnd += got;
+        m_stats.bytesIn += got;
+    }
+    return true;
+}
+
+bool JobServer::Flush()
+{
+    size_t done = 0;
+    while (done < m_out.size()) {
+        ssize_t put = write(m_outFd, m_out.data() + done, m_out.size() - done);
+        if (put < 0 and errno == EINTR) {
+            continue;
+        }
+        if (put <= 0) {
+            return false;
+        }
+        done += put;
+        m_stats.writes += 1;
+    }
+    m_stats.bytesOut += m_out.size();
+    m_out.clear();
+    m_unflushedJobs = 0;
+    return true;
+}
+
+void JobServer::RunJob(const uint8_t* record, size_t size)
+{
+    uint32_t jobId      = GetLe(record, 4);
+    uint16_t loadAddr   = GetLe(record + 4, 2);
+    uint16_t startAddr  = GetLe(record + 6, 2);
+    uint64_t cycleLimit = GetLe(record + 8, 8);
+    uint32_t flags      = GetLe(record + 16, 4);
+
+    m_engine.ResetToBaseline();  // zeroes again where the previous job wrote
+    JobStatus jobStatus         = JOB_OK;
+    MosT6502::StopReason reason = MosT6502::StopReason::RUNNING;
+    if (m_engine.Load(record + kJobHeaderBytes, size - kJobHeaderBytes, loadAddr) !=
+        Mos6502Engine::OK) {
+        jobStatus = JOB_IMAGE_BOUNDS;
+    }
+    m_engine.SetResetVector(startAddr);
+    m_engine.Reset();  // power-on registers in the result even when nothing runs
+    if (jobStatus == JOB_OK) {
+        m_engine.Run(cycleLimit, &reason);
+    }
+
+    std::string dump;
+    if ((flags & JOB_DUMP_DIRTY) and jobStatus == JOB_OK) {
+        m_dump.str(std::string());
+        m_engine.GetBus().DumpDirtyRam(m_dump, Bus::DUMP_BINARY);
+        dump = m_dump.str();
+    }
+
+    const MosT6502& cpu = m_engine.GetCpu();
+    AppendLe(&m_out, kResultHeaderBytes + dump.size(), 4);
+    AppendLe(&m_out, jobId, 4);
+    m_out.push_back((char)jobStatus);
+    m_out.push_back((char)reason);
+    AppendLe(&m_out, cpu.pc, 2);
+    m_out.push_back((char)cpu.a);
+    m_out.push_back((char)cpu.x);
+    m_out.push_back((char)cpu.y);
+    m_out.push_back((char)cpu.sp);
+    m_out.push_back((char)cpu.GetStatus());
+    m_out.push_back(0);
+    AppendLe(&m_out, cpu.cycles, 8);
+    AppendLe(&m_out, cpu.instructions, 8);
+    AppendLe(&m_out, dump.size(), 4);
+    m_out.append(dump);
+    m_stats.jobs += 1;
+}
+
+const char* JobServer::GetStatusName(Status status)
+{
+    switch (status) {
+        case (Status::OK): {
+            return "ok";
+        }
+        case (Status::ERR_READ): {
+            return "error reading jobs";
+        }
+        case (Status::ERR_WRITE): {
+            return "error writing results";
+        }
+        case (Status::ERR_FORMAT): {
+            return "malformed job record";
+        }
+    }
+    return "xxx";
+}
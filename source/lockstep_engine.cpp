@@ -0,0 +1,877 @@
+#include "../include/lockstep_engine.h"
+
+#include <cstring>
+
+// The lane kernels are written with GCC vector extensions, one element per lane. RunLanes() is
+// built twice, for AVX2 and for baseline x86-64 (SSE2), and the loader binds whichever the cpu
+// supports. Everything it calls is forced inline (LANE_KERNEL) : a helper left out of line would
+// be built for the baseline and pass 32 byte vectors differently than the AVX2 clone expects.
+#if defined(__x86_64__) && defined(__linux__)
+#define LOCKSTEP_CLONES __attribute__((target_clones("avx2", "default")))
+#else
+#define LOCKSTEP_CLONES
+#endif
+#define LANE_KERNEL __attribute__((always_inline))
+
+namespace {
+
+constexpr unsigned kLanes = LockstepEngine::kBlockLanes;
+
+typedef uint8_t Bytes __attribute__((vector_size(kLanes)));
+typedef int8_t SignedBytes __attribute__((vector_size(kLanes)));
+typedef uint16_t Words __attribute__((vector_size(2 * kLanes)));
+typedef int16_t SignedWords __attribute__((vector_size(2 * kLanes)));
+
+template <typename V, typename T>
+LANE_KERNEL inline V LoadLanes(const T* p)
+{
+    V v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+template <typename V, typename T>
+LANE_KERNEL inline void StoreLanes(T* p, V v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+template <typename V>
+LANE_KERNEL inline V Select(V mask, V a, V b)
+{
+    return (a & mask) | (b & ~mask);
+}
+
+// lanes outside mask keep what p holds
+template <typename V, typename T>
+LANE_KERNEL inline void Merge(T* p, V mask, V v)
+{
+    StoreLanes(p, Select(mask, v, LoadLanes<V>(p)));
+}
+
+template <typename V>
+LANE_KERNEL inline V Splat(unsigned value)
+{
+    V v;
+    for (unsigned i = 0; i < kLanes; i++) {
+        v[i] = value;
+    }
+    return v;
+}
+
+template <typename V>
+LANE_KERNEL inline bool Any(V v)
+{
+    uint64_t words[sizeof(V) / 8];
+    memcpy(words, &v, sizeof(v));
+    uint64_t any = 0;
+    for (uint64_t word : words) {
+        any |= word;
+    }
+    return any != 0;
+}
+
+LANE_KERNEL inline unsigned CountLanes(Bytes mask)
+{
+    uint64_t words[sizeof(Bytes) / 8];
+    Bytes ones = mask & Splat<Bytes>(1);
+    memcpy(words, &ones, sizeof(ones));
+    unsigned count = 0;
+    for (uint64_t word : words) {
+        count += __builtin_popcountll(word);
+    }
+    return count;
+}
+
+// comparisons give -1 / 0 per lane, as masks of every width
+LANE_KERNEL inline Bytes ByteMask(SignedBytes cmp) { return (Bytes)cmp; }
+LANE_KERNEL inline Bytes ByteMask(SignedWords cmp)
+{
+    return (Bytes)__builtin_convertvector(cmp, SignedBytes);
+}
+LANE_KERNEL inline Words WordMask(Bytes mask)
+{
+    return (Words)__builtin_convertvector((SignedBytes)mask, SignedWords);
+}
+LANE_KERNEL inline Words ToWords(Bytes v) { return __builtin_convertvector(v, Words); }
+
+// one block of lanes in the interleaved ram : lane i's byte at addr is base[addr * stride + i]
+struct BlockRam {
+    uint8_t* base;
+    size_t stride;
+
+    LANE_KERNEL uint8_t* Row(uint16_t addr) const { return base + (size_t)addr * stride; }
+    LANE_KERNEL Bytes ReadRow(uint16_t addr) const { return LoadLanes<Bytes>(Row(addr)); }
+
+    // true with *common when every lane of mask uses that one address
+    LANE_KERNEL static bool SameAddress(Words addr, Bytes mask, uint16_t* common)
+    {
+        unsigned first = 0;
+        while (!mask[first]) {
+            first++;
+        }
+        *common = addr[first];
+        return !Any((addr ^ Splat<Words>(*common)) & WordMask(mask));
+    }
+
+    LANE_KERNEL Bytes Read(Words addr, Bytes mask) const
+    {
+        uint16_t common;
+        if (SameAddress(addr, mask, &common)) {
+            return ReadRow(common);
+        }
+        Bytes data = {};
+        for (unsigned i = 0; i < kLanes; i++) {
+            if (mask[i]) {
+                data[i] = base[(size_t)addr[i] * stride + i];
+            }
+        }
+        return data;
+    }
+
+    LANE_KERNEL void Write(Words addr, Bytes mask, Bytes data) const
+    {
+        uint16_t common;
+        if (SameAddress(addr, mask, &common)) {
+            Merge(Row(common), mask, data);
+            return;
+        }
+        for (unsigned i = 0; i < kLanes; i++) {
+            if (mask[i]) {
+                base[(size_t)addr[i] * stride + i] = data[i];
+            }
+        }
+    }
+};
+
+// Run() : at most this many cycles pile up in the 16 bit counts before they are folded into the
+// 64 bit counters; an instruction adds at most 9, so they cannot wrap
+constexpr uint16_t kFoldWindow = 0xff00;
+
+// adds one lane's 16 bit counts to its counters; returns the cycles it may spend until the next
+// fold is due, 0 once its budget is used up
+LANE_KERNEL inline uint16_t FoldCounters(uint64_t* cycles, uint64_t* instructions, uint64_t end,
+                                         uint16_t* spent, uint16_t* counted)
+{
+    *cycles += *spent;
+    *instructions += *counted;
+    *spent   = 0;
+    *counted = 0;
+    if (*cycles >= end) {
+        return 0;
+    }
+    return (end - *cycles < kFoldWindow) ? end - *cycles : kFoldWindow;
+}
+
+// one block's slice of every lane array
+struct Block {
+    uint8_t *a, *x, *y, *sp, *sr, *nValue, *zValue, *carry, *overflow;
+    uint16_t* pc;
+    uint64_t *cycles, *instructions, *end;
+    uint16_t *spent, *counted, *left;
+    uint8_t *running, *reason;
+    BlockRam ram;
+};
+
+LANE_KERNEL inline Bytes GetStatus(const Block& b)
+{
+    Bytes sr   = LoadLanes<Bytes>(b.sr) & Splat<Bytes>(MosT6502::I | MosT6502::D | MosT6502::B |
+                                                      MosT6502::U);
+    Bytes zero = ByteMask(LoadLanes<Bytes>(b.zValue) == Splat<Bytes>(0));
+    return sr | (LoadLanes<Bytes>(b.nValue) & Splat<Bytes>(MosT6502::N)) |
+           (zero & Splat<Bytes>(MosT6502::Z)) | LoadLanes<Bytes>(b.carry) |
+           (LoadLanes<Bytes>(b.overflow) << 6);
+}
+
+LANE_KERNEL inline void SetStatus(const Block& b, Bytes mask, Bytes sr)
+{
+    Merge(b.sr, mask, sr);
+    Merge(b.nValue, mask, sr);
+    Merge(b.zValue, mask, ~sr & Splat<Bytes>(MosT6502::Z));
+    Merge(b.carry, mask, sr & Splat<Bytes>(1));
+    Merge(b.overflow, mask, (sr >> 6) & Splat<Bytes>(1));
+}
+
+LANE_KERNEL inline void SetNz(const Block& b, Bytes mask, Bytes value)
+{
+    Merge(b.nValue, mask, value);
+    Merge(b.zValue, mask, value);
+}
+
+LANE_KERNEL inline void SetFlagBits(const Block& b, Bytes mask, uint8_t bits, bool set)
+{
+    Bytes sr = LoadLanes<Bytes>(b.sr);
+    Merge(b.sr, mask, (set) ? sr | Splat<Bytes>(bits) : sr & Splat<Bytes>((uint8_t)~bits));
+}
+
+LANE_KERNEL inline void Push(const Block& b, Bytes mask, Bytes value)
+{
+    Bytes sp = LoadLanes<Bytes>(b.sp);
+    b.ram.Write(ToWords(sp) | Splat<Words>(0x0100), mask, value);
+    Merge(b.sp, mask, sp - Splat<Bytes>(1));
+}
+
+LANE_KERNEL inline Bytes Pull(const Block& b, Bytes mask)
+{
+    Bytes sp = LoadLanes<Bytes>(b.sp) + Splat<Bytes>(1);
+    Merge(b.sp, mask, sp);
+    return b.ram.Read(ToWords(sp) | Splat<Words>(0x0100), mask);
+}
+
+// PLP / RTI : B is not a real flag, U always reads 1
+LANE_KERNEL inline void PullStatus(const Block& b, Bytes mask)
+{
+    Bytes sr = Pull(b, mask);
+    SetStatus(b, mask, (sr & Splat<Bytes>((uint8_t)~MosT6502::B)) | Splat<Bytes>(MosT6502::U));
+}
+
+// MosT6502::FetchAddress per lane; pcNext is the pc after the instruction. Indexed accesses that
+// cross a page add 1 to *extra where the opcode pays for it.
+LANE_KERNEL inline Words Address(const Block& b, Bytes mask, const MosT6502::OpcodeInfo& info,
+                                 uint16_t operand, uint16_t pcNext, Bytes* extra)
+{
+    auto indexed = [&](Words base, const uint8_t* index) LANE_KERNEL {
+        Words addr = base + ToWords(LoadLanes<Bytes>(index));
+        if (info.flags & MosT6502::OPCODE_PAGE_PENALTY) {
+            Bytes crossed = ByteMask(((addr ^ base) & Splat<Words>(0xff00)) != Splat<Words>(0));
+            *extra += crossed & Splat<Bytes>(1);
+        }
+        return addr;
+    };
+    auto pointer = [&](Words at, Words next) LANE_KERNEL {  // little endian pointer per lane
+        return ToWords(b.ram.Read(at, mask)) | (ToWords(b.ram.Read(next, mask)) << 8);
+    };
+
+    switch (info.addrMode) {
+        case (MosT6502::AddrMode::IMMEDIATE): {
+            return Splat<Words>((uint16_t)(pcNext - 1));
+        }
+        case (MosT6502::AddrMode::RELATIVE): {
+            return Splat<Words>(pcNext);
+        }
+        case (MosT6502::AddrMode::ZERO_PAGE): {
+            return Splat<Words>(operand & 0x00ff);
+        }
+        case (MosT6502::AddrMode::ZERO_PAGE_X): {
+            return (Splat<Words>(operand) + ToWords(LoadLanes<Bytes>(b.x))) & Splat<Words>(0x00ff);
+        }
+        case (MosT6502::AddrMode::ZERO_PAGE_Y): {
+            return (Splat<Words>(operand) + ToWords(LoadLanes<Bytes>(b.y))) & Splat<Words>(0x00ff);
+        }
+        case (MosT6502::AddrMode::ABSOLUTE): {
+            return Splat<Words>(operand);
+        }
+        case (MosT6502::AddrMode::ABSOLUTE_X): {
+            return indexed(Splat<Words>(operand), b.x);
+        }
+        case (MosT6502::AddrMode::ABSOLUTE_Y): {
+            return indexed(Splat<Words>(operand), b.y);
+        }
+        case (MosT6502::AddrMode::INDIRECT): {  // same page quirk as the scalar core
+            uint16_t next = (operand & 0xff00) | ((operand + 1) & 0x00ff);
+            return pointer(Splat<Words>(operand), Splat<Words>(next));
+        }
+        case (MosT6502::AddrMode::INDIRECT_X): {
+            Words at = (Splat<Words>(operand) + ToWords(LoadLanes<Bytes>(b.x))) &
+                       Splat<Words>(0x00ff);
+            return pointer(at, (at + Splat<Words>(1)) & Splat<Words>(0x00ff));
+        }
+        case (MosT6502::AddrMode::INDIRECT_Y): {
+            Words at = Splat<Words>(operand & 0x00ff);
+            return indexed(pointer(at, (at + Splat<Words>(1)) & Splat<Words>(0x00ff)), b.y);
+        }
+        case (MosT6502::AddrMode::IMPLIED): {
+            break;
+        }
+    }
+    return Splat<Words>(0x0000);
+}
+
+// MosT6502::FetchData per lane
+LANE_KERNEL inline Bytes Data(const Block& b, Bytes mask, const MosT6502::OpcodeInfo& info,
+                              uint16_t operand, Words addr)
+{
+    switch (info.addrMode) {
+        case (MosT6502::AddrMode::IMPLIED): {
+            return LoadLanes<Bytes>(b.a);
+        }
+        case (MosT6502::AddrMode::IMMEDIATE):
+        case (MosT6502::AddrMode::RELATIVE): {
+            return Splat<Bytes>(operand & 0x00ff);
+        }
+        default: {
+            return b.ram.Read(addr, mask);
+        }
+    }
+}
+
+// MosT6502::Execute on the lanes of mask, all of them at pc with the same instruction bytes
+LANE_KERNEL inline void ExecuteBlock(const Block& b, Bytes mask,
+                                     const MosT6502::OpcodeInfo& info, uint16_t operand,
+                                     uint16_t pc)
+{
+    typedef MosT6502::InstrName Name;
+
+    uint16_t pcNext = pc + MosT6502::GetInstrLength(info.addrMode);
+    Words newPc     = Splat<Words>(pcNext);
+    Bytes extra     = Splat<Bytes>(0);  // page crossing and branch cycles
+    Bytes one       = Splat<Bytes>(1);
+    Words addr      = Address(b, mask, info, operand, pcNext, &extra);
+
+    // accumulator or memory, for the shifts and rotates
+    auto writeBack = [&](Bytes value) LANE_KERNEL {
+        if (info.addrMode == MosT6502::AddrMode::IMPLIED) {
+            Merge(b.a, mask, value);
+        } else {
+            b.ram.Write(addr, mask, value);
+        }
+    };
+    auto branch = [&](Bytes taken) LANE_KERNEL {
+        taken &= mask;
+        uint16_t target = pcNext + (uint16_t)(int8_t)(operand & 0xff);
+        newPc           = Select(WordMask(taken), Splat<Words>(target), newPc);
+        extra           = taken & Splat<Bytes>(((target ^ pcNext) & 0xff00) ? 2 : 1);
+    };
+    auto compare = [&](const uint8_t* reg) LANE_KERNEL {
+        Bytes r = LoadLanes<Bytes>(reg);
+        Bytes d = Data(b, mask, info, operand, addr);
+        Merge(b.carry, mask, ByteMask(r >= d) & one);
+        SetNz(b, mask, r - d);
+    };
+    auto load = [&](uint8_t* reg) LANE_KERNEL {
+        Bytes d = Data(b, mask, info, operand, addr);
+        Merge(reg, mask, d);
+        SetNz(b, mask, d);
+    };
+    auto transfer = [&](const uint8_t* from, uint8_t* to) LANE_KERNEL {
+        Bytes v = LoadLanes<Bytes>(from);
+        Merge(to, mask, v);
+        SetNz(b, mask, v);
+    };
+    auto step = [&](uint8_t* reg, Bytes delta) LANE_KERNEL {
+        Bytes v = LoadLanes<Bytes>(reg) + delta;
+        Merge(reg, mask, v);
+        SetNz(b, mask, v);
+    };
+
+    switch (info.instrName) {
+        case (Name::BRK): {
+            Push(b, mask, Splat<Bytes>(pcNext >> 8));
+            Push(b, mask, Splat<Bytes>(pcNext & 0xff));
+            Push(b, mask, GetStatus(b) | Splat<Bytes>(MosT6502::B | MosT6502::U));
+            SetFlagBits(b, mask, MosT6502::I, true);
+            newPc = ToWords(b.ram.ReadRow(0xfffe)) | (ToWords(b.ram.ReadRow(0xffff)) << 8);
+            Merge(b.reason, mask, Splat<Bytes>(MosT6502::StopReason::BREAK));
+            break;
+        }
+        case (Name::ADC):
+        case (Name::SBC): {
+            bool subtract = (info.instrName == Name::SBC);
+            Bytes m       = Data(b, mask, info, operand, addr);
+            Bytes d       = subtract ? ~m : m;
+            Bytes a       = LoadLanes<Bytes>(b.a);
+            Bytes c       = LoadLanes<Bytes>(b.carry);
+            Bytes r       = a + d + c;
+            Merge(b.carry, mask, (ByteMask(r < a) | (ByteMask(r == a) & ByteMask(c != 0))) & one);
+            Merge(b.overflow, mask, ((~(a ^ d) & (a ^ r)) >> 7) & one);
+            SetNz(b, mask, r);
+            Merge(b.a, mask, r);
+
+            // lanes with D set redo it from the decimal table, see MosT6502::AddDecimal()
+            Bytes sr      = LoadLanes<Bytes>(b.sr);
+            Bytes decimal = mask & ByteMask((sr & Splat<Bytes>(MosT6502::D)) != 0);
+            if (Any(decimal)) {
+                Bytes result = {}, flags = {};
+                for (unsigned i = 0; i < kLanes; i++) {
+                    if (decimal[i]) {
+                        uint16_t entry =
+                                MosT6502::kDecimalTable.entries[subtract][c[i]][a[i]][m[i]];
+                        result[i] = entry & 0xff;
+                        flags[i]  = entry >> 8;
+                    }
+                }
+                Merge(b.a, decimal, result);
+                Merge(b.nValue, decimal, flags);
+                Merge(b.zValue, decimal, ~flags & Splat<Bytes>(MosT6502::Z));
+                Merge(b.carry, decimal, flags & one);
+                Merge(b.overflow, decimal, (flags >> 6) & one);
+            }
+            break;
+        }
+        case (Name::AND): {
+            Bytes a = LoadLanes<Bytes>(b.a) & Data(b, mask, info, operand, addr);
+            Merge(b.a, mask, a);
+            SetNz(b, mask, a);
+            break;
+        }
+        case (Name::EOR): {
+            Bytes a = LoadLanes<Bytes>(b.a) ^ Data(b, mask, info, operand, addr);
+            Merge(b.a, mask, a);
+            SetNz(b, mask, a);
+            break;
+        }
+        case (Name::ORA): {
+            Bytes a = LoadLanes<Bytes>(b.a) | Data(b, mask, info, operand, addr);
+            Merge(b.a, mask, a);
+            SetNz(b, mask, a);
+            break;
+        }
+        case (Name::ASL): {
+            Bytes d = Data(b, mask, info, operand, addr);
+            Bytes r = d << 1;
+            Merge(b.carry, mask, d >> 7);
+            SetNz(b, mask, r);
+            writeBack(r);
+            break;
+        }
+        case (Name::LSR): {
+            Bytes d = Data(b, mask, info, operand, addr);
+            Bytes r = d >> 1;
+            Merge(b.carry, mask, d & one);
+            SetNz(b, mask, r);
+            writeBack(r);
+            break;
+        }
+        case (Name::ROL): {
+            Bytes d = Data(b, mask, info, operand, addr);
+            Bytes r = (d << 1) | LoadLanes<Bytes>(b.carry);
+            Merge(b.carry, mask, d >> 7);
+            SetNz(b, mask, r);
+            writeBack(r);
+            break;
+        }
+        case (Name::ROR): {
+            Bytes d = Data(b, mask, info, operand, addr);
+            Bytes r = (LoadLanes<Bytes>(b.carry) << 7) | (d >> 1);
+            Merge(b.carry, mask, d & one);
+            SetNz(b, mask, r);
+            writeBack(r);
+            break;
+        }
+        case (Name::BIT): {
+            Bytes d = Data(b, mask, info, operand, addr);
+            Merge(b.zValue, mask, LoadLanes<Bytes>(b.a) & d);
+            Merge(b.nValue, mask, d);
+            Merge(b.overflow, mask, (d >> 6) & one);
+            break;
+        }
+        case (Name::BCC): {
+            branch(ByteMask(LoadLanes<Bytes>(b.carry) == Splat<Bytes>(0)));
+            break;
+        }
+        case (Name::BCS): {
+            branch(ByteMask(LoadLanes<Bytes>(b.carry) != Splat<Bytes>(0)));
+            break;
+        }
+        case (Name::BEQ): {
+            branch(ByteMask(LoadLanes<Bytes>(b.zValue) == Splat<Bytes>(0)));
+            break;
+        }
+        case (Name::BNE): {
+            branch(ByteMask(LoadLanes<Bytes>(b.zValue) != Splat<Bytes>(0)));
+            break;
+        }
+        case (Name::BMI): {
+            branch(ByteMask((LoadLanes<Bytes>(b.nValue) & Splat<Bytes>(0x80)) != Splat<Bytes>(0)));
+            break;
+        }
+        case (Name::BPL): {
+            branch(ByteMask((LoadLanes<Bytes>(b.nValue) & Splat<Bytes>(0x80)) == Splat<Bytes>(0)));
+            break;
+        }
+        case (Name::BVC): {
+            branch(ByteMask(LoadLanes<Bytes>(b.overflow) == Splat<Bytes>(0)));
+            break;
+        }
+        case (Name::BVS): {
+            branch(ByteMask(LoadLanes<Bytes>(b.overflow) != Splat<Bytes>(0)));
+            break;
+        }
+        case (Name::CLC): {
+            Merge(b.carry, mask, Splat<Bytes>(0));
+            break;
+        }
+        case (Name::SEC): {
+            Merge(b.carry, mask, one);
+            break;
+        }
+        case (Name::CLV): {
+            Merge(b.overflow, mask, Splat<Bytes>(0));
+            break;
+        }
+        case (Name::CLD): {
+            SetFlagBits(b, mask, MosT6502::D, false);
+            break;
+        }
+        case (Name::SED): {
+            SetFlagBits(b, mask, MosT6502::D, true);
+            break;
+        }
+        case (Name::CLI): {  // no irq lines here, nothing to unmask
+            SetFlagBits(b, mask, MosT6502::I, false);
+            break;
+        }
+        case (Name::SEI): {
+            SetFlagBits(b, mask, MosT6502::I, true);
+            break;
+        }
+        case (Name::CMP): {
+            compare(b.a);
+            break;
+        }
+        case (Name::CPX): {
+            compare(b.x);
+            break;
+        }
+        case (Name::CPY): {
+            compare(b.y);
+            break;
+        }
+        case (Name::DEC):
+        case (Name::INC): {
+            Bytes d = Data(b, mask, info, operand, addr);
+            Bytes r = (info.instrName == Name::INC) ? d + one : d - one;
+            b.ram.Write(addr, mask, r);
+            SetNz(b, mask, r);
+            break;
+        }
+        case (Name::DEX): {
+            step(b.x, Splat<Bytes>(0xff));
+            break;
+        }
+        case (Name::DEY): {
+            step(b.y, Splat<Bytes>(0xff));
+            break;
+        }
+        case (Name::INX): {
+            step(b.x, one);
+            break;
+        }
+        case (Name::INY): {
+            step(b.y, one);
+            break;
+        }
+        case (Name::JMP): {
+            newPc = addr;
+            break;
+        }
+        case (Name::JSR): {
+            uint16_t ret = pcNext - 1;
+            Push(b, mask, Splat<Bytes>(ret >> 8));
+            Push(b, mask, Splat<Bytes>(ret & 0xff));
+            newPc = addr;
+            break;
+        }
+        case (Name::LDA): {
+            load(b.a);
+            break;
+        }
+        case (Name::LDX): {
+            load(b.x);
+            break;
+        }
+        case (Name::LDY): {
+            load(b.y);
+            break;
+        }
+        case (Name::NOP): {
+            break;
+        }
+        case (Name::PHA): {
+            Push(b, mask, LoadLanes<Bytes>(b.a));
+            break;
+        }
+        case (Name::PHP): {
+            Push(b, mask, GetStatus(b) | Splat<Bytes>(MosT6502::B | MosT6502::U));
+            break;
+        }
+        case (Name::PLA): {
+            Bytes a = Pull(b, mask);
+            Merge(b.a, mask, a);
+            SetNz(b, mask, a);
+            break;
+        }
+        case (Name::PLP): {
+            PullStatus(b, mask);
+            break;
+        }
+        case (Name::RTI): {
+            PullStatus(b, mask);
+            Bytes lo = Pull(b, mask);
+            Bytes hi = Pull(b, mask);
+            newPc    = ToWords(lo) | (ToWords(hi) << 8);
+            break;
+        }
+        case (Name::RTS): {
+            Bytes lo = Pull(b, mask);
+            Bytes hi = Pull(b, mask);
+            newPc    = (ToWords(lo) | (ToWords(hi) << 8)) + Splat<Words>(1);
+            break;
+        }
+        case (Name::STA): {
+            b.ram.Write(addr, mask, LoadLanes<Bytes>(b.a));
+            break;
+        }
+        case (Name::STX): {
+            b.ram.Write(addr, mask, LoadLanes<Bytes>(b.x));
+            break;
+        }
+        case (Name::STY): {
+            b.ram.Write(addr, mask, LoadLanes<Bytes>(b.y));
+            break;
+        }
+        case (Name::TAX): {
+            transfer(b.a, b.x);
+            break;
+        }
+        case (Name::TAY): {
+            transfer(b.a, b.y);
+            break;
+        }
+        case (Name::TSX): {
+            transfer(b.sp, b.x);
+            break;
+        }
+        case (Name::TXA): {
+            transfer(b.x, b.a);
+            break;
+        }
+        case (Name::TXS): {
+            Merge(b.sp, mask, LoadLanes<Bytes>(b.x));
+            break;
+        }
+        case (Name::TYA): {
+            transfer(b.y, b.a);
+            break;
+        }
+        default: {  // decoded as legal but without an implementation, nothing ran
+            Merge(b.reason, mask, Splat<Bytes>(MosT6502::StopReason::ILLEGAL_OPCODE));
+            Merge(b.running, mask, Splat<Bytes>(0));
+            return;
+        }
+    }
+
+    Merge(b.pc, WordMask(mask), newPc);
+    // the 64 bit counters do not fit a register as vectors : count in 16 bits, fold when due
+    Bytes cost  = (extra + Splat<Bytes>(info.cycles)) & mask;
+    Words spent = LoadLanes<Words>(b.spent) + ToWords(cost);
+    StoreLanes(b.spent, spent);
+    StoreLanes(b.counted, LoadLanes<Words>(b.counted) + ToWords(mask & one));
+    Bytes stopped =
+            ByteMask(LoadLanes<Bytes>(b.reason) != Splat<Bytes>(MosT6502::StopReason::RUNNING));
+    Bytes due = ByteMask(spent >= LoadLanes<Words>(b.left)) & mask;
+    if (Any(due)) {
+        for (unsigned i = 0; i < kLanes; i++) {
+            if (due[i]) {
+                b.left[i] = FoldCounters(&b.cycles[i], &b.instructions[i], b.end[i], &b.spent[i],
+                                         &b.counted[i]);
+            }
+        }
+        stopped |= due & ByteMask(LoadLanes<Words>(b.left) == Splat<Words>(0));
+    }
+    Merge(b.running, mask & stopped, Splat<Bytes>(0));
+}
+
+}  // namespace
+
+LockstepEngine::LockstepEngine(unsigned lanes)
+    : m_lanes((lanes != 0) ? lanes : 1),
+      m_stride((m_lanes + kBlockLanes - 1) / kBlockLanes * kBlockLanes),
+      m_ram(new uint8_t[0x10000 * m_stride]())
+{
+    for (auto* bytes : {&m_a, &m_x, &m_y, &m_sp, &m_sr, &m_nValue, &m_zValue, &m_carry,
+                        &m_overflow, &m_running, &m_reason}) {
+        bytes->assign(m_stride, 0x00);
+    }
+    m_pc.assign(m_stride, 0x0000);
+    m_cycles.assign(m_stride, 0);
+    m_instructions.assign(m_stride, 0);
+    m_end.assign(m_stride, 0);
+    m_spent.assign(m_stride, 0);
+    m_counted.assign(m_stride, 0);
+    m_left.assign(m_stride, 0);
+}
+
+LockstepEngine::Status LockstepEngine::Load(const uint8_t* image, size_t size, uint16_t loadAddr)
+{
+    if (size > 0x10000 - (size_t)loadAddr) {
+        return ERR_IMAGE_BOUNDS;
+    }
+    for (size_t i = 0; i < size; i++) {
+        memset(Row(loadAddr + i), image[i], m_stride);
+    }
+    return OK;
+}
+
+LockstepEngine::Status LockstepEngine::LoadLane(unsigned lane, const uint8_t* image, size_t size,
+                                                uint16_t loadAddr)
+{
+    if (size > 0x10000 - (size_t)loadAddr) {
+        return ERR_IMAGE_BOUNDS;
+    }
+    for (size_t i = 0; i < size; i++) {
+        Row(loadAddr + i)[lane] = image[i];
+    }
+    return OK;
+}
+
+void LockstepEngine::SetResetVector(uint16_t addr)
+{
+    memset(Row(0xfffc), addr & 0xff, m_stride);
+    memset(Row(0xfffd), (addr >> 8) & 0xff, m_stride);
+}
+
+void LockstepEngine::Reset()
+{
+    for (size_t lane = 0; lane < m_stride; lane++) {
+        LaneState state;
+        state.a = state.x = state.y = 0x00;
+        state.sp                    = 0xff;
+        state.sr                    = MosT6502::U;
+        state.pc                    = Row(0xfffc)[lane] | (Row(0xfffd)[lane] << 8);
+        state.cycles                = 0;
+        state.instructions          = 0;
+        SetLane(lane, state);
+        m_reason[lane] = MosT6502::StopReason::RUNNING;
+    }
+    m_isReset = true;
+}
+
+LockstepEngine::LaneState LockstepEngine::GetLane(unsigned lane) const
+{
+    uint8_t sr = (m_sr[lane] & ~(MosT6502::N | MosT6502::Z | MosT6502::C | MosT6502::V)) |
+                 (m_nValue[lane] & MosT6502::N) | ((m_zValue[lane] == 0) ? MosT6502::Z : 0) |
+                 (m_carry[lane] ? MosT6502::C : 0) | (m_overflow[lane] ? MosT6502::V : 0);
+    return {m_a[lane], m_x[lane],      m_y[lane],           m_sp[lane],
+            sr,        m_pc[lane],     m_cycles[lane],      m_instructions[lane]};
+}
+
+void LockstepEngine::SetLane(unsigned lane, const LaneState& state)
+{
+    m_a[lane]            = state.a;
+    m_x[lane]            = state.x;
+    m_y[lane]            = state.y;
+    m_sp[lane]           = state.sp;
+    m_pc[lane]           = state.pc;
+    m_cycles[lane]       = state.cycles;
+    m_instructions[lane] = state.instructions;
+    // like MosT6502::SetStatus
+    m_sr[lane]       = state.sr;
+    m_nValue[lane]   = state.sr;
+    m_zValue[lane]   = ~state.sr & MosT6502::Z;
+    m_carry[lane]    = state.sr & MosT6502::C;
+    m_overflow[lane] = (state.sr & MosT6502::V) ? 1 : 0;
+}
+
+LockstepEngine::Status LockstepEngine::Run(uint64_t cycleBudget)
+{
+    if (!m_isReset) {
+        return ERR_NOT_RESET;
+    }
+    for (size_t lane = 0; lane < m_stride; lane++) {
+        m_end[lane]     = m_cycles[lane] + cycleBudget;
+        m_left[lane]    = FoldCounters(&m_cycles[lane], &m_instructions[lane], m_end[lane],
+                                    &m_spent[lane], &m_counted[lane]);
+        m_running[lane] = (lane < m_lanes and m_left[lane] != 0) ? 0xff : 0x00;
+        m_reason[lane]  = MosT6502::StopReason::RUNNING;
+    }
+    RunLanes();
+    for (size_t lane = 0; lane < m_stride; lane++) {
+        FoldCounters(&m_cycles[lane], &m_instructions[lane], m_end[lane], &m_spent[lane],
+                     &m_counted[lane]);
+        if (m_reason[lane] == MosT6502::StopReason::RUNNING) {
+            m_reason[lane] = MosT6502::StopReason::CYCLE_BUDGET;
+        }
+    }
+    return OK;
+}
+
+LOCKSTEP_CLONES void LockstepEngine::RunLanes()
+{
+    size_t blocks = m_stride / kLanes;
+    auto block    = [this](size_t index) LANE_KERNEL {
+        size_t first = index * kLanes;
+        return Block{&m_a[first],      &m_x[first],       &m_y[first],
+                     &m_sp[first],     &m_sr[first],      &m_nValue[first],
+                     &m_zValue[first], &m_carry[first],   &m_overflow[first],
+                     &m_pc[first],     &m_cycles[first],  &m_instructions[first],
+                     &m_end[first],    &m_spent[first],   &m_counted[first],
+                     &m_left[first],   &m_running[first], &m_reason[first],
+                     {m_ram.get() + first, m_stride}};
+    };
+
+    while (true) {
+        // lowest pc of all running lanes
+        Words lowest     = Splat<Words>(0xffff);
+        Bytes anyRunning = Splat<Bytes>(0);
+        for (size_t i = 0; i < blocks; i++) {
+            Bytes running = LoadLanes<Bytes>(&m_running[i * kLanes]);
+            Words pcs     = Select(WordMask(running), LoadLanes<Words>(&m_pc[i * kLanes]),
+                               Splat<Words>(0xffff));
+            lowest = Select((Words)(pcs < lowest), pcs, lowest);
+            anyRunning |= running;
+        }
+        if (!Any(anyRunning)) {
+            break;
+        }
+        uint16_t pc = 0xffff;
+        for (unsigned i = 0; i < kLanes; i++) {
+            pc = (lowest[i] < pc) ? lowest[i] : pc;
+        }
+
+        // the first lane there decides which instruction this step runs
+        size_t firstBlock = 0;
+        Bytes there;
+        while (true) {
+            there = LoadLanes<Bytes>(&m_running[firstBlock * kLanes]) &
+                    ByteMask(LoadLanes<Words>(&m_pc[firstBlock * kLanes]) == Splat<Words>(pc));
+            if (Any(there)) {
+                break;
+            }
+            firstBlock++;
+        }
+        size_t leader = firstBlock * kLanes;
+        while (!there[leader % kLanes]) {
+            leader++;
+        }
+        uint8_t opcode                   = Row(pc)[leader];
+        const MosT6502::OpcodeInfo& info = MosT6502::Decode(opcode);
+        bool runs       = opcode != TERMINATE_OPCODE and MosT6502::IsLegal(info);
+        unsigned length = (runs) ? MosT6502::GetInstrLength(info.addrMode) : 1;
+        uint8_t operandLo = Row(pc + 1)[leader];
+        uint8_t operandHi = Row(pc + 2)[leader];
+        uint16_t operand  = (length == 3) ? operandLo | (operandHi << 8)
+                                          : (length == 2) ? operandLo : 0x0000;
+
+        unsigned lanes = 0;
+        for (size_t i = firstBlock; i < blocks; i++) {
+            Block b     = block(i);
+            Bytes group = LoadLanes<Bytes>(b.running) &
+                          ByteMask(LoadLanes<Words>(b.pc) == Splat<Words>(pc)) &
+                          ByteMask(b.ram.ReadRow(pc) == Splat<Bytes>(opcode));
+            if (length >= 2) {
+                group &= ByteMask(b.ram.ReadRow(pc + 1) == Splat<Bytes>(operandLo));
+            }
+            if (length == 3) {
+                group &= ByteMask(b.ram.ReadRow(pc + 2) == Splat<Bytes>(operandHi));
+            }
+            if (!Any(group)) {
+                continue;
+            }
+            lanes += CountLanes(group);
+            if (runs) {
+                ExecuteBlock(b, group, info, operand, pc);
+            } else {  // pc stays on the opcode, like the scalar core
+                MosT6502::StopReason reason = (opcode == TERMINATE_OPCODE)
+                                                      ? MosT6502::StopReason::TERMINATED
+                                                      : MosT6502::StopReason::ILLEGAL_OPCODE;
+                Merge(b.reason, group, Splat<Bytes>(reason));
+                Merge(b.running, group, Splat<Bytes>(0));
+            }
+        }
+        if (runs) {
+            m_stats.steps += 1;
+            m_stats.laneInstructions += lanes;
+        }
+    }
+}
@@ -0,0 +1,285 @@
+#include "../include/machine_snapshot.h"
+
+#include <cstring>
+#include <fstream>
+
+#include "../include/bus.h"
+
+namespace {
+
+const char kMagic[8]       = {'M', '6', '5', 'S', 'N', 'A', 'P', '\0'};
+const uint32_t kVersion    = 1;
+const uint32_t kFlagDelta  = 1;
+const size_t kCpuStateSize = 8 + 8 + 8;  // a x y sp sr pad pc, cycles, instructions
+
+class Fnv1a {
+   public:
+    void Add(const uint8_t* bytes, size_t size)
+    {
+        for (size_t i = 0; i < size; i++) {
+            m_hash ^= bytes[i];
+            m_hash *= 0x100000001b3ull;
+        }
+    }
+    void Add(uint64_t v)
+    {
+        uint8_t bytes[8];
+        for (int i = 0; i < 8; i++) {
+            bytes[i] = (v >> (8 * i)) & 0xff;
+        }
+        Add(bytes, 8);
+    }
+    uint64_t Get() const { return m_hash; }
+
+   private:
+    uint64_t m_hash = 0xcbf29ce484222325ull;
+};
+
+void PutLe(uint8_t* out, uint64_t v, int bytes)
+{
+    for (int i = 0; i < bytes; i++) {
+        out[i] = (v >> (8 * i)) & 0xff;
+    }
+}
+
+uint64_t GetLe(const uint8_t* in, int bytes)
+{
+    uint64_t v = 0;
+    for (int i = bytes - 1; i >= 0; i--) {
+        v = (v << 8) | in[i];
+    }
+    return v;
+}
+
+Fnv1a CpuHash(const MachineSnapshot::CpuState& cpu)  // the start of a content id
+{
+    Fnv1a hash;
+    hash.Add(cpu.a);
+    hash.Add(cpu.x);
+    hash.Add(cpu.y);
+    hash.Add(cpu.sp);
+    hash.Add(cpu.sr);
+    hash.Add(cpu.pc);
+    hash.Add(cpu.cycles);
+    hash.Add(cpu.instructions);
+    return hash;
+}
+
+uint64_t ContentId(const MachineSnapshot::CpuState& cpu, Bus& bus)
+{
+    Fnv1a hash = CpuHash(cpu);
+    for (unsigned page = 0; page < 256; page++) {
+        hash.Add(bus.RamPage(page), 256);
+    }
+    return hash.Get();
+}
+
+uint64_t ContentId(const MachineSnapshot::CpuState& cpu, const std::vector<uint8_t>& ram)
+{
+    Fnv1a hash = CpuHash(cpu);
+    hash.Add(ram.data(), ram.size());
+    return hash.Get();
+}
+
+}  // namespace
+
+void MachineSnapshot::CaptureCpu(Bus& bus)
+{
+    const MosT6502& cpu = bus.GetMicroprocessor();
+    m_cpu               = {cpu.a, cpu.x, cpu.y, cpu.sp, cpu.GetStatus(), cpu.pc, cpu.cycles, cpu.instructions};
+}
+
+void MachineSnapshot::Capture(Bus& bus)
+{
+    CaptureCpu(bus);
+    m_isDelta = false;
+    m_baseId  = 0;
+    memset(m_pageBitmap, 0xff, sizeof(m_pageBitmap));
+    m_pages.resize(0x10000);
+    for (unsigned page = 0; page < 256; page++) {
+        memcpy(&m_pages[page << 8], bus.RamPage(page), 256);
+    }
+    m_id = ContentId(m_cpu, bus);
+}
+
+MachineSnapshot::Status MachineSnapshot::CaptureDelta(Bus& bus, const MachineSnapshot& base)
+{
+    if (base.IsDelta()) {
+        return ERR_BASE_MISMATCH;
+    }
+    CaptureCpu(bus);
+    m_isDelta = true;
+    m_baseId  = base.GetId();
+    memset(m_pageBitmap, 0x00, sizeof(m_pageBitmap));
+    m_pages.clear();
+    for (unsigned page = 0; page < 256; page++) {
+        const uint8_t* current = bus.RamPage(page);
+        if (memcmp(current, base.FindPage(page), 256) != 0) {
+            m_pageBitmap[page >> 3] |= 1 << (page & 7);
+            m_pages.insert(m_pages.end(), current, current + 256);
+        }
+    }
+    m_id = ContentId(m_cpu, bus);
+    return OK;
+}
+
+const uint8_t* MachineSnapshot::FindPage(uint8_t page) const { return &m_pages[page << 8]; }
+
+MachineSnapshot::Status MachineSnapshot::Restore(Bus& bus, const MachineSnapshot* base) const
+{
+    if (m_isDelta) {
+        if (base == nullptr or base->IsDelta() or base->GetId() != m_baseId) {
+            return ERR_BASE_MISMATCH;
+        }
+        base->Restore(bus);
+    }
+
+    const uint8_t* data = m_pages.data();
+    for (unsigned page = 0; page < 256; page++) {
+        if (HasPage(page)) {
+            bus.LoadRamPage(page, data);
+            data += 256;
+        }
+    }
+
+    MosT6502& cpu    = bus.GetMicroprocessor();
+    cpu.a            = m_cpu.a;
+    cpu.x            = m_cpu.x;
+    cpu.y            = m_cpu.y;
+    cpu.sp           = m_cpu.sp;
+    cpu.pc           = m_cpu.pc;
+    cpu.cycles       = m_cpu.cycles;
+    cpu.instructions = m_cpu.instructions;
+    cpu.SetStatus(m_cpu.sr);
+    return OK;
+}
+
+MachineSnapshot::Status MachineSnapshot::Save(const std::string& path) const
+{
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) {
+        return ERR_OPEN;
+    }
+    return Save(out);
+}
+
+MachineSnapshot::Status MachineSnapshot::Load(const std::string& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) {
+        return ERR_OPEN;
+    }
+    return Load(in);
+}
+
+MachineSnapshot::Status MachineSnapshot::Save(std::ostream& out) const
+{
+    uint8_t header[8 + 4 + 4 + 8 + 8 + kCpuStateSize + 32];
+    uint8_t* p = header;
+    memcpy(p, kMagic, 8);
+    p += 8;
+    PutLe(p, kVersion, 4);
+    p += 4;
+    PutLe(p, m_isDelta ? kFlagDelta : 0, 4);
+    p += 4;
+    PutLe(p, m_id, 8);
+    p += 8;
+    PutLe(p, m_baseId, 8);
+    p += 8;
+    *p++ = m_cpu.a;
+    *p++ = m_cpu.x;
+    *p++ = m_cpu.y;
+    *p++ = m_cpu.sp;
+    *p++ = m_cpu.sr;
+    *p++ = 0x00;
+    PutLe(p, m_cpu.pc, 2);
+    p += 2;
+    PutLe(p, m_cpu.cycles, 8);
+    p += 8;
+    PutLe(p, m_cpu.instructions, 8);
+    p += 8;
+    memcpy(p, m_pageBitmap, 32);
+
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(m_pages.data()), m_pages.size());
+    return out.good() ? OK : ERR_OPEN;
+}
+
+// everything is parsed into locals first : on any error the snapshot is left as it was
+MachineSnapshot::Status MachineSnapshot::Load(std::istream& in)
+{
+    uint8_t header[8 + 4 + 4 + 8 + 8 + kCpuStateSize + 32];
+    if (!in.read(reinterpret_cast<char*>(header), sizeof(header)) or
+        memcmp(header, kMagic, 8) != 0 or GetLe(header + 8, 4) != kVersion) {
+        return ERR_FORMAT;
+    }
+
+    const uint8_t* p = header + 12;
+    uint32_t flags   = GetLe(p, 4);
+    p += 4;
+    bool isDelta = (flags & kFlagDelta) != 0;
+    uint64_t id  = GetLe(p, 8);
+    p += 8;
+    uint64_t baseId = GetLe(p, 8);
+    p += 8;
+    CpuState cpu;
+    cpu.a  = *p++;
+    cpu.x  = *p++;
+    cpu.y  = *p++;
+    cpu.sp = *p++;
+    cpu.sr = *p++;
+    p++;
+    cpu.pc = GetLe(p, 2);
+    p += 2;
+    cpu.cycles = GetLe(p, 8);
+    p += 8;
+    cpu.instructions = GetLe(p, 8);
+    p += 8;
+    const uint8_t* bitmap = p;
+
+    size_t pageCount = 0;
+    for (unsigned page = 0; page < 256; page++) {
+        pageCount += (bitmap[page >> 3] & (1 << (page & 7))) ? 1 : 0;
+    }
+    if (!isDelta and pageCount != 256) {
+        return ERR_FORMAT;
+    }
+    std::vector<uint8_t> pages(pageCount * 256);
+    if (!in.read(reinterpret_cast<char*>(pages.data()), pages.size())) {
+        return ERR_FORMAT;
+    }
+    // a delta only holds part of the ram its id covers, Restore() goes by its base id
+    if (!isDelta and ContentId(cpu, pages) != id) {
+        return ERR_CORRUPT;
+    }
+
+    m_isDelta = isDelta;
+    m_id      = id;
+    m_baseId  = baseId;
+    m_cpu     = cpu;
+    memcpy(m_pageBitmap, bitmap, 32);
+    m_pages.swap(pages);
+    return OK;
+}
+
+const char* MachineSnapshot::GetStatusName(Status status)
+{
+    switch (status) {
+        case (Status::OK): {
+            return "ok";
+        }
+        case (Status::ERR_OPEN): {
+            return "unable to open snapshot file";
+        }
+        case (Status::ERR_FORMAT): {
+            return "not a valid snapshot file";
+        }
+        case (Status::ERR_BASE_MISMATCH): {
+            return "delta snapshot does not belong to this base";
+        }
+        case (Status::ERR_CORRUPT): {
+            return "snapshot contents do not match its id";
+        }
+    }
+    return "xxx";
+}
@@ -0,0 +1,202 @@
+#include "../include/mos6502_engine.h"
+
+#include <algorithm>
+
+#include "../include/breakpoints.h"
+#include "../include/threaded_core.h"
+
+Mos6502Engine::Mos6502Engine() : m_scheduler(m_bus.GetMicroprocessor())
+{
+    m_bus.Initialize();
+    SetCore(CORE_BLOCK_CACHE);
+}
+
+void Mos6502Engine::SetCore(Core core)
+{
+    m_core = core;
+    m_recompiledCore.reset();  // one code write listener at a time
+    if (core == CORE_RECOMPILED) {
+        m_blockCache.reset();
+        if (m_recompiledModule) {
+            m_recompiledCore.reset(new RecompiledCore(m_bus, *m_recompiledModule));
+        }
+        return;
+    }
+    if (core == CORE_INTERPRETER or core == CORE_THREADED) {
+        m_blockCache.reset();
+        return;
+    }
+    if (!m_blockCache) {
+        m_blockCache.reset(new BlockCache(m_bus));
+    }
+    m_blockCache->SetJitEnabled(core == CORE_JIT);
+}
+
+void Mos6502Engine::SetRecompiledModule(const RecompiledModule* module)
+{
+    m_recompiledCore.reset();
+    m_recompiledModule = module;
+    m_recompiledLibrary.reset();
+    SetCore(m_core);
+}
+
+Mos6502Engine::Status Mos6502Engine::LoadRecompiled(const std::string& path)
+{
+    std::unique_ptr<RecompiledLibrary> library(new RecompiledLibrary);
+    if (library->Open(path) != RecompiledLibrary::OK) {
+        return ERR_RECOMPILED;
+    }
+    SetRecompiledModule(library->GetModule());
+    m_recompiledLibrary = std::move(library);
+    return OK;
+}
+
+Mos6502Engine::Status Mos6502Engine::Load(const uint8_t* image, size_t size, uint16_t loadAddr)
+{
+    if (size > 0x10000 - (size_t)loadAddr) {
+        return ERR_IMAGE_BOUNDS;
+    }
+    m_bus.WriteBlock(loadAddr, image, size);
+    return OK;
+}
+
+Mos6502Engine::Status Mos6502Engine::LoadImage(const ProgramImage& image, uint16_t loadAddr,
+                                               uint16_t startAddr, bool useImageResetVector)
+{
+    if (image.LoadInto(m_bus, loadAddr) != ProgramImage::OK) {
+        return ERR_IMAGE_BOUNDS;
+    }
+    if (!useImageResetVector or !image.ProvidesResetVector(loadAddr)) {
+        SetResetVector(startAddr);
+    }
+    return OK;
+}
+
+void Mos6502Engine::SetResetVector(uint16_t addr)
+{
+    m_bus.Write(0xfffc, addr & 0xff);
+    m_bus.Write(0xfffd, (addr >> 8) & 0xff);
+}
+
+void Mos6502Engine::Clear()
+{
+    m_bus.Initialize();
+    ClearDeviceState();
+    m_isReset = false;
+}
+
+Mos6502Engine::Status Mos6502Engine::Reset()
+{
+    m_bus.ClearDirtyPages();  // from here on dirty pages are what the program changed
+    m_bus.StartCpu();
+    m_isReset = true;
+    return OK;
+}
+
+void Mos6502Engine::SetBaseline(std::shared_ptr<const PagedMemory::Image> baseline)
+{
+    m_bus.SetBaseline(std::move(baseline));
+    ResetToBaseline();
+}
+
+void Mos6502Engine::ResetToBaseline()
+{
+    m_bus.RevertToBaseline();
+    ClearDeviceState();
+    Reset();
+}
+
+Mos6502Engine::Status Mos6502Engine::Restore(const MachineSnapshot& snapshot,
+                                             const MachineSnapshot* base)
+{
+    if (snapshot.Restore(m_bus, base) != MachineSnapshot::OK) {
+        return ERR_SNAPSHOT_BASE;
+    }
+    ClearDeviceState();
+    m_isReset = true;
+    return OK;
+}
+
+Mos6502Engine::Status Mos6502Engine::Step(MosT6502::StopReason* reason)
+{
+    if (!m_isReset) {
+        return ERR_NOT_RESET;
+    }
+    ClearWatchpointHit();
+    ServiceEvents();
+    if (IsWatchpointHit()) {  // the interrupt entry touched a watched address
+        *reason = MosT6502::StopReason::WATCHPOINT;
+        return OK;
+    }
+    *reason = GetCpu().ExecuteInstruction();
+    if (*reason == MosT6502::StopReason::RUNNING and IsWatchpointHit()) {
+        *reason = MosT6502::StopReason::WATCHPOINT;
+    }
+    return ToStatus(*reason);
+}
+
+Mos6502Engine::Status Mos6502Engine::Run(uint64_t cycleBudget, MosT6502::StopReason* reason)
+{
+    if (!m_isReset) {
+        return ERR_NOT_RESET;
+    }
+    MosT6502& cpu   = GetCpu();
+    uint64_t target = cpu.cycles + cycleBudget;
+    ClearWatchpointHit();
+    while (true) {
+        ServiceEvents();
+        if (IsWatchpointHit()) {
+            *reason = MosT6502::StopReason::WATCHPOINT;
+            break;
+        }
+        if (cpu.cycles >= target) {
+            *reason = MosT6502::StopReason::CYCLE_BUDGET;
+            break;
+        }
+        // a slice also ends early when an irq gets unmasked or a device schedules something
+        uint64_t sliceEnd = std::min(target, m_scheduler.NextCycle());
+        if (cpu.IsIrqDeferred()) {  // the slice stopped right after a CLI or PLP
+            sliceEnd = std::min(sliceEnd, cpu.cycles + 1);
+        }
+        if (sliceEnd <= cpu.cycles) {  // the interrupt entry ran into the next event
+            continue;
+        }
+        *reason = RunCore(sliceEnd - cpu.cycles);
+        if (*reason == MosT6502::StopReason::CYCLE_BUDGET and IsWatchpointHit()) {
+            *reason = MosT6502::StopReason::WATCHPOINT;  // the core stopped right after it
+        }
+        if (*reason != MosT6502::StopReason::CYCLE_BUDGET) {
+            break;
+        }
+    }
+    return ToStatus(*reason);
+}
+
+void Mos6502Engine::ClearWatchpointHit()
+{
+    Breakpoints* breakpoints = m_bus.GetBreakpoints();
+    if (breakpoints) {
+        breakpoints->ClearHit();
+    }
+}
+
+bool Mos6502Engine::IsWatchpointHit() const
+{
+    const Breakpoints* breakpoints = m_bus.GetBreakpoints();
+    return breakpoints and breakpoints->IsHit() and
+           breakpoints->GetHit().kind != Breakpoints::HIT_EXECUTE;
+}
+
+MosT6502::StopReason Mos6502Engine::RunCore(uint64_t cycleBudget)
+{
+    if (m_blockCache) {
+        return m_blockCache->Run(GetCpu(), cycleBudget);
+    }
+    if (m_recompiledCore) {
+        return m_recompiledCore->Run(GetCpu(), cycleBudget);
+    }
+    if (m_core == CORE_THREADED) {
+        return ThreadedCore::Run(GetCpu(), cycleBudget);
+    }
+    return GetCpu().Run(cycleBudget);
+}
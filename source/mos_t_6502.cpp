@@ -1,19 +1,29 @@
 #include "../include/mos_t_6502.h"
 // concept : we need full obj declaration during usage eg : bus->Read(...)
+#include "../include/breakpoints.h"
 #include "../include/bus.h"  // to prevent circular includes
+#include "../include/guest_profile.h"
+#include "../include/mos_t_6502_alu.h"
+#include "../include/mos_t_6502_opcodes.h"
+#include "../include/trace_sink.h"
+
+// built once at compile time; shared read-only by every MosT6502 instance
+const MosT6502::DecodeTable MosT6502::kDecodeTable = BuildDecodeTable();
+const MosT6502::NameTable MosT6502::kNameTable     = BuildNameTable();
+const MosT6502::DecimalTable MosT6502::kDecimalTable = BuildDecimalTable();
 
 // helpers
 
-void MosT6502::PrintState()
+void MosT6502::PrintState(std::ostream& os)
 {
-    std::cout << "\nMosT6502_State : "
-              << "a=" << STREAM_BYTE(a) << " | "
-              << "x=" << STREAM_BYTE(x) << " | "
-              << "y=" << STREAM_BYTE(y) << " | "
-              << "sp=" << STREAM_BYTE(sp) << " | "
-              << "pc=" << STREAM_WORD(pc) << '\n';
-    PrintStatus();
-    std::cout << "\n";
+    os << "\nMosT6502_State : "
+       << "a=" << STREAM_BYTE(a) << " | "
+       << "x=" << STREAM_BYTE(x) << " | "
+       << "y=" << STREAM_BYTE(y) << " | "
+       << "sp=" << STREAM_BYTE(sp) << " | "
+       << "pc=" << STREAM_WORD(pc) << '\n';
+    PrintStatus(os);
+    os << "\n";
 }
 
 void MosT6502::Reset()
@@ -26,233 +36,312 @@ void MosT6502::Reset()
 
     sp = 0xFF;  // bus/ram space : 0x0100 - 0x01FF
 
-    sr = 0x00;
-    SetFlag(FLAGS6502::U, true);  // this is set at reset
+    SetStatus(FLAGS6502::U);  // this is set at reset
+
+    cycles       = 0;
+    instructions = 0;
+    m_nmiPending = false;  // irq lines belong to the devices driving them
+    m_irqPollAt  = UINT64_MAX;
 }
 
-void MosT6502::ExecBranchInstr(const MosT6502::Instruction& instr, MosT6502::FLAGS6502 f,
-                               uint8_t expectedValue)
+void MosT6502::ExecBranchInstr(const MosT6502::OpcodeInfo& instr, uint16_t operand,
+                               MosT6502::FLAGS6502 f, uint8_t expectedValue)
 {
-    uint16_t jumpDelta = (uint16_t)FetchData(instr).data;
+    uint16_t jumpDelta = (uint16_t)FetchData(instr, operand).data;
     if (jumpDelta & 0x80) {
         jumpDelta |= 0xff00;
     }
     if (GetFlag(f) == expectedValue) {
-        pc += jumpDelta;
+        uint16_t target = pc + jumpDelta;
+        cycles += ((target & 0xff00) != (pc & 0xff00)) ? 2 : 1;  // taken (+ page crossed)
+        pc = target;
     }
 }
 
-void MosT6502::CompareRegister(const MosT6502::Instruction& instr, uint8_t targetReg)
+void MosT6502::CompareRegister(const MosT6502::OpcodeInfo& instr, uint16_t operand,
+                               uint8_t targetReg)
 {
-    auto dd = FetchData(instr);
+    auto dd = FetchData(instr, operand);
 
     uint16_t temp = (uint16_t)targetReg - (uint16_t)dd.data;
-    SetFlag(FLAGS6502::C, a >= dd.data);
-    SetFlag(FLAGS6502::Z, (temp & 0x00ff) == 0x0000);
-    SetFlag(FLAGS6502::N, temp & 0x0080);
+    SetFlag(FLAGS6502::C, targetReg >= dd.data);
+    SetNz(temp & 0x00ff);
+}
+
+// the interrupted pc and sr (B clear) are pushed before I is set, so RTI brings back the
+// caller's I; 7 cycles like BRK
+static void EnterInterrupt(MosT6502& cpu, uint16_t vector)
+{
+    if (cpu.m_interruptListener) {
+        cpu.m_interruptListener->OnInterrupt(vector == 0xfffa);
+    }
+    cpu.bus->Write(0x0100 + cpu.sp, (cpu.pc >> 8) & 0x00ff);
+    cpu.sp -= 1;
+    cpu.bus->Write(0x0100 + cpu.sp, cpu.pc & 0x00ff);
+    cpu.sp -= 1;
+    cpu.bus->Write(0x0100 + cpu.sp, (cpu.GetStatus() & ~MosT6502::B) | MosT6502::U);
+    cpu.sp -= 1;
+    cpu.SetFlag(MosT6502::I, true);
+
+    uint16_t lo = cpu.bus->Read(vector + 0);
+    uint16_t hi = cpu.bus->Read(vector + 1);
+    cpu.pc      = (hi << 8) | lo;
+    cpu.cycles += 7;
+    if (cpu.m_profile) {
+        cpu.m_profile->Interrupt(cpu.pc, vector == 0xfffa);
+    }
 }
 
 void MosT6502::ExecIRQ()
 {
     if (GetFlag(FLAGS6502::I) == 0) {
-        bus->Write(0x0100 + sp, (pc >> 8) & 0x00ff);
-        sp -= 1;
-        bus->Write(0x0100 + sp, pc & 0x00ff);
-        sp -= 1;
-
-        SetFlag(FLAGS6502::B, false);
-        SetFlag(FLAGS6502::U, true);
-        SetFlag(FLAGS6502::I, true);
-        bus->Write(0x0100 + sp, sr);
-        sp -= 1;
-
-        uint16_t pc_read_addr = 0xfffe;
-        uint16_t lo           = bus->Read(pc_read_addr + 0);
-        uint16_t hi           = bus->Read(pc_read_addr + 1);
-        pc                    = (hi << 8) | lo;
+        EnterInterrupt(*this, 0xfffe);
     }
 }
 
-void MosT6502::NmExecIRQ()
+void MosT6502::NmExecIRQ() { EnterInterrupt(*this, 0xfffa); }
+
+bool MosT6502::TakeInterrupt()
 {
-    bus->Write(0x0100 + sp, (pc >> 8) & 0x00ff);
-    sp -= 1;
-    bus->Write(0x0100 + sp, pc & 0x00ff);
-    sp -= 1;
-
-    SetFlag(FLAGS6502::B, false);
-    SetFlag(FLAGS6502::U, true);
-    SetFlag(FLAGS6502::I, true);
-    bus->Write(0x0100 + sp, sr);
-    sp -= 1;
-
-    uint16_t pc_read_addr = 0xfffa;
-    uint16_t lo           = bus->Read(pc_read_addr + 0);
-    uint16_t hi           = bus->Read(pc_read_addr + 1);
-    pc                    = (hi << 8) | lo;
+    if (m_nmiPending) {
+        m_nmiPending = false;
+        NmExecIRQ();
+        return true;
+    }
+    bool masked = (cycles == m_irqPollAt) ? m_irqPollMasked : GetFlag(FLAGS6502::I) != 0;
+    if (m_irqLines != 0 and !masked) {
+        EnterInterrupt(*this, 0xfffe);
+        return true;
+    }
+    return false;
 }
 
-MosT6502::DataDetails MosT6502::FetchData(Instruction instr)
+// operand bytes were already read and pc already points past the whole instruction.
+// Only pointers are read here (the operand itself is not), so stores and jumps cause no
+// bus read of their target.
+uint16_t MosT6502::FetchAddress(const OpcodeInfo& instr, uint16_t operand)
 {
-    DataDetails dd;
-
     switch (instr.addrMode) {
         case AddrMode::IMPLIED: {
-            dd = {a, 0x0000};
-            break;
+            return 0x0000;
         }
         case AddrMode::IMMEDIATE: {
-            dd = {bus->Read(pc), pc};
-            pc += 1;
-            break;
+            return pc - 1;
+        }
+        case AddrMode::RELATIVE: {
+            return pc;
         }
         case AddrMode::ZERO_PAGE: {
-            uint16_t zpOffset = bus->Read(pc);
-            pc += 1;
-            dd = {bus->Read(zpOffset), zpOffset};
-            break;
+            return operand & 0x00ff;
         }
-        case AddrMode::ZERO_PAGE_X: {
-            uint16_t zpOffset = bus->Read(pc);
-            pc += 1;
-            zpOffset += zpOffset + (uint16_t)x;
-            dd = {bus->Read((zpOffset) & (0x00FF)), (uint16_t)((zpOffset) & (0x00FF))};
-            break;
+        case AddrMode::ZERO_PAGE_X: {  // wraps around inside the zero page
+            return (operand + x) & 0x00ff;
         }
         case AddrMode::ZERO_PAGE_Y: {
-            uint16_t zpOffset = bus->Read(pc);
-            pc += 1;
-            zpOffset += zpOffset + (uint16_t)y;
-            dd = {bus->Read((zpOffset) & (0x00FF)), (uint16_t)((zpOffset) & (0x00FF))};
-            break;
+            return (operand + y) & 0x00ff;
         }
         case AddrMode::ABSOLUTE: {
-            uint16_t lo = bus->Read(pc);
-            pc += 1;
-            uint16_t hi = bus->Read(pc);
-            pc += 1;
-            dd = {bus->Read((hi << 8) | lo), (uint16_t)((hi << 8) | lo)};
-            break;
+            return operand;
         }
         case AddrMode::ABSOLUTE_X: {
-            uint16_t lo = bus->Read(pc);
-            pc += 1;
-            uint16_t hi = bus->Read(pc);
-            pc += 1;
-            dd = {bus->Read(((hi << 8) | lo) + x), (uint16_t)(((hi << 8) | lo) + x)};
-            break;
+            uint16_t base = operand;
+            uint16_t addr = base + x;
+            if ((instr.flags & OPCODE_PAGE_PENALTY) and ((addr ^ base) & 0xff00)) {
+                cycles += 1;
+            }
+            return addr;
         }
         case AddrMode::ABSOLUTE_Y: {
-            uint16_t lo = bus->Read(pc);
-            pc += 1;
-            uint16_t hi = bus->Read(pc);
-            pc += 1;
-            dd = {bus->Read(((hi << 8) | lo) + y), (uint16_t)(((hi << 8) | lo) + y)};
-            break;
+            uint16_t base = operand;
+            uint16_t addr = base + y;
+            if ((instr.flags & OPCODE_PAGE_PENALTY) and ((addr ^ base) & 0xff00)) {
+                cycles += 1;
+            }
+            return addr;
         }
-        case AddrMode::INDIRECT: {
-            uint16_t lo = bus->Read(pc);
-            pc += 1;
-            uint16_t hi = bus->Read(pc);
-            pc += 1;
-            uint16_t ptr = (hi << 8) | lo;
-
-            dd = {bus->Read((bus->Read(ptr + 1) << 8) | bus->Read(ptr + 0)),
-                  (uint16_t)((bus->Read(ptr + 1) << 8) | bus->Read(ptr + 0))};
-            break;
+        case AddrMode::INDIRECT: {  // nmos quirk : the pointer's high byte never carries into
+                                    // the next page, JMP ($xxff) reads $xxff and $xx00
+            uint16_t ptr = operand;
+            uint16_t lo  = bus->Read(ptr);
+            uint16_t hi  = bus->Read((ptr & 0xff00) | ((ptr + 1) & 0x00ff));
+            return (hi << 8) | lo;
         }
-        case AddrMode::INDIRECT_X: {
-            uint16_t list_base_addr = bus->Read(pc);
-            pc += 1;
-            uint16_t list_addr = list_base_addr + x;
+        case AddrMode::INDIRECT_X: {  // the pointer lives in the zero page, wraps there too
+            uint16_t list_addr = (operand + x) & 0x00ff;
 
             uint16_t lo = bus->Read(list_addr);
-            uint16_t hi = bus->Read(list_addr + 1);
-
-            dd = {bus->Read((hi << 8) | lo), (uint16_t)((hi << 8) | lo)};
-            break;
+            uint16_t hi = bus->Read((list_addr + 1) & 0x00ff);
+            return (hi << 8) | lo;
         }
-        case AddrMode::INDIRECT_Y: {
-            uint16_t list_base_addr = bus->Read(pc);
-            pc += 1;
-            uint16_t list_addr = list_base_addr + y;
+        case AddrMode::INDIRECT_Y: {  // y indexes the pointed-to address, not the pointer
+            uint16_t list_addr = operand & 0x00ff;
 
             uint16_t lo = bus->Read(list_addr);
-            uint16_t hi = bus->Read(list_addr + 1);
+            uint16_t hi = bus->Read((list_addr + 1) & 0x00ff);
 
-            dd = {bus->Read((hi << 8) | lo), (uint16_t)((hi << 8) | lo)};
-            break;
+            uint16_t base = (hi << 8) | lo;
+            uint16_t addr = base + y;
+            if ((instr.flags & OPCODE_PAGE_PENALTY) and ((addr ^ base) & 0xff00)) {
+                cycles += 1;
+            }
+            return addr;
         }
-        case AddrMode::RELATIVE: {
-            uint8_t jumpDelta = bus->Read(pc);
-            pc += 1;
+    }
+    return 0x0000;
+}
 
-            dd = {jumpDelta, pc};
-            break;
+MosT6502::DataDetails MosT6502::FetchData(const OpcodeInfo& instr, uint16_t operand)
+{
+    switch (instr.addrMode) {
+        case AddrMode::IMPLIED: {
+            return {a, 0x0000};
+        }
+        case AddrMode::IMMEDIATE:
+        case AddrMode::RELATIVE: {
+            return {(uint8_t)operand, FetchAddress(instr, operand)};
         }
         default: {
-            std::cout << "Addr_mode=" << GetAddrModeName(instr.addrMode)
-                      << " not implemented yet for instr=" << instr.nameStr;
-            abort();
+            uint16_t addr = FetchAddress(instr, operand);
+            return {bus->Read(addr), addr};
+        }
+    }
+}
+
+// the breakpoint test is compiled into the loop only while Breakpoints are attached
+template <bool CheckBreakpoints>
+static MosT6502::StopReason RunSlice(MosT6502& cpu)
+{
+    while (cpu.cycles < cpu.m_sliceEnd) {
+        MosT6502::StopReason reason =
+                (CheckBreakpoints) ? cpu.ExecuteInstruction() : cpu.FetchAndExecute();
+        if (reason != MosT6502::StopReason::RUNNING) {
+            return reason;
         }
     }
-    return dd;
+    return MosT6502::StopReason::CYCLE_BUDGET;
+}
+
+MosT6502::StopReason MosT6502::Run(uint64_t cycleBudget)
+{
+    m_sliceEnd = cycles + cycleBudget;
+    return (m_breakpoints) ? RunSlice<true>(*this) : RunSlice<false>(*this);
 }
 
-void MosT6502::ExecuteInstruction()
+MosT6502::StopReason MosT6502::ExecuteInstruction()
 {
-    uint8_t opcode = bus->Read(pc);
-    pc += 1;  // as soon as a read from pc happens; pc++; from WD spec;
+    if (m_breakpoints and m_breakpoints->CheckExecute(*this)) {
+        return StopReason::BREAKPOINT;
+    }
+    return FetchAndExecute();
+}
+
+MosT6502::StopReason MosT6502::FetchAndExecute()
+{
+    uint8_t opcode = bus->Fetch(pc);
+
+    if (m_traceSink) {
+        m_traceSink->Record({cycles, pc, opcode, a, x, y, sp, GetStatus()});
+    }
 
     if (opcode == TERMINATE_OPCODE) {
-        std::cout << "\nProgram completed !\n";
-        bus->PrintRamState();
-        exit(0);
+        return StopReason::TERMINATED;
     }
 
-    if (m_instrSet.find(opcode) == m_instrSet.end()) {
-        std::cout << "Illegal instr in the code. opcode=" << (opcode);
-        abort();
+    const OpcodeInfo& instr = Decode(opcode);
+    if (!IsLegal(instr)) {
+        return StopReason::ILLEGAL_OPCODE;
     }
-    auto instr = m_instrSet[opcode];
-    std::cout << "instr_name=" << instr.nameStr << '\n';
 
-    switch (instr.instrName) {
-        case InstrName::BRK: {
+    uint16_t operand = 0x0000;
+    switch (GetInstrLength(instr.addrMode)) {
+        case (3): {
+            operand = bus->Fetch(pc + 1);
+            operand |= (uint16_t)bus->Fetch(pc + 2) << 8;
+            break;
+        }
+        case (2): {
+            operand = bus->Fetch(pc + 1);
             break;
         }
+    }
+    if (!m_profile) {
+        return Execute(instr, operand);
+    }
+    uint16_t start      = pc;
+    uint64_t startCycle = cycles;
+    StopReason reason   = Execute(instr, operand);
+    m_profile->Count(start, opcode, cycles - startCycle, pc);
+    return reason;
+}
+
+MosT6502::StopReason MosT6502::Execute(const OpcodeInfo& instr, uint16_t operand)
+{
+    pc += GetInstrLength(instr.addrMode);  // pc already points at the next instruction
+    cycles += instr.cycles;
+    instructions += 1;
+
+    switch (instr.instrName) {
+        case InstrName::BRK: {  // the signature byte after BRK is the (ignored) operand
+            bus->Write(0x0100 + sp, (pc >> 8) & 0x00ff);
+            sp -= 1;
+            bus->Write(0x0100 + sp, pc & 0x00ff);
+            sp -= 1;
+            bus->Write(0x0100 + sp, GetStatus() | FLAGS6502::B | FLAGS6502::U);
+            sp -= 1;
+            SetFlag(FLAGS6502::I, true);
+
+            uint16_t lo = bus->Read(0xfffe);
+            uint16_t hi = bus->Read(0xffff);
+            pc          = (hi << 8) | lo;
+            return StopReason::BREAK;
+        }
         case InstrName::ADC: {
-            uint16_t byteData = (uint16_t)FetchData(instr).data;
+            uint16_t byteData = (uint16_t)FetchData(instr, operand).data;
+            if (m_sr & FLAGS6502::D) {
+                AddDecimal(byteData, false);
+                break;
+            }
             uint16_t result   = (uint16_t)a + byteData + (uint16_t)GetFlag(FLAGS6502::C);
 
             SetFlag(FLAGS6502::C, result > 255);
-            SetFlag(FLAGS6502::Z, (result & 0xff) == 0);
             SetFlag(FLAGS6502::V,
                     (~((uint16_t)a ^ byteData) & ((uint16_t)a ^ (uint16_t)result)) & 0x0080);
-            SetFlag(FLAGS6502::N, result & 0x80);
+            SetNz(result & 0x00ff);
 
             a = result & 0xff;
 
             break;
         }
-        case InstrName::SBC: {  // TODO !
+        case InstrName::SBC: {  // a + ~m + c in binary mode
+            uint16_t byteData = (uint16_t)FetchData(instr, operand).data;
+            if (m_sr & FLAGS6502::D) {
+                AddDecimal(byteData, true);
+                break;
+            }
+            byteData ^= 0x00ff;
+            uint16_t result   = (uint16_t)a + byteData + (uint16_t)GetFlag(FLAGS6502::C);
+
+            SetFlag(FLAGS6502::C, result > 255);
+            SetFlag(FLAGS6502::V,
+                    (~((uint16_t)a ^ byteData) & ((uint16_t)a ^ (uint16_t)result)) & 0x0080);
+            SetNz(result & 0x00ff);
+
+            a = result & 0xff;
             break;
         }
         case InstrName::AND: {
-            a = a & FetchData(instr).data;
+            a = a & FetchData(instr, operand).data;
 
-            SetFlag(FLAGS6502::Z, a == 0x00);
-            SetFlag(FLAGS6502::N, a & 0x80);
+            SetNz(a);
             break;
         }
         case InstrName::ASL: {
-            auto dd = FetchData(instr);
+            auto dd = FetchData(instr, operand);
 
             uint16_t dataByte = (uint16_t)dd.data << 1;
 
             SetFlag(FLAGS6502::C, (dataByte & 0xFF00) > 0);
-            SetFlag(FLAGS6502::Z, (dataByte & 0x00FF) == 0x00);
-            SetFlag(FLAGS6502::N, dataByte & 0x80);
+            SetNz(dataByte & 0x00ff);
             if (instr.addrMode == AddrMode::IMPLIED) {
                 a = dataByte & 0x00FF;
             } else {
@@ -261,44 +350,44 @@ void MosT6502::ExecuteInstruction()
             break;
         }
         case InstrName::BCC: {
-            ExecBranchInstr(instr, FLAGS6502::C, 0);
+            ExecBranchInstr(instr, operand, FLAGS6502::C, 0);
             break;
         }
         case InstrName::BCS: {
-            ExecBranchInstr(instr, FLAGS6502::C, 1);
+            ExecBranchInstr(instr, operand, FLAGS6502::C, 1);
             break;
         }
         case InstrName::BEQ: {
-            ExecBranchInstr(instr, FLAGS6502::Z, 1);
+            ExecBranchInstr(instr, operand, FLAGS6502::Z, 1);
             break;
         }
         case InstrName::BIT: {
-            auto dd = FetchData(instr);
+            auto dd = FetchData(instr, operand);
 
-            SetFlag(FLAGS6502::Z, (a & dd.data) == 0x00);
-            SetFlag(FLAGS6502::N, dd.data & (1 << 7));
+            m_zValue = a & dd.data;
+            m_nValue = dd.data;  // bit 7
             SetFlag(FLAGS6502::V, dd.data & (1 << 6));
 
             break;
         }
         case InstrName::BMI: {
-            ExecBranchInstr(instr, FLAGS6502::N, 1);
+            ExecBranchInstr(instr, operand, FLAGS6502::N, 1);
             break;
         }
         case InstrName::BNE: {
-            ExecBranchInstr(instr, FLAGS6502::Z, 0);
+            ExecBranchInstr(instr, operand, FLAGS6502::Z, 0);
             break;
         }
         case InstrName::BPL: {
-            ExecBranchInstr(instr, FLAGS6502::N, 0);
+            ExecBranchInstr(instr, operand, FLAGS6502::N, 0);
             break;
         }
         case InstrName::BVC: {
-            ExecBranchInstr(instr, FLAGS6502::V, 0);
+            ExecBranchInstr(instr, operand, FLAGS6502::V, 0);
             break;
         }
         case InstrName::BVS: {
-            ExecBranchInstr(instr, FLAGS6502::V, 1);
+            ExecBranchInstr(instr, operand, FLAGS6502::V, 1);
             break;
         }
         case InstrName::CLC: {
@@ -310,7 +399,9 @@ void MosT6502::ExecuteInstruction()
             break;
         }
         case InstrName::CLI: {
+            uint8_t status = m_sr;
             SetFlag(FLAGS6502::I, false);
+            DeferIrqMask(status);
             break;
         }
         case InstrName::CLV: {
@@ -318,77 +409,70 @@ void MosT6502::ExecuteInstruction()
             break;
         }
         case InstrName::CMP: {
-            CompareRegister(instr, a);
+            CompareRegister(instr, operand, a);
             break;
         }
         case InstrName::CPX: {
-            CompareRegister(instr, x);
+            CompareRegister(instr, operand, x);
             break;
         }
         case InstrName::CPY: {
-            CompareRegister(instr, y);
+            CompareRegister(instr, operand, y);
             break;
         }
         case InstrName::DEC: {
-            auto dd = FetchData(instr);
+            auto dd = FetchData(instr, operand);
 
             uint16_t temp = (uint16_t)dd.data - 1;
             bus->Write(dd.addr, temp & 0x00ff);
-            SetFlag(FLAGS6502::Z, (temp & 0x00ff) == 0x0000);
-            SetFlag(FLAGS6502::N, temp & 0x0080);
+            SetNz(temp & 0x00ff);
             break;
         }
         case InstrName::DEX: {
             uint16_t temp = (uint16_t)x - 1;
-            SetFlag(FLAGS6502::Z, (temp & 0x00ff) == 0x0000);
-            SetFlag(FLAGS6502::N, temp & 0x0080);
+            SetNz(temp & 0x00ff);
             x = temp;
             break;
         }
         case InstrName::DEY: {
             uint16_t temp = (uint16_t)y - 1;
-            SetFlag(FLAGS6502::Z, (temp & 0x00ff) == 0x0000);
-            SetFlag(FLAGS6502::N, temp & 0x0080);
+            SetNz(temp & 0x00ff);
             y = temp;
             break;
         }
         case InstrName::EOR: {
-            auto dd = FetchData(instr);
+            auto dd = FetchData(instr, operand);
 
             a = a ^ dd.data;
-            SetFlag(FLAGS6502::Z, a == 0x00);
-            SetFlag(FLAGS6502::N, a & 0x80);
+            SetNz(a);
             break;
         }
         case InstrName::INC: {
-            auto dd = FetchData(instr);
+            auto dd = FetchData(instr, operand);
 
             uint16_t temp = (uint16_t)dd.data + 1;
             bus->Write(dd.addr, temp & 0x00ff);
-            SetFlag(FLAGS6502::Z, (temp & 0x00ff) == 0x0000);
-            SetFlag(FLAGS6502::N, temp & 0x0080);
+            SetNz(temp & 0x00ff);
             break;
         }
         case InstrName::INX: {
             uint16_t temp = (uint16_t)x + 1;
-            SetFlag(FLAGS6502::Z, (temp & 0x00ff) == 0x0000);
-            SetFlag(FLAGS6502::N, temp & 0x0080);
+            SetNz(temp & 0x00ff);
             x = temp;
             break;
         }
         case InstrName::INY: {
             uint16_t temp = (uint16_t)y + 1;
-            SetFlag(FLAGS6502::Z, (temp & 0x00ff) == 0x0000);
-            SetFlag(FLAGS6502::N, temp & 0x0080);
+            SetNz(temp & 0x00ff);
             y = temp;
             break;
         }
         case InstrName::JMP: {
-            pc = FetchData(instr).addr;
+            pc = FetchAddress(instr, operand);
             break;
         }
         case InstrName::JSR: {
-            uint16_t jumpAddr = FetchData(instr).addr;
+            uint16_t jumpAddr = FetchAddress(instr, operand);
 
             pc -= 1;
 
@@ -401,29 +485,25 @@ void MosT6502::ExecuteInstruction()
             break;
         }
         case InstrName::LDA: {
-            a = FetchData(instr).data;
-            SetFlag(FLAGS6502::Z, a == 0x00);
-            SetFlag(FLAGS6502::N, a & 0x80);
+            a = FetchData(instr, operand).data;
+            SetNz(a);
             break;
         }
         case InstrName::LDX: {
-            x = FetchData(instr).data;
-            SetFlag(FLAGS6502::Z, x == 0x00);
-            SetFlag(FLAGS6502::N, x & 0x80);
+            x = FetchData(instr, operand).data;
+            SetNz(x);
             break;
         }
         case InstrName::LDY: {
-            y = FetchData(instr).data;
-            SetFlag(FLAGS6502::Z, y == 0x00);
-            SetFlag(FLAGS6502::N, y & 0x80);
+            y = FetchData(instr, operand).data;
+            SetNz(y);
             break;
         }
         case InstrName::LSR: {
-            auto dd = FetchData(instr);
+            auto dd = FetchData(instr, operand);
             SetFlag(FLAGS6502::C, dd.data & 0x01);
             uint8_t fData = dd.data >> 1;
-            SetFlag(FLAGS6502::Z, (fData & 0xff) == 0x00);
-            SetFlag(FLAGS6502::N, fData & 0x80);
+            SetNz(fData);
             if (instr.addrMode == AddrMode::IMPLIED) {
                 a = fData;
             } else {
@@ -435,11 +515,10 @@ void MosT6502::ExecuteInstruction()
             break;
         }
         case InstrName::ORA: {
-            auto dd = FetchData(instr);
+            auto dd = FetchData(instr, operand);
 
             a = a | dd.data;
-            SetFlag(FLAGS6502::Z, a == 0x00);
-            SetFlag(FLAGS6502::N, a & 0x80);
+            SetNz(a);
             break;
         }
         case InstrName::PHA: {
@@ -448,32 +527,29 @@ void MosT6502::ExecuteInstruction()
             break;
         }
         case InstrName::PHP: {
-            bus->Write(0x0100 + sp, sr | FLAGS6502::B | FLAGS6502::U);
-            SetFlag(FLAGS6502::B, false);
-            SetFlag(FLAGS6502::U, false);
+            bus->Write(0x0100 + sp, GetStatus() | FLAGS6502::B | FLAGS6502::U);
             sp -= 1;
             break;
         }
         case InstrName::PLA: {
             sp += 1;
             a = bus->Read(0x0100 + sp);
-            SetFlag(FLAGS6502::Z, a == 0x00);
-            SetFlag(FLAGS6502::N, a & 0x80);
+            SetNz(a);
             break;
         }
         case InstrName::PLP: {
+            uint8_t status = m_sr;
             sp += 1;
-            sr = bus->Read(0x0100 + sp);
-            SetFlag(FLAGS6502::U, 1);
+            SetStatus((bus->Read(0x0100 + sp) & ~FLAGS6502::B) | FLAGS6502::U);
+            DeferIrqMask(status);
             break;
         }
         case InstrName::ROL: {
-            auto dd = FetchData(instr);
+            auto dd = FetchData(instr, operand);
 
             uint16_t rolData = (uint16_t)(dd.data << 1) | GetFlag(FLAGS6502::C);
             SetFlag(FLAGS6502::C, rolData & 0xff00);
-            SetFlag(FLAGS6502::Z, (rolData & 0x00ff) == 0x0000);
-            SetFlag(FLAGS6502::N, rolData & 0x0080);
+            SetNz(rolData & 0x00ff);
             if (instr.addrMode == AddrMode::IMPLIED) {
                 a = rolData & 0x00ff;
             } else {
@@ -482,12 +558,11 @@ void MosT6502::ExecuteInstruction()
             break;
         }
         case InstrName::ROR: {
-            auto dd = FetchData(instr);
+            auto dd = FetchData(instr, operand);
 
             uint16_t rorData = (uint16_t)(GetFlag(FLAGS6502::C) << 7) | (dd.data >> 1);
-            SetFlag(FLAGS6502::C, rorData & 0x01);
-            SetFlag(FLAGS6502::Z, (rorData & 0x00ff) == 0x00);
-            SetFlag(FLAGS6502::N, rorData & 0x0080);
+            SetFlag(FLAGS6502::C, dd.data & 0x01);
+            SetNz(rorData & 0x00ff);
             if (instr.addrMode == AddrMode::IMPLIED) {
                 a = rorData & 0x00ff;
             } else {
@@ -497,14 +572,13 @@ void MosT6502::ExecuteInstruction()
         }
         case InstrName::RTI: {
             sp += 1;
-            sr = bus->Read(0x0100 + sp);
-            sr &= ~FLAGS6502::B;
-            sr &= ~FLAGS6502::U;
+            SetStatus((bus->Read(0x0100 + sp) & ~FLAGS6502::B) | FLAGS6502::U);
 
             sp += 1;
             pc = (uint16_t)bus->Read(0x0100 + sp);
             sp += 1;
             pc |= (uint16_t)bus->Read(0x0100 + sp) << 8;
+            CheckIrqUnmasked();
             break;
         }
         case InstrName::RTS: {
@@ -528,46 +602,41 @@ void MosT6502::ExecuteInstruction()
             break;
         }
         case InstrName::SEI: {
+            uint8_t status = m_sr;
             SetFlag(FLAGS6502::I, true);
+            DeferIrqMask(status);
             break;
         }
         case InstrName::STA: {
-            auto dd = FetchData(instr);
-            bus->Write(dd.addr, a);
+            bus->Write(FetchAddress(instr, operand), a);
             break;
         }
         case InstrName::STX: {
-            auto dd = FetchData(instr);
-            bus->Write(dd.addr, x);
+            bus->Write(FetchAddress(instr, operand), x);
             break;
         }
         case InstrName::STY: {
-            auto dd = FetchData(instr);
-            bus->Write(dd.addr, y);
+            bus->Write(FetchAddress(instr, operand), y);
             break;
         }
         case InstrName::TAX: {
             x = a;
-            SetFlag(FLAGS6502::Z, x == 0x00);
-            SetFlag(FLAGS6502::N, x & 0x80);
+            SetNz(x);
             break;
         }
         case InstrName::TAY: {
             y = a;
-            SetFlag(FLAGS6502::Z, y == 0x00);
-            SetFlag(FLAGS6502::N, y & 0x80);
+            SetNz(y);
             break;
         }
         case InstrName::TSX: {
             x = sp;
-            SetFlag(FLAGS6502::Z, x == 0x00);
-            SetFlag(FLAGS6502::N, x & 0x80);
+            SetNz(x);
             break;
         }
         case InstrName::TXA: {
             a = x;
-            SetFlag(FLAGS6502::Z, a == 0x00);
-            SetFlag(FLAGS6502::N, a & 0x80);
+            SetNz(a);
             break;
         }
         case InstrName::TXS: {
@@ -576,15 +645,15 @@ void MosT6502::ExecuteInstruction()
         }
         case InstrName::TYA: {
             a = y;
-            SetFlag(FLAGS6502::Z, a == 0x00);
-            SetFlag(FLAGS6502::N, a & 0x80);
+            SetNz(a);
             break;
         }
-        default: {
-            std::cout << "Instruction opcode=" << opcode << " not implemented yet";
-            abort();
+        default: {  // decoded as legal but without an implementation
+            pc -= GetInstrLength(instr.addrMode);
+            cycles -= instr.cycles;
+            instructions -= 1;
+            return StopReason::ILLEGAL_OPCODE;
         }
     }
-
-    PrintState();
+    return StopReason::RUNNING;
 }
@@ -0,0 +1,71 @@
+#include "../include/paged_memory.h"
+
+#include <cstring>
+
+PagedMemory::Image::Image(const uint8_t* ram, PageSize pageSize) : m_pageSize(pageSize)
+{
+    size_t bytes = (size_t)1 << pageSize;
+    size_t count = 0x10000 >> pageSize;
+
+    m_pages.resize(count);
+    for (size_t page = 0; page < count; page++) {
+        const uint8_t* src = ram + page * bytes;
+
+        // pages repeat rarely except for fill patterns, a linear scan of what is stored is enough
+        const uint8_t* shared = nullptr;
+        for (const auto& stored : m_storage) {
+            if (memcmp(stored.get(), src, bytes) == 0) {
+                shared = stored.get();
+                break;
+            }
+        }
+        if (shared == nullptr) {
+            m_storage.emplace_back(new uint8_t[bytes]);
+            memcpy(m_storage.back().get(), src, bytes);
+            shared = m_storage.back().get();
+        }
+        m_pages[page] = shared;
+    }
+}
+
+PagedMemory::PagedMemory(std::shared_ptr<const Image> image)
+    : m_image(std::move(image)),
+      m_shift(m_image->GetPageSize()),
+      m_mask((1u << m_shift) - 1),
+      m_pageCount(0x10000 >> m_shift)
+{
+    Revert();
+}
+
+void PagedMemory::Revert()
+{
+    for (unsigned page = 0; page < m_pageCount; page++) {
+        m_read[page]  = m_image->m_pages[page];
+        m_write[page] = nullptr;
+        m_private[page].reset();
+    }
+}
+
+void PagedMemory::MakePrivate(unsigned page)
+{
+    size_t bytes = (size_t)1 << m_shift;
+    m_private[page].reset(new uint8_t[bytes]);
+    memcpy(m_private[page].get(), m_read[page], bytes);
+    m_read[page]  = m_private[page].get();
+    m_write[page] = m_private[page].get();
+}
+
+PagedMemory::Stats PagedMemory::GetStats() const
+{
+    Stats stats         = {};
+    stats.pageSize      = (size_t)1 << m_shift;
+    for (unsigned page = 0; page < m_pageCount; page++) {
+        if (m_write[page] != nullptr) {
+            stats.privatePages += 1;
+        } else {
+            stats.sharedPages += 1;
+        }
+    }
+    stats.residentBytes = stats.privatePages * stats.pageSize + sizeof(*this);
+    return stats;
+}
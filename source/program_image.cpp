@@ -0,0 +1,462 @@
+#include "../include/program_image.h"
+
+#include <fcntl.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cctype>
+#include <cstring>
+
+#include "../include/bus.h"
+
+namespace {
+
+int HexDigit(char c)
+{
+    if (c >= '0' and c <= '9') {
+        return c - '0';
+    }
+    c = tolower(c);
+    if (c >= 'a' and c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+// two hex chars at text[0..1] -> *value, false when either is not a hex digit
+bool HexPair(const char* text, uint8_t* value)
+{
+    int hi = HexDigit(text[0]);
+    int lo = HexDigit(text[1]);
+    if (hi < 0 or lo < 0) {
+        return false;
+    }
+    *value = (hi << 4) | lo;
+    return true;
+}
+
+bool EndsWith(const std::string& str, const char* suffix)
+{
+    size_t len = strlen(suffix);
+    return str.size() >= len and strcasecmp(str.c_str() + str.size() - len, suffix) == 0;
+}
+
+// one text line at a time, without the line terminator
+class LineReader {
+   public:
+    LineReader(const char* text, size_t size) : m_pos(text), m_end(text + size) {}
+
+    bool Next(const char** line, size_t* len)
+    {
+        while (m_pos < m_end) {
+            const char* start = m_pos;
+            while (m_pos < m_end and *m_pos != '\n') {
+                m_pos++;
+            }
+            const char* stop = m_pos;
+            if (m_pos < m_end) {
+                m_pos++;
+            }
+            while (stop > start and isspace((unsigned char)stop[-1])) {
+                stop--;
+            }
+            while (start < stop and isspace((unsigned char)*start)) {
+                start++;
+            }
+            if (stop > start) {
+                *line = start;
+                *len  = stop - start;
+                return true;
+            }
+        }
+        return false;
+    }
+
+   private:
+    const char* m_pos;
+    const char* m_end;
+};
+
+}  // namespace
+
+ProgramImage::Status ProgramImage::Open(const std::string& path, Format format)
+{
+    Close();
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return ERR_OPEN;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return ERR_OPEN;
+    }
+    if (st.st_size > 0) {
+        m_mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m_mapping == MAP_FAILED) {
+            m_mapping = nullptr;
+            close(fd);
+            return ERR_OPEN;
+        }
+        m_mappingSize = st.st_size;
+    }
+    close(fd);
+
+    const uint8_t* bytes = static_cast<const uint8_t*>(m_mapping);
+    const char* text     = static_cast<const char*>(m_mapping);
+
+    if (format == AUTO) {
+        size_t first = 0;
+        while (first < m_mappingSize and isspace(bytes[first])) {
+            first++;
+        }
+        if (EndsWith(path, ".bin") or EndsWith(path, ".rom")) {
+            format = RAW;
+        } else if (EndsWith(path, ".prg")) {
+            format = PRG;
+        } else if (first < m_mappingSize and bytes[first] == ':') {
+            format = INTEL_HEX;
+        } else if (first + 1 < m_mappingSize and bytes[first] == 'S' and
+                   isdigit(bytes[first + 1])) {
+            format = SREC;
+        } else {
+            format = HEX_TEXT;
+        }
+    }
+    m_format = format;
+
+    Status status = OK;
+    switch (format) {
+        case Format::RAW: {
+            if (m_mappingSize > 0x10000) {
+                status = ERR_BOUNDS;
+            } else if (m_mappingSize > 0) {
+                m_segments.push_back({0x0000, bytes, m_mappingSize});
+            }
+            break;
+        }
+        case Format::PRG: {
+            if (m_mappingSize < 2) {
+                status = ERR_FORMAT;
+                break;
+            }
+            uint32_t loadAddr = bytes[0] | (bytes[1] << 8);
+            if (loadAddr + m_mappingSize - 2 > 0x10000) {
+                status = ERR_BOUNDS;
+            } else if (m_mappingSize > 2) {
+                m_segments.push_back({(uint16_t)loadAddr, bytes + 2, m_mappingSize - 2});
+            }
+            break;
+        }
+        case Format::HEX_TEXT: {
+            status = ParseHexText(text, m_mappingSize);
+            break;
+        }
+        case Format::INTEL_HEX: {
+            status = ParseIntelHex(text, m_mappingSize);
+            break;
+        }
+        case Format::SREC: {
+            status = ParseSrec(text, m_mappingSize);
+            break;
+        }
+        default: {
+            status = ERR_FORMAT;
+        }
+    }
+
+    if (status == OK and (format == HEX_TEXT or format == INTEL_HEX or format == SREC)) {
+        FinishDecoded();
+        // text was only needed for decoding
+        munmap(m_mapping, m_mappingSize);
+        m_mapping     = nullptr;
+        m_mappingSize = 0;
+    }
+    if (status != OK) {
+        Close();
+    }
+    return status;
+}
+
+void ProgramImage::Close()
+{
+    if (m_mapping) {
+        munmap(m_mapping, m_mappingSize);
+    }
+    m_mapping     = nullptr;
+    m_mappingSize = 0;
+    m_format      = AUTO;
+    m_decoded.clear();
+    m_decodedOffsets.clear();
+    m_segments.clear();
+}
+
+size_t ProgramImage::TotalBytes() const
+{
+    size_t total = 0;
+    for (const auto& seg : m_segments) {
+        total += seg.size;
+    }
+    return total;
+}
+
+bool ProgramImage::ProvidesResetVector(uint16_t loadAddr) const
+{
+    uint32_t shift = IsRelocatable() ? loadAddr : 0;
+    bool lo = false, hi = false;
+    for (const auto& seg : m_segments) {
+        uint32_t begin = seg.addr + shift;
+        uint32_t end   = begin + seg.size;
+        lo |= (begin <= 0xfffc and 0xfffc < end);
+        hi |= (begin <= 0xfffd and 0xfffd < end);
+    }
+    return lo and hi;
+}
+
+ProgramImage::Status ProgramImage::LoadInto(Bus& bus, uint16_t loadAddr) const
+{
+    uint32_t shift = IsRelocatable() ? loadAddr : 0;
+    for (const auto& seg : m_segments) {
+        if (seg.addr + shift + seg.size > 0x10000) {
+            return ERR_BOUNDS;
+        }
+    }
+    for (const auto& seg : m_segments) {
+        bus.WriteBlock(seg.addr + shift, seg.data, seg.size);
+    }
+    return OK;
+}
+
+const char* ProgramImage::GetStatusName(Status status)
+{
+    switch (status) {
+        case (Status::OK): {
+            return "ok";
+        }
+        case (Status::ERR_OPEN): {
+            return "unable to open image";
+        }
+        case (Status::ERR_FORMAT): {
+            return "malformed image";
+        }
+        case (Status::ERR_CHECKSUM): {
+            return "image record checksum mismatch";
+        }
+        case (Status::ERR_BOUNDS): {
+            return "image does not fit below 0xffff";
+        }
+    }
+    return "xxx";
+}
+
+void ProgramImage::AppendDecoded(uint32_t addr, const uint8_t* bytes, size_t size)
+{
+    if (!m_decodedOffsets.empty()) {
+        auto& last      = m_decodedOffsets.back();
+        size_t lastSize = m_decoded.size() - last.second;
+        if (last.first + lastSize == addr) {
+            m_decoded.insert(m_decoded.end(), bytes, bytes + size);
+            return;
+        }
+    }
+    m_decodedOffsets.push_back({addr, m_decoded.size()});
+    m_decoded.insert(m_decoded.end(), bytes, bytes + size);
+}
+
+void ProgramImage::FinishDecoded()
+{
+    // m_decoded no longer grows, pointers into it are stable from here on
+    for (size_t i = 0; i < m_decodedOffsets.size(); i++) {
+        size_t begin = m_decodedOffsets[i].second;
+        size_t end   = (i + 1 < m_decodedOffsets.size()) ? m_decodedOffsets[i + 1].second
+                                                         : m_decoded.size();
+        if (end > begin) {
+            m_segments.push_back(
+                {(uint16_t)m_decodedOffsets[i].first, m_decoded.data() + begin, end - begin});
+        }
+    }
+}
+
+ProgramImage::Status ProgramImage::ParseHexText(const char* text, size_t size)
+{
+    std::vector<uint8_t> bytes;
+    bytes.reserve(size / 3 + 1);
+
+    size_t pos = 0;
+    while (pos < size) {
+        while (pos < size and isspace((unsigned char)text[pos])) {
+            pos++;
+        }
+        if (pos == size) {
+            break;
+        }
+        if (pos + 1 < size and text[pos] == '0' and (text[pos + 1] == 'x' or text[pos + 1] == 'X')) {
+            pos += 2;
+        }
+        unsigned value = 0;
+        int digits     = 0;
+        while (pos < size and HexDigit(text[pos]) >= 0) {
+            value = (value << 4) | HexDigit(text[pos]);
+            pos++;
+            digits++;
+        }
+        if (digits == 0 or (pos < size and !isspace((unsigned char)text[pos]))) {
+            return ERR_FORMAT;
+        }
+        bytes.push_back(value & 0xff);  // same truncation as the original stream parser
+    }
+    if (bytes.size() > 0x10000) {
+        return ERR_BOUNDS;
+    }
+    AppendDecoded(0x0000, bytes.data(), bytes.size());
+    return OK;
+}
+
+ProgramImage::Status ProgramImage::ParseIntelHex(const char* text, size_t size)
+{
+    LineReader lines(text, size);
+    const char* line;
+    size_t len;
+    uint32_t base = 0;
+    uint8_t record[256 + 5];
+
+    while (lines.Next(&line, &len)) {
+        if (line[0] != ':' or len < 11 or (len - 1) % 2 != 0) {
+            return ERR_FORMAT;
+        }
+        size_t count = (len - 1) / 2;
+        if (count > sizeof(record)) {
+            return ERR_FORMAT;
+        }
+        uint8_t sum = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (!HexPair(line + 1 + 2 * i, &record[i])) {
+                return ERR_FORMAT;
+            }
+            sum += record[i];
+        }
+        uint8_t dataLen = record[0];
+        if (count != (size_t)dataLen + 5) {
+            return ERR_FORMAT;
+        }
+        if (sum != 0) {
+            return ERR_CHECKSUM;
+        }
+
+        uint16_t offset = (record[1] << 8) | record[2];
+        switch (record[3]) {
+            case 0x00: {  // data
+                uint32_t addr = base + offset;
+                if (addr + dataLen > 0x10000) {
+                    return ERR_BOUNDS;
+                }
+                AppendDecoded(addr, record + 4, dataLen);
+                break;
+            }
+            case 0x01: {  // end of file
+                return OK;
+            }
+            case 0x02: {  // extended segment address
+                if (dataLen != 2) {
+                    return ERR_FORMAT;
+                }
+                base = ((record[4] << 8) | record[5]) << 4;
+                break;
+            }
+            case 0x04: {  // extended linear address
+                if (dataLen != 2) {
+                    return ERR_FORMAT;
+                }
+                base = (uint32_t)((record[4] << 8) | record[5]) << 16;
+                break;
+            }
+            case 0x03:
+            case 0x05: {  // start address, the reset vector decides where we start
+                break;
+            }
+            default: {
+                return ERR_FORMAT;
+            }
+        }
+    }
+    return OK;
+}
+
+ProgramImage::Status ProgramImage::ParseSrec(const char* text, size_t size)
+{
+    LineReader lines(text, size);
+    const char* line;
+    size_t len;
+    uint8_t record[256];
+
+    while (lines.Next(&line, &len)) {
+        if (line[0] != 'S' or len < 4 or (len - 2) % 2 != 0 or !isdigit((unsigned char)line[1])) {
+            return ERR_FORMAT;
+        }
+        size_t count = (len - 2) / 2;
+        if (count > sizeof(record)) {
+            return ERR_FORMAT;
+        }
+        uint8_t sum = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (!HexPair(line + 2 + 2 * i, &record[i])) {
+                return ERR_FORMAT;
+            }
+            sum += record[i];
+        }
+        if (record[0] + 1u != count) {
+            return ERR_FORMAT;
+        }
+        if (sum != 0xff) {
+            return ERR_CHECKSUM;
+        }
+
+        int type = line[1] - '0';
+        size_t addrBytes;
+        switch (type) {
+            case 1:
+            case 9: {
+                addrBytes = 2;
+                break;
+            }
+            case 2:
+            case 8: {
+                addrBytes = 3;
+                break;
+            }
+            case 3:
+            case 7: {
+                addrBytes = 4;
+                break;
+            }
+            case 0:
+            case 5:
+            case 6: {  // header and record counts
+                continue;
+            }
+            default: {
+                return ERR_FORMAT;
+            }
+        }
+        if (count < addrBytes + 2) {
+            return ERR_FORMAT;
+        }
+        if (type >= 7) {  // start address, the reset vector decides where we start
+            continue;
+        }
+
+        uint32_t addr = 0;
+        for (size_t i = 0; i < addrBytes; i++) {
+            addr = (addr << 8) | record[1 + i];
+        }
+        size_t dataLen = count - 1 - addrBytes - 1;
+        if (addr + dataLen > 0x10000) {
+            return ERR_BOUNDS;
+        }
+        AppendDecoded(addr, record + 1 + addrBytes, dataLen);
+    }
+    return OK;
+}
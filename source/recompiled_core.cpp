@@ -0,0 +1,200 @@
+#include "../include/recompiled_core.h"
+
+#include <dlfcn.h>
+
+#include <algorithm>
+#include <cstring>
+
+static void LoadRegs(const MosT6502& cpu, RecompiledRegs* r)
+{
+    r->a            = cpu.a;
+    r->x            = cpu.x;
+    r->y            = cpu.y;
+    r->sp           = cpu.sp;
+    r->sr           = cpu.m_sr;
+    r->nValue       = cpu.m_nValue;
+    r->zValue       = cpu.m_zValue;
+    r->carry        = cpu.m_carry;
+    r->overflow     = cpu.m_overflow;
+    r->pc           = cpu.pc;
+    r->cycles       = cpu.cycles;
+    r->instructions = cpu.instructions;
+}
+
+static void StoreRegs(const RecompiledRegs& r, MosT6502& cpu)
+{
+    cpu.a            = r.a;
+    cpu.x            = r.x;
+    cpu.y            = r.y;
+    cpu.sp           = r.sp;
+    cpu.m_sr         = r.sr;
+    cpu.m_nValue     = r.nValue;
+    cpu.m_zValue     = r.zValue;
+    cpu.m_carry      = r.carry;
+    cpu.m_overflow   = r.overflow;
+    cpu.pc           = r.pc;
+    cpu.cycles       = r.cycles;
+    cpu.instructions = r.instructions;
+}
+
+RecompiledCore::RecompiledCore(Bus& bus, const RecompiledModule& module)
+    : m_bus(bus),
+      m_module(module),
+      m_lookup(new int32_t[0x10000]),
+      m_runnable(module.blockCount, 0),
+      m_state(module.blockCount, BLOCK_UNCHECKED)
+{
+    std::fill(m_lookup.get(), m_lookup.get() + 0x10000, -1);
+    for (uint32_t i = 0; i < module.blockCount; i++) {
+        const RecompiledBlock& block = module.blocks[i];
+        m_lookup[block.pc]           = i;
+        for (unsigned page = block.pc >> 8; page <= (block.pc + block.size - 1u) >> 8; page++) {
+            m_pageBlocks[page].push_back(i);
+        }
+    }
+
+    m_context              = RecompiledContext();
+    m_context.readMap      = m_bus.GetReadMap();
+    m_context.writeMap     = m_bus.GetWriteMap();
+    m_context.read         = HostRead;
+    m_context.write        = HostWrite;
+    m_context.decimalTable = &MosT6502::kDecimalTable.entries[0][0][0][0];
+    m_context.runnable     = m_runnable.data();
+    m_context.host         = this;
+    m_bus.SetCodeWriteListener(this);
+}
+
+RecompiledCore::~RecompiledCore() { m_bus.SetCodeWriteListener(nullptr); }
+
+MosT6502::StopReason RecompiledCore::Run(MosT6502& cpu, uint64_t cycleBudget)
+{
+    cpu.m_sliceEnd = cpu.cycles + cycleBudget;
+    bool native    = !cpu.m_traceSink and !cpu.m_profile and !cpu.m_breakpoints;
+    while (cpu.cycles < cpu.m_sliceEnd) {
+        if (native) {
+            int32_t index = m_lookup[cpu.pc];
+            if (index >= 0 and cpu.cycles + m_module.blocks[index].leadCycles < cpu.m_sliceEnd and
+                IsRunnable(index)) {
+                Enter(cpu);
+                continue;
+            }
+        }
+        MosT6502::StopReason reason = cpu.ExecuteInstruction();
+        if (reason != MosT6502::StopReason::RUNNING) {
+            return reason;
+        }
+    }
+    return MosT6502::StopReason::CYCLE_BUDGET;
+}
+
+// compares ram with the bytes the block was translated from, then watches its pages so the
+// answer holds until one of them is written
+bool RecompiledCore::IsRunnable(uint32_t index)
+{
+    if (m_state[index] != BLOCK_UNCHECKED) {
+        return m_state[index] == BLOCK_RUNNABLE;
+    }
+    const RecompiledBlock& block = m_module.blocks[index];
+    uint32_t end                 = block.pc + block.size;
+    for (uint32_t addr = block.pc; addr < end; addr = (addr & 0xff00) + 0x100) {
+        if (m_bus.GetDevice(addr >> 8)) {
+            return false;  // no watch on device pages, stays unchecked
+        }
+    }
+
+    bool matches = true;
+    for (uint32_t addr = block.pc; addr < end; addr = (addr & 0xff00) + 0x100) {
+        uint8_t page    = addr >> 8;
+        uint32_t length = std::min(end, (addr & 0xff00) + 0x100) - addr;
+        if (memcmp(m_bus.RamPage(page) + (addr & 0xff),
+                   m_module.code + block.codeOffset + (addr - block.pc), length) != 0) {
+            matches = false;
+        }
+        m_bus.WatchCodePage(page);
+    }
+    m_state[index]    = (matches) ? BLOCK_RUNNABLE : BLOCK_MISMATCH;
+    m_runnable[index] = matches;
+    m_blocksMismatched += (matches) ? 0 : 1;
+    return matches;
+}
+
+void RecompiledCore::Enter(MosT6502& cpu)
+{
+    LoadRegs(cpu, &m_context.regs);
+    m_context.sliceEnd = cpu.m_sliceEnd;
+    m_context.exit     = 0;
+    m_invalidated      = false;
+    m_cpu              = &cpu;
+    m_module.run(&m_context);
+    m_cpu = nullptr;
+    StoreRegs(m_context.regs, cpu);
+    m_moduleRuns += 1;
+}
+
+void RecompiledCore::OnCodeWrite(uint8_t page)
+{
+    for (uint32_t index : m_pageBlocks[page]) {
+        m_state[index]    = BLOCK_UNCHECKED;
+        m_runnable[index] = 0;
+    }
+    m_invalidated = true;
+}
+
+uint8_t RecompiledCore::HostRead(RecompiledContext* ctx, uint16_t addr)
+{
+    RecompiledCore* core = static_cast<RecompiledCore*>(ctx->host);
+    StoreRegs(ctx->regs, *core->m_cpu);
+    uint8_t data = core->m_bus.Read(addr);
+    core->AfterHostAccess(ctx);
+    return data;
+}
+
+void RecompiledCore::HostWrite(RecompiledContext* ctx, uint16_t addr, uint8_t data)
+{
+    RecompiledCore* core = static_cast<RecompiledCore*>(ctx->host);
+    StoreRegs(ctx->regs, *core->m_cpu);
+    core->m_bus.Write(addr, data);
+    core->AfterHostAccess(ctx);
+}
+
+// a device that ended the slice, or a write that dropped code, sends control back here
+void RecompiledCore::AfterHostAccess(RecompiledContext* ctx)
+{
+    if (m_invalidated or m_cpu->m_sliceEnd != ctx->sliceEnd) {
+        ctx->exit = 1;
+    }
+}
+
+RecompiledLibrary::~RecompiledLibrary()
+{
+    if (m_handle) {
+        dlclose(m_handle);
+    }
+}
+
+RecompiledLibrary::Status RecompiledLibrary::Open(const std::string& path)
+{
+    if (m_handle) {
+        dlclose(m_handle);
+        m_handle = nullptr;
+        m_module = nullptr;
+    }
+    void* handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        return ERR_OPEN;
+    }
+    RecompiledModuleGetter getter =
+            reinterpret_cast<RecompiledModuleGetter>(dlsym(handle, kRecompiledModuleSymbol));
+    if (!getter) {
+        dlclose(handle);
+        return ERR_SYMBOL;
+    }
+    const RecompiledModule* module = getter();
+    if (!module or module->abiVersion != kRecompiledAbiVersion) {
+        dlclose(handle);
+        return ERR_VERSION;
+    }
+    m_handle = handle;
+    m_module = module;
+    return OK;
+}
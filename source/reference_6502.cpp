@@ -0,0 +1,567 @@
+#include "../include/reference_6502.h"
+
+namespace {
+
+enum Mnemonic : uint8_t
+{
+    ___,  // not a documented opcode
+    ADC, AND, ASL, BCC, BCS, BEQ, BIT, BMI, BNE, BPL, BRK, BVC, BVS, CLC,
+    CLD, CLI, CLV, CMP, CPX, CPY, DEC, DEX, DEY, EOR, INC, INX, INY, JMP,
+    JSR, LDA, LDX, LDY, LSR, NOP, ORA, PHA, PHP, PLA, PLP, ROL, ROR, RTI,
+    RTS, SBC, SEC, SED, SEI, STA, STX, STY, TAX, TAY, TSX, TXA, TXS, TYA,
+};
+
+enum Mode : uint8_t
+{
+    IMP,  // implied, or the accumulator for ASL/LSR/ROL/ROR
+    IMM,
+    ZPG,
+    ZPX,
+    ZPY,
+    REL,
+    ABS,
+    ABX,
+    ABY,
+    IND,
+    IZX,
+    IZY,
+};
+
+struct Entry {
+    Mnemonic mnemonic;
+    Mode mode;
+    uint8_t cycles;
+    bool pagePenalty;  // +1 when indexing crosses a page
+};
+
+// the data sheet's opcode matrix, row = high nibble
+#define E(m, mode, cycles) {m, mode, cycles, false}
+#define P(m, mode, cycles) {m, mode, cycles, true}
+#define X {___, IMP, 0, false}
+// clang-format off
+const Entry kMatrix[256] = {
+    E(BRK,IMM,7), E(ORA,IZX,6), X, X, X,           E(ORA,ZPG,3), E(ASL,ZPG,5), X, E(PHP,IMP,3), E(ORA,IMM,2), E(ASL,IMP,2), X, X,           E(ORA,ABS,4), E(ASL,ABS,6), X,
+    E(BPL,REL,2), P(ORA,IZY,5), X, X, X,           E(ORA,ZPX,4), E(ASL,ZPX,6), X, E(CLC,IMP,2), P(ORA,ABY,4), X,            X, X,           P(ORA,ABX,4), E(ASL,ABX,7), X,
+    E(JSR,ABS,6), E(AND,IZX,6), X, X, E(BIT,ZPG,3), E(AND,ZPG,3), E(ROL,ZPG,5), X, E(PLP,IMP,4), E(AND,IMM,2), E(ROL,IMP,2), X, E(BIT,ABS,4), E(AND,ABS,4), E(ROL,ABS,6), X,
+    E(BMI,REL,2), P(AND,IZY,5), X, X, X,           E(AND,ZPX,4), E(ROL,ZPX,6), X, E(SEC,IMP,2), P(AND,ABY,4), X,            X, X,           P(AND,ABX,4), E(ROL,ABX,7), X,
+    E(RTI,IMP,6), E(EOR,IZX,6), X, X, X,           E(EOR,ZPG,3), E(LSR,ZPG,5), X, E(PHA,IMP,3), E(EOR,IMM,2), E(LSR,IMP,2), X, E(JMP,ABS,3), E(EOR,ABS,4), E(LSR,ABS,6), X,
+    E(BVC,REL,2), P(EOR,IZY,5), X, X, X,           E(EOR,ZPX,4), E(LSR,ZPX,6), X, E(CLI,IMP,2), P(EOR,ABY,4), X,            X, X,           P(EOR,ABX,4), E(LSR,ABX,7), X,
+    E(RTS,IMP,6), E(ADC,IZX,6), X, X, X,           E(ADC,ZPG,3), E(ROR,ZPG,5), X, E(PLA,IMP,4), E(ADC,IMM,2), E(ROR,IMP,2), X, E(JMP,IND,5), E(ADC,ABS,4), E(ROR,ABS,6), X,
+    E(BVS,REL,2), P(ADC,IZY,5), X, X, X,           E(ADC,ZPX,4), E(ROR,ZPX,6), X, E(SEI,IMP,2), P(ADC,ABY,4), X,            X, X,           P(ADC,ABX,4), E(ROR,ABX,7), X,
+    X,            E(STA,IZX,6), X, X, E(STY,ZPG,3), E(STA,ZPG,3), E(STX,ZPG,3), X, E(DEY,IMP,2), X,            E(TXA,IMP,2), X, E(STY,ABS,4), E(STA,ABS,4), E(STX,ABS,4), X,
+    E(BCC,REL,2), E(STA,IZY,6), X, X, E(STY,ZPX,4), E(STA,ZPX,4), E(STX,ZPY,4), X, E(TYA,IMP,2), E(STA,ABY,5), E(TXS,IMP,2), X, X,           E(STA,ABX,5), X,            X,
+    E(LDY,IMM,2), E(LDA,IZX,6), E(LDX,IMM,2), X, E(LDY,ZPG,3), E(LDA,ZPG,3), E(LDX,ZPG,3), X, E(TAY,IMP,2), E(LDA,IMM,2), E(TAX,IMP,2), X, E(LDY,ABS,4), E(LDA,ABS,4), E(LDX,ABS,4), X,
+    E(BCS,REL,2), P(LDA,IZY,5), X,            X, E(LDY,ZPX,4), E(LDA,ZPX,4), E(LDX,ZPY,4), X, E(CLV,IMP,2), P(LDA,ABY,4), E(TSX,IMP,2), X, P(LDY,ABX,4), P(LDA,ABX,4), P(LDX,ABY,4), X,
+    E(CPY,IMM,2), E(CMP,IZX,6), X, X, E(CPY,ZPG,3), E(CMP,ZPG,3), E(DEC,ZPG,5), X, E(INY,IMP,2), E(CMP,IMM,2), E(DEX,IMP,2), X, E(CPY,ABS,4), E(CMP,ABS,4), E(DEC,ABS,6), X,
+    E(BNE,REL,2), P(CMP,IZY,5), X, X, X,           E(CMP,ZPX,4), E(DEC,ZPX,6), X, E(CLD,IMP,2), P(CMP,ABY,4), X,            X, X,           P(CMP,ABX,4), E(DEC,ABX,7), X,
+    E(CPX,IMM,2), E(SBC,IZX,6), X, X, E(CPX,ZPG,3), E(SBC,ZPG,3), E(INC,ZPG,5), X, E(INX,IMP,2), E(SBC,IMM,2), E(NOP,IMP,2), X, E(CPX,ABS,4), E(SBC,ABS,4), E(INC,ABS,6), X,
+    E(BEQ,REL,2), P(SBC,IZY,5), X, X, X,           E(SBC,ZPX,4), E(INC,ZPX,6), X, E(SED,IMP,2), P(SBC,ABY,4), X,            X, X,           P(SBC,ABX,4), E(INC,ABX,7), X,
+};
+// clang-format on
+#undef E
+#undef P
+#undef X
+
+const uint8_t kTerminate = 0x11;  // same byte as TERMINATE_OPCODE, kept separate on purpose
+
+const uint8_t kC = 0x01;
+const uint8_t kZ = 0x02;
+const uint8_t kI = 0x04;
+const uint8_t kD = 0x08;
+const uint8_t kB = 0x10;
+const uint8_t kU = 0x20;
+const uint8_t kV = 0x40;
+const uint8_t kN = 0x80;
+
+int OperandBytes(Mode mode)
+{
+    switch (mode) {
+        case (IMP): {
+            return 0;
+        }
+        case (ABS):
+        case (ABX):
+        case (ABY):
+        case (IND): {
+            return 2;
+        }
+        default: {
+            return 1;
+        }
+    }
+}
+
+}  // namespace
+
+void Reference6502::Reset()
+{
+    pc           = ReadWord(0xfffc, 0xfffd);
+    a            = 0x00;
+    x            = 0x00;
+    y            = 0x00;
+    sp           = 0xff;
+    sr           = kU;
+    cycles       = 0;
+    instructions = 0;
+}
+
+MosT6502::StopReason Reference6502::Run(uint64_t cycleBudget)
+{
+    uint64_t target = cycles + cycleBudget;
+    while (cycles < target) {
+        MosT6502::StopReason reason = Step();
+        if (reason != MosT6502::StopReason::RUNNING) {
+            return reason;
+        }
+    }
+    return MosT6502::StopReason::CYCLE_BUDGET;
+}
+
+void Reference6502::Push(uint8_t v)
+{
+    mem[0x0100 | sp] = v;
+    sp--;
+}
+
+uint8_t Reference6502::Pull()
+{
+    sp++;
+    return mem[0x0100 | sp];
+}
+
+void Reference6502::SetNz(uint8_t v)
+{
+    SetFlag(kN, v & 0x80);
+    SetFlag(kZ, v == 0);
+}
+
+void Reference6502::Add(uint8_t m)
+{
+    unsigned sum = a + m + (sr & kC);
+    SetFlag(kV, ((a ^ sum) & (m ^ sum) & 0x80) != 0);
+    SetFlag(kC, sum > 0xff);
+    a = sum & 0xff;
+    SetNz(a);
+}
+
+// decimal mode, nibble by nibble as the nmos part does it : N and V come from the high nibble
+// before its adjustment, Z from the binary sum
+void Reference6502::AddDecimal(uint8_t m)
+{
+    unsigned c  = sr & kC;
+    unsigned lo = (a & 0x0f) + (m & 0x0f) + c;
+    unsigned hi = (a >> 4) + (m >> 4);
+    if (lo > 9) {
+        lo += 6;
+    }
+    if (lo > 0x0f) {
+        hi += 1;
+    }
+    SetFlag(kZ, ((a + m + c) & 0xff) == 0);
+    SetFlag(kN, hi & 0x08);
+    SetFlag(kV, (~(a ^ m) & (a ^ (hi << 4)) & 0x80) != 0);
+    if (hi > 9) {
+        hi += 6;
+    }
+    SetFlag(kC, hi > 0x0f);
+    a = ((hi << 4) | (lo & 0x0f)) & 0xff;
+}
+
+// decimal mode, every flag as in binary mode
+void Reference6502::SubtractDecimal(uint8_t m)
+{
+    uint8_t minuend = a;
+    int lo          = (minuend & 0x0f) - (m & 0x0f) - ((sr & kC) ? 0 : 1);
+    int hi          = (minuend >> 4) - (m >> 4);
+    Add(~m);
+    if (lo < 0) {
+        lo -= 6;
+        hi -= 1;
+    }
+    if (hi < 0) {
+        hi -= 6;
+    }
+    a = ((hi << 4) | (lo & 0x0f)) & 0xff;
+}
+
+void Reference6502::Compare(uint8_t reg, uint8_t m)
+{
+    SetFlag(kC, reg >= m);
+    SetNz(reg - m);
+}
+
+void Reference6502::Branch(bool taken, uint8_t offset)
+{
+    if (taken) {
+        uint16_t target = pc + (int8_t)offset;
+        cycles += ((target >> 8) != (pc >> 8)) ? 2 : 1;
+        pc = target;
+    }
+}
+
+MosT6502::StopReason Reference6502::Step()
+{
+    uint8_t opcode = Read(pc);
+    if (opcode == kTerminate) {
+        return MosT6502::StopReason::TERMINATED;
+    }
+    const Entry& e = kMatrix[opcode];
+    if (e.mnemonic == ___) {
+        return MosT6502::StopReason::ILLEGAL_OPCODE;
+    }
+
+    uint16_t operand = 0;
+    if (OperandBytes(e.mode) == 1) {
+        operand = Read(pc + 1);
+    } else if (OperandBytes(e.mode) == 2) {
+        operand = ReadWord(pc + 1, (uint16_t)(pc + 2));
+    }
+    pc += 1 + OperandBytes(e.mode);
+    cycles += e.cycles;
+    instructions += 1;
+
+    // effective address; a page cross costs a cycle only where the matrix says so
+    uint16_t ea   = 0;
+    uint16_t base = 0;
+    switch (e.mode) {
+        case (ZPG): {
+            ea = operand;
+            break;
+        }
+        case (ZPX): {
+            ea = (uint8_t)(operand + x);
+            break;
+        }
+        case (ZPY): {
+            ea = (uint8_t)(operand + y);
+            break;
+        }
+        case (ABS): {
+            ea = operand;
+            break;
+        }
+        case (ABX): {
+            base = operand;
+            ea   = base + x;
+            break;
+        }
+        case (ABY): {
+            base = operand;
+            ea   = base + y;
+            break;
+        }
+        case (IND): {  // JMP ($xxff) takes its high byte from $xx00
+            ea = ReadWord(operand, (operand & 0xff00) | (uint8_t)(operand + 1));
+            break;
+        }
+        case (IZX): {
+            uint8_t ptr = operand + x;
+            ea          = ReadWord(ptr, (uint8_t)(ptr + 1));
+            break;
+        }
+        case (IZY): {
+            base = ReadWord(operand, (uint8_t)(operand + 1));
+            ea   = base + y;
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+    if (e.pagePenalty and (ea >> 8) != (base >> 8)) {
+        cycles += 1;
+    }
+
+    auto load = [&]() -> uint8_t { return (e.mode == IMM) ? (uint8_t)operand : Read(ea); };
+    // read-modify-write on the accumulator or memory
+    auto modify = [&](uint8_t (*op)(Reference6502&, uint8_t)) {
+        if (e.mode == IMP) {
+            a = op(*this, a);
+        } else {
+            mem[ea] = op(*this, mem[ea]);
+        }
+    };
+
+    switch (e.mnemonic) {
+        case (LDA): {
+            a = load();
+            SetNz(a);
+            break;
+        }
+        case (LDX): {
+            x = load();
+            SetNz(x);
+            break;
+        }
+        case (LDY): {
+            y = load();
+            SetNz(y);
+            break;
+        }
+        case (STA): {
+            mem[ea] = a;
+            break;
+        }
+        case (STX): {
+            mem[ea] = x;
+            break;
+        }
+        case (STY): {
+            mem[ea] = y;
+            break;
+        }
+        case (TAX): {
+            x = a;
+            SetNz(x);
+            break;
+        }
+        case (TAY): {
+            y = a;
+            SetNz(y);
+            break;
+        }
+        case (TXA): {
+            a = x;
+            SetNz(a);
+            break;
+        }
+        case (TYA): {
+            a = y;
+            SetNz(a);
+            break;
+        }
+        case (TSX): {
+            x = sp;
+            SetNz(x);
+            break;
+        }
+        case (TXS): {
+            sp = x;
+            break;
+        }
+        case (PHA): {
+            Push(a);
+            break;
+        }
+        case (PHP): {
+            Push(sr | kB | kU);
+            break;
+        }
+        case (PLA): {
+            a = Pull();
+            SetNz(a);
+            break;
+        }
+        case (PLP): {
+            sr = (Pull() & ~kB) | kU;
+            break;
+        }
+        case (AND): {
+            a &= load();
+            SetNz(a);
+            break;
+        }
+        case (ORA): {
+            a |= load();
+            SetNz(a);
+            break;
+        }
+        case (EOR): {
+            a ^= load();
+            SetNz(a);
+            break;
+        }
+        case (BIT): {
+            uint8_t m = load();
+            SetFlag(kZ, (a & m) == 0);
+            SetFlag(kN, m & kN);
+            SetFlag(kV, m & kV);
+            break;
+        }
+        case (ADC): {
+            uint8_t m = load();
+            if (sr & kD) {
+                AddDecimal(m);
+            } else {
+                Add(m);
+            }
+            break;
+        }
+        case (SBC): {
+            uint8_t m = load();
+            if (sr & kD) {
+                SubtractDecimal(m);
+            } else {
+                Add(~m);
+            }
+            break;
+        }
+        case (CMP): {
+            Compare(a, load());
+            break;
+        }
+        case (CPX): {
+            Compare(x, load());
+            break;
+        }
+        case (CPY): {
+            Compare(y, load());
+            break;
+        }
+        case (INC): {
+            mem[ea] += 1;
+            SetNz(mem[ea]);
+            break;
+        }
+        case (DEC): {
+            mem[ea] -= 1;
+            SetNz(mem[ea]);
+            break;
+        }
+        case (INX): {
+            SetNz(++x);
+            break;
+        }
+        case (INY): {
+            SetNz(++y);
+            break;
+        }
+        case (DEX): {
+            SetNz(--x);
+            break;
+        }
+        case (DEY): {
+            SetNz(--y);
+            break;
+        }
+        case (ASL): {
+            modify([](Reference6502& cpu, uint8_t v) -> uint8_t {
+                cpu.SetFlag(kC, v & 0x80);
+                cpu.SetNz(v << 1);
+                return v << 1;
+            });
+            break;
+        }
+        case (LSR): {
+            modify([](Reference6502& cpu, uint8_t v) -> uint8_t {
+                cpu.SetFlag(kC, v & 0x01);
+                cpu.SetNz(v >> 1);
+                return v >> 1;
+            });
+            break;
+        }
+        case (ROL): {
+            modify([](Reference6502& cpu, uint8_t v) -> uint8_t {
+                uint8_t r = (v << 1) | (cpu.sr & kC);
+                cpu.SetFlag(kC, v & 0x80);
+                cpu.SetNz(r);
+                return r;
+            });
+            break;
+        }
+        case (ROR): {
+            modify([](Reference6502& cpu, uint8_t v) -> uint8_t {
+                uint8_t r = (v >> 1) | ((cpu.sr & kC) << 7);
+                cpu.SetFlag(kC, v & 0x01);
+                cpu.SetNz(r);
+                return r;
+            });
+            break;
+        }
+        case (BCC): {
+            Branch(!(sr & kC), operand);
+            break;
+        }
+        case (BCS): {
+            Branch(sr & kC, operand);
+            break;
+        }
+        case (BNE): {
+            Branch(!(sr & kZ), operand);
+            break;
+        }
+        case (BEQ): {
+            Branch(sr & kZ, operand);
+            break;
+        }
+        case (BPL): {
+            Branch(!(sr & kN), operand);
+            break;
+        }
+        case (BMI): {
+            Branch(sr & kN, operand);
+            break;
+        }
+        case (BVC): {
+            Branch(!(sr & kV), operand);
+            break;
+        }
+        case (BVS): {
+            Branch(sr & kV, operand);
+            break;
+        }
+        case (CLC): {
+            SetFlag(kC, false);
+            break;
+        }
+        case (SEC): {
+            SetFlag(kC, true);
+            break;
+        }
+        case (CLI): {
+            SetFlag(kI, false);
+            break;
+        }
+        case (SEI): {
+            SetFlag(kI, true);
+            break;
+        }
+        case (CLV): {
+            SetFlag(kV, false);
+            break;
+        }
+        case (CLD): {
+            SetFlag(kD, false);
+            break;
+        }
+        case (SED): {
+            SetFlag(kD, true);
+            break;
+        }
+        case (JMP): {
+            pc = ea;
+            break;
+        }
+        case (JSR): {  // pushes the address of its own last byte
+            uint16_t ret = pc - 1;
+            Push(ret >> 8);
+            Push(ret & 0xff);
+            pc = ea;
+            break;
+        }
+        case (RTS): {
+            uint8_t lo = Pull();
+            pc         = (lo | (Pull() << 8)) + 1;
+            break;
+        }
+        case (RTI): {
+            sr         = (Pull() & ~kB) | kU;
+            uint8_t lo = Pull();
+            pc         = lo | (Pull() << 8);
+            break;
+        }
+        case (BRK): {  // the signature byte is skipped
+            Push(pc >> 8);
+            Push(pc & 0xff);
+            Push(sr | kB | kU);
+            SetFlag(kI, true);
+            pc = ReadWord(0xfffe, 0xffff);
+            return MosT6502::StopReason::BREAK;
+        }
+        case (NOP):
+        case (___): {
+            break;
+        }
+    }
+    return MosT6502::StopReason::RUNNING;
+}
@@ -0,0 +1,715 @@
+#include "../include/static_recompiler.h"
+
+#include <iomanip>
+
+#include "../include/mos_t_common.h"
+#include "../include/recompiled_module.h"
+
+typedef MosT6502::InstrName InstrName;
+typedef MosT6502::AddrMode AddrMode;
+
+// instructions RecompiledModule::run() hands back to the interpreter, see the class comment
+static bool IsLeftToHost(const MosT6502::OpcodeInfo& info)
+{
+    if (info.addrMode == AddrMode::INDIRECT) {
+        return true;
+    }
+    switch (info.instrName) {
+        case (InstrName::BRK):
+        case (InstrName::CLI):
+        case (InstrName::PLP):
+        case (InstrName::RTI): {
+            return true;
+        }
+        default: {
+            return false;
+        }
+    }
+}
+
+static bool IsBranch(InstrName instrName)
+{
+    switch (instrName) {
+        case (InstrName::BCC):
+        case (InstrName::BCS):
+        case (InstrName::BEQ):
+        case (InstrName::BMI):
+        case (InstrName::BNE):
+        case (InstrName::BPL):
+        case (InstrName::BVC):
+        case (InstrName::BVS): {
+            return true;
+        }
+        default: {
+            return false;
+        }
+    }
+}
+
+static bool EndsBlock(InstrName instrName)
+{
+    return IsBranch(instrName) or instrName == InstrName::JMP or instrName == InstrName::JSR or
+           instrName == InstrName::RTS;
+}
+
+// does the instruction go to the bus (besides fetching itself)
+static bool TouchesMemory(const MosT6502::OpcodeInfo& info)
+{
+    switch (info.instrName) {
+        case (InstrName::PHA):
+        case (InstrName::PHP):
+        case (InstrName::PLA):
+        case (InstrName::JSR):
+        case (InstrName::RTS): {
+            return true;
+        }
+        case (InstrName::JMP): {
+            return false;
+        }
+        default: {
+            return info.addrMode != AddrMode::IMPLIED and info.addrMode != AddrMode::IMMEDIATE and
+                   info.addrMode != AddrMode::RELATIVE;
+        }
+    }
+}
+
+static uint16_t BranchTarget(uint16_t next, uint8_t offset) { return next + (int8_t)offset; }
+
+StaticRecompiler::StaticRecompiler(const uint8_t* memory)
+    : m_memory(memory, memory + 0x10000), m_inImage(0x10000, false)
+{
+}
+
+void StaticRecompiler::AddImageRange(uint16_t addr, size_t size)
+{
+    for (size_t i = 0; i < size and addr + i < 0x10000; i++) {
+        m_inImage[addr + i] = true;
+    }
+}
+
+void StaticRecompiler::AddEntry(uint16_t addr) { m_entries.push_back(addr); }
+
+void StaticRecompiler::AddVectorEntries()
+{
+    for (uint16_t vector : {0xfffa, 0xfffc, 0xfffe}) {
+        if (m_inImage[vector] and m_inImage[vector + 1]) {
+            uint16_t addr = m_memory[vector] | (m_memory[vector + 1] << 8);
+            if (m_inImage[addr]) {
+                AddEntry(addr);
+            }
+        }
+    }
+}
+
+bool StaticRecompiler::Decode(uint16_t pc, Instr* instr) const
+{
+    uint8_t opcode                   = m_memory[pc];
+    const MosT6502::OpcodeInfo& info = MosT6502::Decode(opcode);
+    if (opcode == TERMINATE_OPCODE or !MosT6502::IsLegal(info)) {
+        return false;
+    }
+    uint8_t length = MosT6502::GetInstrLength(info.addrMode);
+    for (uint8_t i = 0; i < length; i++) {
+        if (pc + i >= 0x10000 or !m_inImage[pc + i]) {
+            return false;
+        }
+    }
+    instr->pc      = pc;
+    instr->opcode  = opcode;
+    instr->info    = info;
+    instr->operand = 0x0000;
+    for (uint8_t i = length - 1; i > 0; i--) {
+        instr->operand = (instr->operand << 8) | m_memory[pc + i];
+    }
+    return true;
+}
+
+// every address control can reach becomes a leader (entries, branch and jump targets, the
+// instruction after a branch, JSR or something left to the host) or is reached by falling
+// through from one; where two paths meet starts a block too
+void StaticRecompiler::Analyze()
+{
+    m_leader.assign(0x10000, false);
+    m_visited.assign(0x10000, false);
+    m_blocks.clear();
+    m_stats = Stats();
+
+    std::vector<uint16_t> work;
+    auto addLeader = [&](uint32_t addr) {
+        if (addr < 0x10000 and m_inImage[addr] and !m_leader[addr]) {
+            m_leader[addr] = true;
+            work.push_back(addr);
+        }
+    };
+    for (uint16_t entry : m_entries) {
+        m_stats.entries += m_inImage[entry] ? 1 : 0;
+        addLeader(entry);
+    }
+
+    while (!work.empty()) {
+        uint32_t pc = work.back();
+        work.pop_back();
+        while (pc < 0x10000) {
+            if (m_visited[pc]) {
+                m_leader[pc] = true;
+                break;
+            }
+            Instr instr;
+            if (!Decode(pc, &instr)) {
+                break;
+            }
+            m_visited[pc] = true;
+            uint32_t next = pc + MosT6502::GetInstrLength(instr.info.addrMode);
+            InstrName name = instr.info.instrName;
+            if (IsLeftToHost(instr.info)) {
+                m_stats.leftToHost += 1;
+                if (name == InstrName::BRK or name == InstrName::CLI or name == InstrName::PLP) {
+                    addLeader(next);  // after BRK : where its RTI comes back to
+                }
+                break;
+            }
+            if (IsBranch(name)) {
+                addLeader(BranchTarget(next, instr.operand));
+                addLeader(next);
+                break;
+            }
+            if (name == InstrName::JMP or name == InstrName::JSR) {
+                addLeader(instr.operand);
+                if (name == InstrName::JSR) {
+                    addLeader(next);
+                }
+                break;
+            }
+            if (name == InstrName::RTS) {
+                break;
+            }
+            pc = next;
+        }
+    }
+    BuildBlocks();
+}
+
+void StaticRecompiler::BuildBlocks()
+{
+    for (uint32_t start = 0; start < 0x10000; start++) {
+        if (!m_leader[start]) {
+            continue;
+        }
+        Block block;
+        block.pc         = start;
+        block.leadCycles = 0;
+        uint32_t pc      = start;
+        Instr instr;
+        while (Decode(pc, &instr) and !IsLeftToHost(instr.info)) {
+            block.instrs.push_back(instr);
+            pc += MosT6502::GetInstrLength(instr.info.addrMode);
+            if (EndsBlock(instr.info.instrName) or pc >= 0x10000 or m_leader[pc]) {
+                break;
+            }
+        }
+        if (block.instrs.empty()) {
+            continue;
+        }
+        block.size = pc - start;
+        for (size_t i = 0; i + 1 < block.instrs.size(); i++) {
+            const MosT6502::OpcodeInfo& info = block.instrs[i].info;
+            bool penalty                     = info.flags & MosT6502::OPCODE_PAGE_PENALTY;
+            block.leadCycles += info.cycles + (penalty ? 1 : 0);
+        }
+        m_stats.blocks += 1;
+        m_stats.instructions += block.instrs.size();
+        m_stats.codeBytes += block.size;
+        m_blocks.push_back(block);
+    }
+}
+
+// one instruction as a scope of its own, in the order MosT6502::Execute() does things so a
+// bus callback sees the same cpu state : pc, cycles and the counter first, then the access
+void StaticRecompiler::WriteInstr(std::ostream& os, const Instr& instr, bool last) const
+{
+    const MosT6502::OpcodeInfo& info = instr.info;
+    uint16_t next = instr.pc + MosT6502::GetInstrLength(info.addrMode);
+    uint16_t op   = instr.operand;
+    bool penalty  = info.flags & MosT6502::OPCODE_PAGE_PENALTY;
+
+    os << "    // " << STREAM_WORD(instr.pc) << " : " << MosT6502::GetInstrString(instr.opcode);
+    if (next - instr.pc == 2) {
+        os << ' ' << STREAM_BYTE(op);
+    } else if (next - instr.pc == 3) {
+        os << ' ' << STREAM_WORD(op);
+    }
+    os << "\n    {\n";
+    os << "        r.pc = " << STREAM_WORD(next) << ";\n";
+    os << "        r.cycles += " << std::dec << +info.cycles << ";\n";
+    os << "        r.instructions += 1;\n";
+
+    // effective address in ea
+    switch (info.addrMode) {
+        case (AddrMode::ZERO_PAGE): {
+            os << "        uint16_t ea = " << STREAM_BYTE(op & 0xff) << ";\n";
+            break;
+        }
+        case (AddrMode::ZERO_PAGE_X):
+        case (AddrMode::ZERO_PAGE_Y): {
+            const char* reg = (info.addrMode == AddrMode::ZERO_PAGE_X) ? "r.x" : "r.y";
+            os << "        uint16_t ea = (uint8_t)(" << STREAM_BYTE(op & 0xff) << " + " << reg
+               << ");\n";
+            break;
+        }
+        case (AddrMode::ABSOLUTE): {
+            if (info.instrName != InstrName::JMP and info.instrName != InstrName::JSR) {
+                os << "        uint16_t ea = " << STREAM_WORD(op) << ";\n";
+            }
+            break;
+        }
+        case (AddrMode::ABSOLUTE_X):
+        case (AddrMode::ABSOLUTE_Y): {
+            const char* reg = (info.addrMode == AddrMode::ABSOLUTE_X) ? "r.x" : "r.y";
+            os << "        uint16_t ea = " << STREAM_WORD(op) << " + " << reg << ";\n";
+            if (penalty) {
+                os << "        r.cycles += ((ea ^ " << STREAM_WORD(op) << ") & 0xff00) != 0;\n";
+            }
+            break;
+        }
+        case (AddrMode::INDIRECT_X): {  // separate statements : the two reads stay in order
+            os << "        uint8_t ptr = " << STREAM_BYTE(op & 0xff) << " + r.x;\n";
+            os << "        uint16_t ea = RecompiledRead(ctx, r, ptr);\n";
+            os << "        ea |= RecompiledRead(ctx, r, (uint8_t)(ptr + 1)) << 8;\n";
+            break;
+        }
+        case (AddrMode::INDIRECT_Y): {
+            os << "        uint16_t base = RecompiledRead(ctx, r, " << STREAM_BYTE(op & 0xff)
+               << ");\n";
+            os << "        base |= RecompiledRead(ctx, r, " << STREAM_BYTE((op + 1) & 0xff)
+               << ") << 8;\n";
+            os << "        uint16_t ea = base + r.y;\n";
+            if (penalty) {
+                os << "        r.cycles += ((ea ^ base) & 0xff00) != 0;\n";
+            }
+            break;
+        }
+        default: {  // implied, immediate, relative; indirect is left to the host
+            break;
+        }
+    }
+
+    // operand byte in m for the instructions reading one
+    const char* data = "RecompiledRead(ctx, r, ea)";
+    std::string immediate;
+    if (info.addrMode == AddrMode::IMMEDIATE) {
+        std::ostringstream literal;
+        literal << STREAM_BYTE(op & 0xff);
+        immediate = literal.str();
+        data      = immediate.c_str();
+    } else if (info.addrMode == AddrMode::IMPLIED) {
+        data = "r.a";
+    }
+
+    switch (info.instrName) {
+        case (InstrName::ADC):
+        case (InstrName::SBC): {
+            os << "        RecompiledAdd(ctx, r, " << data << ", "
+               << ((info.instrName == InstrName::SBC) ? "true" : "false") << ");\n";
+            break;
+        }
+        case (InstrName::AND):
+        case (InstrName::ORA):
+        case (InstrName::EOR): {
+            const char* op2 = (info.instrName == InstrName::AND)   ? "&="
+                              : (info.instrName == InstrName::ORA) ? "|="
+                                                                   : "^=";
+            os << "        r.a " << op2 << ' ' << data << ";\n";
+            os << "        RecompiledSetNz(r, r.a);\n";
+            break;
+        }
+        case (InstrName::LDA):
+        case (InstrName::LDX):
+        case (InstrName::LDY): {
+            const char* reg = (info.instrName == InstrName::LDA)   ? "r.a"
+                              : (info.instrName == InstrName::LDX) ? "r.x"
+                                                                   : "r.y";
+            os << "        " << reg << " = " << data << ";\n";
+            os << "        RecompiledSetNz(r, " << reg << ");\n";
+            break;
+        }
+        case (InstrName::STA):
+        case (InstrName::STX):
+        case (InstrName::STY): {
+            const char* reg = (info.instrName == InstrName::STA)   ? "r.a"
+                              : (info.instrName == InstrName::STX) ? "r.x"
+                                                                   : "r.y";
+            os << "        RecompiledWrite(ctx, r, ea, " << reg << ");\n";
+            break;
+        }
+        case (InstrName::CMP):
+        case (InstrName::CPX):
+        case (InstrName::CPY): {
+            const char* reg = (info.instrName == InstrName::CMP)   ? "r.a"
+                              : (info.instrName == InstrName::CPX) ? "r.x"
+                                                                   : "r.y";
+            os << "        RecompiledCompare(r, " << reg << ", " << data << ");\n";
+            break;
+        }
+        case (InstrName::BIT): {
+            os << "        uint8_t m = " << data << ";\n";
+            os << "        r.zValue = r.a & m;\n";
+            os << "        r.nValue = m;\n";
+            os << "        r.overflow = (m >> 6) & 1;\n";
+            break;
+        }
+        case (InstrName::ASL):
+        case (InstrName::LSR):
+        case (InstrName::ROL):
+        case (InstrName::ROR): {  // flags before the write, like the interpreter
+            os << "        uint8_t m = " << data << ";\n";
+            os << "        uint8_t result;\n";
+            switch (info.instrName) {
+                case (InstrName::ASL): {
+                    os << "        result = m << 1;\n";
+                    os << "        r.carry = m >> 7;\n";
+                    break;
+                }
+                case (InstrName::LSR): {
+                    os << "        result = m >> 1;\n";
+                    os << "        r.carry = m & 1;\n";
+                    break;
+                }
+                case (InstrName::ROL): {
+                    os << "        result = (m << 1) | r.carry;\n";
+                    os << "        r.carry = m >> 7;\n";
+                    break;
+                }
+                default: {
+                    os << "        result = (r.carry << 7) | (m >> 1);\n";
+                    os << "        r.carry = m & 1;\n";
+                    break;
+                }
+            }
+            os << "        RecompiledSetNz(r, result);\n";
+            if (info.addrMode == AddrMode::IMPLIED) {
+                os << "        r.a = result;\n";
+            } else {
+                os << "        RecompiledWrite(ctx, r, ea, result);\n";
+            }
+            break;
+        }
+        case (InstrName::INC):
+        case (InstrName::DEC): {  // the write comes before the flags here
+            os << "        uint8_t result = " << data
+               << ((info.instrName == InstrName::INC) ? " + 1" : " - 1") << ";\n";
+            os << "        RecompiledWrite(ctx, r, ea, result);\n";
+            os << "        RecompiledSetNz(r, result);\n";
+            break;
+        }
+        case (InstrName::INX):
+        case (InstrName::INY):
+        case (InstrName::DEX):
+        case (InstrName::DEY): {
+            const char* reg =
+                    (info.instrName == InstrName::INX or info.instrName == InstrName::DEX) ? "r.x"
+                                                                                           : "r.y";
+            const char* step =
+                    (info.instrName == InstrName::INX or info.instrName == InstrName::INY) ? "+="
+                                                                                           : "-=";
+            os << "        " << reg << ' ' << step << " 1;\n";
+            os << "        RecompiledSetNz(r, " << reg << ");\n";
+            break;
+        }
+        case (InstrName::BCC):
+        case (InstrName::BCS):
+        case (InstrName::BEQ):
+        case (InstrName::BNE):
+        case (InstrName::BMI):
+        case (InstrName::BPL):
+        case (InstrName::BVC):
+        case (InstrName::BVS): {
+            const char* taken = "";
+            switch (info.instrName) {
+                case (InstrName::BCC): {
+                    taken = "!r.carry";
+                    break;
+                }
+                case (InstrName::BCS): {
+                    taken = "r.carry";
+                    break;
+                }
+                case (InstrName::BEQ): {
+                    taken = "r.zValue == 0";
+                    break;
+                }
+                case (InstrName::BNE): {
+                    taken = "r.zValue != 0";
+                    break;
+                }
+                case (InstrName::BMI): {
+                    taken = "r.nValue & 0x80";
+                    break;
+                }
+                case (InstrName::BPL): {
+                    taken = "!(r.nValue & 0x80)";
+                    break;
+                }
+                case (InstrName::BVC): {
+                    taken = "!r.overflow";
+                    break;
+                }
+                default: {
+                    taken = "r.overflow";
+                    break;
+                }
+            }
+            uint16_t target = BranchTarget(next, op);
+            os << "        if (" << taken << ") {\n";
+            os << "            r.cycles += " << (((target ^ next) & 0xff00) ? 2 : 1) << ";\n";
+            os << "            r.pc = " << STREAM_WORD(target) << ";\n";
+            os << "        }\n";
+            break;
+        }
+        case (InstrName::JMP): {
+            os << "        r.pc = " << STREAM_WORD(op) << ";\n";
+            break;
+        }
+        case (InstrName::JSR): {  // pushes the address of its own last byte
+            uint16_t ret = next - 1;
+            os << "        r.pc = " << STREAM_WORD(ret) << ";\n";
+            os << "        RecompiledPush(ctx, r, " << STREAM_BYTE(ret >> 8) << ");\n";
+            os << "        RecompiledPush(ctx, r, " << STREAM_BYTE(ret & 0xff) << ");\n";
+            os << "        r.pc = " << STREAM_WORD(op) << ";\n";
+            break;
+        }
+        case (InstrName::RTS): {
+            os << "        r.pc = RecompiledPull(ctx, r);\n";
+            os << "        r.pc |= RecompiledPull(ctx, r) << 8;\n";
+            os << "        r.pc += 1;\n";
+            break;
+        }
+        case (InstrName::PHA): {
+            os << "        RecompiledPush(ctx, r, r.a);\n";
+            break;
+        }
+        case (InstrName::PHP): {
+            os << "        RecompiledPush(ctx, r, RecompiledGetStatus(r) | 0x30);\n";
+            break;
+        }
+        case (InstrName::PLA): {
+            os << "        r.a = RecompiledPull(ctx, r);\n";
+            os << "        RecompiledSetNz(r, r.a);\n";
+            break;
+        }
+        case (InstrName::CLC):
+        case (InstrName::SEC): {
+            os << "        r.carry = " << ((info.instrName == InstrName::SEC) ? 1 : 0) << ";\n";
+            break;
+        }
+        case (InstrName::CLD): {
+            os << "        r.sr &= ~0x08;\n";
+            break;
+        }
+        case (InstrName::SED): {
+            os << "        r.sr |= 0x08;\n";
+            break;
+        }
+        case (InstrName::SEI): {
+            os << "        r.sr |= 0x04;\n";
+            break;
+        }
+        case (InstrName::CLV): {
+            os << "        r.overflow = 0;\n";
+            break;
+        }
+        case (InstrName::TAX): {
+            os << "        r.x = r.a;\n";
+            os << "        RecompiledSetNz(r, r.x);\n";
+            break;
+        }
+        case (InstrName::TAY): {
+            os << "        r.y = r.a;\n";
+            os << "        RecompiledSetNz(r, r.y);\n";
+            break;
+        }
+        case (InstrName::TXA): {
+            os << "        r.a = r.x;\n";
+            os << "        RecompiledSetNz(r, r.a);\n";
+            break;
+        }
+        case (InstrName::TYA): {
+            os << "        r.a = r.y;\n";
+            os << "        RecompiledSetNz(r, r.a);\n";
+            break;
+        }
+        case (InstrName::TSX): {
+            os << "        r.x = r.sp;\n";
+            os << "        RecompiledSetNz(r, r.x);\n";
+            break;
+        }
+        case (InstrName::TXS): {
+            os << "        r.sp = r.x;\n";
+            break;
+        }
+        default: {  // NOP; the rest never gets here, see IsLeftToHost()
+            break;
+        }
+    }
+    os << "    }\n";
+
+    // a bus callback that dropped code or pulled in the end of the slice ends the block
+    if (!last and TouchesMemory(info)) {
+        os << "    if (ctx->exit) {\n";
+        os << "        ctx->regs = r;\n";
+        os << "        return;\n";
+        os << "    }\n";
+    }
+}
+
+static void WriteBytes(std::ostream& os, const uint8_t* bytes, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        os << ((i % 16 == 0) ? "\n    " : " ") << STREAM_BYTE(bytes[i]) << ',';
+    }
+    os << '\n';
+}
+
+void StaticRecompiler::WriteMain(std::ostream& os) const
+{
+    os << "\n// standalone : the image, run from its reset vector on the recompiled core\n\n";
+    os << "struct ImageRange {\n"
+          "    uint16_t addr;\n"
+          "    size_t size;\n"
+          "    const uint8_t* bytes;\n"
+          "};\n\n";
+
+    std::vector<std::pair<uint32_t, uint32_t>> ranges;
+    for (uint32_t addr = 0; addr < 0x10000; addr++) {
+        if (!m_inImage[addr]) {
+            continue;
+        }
+        uint32_t end = addr;
+        while (end < 0x10000 and m_inImage[end]) {
+            end++;
+        }
+        ranges.push_back({addr, end});
+        addr = end;
+    }
+    for (size_t i = 0; i < ranges.size(); i++) {
+        os << "const uint8_t kImage" << std::dec << i << "[] = {";
+        WriteBytes(os, m_memory.data() + ranges[i].first, ranges[i].second - ranges[i].first);
+        os << "};\n";
+    }
+    os << "\nconst ImageRange kImage[] = {\n";
+    for (size_t i = 0; i < ranges.size(); i++) {
+        os << "    {" << STREAM_WORD(ranges[i].first) << ", " << std::dec
+           << ranges[i].second - ranges[i].first << ", kImage" << i << "},\n";
+    }
+    os << "};\n\n"
+          "}  // namespace\n\n"
+          "int main()\n"
+          "{\n"
+          "    Mos6502Engine engine;\n"
+          "    for (const ImageRange& range : kImage) {\n"
+          "        engine.Load(range.bytes, range.size, range.addr);\n"
+          "    }\n";
+    uint16_t resetVector = m_memory[0xfffc] | (m_memory[0xfffd] << 8);
+    os << "    engine.SetResetVector(" << STREAM_WORD(resetVector) << ");\n"
+          "    engine.SetRecompiledModule(Mos6502RecompiledModule());\n"
+          "    engine.SetCore(Mos6502Engine::CORE_RECOMPILED);\n"
+          "    engine.Reset();\n\n"
+          "    MosT6502::StopReason reason;\n"
+          "    Mos6502Engine::Status status;\n"
+          "    do {\n"
+          "        status = engine.Run(1 << 20, &reason);\n"
+          "    } while (status == Mos6502Engine::OK and\n"
+          "             reason == MosT6502::StopReason::CYCLE_BUDGET);\n\n"
+          "    MosT6502& cpu = engine.GetCpu();\n"
+          "    if (status == Mos6502Engine::ERR_ILLEGAL_OPCODE) {\n"
+          "        std::cout << \"Illegal instr in the code. pc=\" << STREAM_WORD(cpu.pc) << "
+          "'\\n';\n"
+          "        return 1;\n"
+          "    }\n"
+          "    bool brk = reason == MosT6502::StopReason::BREAK;\n"
+          "    std::cout << (brk ? \"Program stopped on BRK !\" : \"Program completed !\")\n"
+          "              << \" cycles=\" << std::dec << cpu.cycles << '\\n';\n"
+          "    cpu.PrintState(std::cout);\n"
+          "    engine.GetBus().DumpDirtyRam(std::cout, Bus::DUMP_HEX);\n"
+          "    return 0;\n"
+          "}\n";
+}
+
+StaticRecompiler::Status StaticRecompiler::Write(std::ostream& os, bool withMain) const
+{
+    if (m_blocks.empty()) {
+        return ERR_NO_CODE;
+    }
+
+    os << "// Generated by opcode_recompile, do not edit : " << std::dec << m_blocks.size()
+       << " blocks, " << m_stats.instructions << " instructions, see include/static_recompiler.h\n"
+       << "#include \"include/recompiled_module.h\"\n";
+    if (withMain) {
+        os << "\n#include <iostream>\n\n#include \"include/mos6502_engine.h\"\n";
+    }
+    os << "\nextern \"C\" const RecompiledModule* " << kRecompiledModuleSymbol << "();\n";
+    os << "\nnamespace {\n\n";
+
+    os << "const uint8_t kCode[] = {";
+    std::vector<uint32_t> offsets;
+    uint32_t offset = 0;
+    std::vector<uint8_t> code;
+    for (const Block& block : m_blocks) {
+        offsets.push_back(offset);
+        code.insert(code.end(), m_memory.begin() + block.pc,
+                    m_memory.begin() + block.pc + block.size);
+        offset += block.size;
+    }
+    WriteBytes(os, code.data(), code.size());
+    os << "};\n\n";
+
+    os << "const RecompiledBlock kBlocks[] = {\n";
+    for (size_t i = 0; i < m_blocks.size(); i++) {
+        os << "    {" << STREAM_WORD(m_blocks[i].pc) << ", " << std::dec << m_blocks[i].size << ", "
+           << offsets[i] << ", " << m_blocks[i].leadCycles << "},\n";
+    }
+    os << "};\n";
+
+    for (const Block& block : m_blocks) {
+        os << "\nvoid Block" << std::hex << std::setw(4) << std::setfill('0') << block.pc
+           << "(RecompiledContext* ctx)\n{\n"
+           << "    RecompiledRegs r = ctx->regs;\n";
+        for (size_t i = 0; i < block.instrs.size(); i++) {
+            WriteInstr(os, block.instrs[i], i + 1 == block.instrs.size());
+        }
+        os << "    ctx->regs = r;\n}\n";
+    }
+
+    os << "\nvoid Run(RecompiledContext* ctx)\n"
+          "{\n"
+          "    while (!ctx->exit) {\n"
+          "        switch (ctx->regs.pc) {\n";
+    for (size_t i = 0; i < m_blocks.size(); i++) {
+        const Block& block = m_blocks[i];
+        os << "            case (" << STREAM_WORD(block.pc) << "): {\n"
+           << "                if (!ctx->runnable[" << std::dec << i << "] or ctx->regs.cycles + "
+           << block.leadCycles << " >= ctx->sliceEnd) {\n"
+           << "                    return;\n"
+           << "                }\n"
+           << "                Block" << std::hex << std::setw(4) << std::setfill('0') << block.pc
+           << "(ctx);\n"
+           << "                break;\n"
+           << "            }\n";
+    }
+    os << "            default: {\n"
+          "                return;\n"
+          "            }\n"
+          "        }\n"
+          "    }\n"
+          "}\n\n";
+
+    os << "const RecompiledModule kModule = {kRecompiledAbiVersion, " << std::dec
+       << m_blocks.size() << ", kBlocks, kCode, Run};\n";
+    if (withMain) {
+        WriteMain(os);
+    } else {
+        os << "\n}  // namespace\n";
+    }
+    os << "\nextern \"C\" const RecompiledModule* " << kRecompiledModuleSymbol
+       << "() { return &kModule; }\n";
+    return os.good() ? OK : ERR_WRITE;
+}
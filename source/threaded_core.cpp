@@ -0,0 +1,590 @@
+#include "../include/threaded_core.h"
+
+#include "../include/breakpoints.h"
+#include "../include/bus.h"
+#include "../include/guest_profile.h"
+#include "../include/mos_t_6502_opcodes.h"
+#include "../include/trace_sink.h"
+
+#if defined(__GNUC__)
+#define MOS6502_COMPUTED_GOTO 1
+#else
+#define MOS6502_COMPUTED_GOTO 0
+#endif
+
+typedef MosT6502::StopReason StopReason;
+typedef MosT6502::FLAGS6502 Flag;
+
+// compile-time copy of the decode table : handlers take their mode/operation/cycles from it
+static constexpr MosT6502::DecodeTable kThreadedTable = BuildDecodeTable();
+
+// access paths
+
+template <AddrMode M, bool Penalty>
+static inline uint16_t Address(MosT6502& cpu, uint16_t operand)
+{
+    switch (M) {
+        case (AddrMode::IMMEDIATE): {
+            return cpu.pc - 1;
+        }
+        case (AddrMode::RELATIVE): {
+            return cpu.pc;
+        }
+        case (AddrMode::ZERO_PAGE): {
+            return operand & 0x00ff;
+        }
+        case (AddrMode::ZERO_PAGE_X): {
+            return (operand + cpu.x) & 0x00ff;
+        }
+        case (AddrMode::ZERO_PAGE_Y): {
+            return (operand + cpu.y) & 0x00ff;
+        }
+        case (AddrMode::ABSOLUTE): {
+            return operand;
+        }
+        case (AddrMode::ABSOLUTE_X):
+        case (AddrMode::ABSOLUTE_Y): {
+            uint16_t addr = operand + ((M == AddrMode::ABSOLUTE_X) ? cpu.x : cpu.y);
+            if (Penalty and ((addr ^ operand) & 0xff00)) {
+                cpu.cycles += 1;
+            }
+            return addr;
+        }
+        case (AddrMode::INDIRECT): {  // no carry into the pointer's high byte
+            uint16_t lo = cpu.bus->Read(operand);
+            uint16_t hi = cpu.bus->Read((operand & 0xff00) | ((operand + 1) & 0x00ff));
+            return (hi << 8) | lo;
+        }
+        case (AddrMode::INDIRECT_X): {
+            uint16_t listAddr = (operand + cpu.x) & 0x00ff;
+            uint16_t lo       = cpu.bus->Read(listAddr);
+            uint16_t hi       = cpu.bus->Read((listAddr + 1) & 0x00ff);
+            return (hi << 8) | lo;
+        }
+        case (AddrMode::INDIRECT_Y): {
+            uint16_t listAddr = operand & 0x00ff;
+            uint16_t lo       = cpu.bus->Read(listAddr);
+            uint16_t hi       = cpu.bus->Read((listAddr + 1) & 0x00ff);
+            uint16_t base     = (hi << 8) | lo;
+            uint16_t addr     = base + cpu.y;
+            if (Penalty and ((addr ^ base) & 0xff00)) {
+                cpu.cycles += 1;
+            }
+            return addr;
+        }
+        default: {  // IMPLIED has no address
+            return 0x0000;
+        }
+    }
+}
+
+template <AddrMode M, bool Penalty>
+static inline uint8_t ReadOperand(MosT6502& cpu, uint16_t operand)
+{
+    if (M == AddrMode::IMPLIED) {
+        return cpu.a;
+    }
+    if (M == AddrMode::IMMEDIATE or M == AddrMode::RELATIVE) {
+        return operand & 0x00ff;
+    }
+    return cpu.bus->Read(Address<M, Penalty>(cpu, operand));
+}
+
+template <AddrMode M>
+static inline void WriteOperand(MosT6502& cpu, uint16_t operand, uint8_t data)
+{
+    cpu.bus->Write(Address<M, false>(cpu, operand), data);
+}
+
+// op(data) returns the new value and sets the flags; implied mode works on a
+template <AddrMode M, typename Op>
+static inline void ReadModifyWrite(MosT6502& cpu, uint16_t operand, Op op)
+{
+    if (M == AddrMode::IMPLIED) {
+        cpu.a = op(cpu.a);
+    } else {
+        uint16_t addr = Address<M, false>(cpu, operand);
+        cpu.bus->Write(addr, op(cpu.bus->Read(addr)));
+    }
+}
+
+static inline void Push(MosT6502& cpu, uint8_t data)
+{
+    cpu.bus->Write(0x0100 + cpu.sp, data);
+    cpu.sp -= 1;
+}
+
+static inline uint8_t Pull(MosT6502& cpu)
+{
+    cpu.sp += 1;
+    return cpu.bus->Read(0x0100 + cpu.sp);
+}
+
+template <AddrMode M>
+static inline void Branch(MosT6502& cpu, uint16_t operand, bool taken)
+{
+    if (taken) {
+        uint16_t target = cpu.pc + (uint16_t)(int8_t)(operand & 0x00ff);
+        cpu.cycles += ((target & 0xff00) != (cpu.pc & 0xff00)) ? 2 : 1;
+        cpu.pc = target;
+    }
+}
+
+// a + data + c; D set goes through the decimal table instead
+static inline void AddWithCarry(MosT6502& cpu, uint8_t data, bool subtract)
+{
+    if (cpu.m_sr & Flag::D) {
+        cpu.AddDecimal(data, subtract);
+        return;
+    }
+    if (subtract) {
+        data ^= 0xff;
+    }
+    uint16_t result = (uint16_t)cpu.a + data + (uint16_t)cpu.GetFlag(Flag::C);
+    cpu.SetFlag(Flag::C, result > 255);
+    cpu.SetFlag(Flag::V, (~(cpu.a ^ data) & (cpu.a ^ result)) & 0x80);
+    cpu.a = result & 0xff;
+    cpu.SetNz(cpu.a);
+}
+
+template <AddrMode M, bool Penalty>
+static inline void Compare(MosT6502& cpu, uint16_t operand, uint8_t reg)
+{
+    uint8_t data  = ReadOperand<M, Penalty>(cpu, operand);
+    uint16_t temp = (uint16_t)reg - (uint16_t)data;
+    cpu.SetFlag(Flag::C, reg >= data);
+    cpu.SetNz(temp & 0x00ff);
+}
+
+// one operation in one addressing mode; the switch folds away in every instantiation
+template <InstrName I, AddrMode M, bool Penalty>
+static inline StopReason Exec(MosT6502& cpu, uint16_t operand)
+{
+    switch (I) {
+        case (InstrName::BRK): {
+            Push(cpu, (cpu.pc >> 8) & 0x00ff);
+            Push(cpu, cpu.pc & 0x00ff);
+            Push(cpu, cpu.GetStatus() | Flag::B | Flag::U);
+            cpu.SetFlag(Flag::I, true);
+            uint16_t lo = cpu.bus->Read(0xfffe);
+            uint16_t hi = cpu.bus->Read(0xffff);
+            cpu.pc      = (hi << 8) | lo;
+            return StopReason::BREAK;
+        }
+        case (InstrName::ADC): {
+            AddWithCarry(cpu, ReadOperand<M, Penalty>(cpu, operand), false);
+            break;
+        }
+        case (InstrName::SBC): {
+            AddWithCarry(cpu, ReadOperand<M, Penalty>(cpu, operand), true);
+            break;
+        }
+        case (InstrName::AND): {
+            cpu.a &= ReadOperand<M, Penalty>(cpu, operand);
+            cpu.SetNz(cpu.a);
+            break;
+        }
+        case (InstrName::ORA): {
+            cpu.a |= ReadOperand<M, Penalty>(cpu, operand);
+            cpu.SetNz(cpu.a);
+            break;
+        }
+        case (InstrName::EOR): {
+            cpu.a ^= ReadOperand<M, Penalty>(cpu, operand);
+            cpu.SetNz(cpu.a);
+            break;
+        }
+        case (InstrName::ASL): {
+            ReadModifyWrite<M>(cpu, operand, [&cpu](uint8_t data) {
+                cpu.SetFlag(Flag::C, data & 0x80);
+                uint8_t result = data << 1;
+                cpu.SetNz(result);
+                return result;
+            });
+            break;
+        }
+        case (InstrName::LSR): {
+            ReadModifyWrite<M>(cpu, operand, [&cpu](uint8_t data) {
+                cpu.SetFlag(Flag::C, data & 0x01);
+                uint8_t result = data >> 1;
+                cpu.SetNz(result);
+                return result;
+            });
+            break;
+        }
+        case (InstrName::ROL): {
+            ReadModifyWrite<M>(cpu, operand, [&cpu](uint8_t data) {
+                uint16_t result = (uint16_t)(data << 1) | cpu.GetFlag(Flag::C);
+                cpu.SetFlag(Flag::C, result & 0xff00);
+                cpu.SetNz(result & 0x00ff);
+                return (uint8_t)(result & 0x00ff);
+            });
+            break;
+        }
+        case (InstrName::ROR): {
+            ReadModifyWrite<M>(cpu, operand, [&cpu](uint8_t data) {
+                uint16_t result = (uint16_t)(cpu.GetFlag(Flag::C) << 7) | (data >> 1);
+                cpu.SetFlag(Flag::C, data & 0x01);
+                cpu.SetNz(result & 0x00ff);
+                return (uint8_t)(result & 0x00ff);
+            });
+            break;
+        }
+        case (InstrName::BCC): {
+            Branch<M>(cpu, operand, !cpu.GetFlag(Flag::C));
+            break;
+        }
+        case (InstrName::BCS): {
+            Branch<M>(cpu, operand, cpu.GetFlag(Flag::C));
+            break;
+        }
+        case (InstrName::BEQ): {
+            Branch<M>(cpu, operand, cpu.GetFlag(Flag::Z));
+            break;
+        }
+        case (InstrName::BMI): {
+            Branch<M>(cpu, operand, cpu.GetFlag(Flag::N));
+            break;
+        }
+        case (InstrName::BNE): {
+            Branch<M>(cpu, operand, !cpu.GetFlag(Flag::Z));
+            break;
+        }
+        case (InstrName::BPL): {
+            Branch<M>(cpu, operand, !cpu.GetFlag(Flag::N));
+            break;
+        }
+        case (InstrName::BVC): {
+            Branch<M>(cpu, operand, !cpu.GetFlag(Flag::V));
+            break;
+        }
+        case (InstrName::BVS): {
+            Branch<M>(cpu, operand, cpu.GetFlag(Flag::V));
+            break;
+        }
+        case (InstrName::BIT): {
+            uint8_t data = ReadOperand<M, Penalty>(cpu, operand);
+            cpu.m_zValue = cpu.a & data;
+            cpu.m_nValue = data;
+            cpu.SetFlag(Flag::V, data & (1 << 6));
+            break;
+        }
+        case (InstrName::CLC): {
+            cpu.SetFlag(Flag::C, false);
+            break;
+        }
+        case (InstrName::CLD): {
+            cpu.SetFlag(Flag::D, false);
+            break;
+        }
+        case (InstrName::CLI): {
+            uint8_t status = cpu.m_sr;
+            cpu.SetFlag(Flag::I, false);
+            cpu.DeferIrqMask(status);
+            break;
+        }
+        case (InstrName::CLV): {
+            cpu.SetFlag(Flag::V, false);
+            break;
+        }
+        case (InstrName::SEC): {
+            cpu.SetFlag(Flag::C, true);
+            break;
+        }
+        case (InstrName::SED): {
+            cpu.SetFlag(Flag::D, true);
+            break;
+        }
+        case (InstrName::SEI): {
+            uint8_t status = cpu.m_sr;
+            cpu.SetFlag(Flag::I, true);
+            cpu.DeferIrqMask(status);
+            break;
+        }
+        case (InstrName::CMP): {
+            Compare<M, Penalty>(cpu, operand, cpu.a);
+            break;
+        }
+        case (InstrName::CPX): {
+            Compare<M, Penalty>(cpu, operand, cpu.x);
+            break;
+        }
+        case (InstrName::CPY): {
+            Compare<M, Penalty>(cpu, operand, cpu.y);
+            break;
+        }
+        case (InstrName::DEC): {
+            ReadModifyWrite<M>(cpu, operand, [&cpu](uint8_t data) {
+                uint8_t result = data - 1;
+                cpu.SetNz(result);
+                return result;
+            });
+            break;
+        }
+        case (InstrName::INC): {
+            ReadModifyWrite<M>(cpu, operand, [&cpu](uint8_t data) {
+                uint8_t result = data + 1;
+                cpu.SetNz(result);
+                return result;
+            });
+            break;
+        }
+        case (InstrName::DEX): {
+            cpu.x -= 1;
+            cpu.SetNz(cpu.x);
+            break;
+        }
+        case (InstrName::DEY): {
+            cpu.y -= 1;
+            cpu.SetNz(cpu.y);
+            break;
+        }
+        case (InstrName::INX): {
+            cpu.x += 1;
+            cpu.SetNz(cpu.x);
+            break;
+        }
+        case (InstrName::INY): {
+            cpu.y += 1;
+            cpu.SetNz(cpu.y);
+            break;
+        }
+        case (InstrName::JMP): {
+            cpu.pc = Address<M, false>(cpu, operand);
+            break;
+        }
+        case (InstrName::JSR): {
+            uint16_t target = Address<M, false>(cpu, operand);
+            uint16_t ret    = cpu.pc - 1;
+            Push(cpu, (ret >> 8) & 0x00ff);
+            Push(cpu, ret & 0x00ff);
+            cpu.pc = target;
+            break;
+        }
+        case (InstrName::RTS): {
+            uint16_t lo = Pull(cpu);
+            uint16_t hi = Pull(cpu);
+            cpu.pc      = ((hi << 8) | lo) + 1;
+            break;
+        }
+        case (InstrName::RTI): {
+            cpu.SetStatus((Pull(cpu) & ~Flag::B) | Flag::U);
+            uint16_t lo = Pull(cpu);
+            uint16_t hi = Pull(cpu);
+            cpu.pc      = (hi << 8) | lo;
+            cpu.CheckIrqUnmasked();
+            break;
+        }
+        case (InstrName::LDA): {
+            cpu.a = ReadOperand<M, Penalty>(cpu, operand);
+            cpu.SetNz(cpu.a);
+            break;
+        }
+        case (InstrName::LDX): {
+            cpu.x = ReadOperand<M, Penalty>(cpu, operand);
+            cpu.SetNz(cpu.x);
+            break;
+        }
+        case (InstrName::LDY): {
+            cpu.y = ReadOperand<M, Penalty>(cpu, operand);
+            cpu.SetNz(cpu.y);
+            break;
+        }
+        case (InstrName::STA): {
+            WriteOperand<M>(cpu, operand, cpu.a);
+            break;
+        }
+        case (InstrName::STX): {
+            WriteOperand<M>(cpu, operand, cpu.x);
+            break;
+        }
+        case (InstrName::STY): {
+            WriteOperand<M>(cpu, operand, cpu.y);
+            break;
+        }
+        case (InstrName::NOP): {
+            break;
+        }
+        case (InstrName::PHA): {
+            Push(cpu, cpu.a);
+            break;
+        }
+        case (InstrName::PHP): {
+            Push(cpu, cpu.GetStatus() | Flag::B | Flag::U);
+            break;
+        }
+        case (InstrName::PLA): {
+            cpu.a = Pull(cpu);
+            cpu.SetNz(cpu.a);
+            break;
+        }
+        case (InstrName::PLP): {
+            uint8_t status = cpu.m_sr;
+            cpu.SetStatus((Pull(cpu) & ~Flag::B) | Flag::U);
+            cpu.DeferIrqMask(status);
+            break;
+        }
+        case (InstrName::TAX): {
+            cpu.x = cpu.a;
+            cpu.SetNz(cpu.x);
+            break;
+        }
+        case (InstrName::TAY): {
+            cpu.y = cpu.a;
+            cpu.SetNz(cpu.y);
+            break;
+        }
+        case (InstrName::TSX): {
+            cpu.x = cpu.sp;
+            cpu.SetNz(cpu.x);
+            break;
+        }
+        case (InstrName::TXA): {
+            cpu.a = cpu.x;
+            cpu.SetNz(cpu.a);
+            break;
+        }
+        case (InstrName::TXS): {
+            cpu.sp = cpu.x;
+            break;
+        }
+        case (InstrName::TYA): {
+            cpu.a = cpu.y;
+            cpu.SetNz(cpu.a);
+            break;
+        }
+        case (InstrName::XXX): {  // never legal, kept so every name has a case
+            return StopReason::ILLEGAL_OPCODE;
+        }
+    }
+    return StopReason::RUNNING;
+}
+
+// everything after the opcode fetch for one opcode
+template <uint8_t Opcode>
+static StopReason Handle(MosT6502& cpu)
+{
+    constexpr MosT6502::OpcodeInfo info = kThreadedTable.entries[Opcode];
+    constexpr uint8_t length            = (info.addrMode == AddrMode::IMPLIED)    ? 1
+                                          : (info.addrMode == AddrMode::ABSOLUTE or
+                                             info.addrMode == AddrMode::ABSOLUTE_X or
+                                             info.addrMode == AddrMode::ABSOLUTE_Y or
+                                             info.addrMode == AddrMode::INDIRECT) ? 3
+                                                                                   : 2;
+    if (Opcode == TERMINATE_OPCODE) {
+        return StopReason::TERMINATED;
+    }
+    if (!(info.flags & MosT6502::OPCODE_LEGAL)) {
+        return StopReason::ILLEGAL_OPCODE;
+    }
+
+    uint16_t operand = 0x0000;
+    if (length > 1) {
+        operand = cpu.bus->Fetch(cpu.pc + 1);
+    }
+    if (length > 2) {
+        operand |= (uint16_t)cpu.bus->Fetch(cpu.pc + 2) << 8;
+    }
+    uint16_t start      = cpu.pc;
+    uint64_t startCycle = cpu.cycles;
+    cpu.pc += length;
+    cpu.cycles += info.cycles;
+    cpu.instructions += 1;
+    StopReason reason =
+            Exec<info.instrName, info.addrMode, (info.flags & MosT6502::OPCODE_PAGE_PENALTY) != 0>(
+                    cpu, operand);
+    if (cpu.m_profile) {
+        cpu.m_profile->Count(start, Opcode, cpu.cycles - startCycle, cpu.pc);
+    }
+    return reason;
+}
+
+static inline bool AtBreakpoint(MosT6502& cpu)
+{
+    return cpu.m_breakpoints and cpu.m_breakpoints->CheckExecute(cpu);
+}
+
+static inline uint8_t FetchOpcode(MosT6502& cpu)
+{
+    uint8_t opcode = cpu.bus->Fetch(cpu.pc);
+    if (cpu.m_traceSink) {
+        cpu.m_traceSink->Record({cpu.cycles, cpu.pc, opcode, cpu.a, cpu.x, cpu.y, cpu.sp, cpu.GetStatus()});
+    }
+    return opcode;
+}
+
+// X(opcode) for all 256 opcodes, in order
+#define MOS6502_OPCODE_ROW(X, h)                                                              \
+    X(h##0) X(h##1) X(h##2) X(h##3) X(h##4) X(h##5) X(h##6) X(h##7) X(h##8) X(h##9) X(h##a) \
+    X(h##b) X(h##c) X(h##d) X(h##e) X(h##f)
+#define MOS6502_OPCODE_LIST(X)                                                                \
+    MOS6502_OPCODE_ROW(X, 0x0) MOS6502_OPCODE_ROW(X, 0x1) MOS6502_OPCODE_ROW(X, 0x2)          \
+    MOS6502_OPCODE_ROW(X, 0x3) MOS6502_OPCODE_ROW(X, 0x4) MOS6502_OPCODE_ROW(X, 0x5)          \
+    MOS6502_OPCODE_ROW(X, 0x6) MOS6502_OPCODE_ROW(X, 0x7) MOS6502_OPCODE_ROW(X, 0x8)          \
+    MOS6502_OPCODE_ROW(X, 0x9) MOS6502_OPCODE_ROW(X, 0xa) MOS6502_OPCODE_ROW(X, 0xb)          \
+    MOS6502_OPCODE_ROW(X, 0xc) MOS6502_OPCODE_ROW(X, 0xd) MOS6502_OPCODE_ROW(X, 0xe)          \
+    MOS6502_OPCODE_ROW(X, 0xf)
+
+typedef StopReason (*OpcodeHandler)(MosT6502& cpu);
+
+#define MOS6502_HANDLER_ENTRY(n) &Handle<n>,
+static const OpcodeHandler kHandlers[256] = {MOS6502_OPCODE_LIST(MOS6502_HANDLER_ENTRY)};
+
+MosT6502::StopReason ThreadedCore::Step(MosT6502& cpu)
+{
+    if (AtBreakpoint(cpu)) {
+        return StopReason::BREAKPOINT;
+    }
+    return kHandlers[FetchOpcode(cpu)](cpu);
+}
+
+// CheckBreakpoints is only instantiated true while Breakpoints are attached, so runs without
+// them do not even test the pointer
+template <bool CheckBreakpoints>
+static StopReason RunSlice(MosT6502& cpu)
+{
+#if MOS6502_COMPUTED_GOTO
+#define MOS6502_LABEL_ENTRY(n) &&op_##n,
+#define MOS6502_LABEL_HANDLER(n)                         \
+    op_##n : {                                           \
+        StopReason reason = Handle<n>(cpu);              \
+        if (reason != StopReason::RUNNING) {             \
+            return reason;                               \
+        }                                                \
+        if (cpu.cycles >= cpu.m_sliceEnd) {              \
+            return StopReason::CYCLE_BUDGET;             \
+        }                                                \
+        if (CheckBreakpoints and AtBreakpoint(cpu)) {    \
+            return StopReason::BREAKPOINT;               \
+        }                                                \
+        goto* kLabels[FetchOpcode(cpu)];                 \
+    }
+    static void* const kLabels[256] = {MOS6502_OPCODE_LIST(MOS6502_LABEL_ENTRY)};
+
+    if (cpu.cycles >= cpu.m_sliceEnd) {
+        return StopReason::CYCLE_BUDGET;
+    }
+    if (CheckBreakpoints and AtBreakpoint(cpu)) {
+        return StopReason::BREAKPOINT;
+    }
+    goto* kLabels[FetchOpcode(cpu)];
+    MOS6502_OPCODE_LIST(MOS6502_LABEL_HANDLER)
+#else
+    while (cpu.cycles < cpu.m_sliceEnd) {
+        if (CheckBreakpoints and AtBreakpoint(cpu)) {
+            return StopReason::BREAKPOINT;
+        }
+        StopReason reason = kHandlers[FetchOpcode(cpu)](cpu);
+        if (reason != StopReason::RUNNING) {
+            return reason;
+        }
+    }
+    return StopReason::CYCLE_BUDGET;
+#endif
+}
+
+MosT6502::StopReason ThreadedCore::Run(MosT6502& cpu, uint64_t cycleBudget)
+{
+    cpu.m_sliceEnd = cpu.cycles + cycleBudget;
+    return (cpu.m_breakpoints) ? RunSlice<true>(cpu) : RunSlice<false>(cpu);
+}
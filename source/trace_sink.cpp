@@ -0,0 +1,97 @@
+#include "../include/trace_sink.h"
+
+#include <cstring>
+
+#include "../include/mos_t_6502.h"
+
+static char* PutString(char* out, const char* str)
+{
+    size_t len = strlen(str);
+    memcpy(out, str, len);
+    return out + len;
+}
+
+static char* PutDecimal(char* out, uint64_t v)
+{
+    char digits[20];
+    int n = 0;
+    do {
+        digits[n++] = '0' + (v % 10);
+        v /= 10;
+    } while (v != 0);
+    while (n > 0) {
+        *out++ = digits[--n];
+    }
+    return out;
+}
+
+size_t FormatTraceRecord(const TraceRecord& rec, char* out)
+{
+    char* p = out;
+    p       = PutHexWord(p, rec.pc);
+    p       = PutString(p, "  ");
+    p       = PutHexByte(p, rec.opcode);
+    p       = PutString(p, "  a=");
+    p       = PutHexByte(p, rec.a);
+    p       = PutString(p, " x=");
+    p       = PutHexByte(p, rec.x);
+    p       = PutString(p, " y=");
+    p       = PutHexByte(p, rec.y);
+    p       = PutString(p, " sp=");
+    p       = PutHexByte(p, rec.sp);
+    p       = PutString(p, " sr=");
+    p       = PutHexByte(p, rec.sr);
+    p       = PutString(p, " cyc=");
+    p       = PutDecimal(p, rec.cycle);
+    *p++    = ' ';
+
+    // names are bounded by the line budget, they are only ever ~40 chars long
+    const char* name = MosT6502::GetInstrString(rec.opcode);
+    size_t nameLen   = strnlen(name, kTraceLineMax - (p - out));
+    memcpy(p, name, nameLen);
+    p += nameLen;
+    return p - out;
+}
+
+RingTraceSink::RingTraceSink(size_t capacity)
+{
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    m_records.resize(size);
+    m_mask = size - 1;
+}
+
+void RingTraceSink::Dump(std::ostream& os) const
+{
+    char line[kTraceLineMax + 1];
+    for (size_t i = 0; i < Size(); i++) {
+        size_t len  = FormatTraceRecord(At(i), line);
+        line[len++] = '\n';
+        os.write(line, len);
+    }
+}
+
+TextTraceSink::TextTraceSink(std::ostream& os, size_t bufferSize)
+    : m_os(os), m_buffer(bufferSize < 2 * kTraceLineMax ? 2 * kTraceLineMax : bufferSize)
+{
+}
+
+void TextTraceSink::Record(const TraceRecord& rec)
+{
+    if (m_buffer.size() - m_used <= kTraceLineMax) {
+        Flush();
+    }
+    m_used += FormatTraceRecord(rec, &m_buffer[m_used]);
+    m_buffer[m_used++] = '\n';
+}
+
+void TextTraceSink::Flush()
+{
+    if (m_used > 0) {
+        m_os.write(m_buffer.data(), m_used);
+        m_used = 0;
+    }
+    m_os.flush();
+}
@@ -0,0 +1,60 @@
+#include "../include/work_stealing_pool.h"
+
+#include <thread>
+
+WorkStealingPool::WorkStealingPool(unsigned workerCount)
+    : m_workerCount(workerCount == 0 ? 1 : workerCount), m_queues(m_workerCount)
+{
+}
+
+bool WorkStealingPool::PopLocal(unsigned worker, size_t* job)
+{
+    WorkQueue& q = m_queues[worker];
+    std::lock_guard<std::mutex> guard(q.lock);
+    if (q.jobs.empty()) {
+        return false;
+    }
+    *job = q.jobs.back();
+    q.jobs.pop_back();
+    return true;
+}
+
+bool WorkStealingPool::Steal(unsigned thief, size_t* job)
+{
+    for (unsigned i = 1; i < m_workerCount; i++) {
+        WorkQueue& q = m_queues[(thief + i) % m_workerCount];
+        std::lock_guard<std::mutex> guard(q.lock);
+        if (!q.jobs.empty()) {
+            *job = q.jobs.front();
+            q.jobs.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::WorkerLoop(unsigned worker, const JobFn& fn)
+{
+    size_t job;
+    // no job is ever added once Run() started, so empty everywhere means done
+    while (PopLocal(worker, &job) or Steal(worker, &job)) {
+        fn(job, worker);
+    }
+}
+
+void WorkStealingPool::Run(size_t jobCount, const JobFn& fn)
+{
+    // deal in reverse so that every worker pops its jobs in ascending order
+    for (size_t job = jobCount; job > 0; job--) {
+        m_queues[(job - 1) % m_workerCount].jobs.push_back(job - 1);
+    }
+
+    std::vector<std::thread> threads;
+    for (unsigned w = 1; w < m_workerCount; w++) {
+        threads.emplace_back(&WorkStealingPool::WorkerLoop, this, w, std::cref(fn));
+    }
+    WorkerLoop(0, fn);
+    for (auto& t : threads) {
+        t.join();
+    }
+}